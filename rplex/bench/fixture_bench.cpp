@@ -0,0 +1,432 @@
+/************************************************************
+ * RPLEX - collector benchmark over synthetic fixtures
+ *
+ * Builds a fake procfs/sysfs tree per process count (stat,
+ * per-core lines, /proc/<pid> files, interfaces, disks, PSI
+ * and a cgroup v2 hierarchy), points set_fs_roots() at it
+ * and times the collectors the monitors run every sample:
+ * the process table (scan, top-K, PSS of the shown rows),
+ * CPU usage from /proc/stat, system info (memory, network,
+ * disks, pressure) and the cgroup table.
+ *
+ * Fixture files are plain tmpfs/disk files, so the numbers
+ * are rplex's own parsing and bookkeeping cost; the kernel's
+ * cost of generating real procfs contents is not included.
+ * The report is JSON on stdout, a summary table on stderr.
+ *
+ * Build: g++ -O2 -std=c++11 -I. bench/fixture_bench.cpp -o fixture_bench
+ * Usage: ./fixture_bench [--pids 1000,10000,100000] [--cores N] [--interfaces N]
+ *                        [--cgroups N] [--iterations N] [--dir DIR] [--keep]
+ ************************************************************/
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdarg>
+#include <cerrno>
+#include <new>
+#include <ftw.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "rplex_procfs.h"
+#include "rplex_proctable.h"
+#include "rplex_meminfo.h"
+#include "rplex_cpustat.h"
+#include "rplex_netstat.h"
+#include "rplex_diskstats.h"
+#include "rplex_cgroup.h"
+#include "rplex_selfprof.h"
+
+using namespace std;
+using namespace chrono;
+
+__attribute__((noinline)) void *operator new(size_t size) {
+    allocation_count().fetch_add(1, memory_order_relaxed);
+    if (void *p = malloc(size ? size : 1)) return p;
+    throw bad_alloc();
+}
+
+__attribute__((noinline)) void operator delete(void *p) noexcept {
+    free(p);
+}
+
+struct FixtureSpec {
+    int pids;
+    int cores;
+    int interfaces;
+    int cgroups;
+};
+
+struct Result {
+    int pids;
+    const char *collector;
+    double first_ms;          // cold sample: opens every fd
+    double mean_ms, p50_ms, p95_ms, max_ms;
+    double allocations;       // per steady-state sample
+    double opens;             // per steady-state sample
+    long long peak_rss_kb;    // VmHWM while this collector ran
+};
+
+// Keeps the optimizer from discarding collected values.
+static volatile double sink;
+
+static bool write_file(const string &path, const string &data) {
+    FILE *f = fopen(path.c_str(), "w");
+    if (!f) return false;
+    bool ok = fwrite(data.data(), 1, data.size(), f) == data.size();
+    return fclose(f) == 0 && ok;
+}
+
+static bool make_dirs(const string &path) {
+    for (size_t i = 1; i <= path.size(); i++) {
+        if (i < path.size() && path[i] != '/') continue;
+        string part = path.substr(0, i);
+        if (mkdir(part.c_str(), 0755) != 0 && errno != EEXIST) return false;
+    }
+    return true;
+}
+
+static int remove_entry(const char *path, const struct stat *, int, struct FTW *) {
+    return ::remove(path);
+}
+
+static string format(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+static string format(const char *fmt, ...) {
+    char buf[1024];
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    return buf;
+}
+
+static const char *const process_names[] = {
+    "systemd", "kworker/0:1", "bash", "sshd", "nginx", "postgres", "java", "python3",
+    "containerd-shim", "node", "redis-server", "(sd-pam)", "rcu_sched", "chrome --type=renderer"};
+
+static string pressure_text(double some, double full) {
+    return format("some avg10=%.2f avg60=%.2f avg300=%.2f total=%llu\n"
+                  "full avg10=%.2f avg60=%.2f avg300=%.2f total=%llu\n",
+                  some, some, some, (unsigned long long)(some * 1e6),
+                  full, full, full, (unsigned long long)(full * 1e6));
+}
+
+// Lay out the fixture under root/proc and root/sys.
+static bool build_fixture(const string &root, const FixtureSpec &spec) {
+    string proc = root + "/proc", sys = root + "/sys";
+    if (!make_dirs(proc + "/net") || !make_dirs(proc + "/pressure") || !make_dirs(sys + "/fs/cgroup")) {
+        return false;
+    }
+
+    string stat = "cpu  4705 356 584 3699176 23 0 2 0 0 0\n";
+    for (int c = 0; c < spec.cores; c++) {
+        stat += format("cpu%d %d 10 %d %d 3 0 1 0 0 0\n", c, 1000 + c, 200 + c, 90000 + c * 7);
+    }
+    stat += format("intr 0\nctxt 123456\nbtime 1700000000\nprocesses %d\nprocs_running 2\n"
+                   "procs_blocked 0\n", spec.pids);
+    bool ok = write_file(proc + "/stat", stat);
+
+    ok = ok && write_file(proc + "/meminfo",
+        "MemTotal:       65536000 kB\nMemFree:        12000000 kB\nMemAvailable:   40000000 kB\n"
+        "Buffers:          500000 kB\nCached:         26000000 kB\nSwapCached:          0 kB\n"
+        "Active:         20000000 kB\nInactive:       18000000 kB\nSwapTotal:       8000000 kB\n"
+        "SwapFree:        7500000 kB\nDirty:              1200 kB\nWriteback:             0 kB\n"
+        "Shmem:            400000 kB\nSlab:            1500000 kB\nSReclaimable:    1100000 kB\n");
+
+    string dev = "Inter-|   Receive                                                |  Transmit\n"
+                 " face |bytes    packets errs drop fifo frame compressed multicast|bytes    "
+                 "packets errs drop fifo colls carrier compressed\n";
+    for (int i = 0; i < spec.interfaces; i++) {
+        dev += format("%6s: %llu %d 0 0 0 0 0 0 %llu %d 0 0 0 0 0 0\n",
+                      i == 0 ? "lo" : format("eth%d", i - 1).c_str(),
+                      1000000ULL * (i + 1), 1000 * (i + 1), 2000000ULL * (i + 1), 1500 * (i + 1));
+    }
+    ok = ok && write_file(proc + "/net/dev", dev);
+    ok = ok && write_file(proc + "/net/snmp",
+        "Tcp: RtoAlgorithm RtoMin RtoMax MaxConn ActiveOpens PassiveOpens AttemptFails EstabResets "
+        "CurrEstab InSegs OutSegs RetransSegs InErrs OutRsts InCsumErrors\n"
+        "Tcp: 1 200 120000 -1 5000 4000 10 20 120 900000 800000 300 0 50 0\n");
+    ok = ok && write_file(proc + "/net/sockstat",
+        "sockets: used 900\nTCP: inuse 130 orphan 0 tw 40 alloc 150 mem 20\nUDP: inuse 12 mem 4\n");
+
+    string diskstats;
+    const char *disks[] = {"nvme0n1", "nvme1n1", "sda", "sdb"};
+    for (int d = 0; d < 4; d++) {
+        diskstats += format(" 259 %d %s 120000 300 9000000 40000 80000 900 7000000 60000 2 90000 100000 0 0 0 0\n",
+                            d * 16, disks[d]);
+        diskstats += format(" 259 %d %sp1 1000 0 8000 400 900 0 7000 600 0 900 1000 0 0 0 0\n",
+                            d * 16 + 1, disks[d]);
+        ok = ok && make_dirs(sys + "/block/" + disks[d]);
+    }
+    ok = ok && write_file(proc + "/diskstats", diskstats);
+
+    ok = ok && write_file(proc + "/pressure/cpu", pressure_text(2.5, 0));
+    ok = ok && write_file(proc + "/pressure/memory", pressure_text(0.4, 0.1));
+    ok = ok && write_file(proc + "/pressure/io", pressure_text(1.2, 0.8));
+    if (!ok) return false;
+
+    // Tree of cgroups, eight children per node; processes spread evenly
+    vector<string> cgroup_dirs(spec.cgroups > 0 ? spec.cgroups : 1);
+    vector<string> cgroup_procs(cgroup_dirs.size());
+    cgroup_dirs[0] = sys + "/fs/cgroup";
+    for (size_t g = 1; g < cgroup_dirs.size(); g++) {
+        cgroup_dirs[g] = cgroup_dirs[(g - 1) / 8] + format("/g%zu.slice", g);
+        if (!make_dirs(cgroup_dirs[g])) return false;
+    }
+
+    for (int i = 0; i < spec.pids; i++) {
+        int pid = i + 1;
+        string dir = proc + format("/%d", pid);
+        if (mkdir(dir.c_str(), 0755) != 0) return false;
+        const char *name = process_names[i % (sizeof(process_names) / sizeof(process_names[0]))];
+        ok = write_file(dir + "/stat", format(
+            "%d (%s) S %d %d %d 0 -1 4194560 %d 0 12 0 %d %d 0 0 20 0 %d 0 %d %llu %d "
+            "18446744073709551615 1 1 0 0 0 0 0 4096 0 0 0 0 17 %d 0 0 0 0 0 0 0 0 0 0 0 0 0\n",
+            pid, name, i ? 1 : 0, pid, pid, 1000 + i % 977, 100 + i % 5000, 50 + i % 3000,
+            1 + i % 8, 100 + i, 100000000ULL + i * 4096ULL, 200 + i % 20000, i % spec.cores));
+        ok = ok && write_file(dir + "/io", format(
+            "rchar: %d\nwchar: %d\nsyscr: %d\nsyscw: %d\nread_bytes: %d\nwrite_bytes: %d\n"
+            "cancelled_write_bytes: 0\n", 100000 + i, 50000 + i, 100 + i, 50 + i, 4096 * (i % 100),
+            8192 * (i % 50)));
+        ok = ok && write_file(dir + "/smaps_rollup", format(
+            "00400000-7ffc00000000 ---p 00000000 00:00 0                          [rollup]\n"
+            "Rss:                %d kB\nPss:                %d kB\nShared_Clean:          0 kB\n"
+            "Private_Dirty:      %d kB\nSwap:               %d kB\nSwapPss:            %d kB\n",
+            800 + i % 20000, 600 + i % 15000, 500 + i % 10000, i % 300, i % 300));
+        if (!ok) return false;
+        cgroup_procs[i % cgroup_procs.size()] += format("%d\n", pid);
+    }
+
+    for (size_t g = 0; g < cgroup_dirs.size(); g++) {
+        const string &dir = cgroup_dirs[g];
+        ok = write_file(dir + "/cgroup.procs", cgroup_procs[g]);
+        ok = ok && write_file(dir + "/cpu.stat", format(
+            "usage_usec %zu\nuser_usec %zu\nsystem_usec %zu\nnr_periods 0\nnr_throttled 0\n"
+            "throttled_usec 0\n", 1000000 + g * 977, 700000 + g * 500, 300000 + g * 477));
+        ok = ok && write_file(dir + "/memory.current", format("%zu\n", 50000000 + g * 4096));
+        ok = ok && write_file(dir + "/memory.stat", format(
+            "anon %zu\nfile %zu\nkernel 100000\nsock 0\nshmem 0\n", 30000000 + g * 1024,
+            20000000 + g * 2048));
+        ok = ok && write_file(dir + "/io.stat", format(
+            "259:0 rbytes=%zu wbytes=%zu rios=100 wios=200 dbytes=0 dios=0\n", 1000000 + g * 10,
+            2000000 + g * 20));
+        ok = ok && write_file(dir + "/cpu.pressure", pressure_text(0.1 * (g % 40), 0));
+        ok = ok && write_file(dir + "/memory.pressure", pressure_text(0.05 * (g % 20), 0.01 * (g % 20)));
+        ok = ok && write_file(dir + "/io.pressure", pressure_text(0.2 * (g % 10), 0.1 * (g % 10)));
+        if (!ok) return false;
+    }
+    return write_file(cgroup_dirs[0] + "/cgroup.stat",
+                      format("nr_descendants %zu\nnr_dying_descendants 0\n", cgroup_dirs.size() - 1));
+}
+
+// Peak RSS is reset by writing 5 to clear_refs (Linux 4.0+), so each
+// collector's high-water mark can be told apart.
+static void reset_peak_rss() {
+    int fd = ::open("/proc/self/clear_refs", O_WRONLY | O_CLOEXEC);
+    if (fd < 0) return;
+    ssize_t n = ::write(fd, "5", 1);
+    (void)n;
+    ::close(fd);
+}
+
+static long long peak_rss_kb() {
+    ProcFile status("/proc/self/status");
+    long long kb = 0;
+    if (status.read()) {
+        ProcScanner s(status);
+        if (s.find_key("VmHWM:", 6)) s.next_i64(kb);
+    }
+    return kb;
+}
+
+static double percentile(vector<double> sorted, double q) {
+    if (sorted.empty()) return 0;
+    sort(sorted.begin(), sorted.end());
+    size_t i = (size_t)(q * (sorted.size() - 1) + 0.5);
+    return sorted[i];
+}
+
+// Run the first (cold) sample, then `iterations` steady-state ones.
+template <typename F>
+static Result measure(int pids, const char *collector, int iterations, F sample) {
+    Result r;
+    r.pids = pids;
+    r.collector = collector;
+    reset_peak_rss();
+
+    steady_clock::time_point start = steady_clock::now();
+    sample();
+    r.first_ms = duration<double, milli>(steady_clock::now() - start).count();
+
+    vector<double> times;
+    times.reserve(iterations);
+    unsigned long long allocations = allocation_count().load();
+    unsigned long long opens = proc_open_count().load();
+    for (int i = 0; i < iterations; i++) {
+        start = steady_clock::now();
+        sample();
+        times.push_back(duration<double, milli>(steady_clock::now() - start).count());
+    }
+    int n = iterations > 0 ? iterations : 1;
+    r.allocations = (double)(allocation_count().load() - allocations) / n;
+    r.opens = (double)(proc_open_count().load() - opens) / n;
+    double total = 0;
+    for (size_t i = 0; i < times.size(); i++) total += times[i];
+    r.mean_ms = total / n;
+    r.p50_ms = percentile(times, 0.50);
+    r.p95_ms = percentile(times, 0.95);
+    r.max_ms = times.empty() ? 0 : *max_element(times.begin(), times.end());
+    r.peak_rss_kb = peak_rss_kb();
+    return r;
+}
+
+// The collectors, each built fresh against the current fixture.
+static void run_collectors(int pids, int iterations, vector<Result> &results) {
+    {
+        ProcessTable table;
+        vector<uint32_t> top;
+        results.push_back(measure(pids, "process_table", iterations, [&] {
+            table.scan();
+            table.top(SORT_CPU, 20, top);
+            table.sample_memory(top, 5, 10.0);
+            sink = top.empty() ? 0 : table.cpu_percent(top[0]);
+        }));
+    }
+    {
+        CpuSampler cpu;
+        results.push_back(measure(pids, "cpu_usage", iterations, [&] {
+            cpu.sample();
+            sink = cpu.total() + cpu.cpus();
+        }));
+    }
+    {
+        MemSampler mem;
+        NetSampler net;
+        DiskSampler disks;
+        PressureSampler pressure;
+        MemInfo info;
+        NetStats net_stats;
+        vector<DiskRates> disk_rates;
+        SystemPressure psi;
+        results.push_back(measure(pids, "system_info", iterations, [&] {
+            mem.sample(info);
+            net.sample(net_stats);
+            disks.sample(disk_rates);
+            pressure.sample(psi);
+            sink = info.used_percent() + net_stats.interfaces.size() + disk_rates.size();
+        }));
+    }
+    {
+        CgroupTable cgroups;
+        char root[256];
+        vector<uint32_t> top;
+        if (find_cgroup2_mount(root, sizeof(root)) && cgroups.open(root)) {
+            results.push_back(measure(pids, "cgroups", iterations, [&] {
+                cgroups.sample();
+                cgroups.top(CG_SORT_CPU, 20, top);
+                sink = (double)cgroups.size();
+            }));
+        }
+    }
+}
+
+static void write_json(FILE *out, const FixtureSpec &spec, int iterations, const vector<Result> &results) {
+    fprintf(out, "{\n  \"benchmark\": \"fixture_bench\",\n  \"iterations\": %d,\n"
+                 "  \"cores\": %d,\n  \"interfaces\": %d,\n  \"cgroups\": %d,\n  \"results\": [\n",
+            iterations, spec.cores, spec.interfaces, spec.cgroups);
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result &r = results[i];
+        fprintf(out, "    {\"pids\": %d, \"collector\": \"%s\", \"first_ms\": %.3f, \"mean_ms\": %.3f, "
+                     "\"p50_ms\": %.3f, \"p95_ms\": %.3f, \"max_ms\": %.3f, \"allocations_per_sample\": %.1f, "
+                     "\"opens_per_sample\": %.1f, \"peak_rss_kb\": %lld}%s\n",
+                r.pids, r.collector, r.first_ms, r.mean_ms, r.p50_ms, r.p95_ms, r.max_ms, r.allocations,
+                r.opens, r.peak_rss_kb, i + 1 < results.size() ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [--pids 1000,10000,100000] [--cores N] [--interfaces N] [--cgroups N]\n"
+                    "       [--iterations N] [--dir DIR] [--keep]\n", prog);
+}
+
+int main(int argc, char **argv) {
+    vector<int> pid_counts;
+    FixtureSpec spec = {0, 64, 16, 200};
+    int iterations = 20;
+    string base = getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp";
+    bool keep = false;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--pids" && has_value) {
+            for (const char *p = argv[++i]; *p;) {
+                char *end;
+                long n = strtol(p, &end, 10);
+                if (end == p || n <= 0) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                pid_counts.push_back((int)n);
+                p = *end == ',' ? end + 1 : end;
+            }
+        } else if (arg == "--cores" && has_value) {
+            spec.cores = max(1, atoi(argv[++i]));
+        } else if (arg == "--interfaces" && has_value) {
+            spec.interfaces = max(1, atoi(argv[++i]));
+        } else if (arg == "--cgroups" && has_value) {
+            spec.cgroups = max(1, atoi(argv[++i]));
+        } else if (arg == "--iterations" && has_value) {
+            iterations = max(1, atoi(argv[++i]));
+        } else if (arg == "--dir" && has_value) {
+            base = argv[++i];
+        } else if (arg == "--keep") {
+            keep = true;
+        } else {
+            usage(argv[0]);
+            return arg == "-h" || arg == "--help" ? 0 : 1;
+        }
+    }
+    if (pid_counts.empty()) {
+        pid_counts.push_back(1000);
+        pid_counts.push_back(10000);
+        pid_counts.push_back(100000);
+    }
+
+    vector<Result> results;
+    for (size_t k = 0; k < pid_counts.size(); k++) {
+        spec.pids = pid_counts[k];
+        string root = base + "/rplex-fixture-XXXXXX";
+        vector<char> templ(root.begin(), root.end());
+        templ.push_back('\0');
+        if (!mkdtemp(&templ[0])) {
+            perror("mkdtemp");
+            return 1;
+        }
+        root = &templ[0];
+        fprintf(stderr, "building %d pids in %s\n", spec.pids, root.c_str());
+        if (!build_fixture(root, spec)) {
+            perror("cannot build fixture");
+            return 1;
+        }
+        set_fs_roots((root + "/proc").c_str(), (root + "/sys").c_str());
+        run_collectors(spec.pids, iterations, results);
+        set_fs_roots(NULL, NULL);
+        if (!keep) nftw(root.c_str(), remove_entry, 64, FTW_DEPTH | FTW_PHYS);
+    }
+
+    fprintf(stderr, "%8s %-14s %10s %10s %10s %10s %12s %10s %12s\n", "pids", "collector", "first ms",
+            "p50 ms", "p95 ms", "max ms", "allocs/smp", "opens/smp", "peak rss kB");
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result &r = results[i];
+        fprintf(stderr, "%8d %-14s %10.3f %10.3f %10.3f %10.3f %12.1f %10.1f %12lld\n", r.pids, r.collector,
+                r.first_ms, r.p50_ms, r.p95_ms, r.max_ms, r.allocations, r.opens, r.peak_rss_kb);
+    }
+    write_json(stdout, spec, iterations, results);
+    return 0;
+}
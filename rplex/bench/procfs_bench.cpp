@@ -0,0 +1,123 @@
+/************************************************************
+ * RPLEX - procfs reader microbenchmark
+ *
+ * Compares the original ifstream/istringstream parsing with
+ * ProcFile + ProcScanner on /proc/stat, /proc/<pid>/stat and
+ * /proc/<pid>/status.
+ *
+ * Build: g++ -O2 -std=c++11 -I. bench/procfs_bench.cpp -o procfs_bench
+ * Usage: ./procfs_bench [pid] [iterations]
+ ************************************************************/
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include "rplex_procfs.h"
+
+using namespace std;
+using namespace chrono;
+
+// Keeps the optimizer from discarding parsed values.
+static volatile unsigned long long sink;
+
+static unsigned long long legacy_stat() {
+    ifstream stat("/proc/stat");
+    string line;
+    getline(stat, line);
+    istringstream iss(line.substr(5));
+    unsigned long long user, nice, system, idle, iowait, irq, softirq;
+    iss >> user >> nice >> system >> idle >> iowait >> irq >> softirq;
+    return user + nice + system + idle + iowait + irq + softirq;
+}
+
+static unsigned long long procfs_stat(ProcFile &f) {
+    CpuTimes t;
+    if (!f.read()) return 0;
+    ProcScanner s(f);
+    if (!s.starts_with("cpu ", 4) || !parse_cpu_times(s, t)) return 0;
+    return t.total();
+}
+
+static unsigned long long legacy_pid_stat(const string &pid_str) {
+    ifstream stat("/proc/" + pid_str + "/stat");
+    string stat_line;
+    getline(stat, stat_line);
+    istringstream stat_iss(stat_line);
+    string dummy;
+    for (int i = 0; i < 13; i++) stat_iss >> dummy;
+    unsigned long utime, stime;
+    stat_iss >> utime >> stime;
+    return utime + stime;
+}
+
+static unsigned long long procfs_pid_stat(ProcFile &f) {
+    PidStat ps;
+    if (!f.read() || !parse_pid_stat(f.data(), f.size(), ps)) return 0;
+    return ps.utime + ps.stime;
+}
+
+static unsigned long long legacy_pid_status(const string &pid_str) {
+    ifstream status("/proc/" + pid_str + "/status");
+    string status_line;
+    long vm_rss = 0;
+    while (getline(status, status_line)) {
+        if (status_line.find("VmRSS:") == 0) {
+            istringstream iss(status_line.substr(6));
+            iss >> vm_rss;
+            break;
+        }
+    }
+    return vm_rss;
+}
+
+static unsigned long long procfs_pid_status(ProcFile &f) {
+    long long vm_rss = 0;
+    if (!f.read()) return 0;
+    ProcScanner s(f);
+    if (s.find_key("VmRSS:", 6)) s.next_i64(vm_rss);
+    return vm_rss;
+}
+
+template <typename F>
+static double time_ns(int iterations, F fn) {
+    auto start = steady_clock::now();
+    for (int i = 0; i < iterations; i++) sink = fn();
+    auto elapsed = duration_cast<nanoseconds>(steady_clock::now() - start).count();
+    return (double)elapsed / iterations;
+}
+
+static void report(const char *name, double legacy, double procfs) {
+    printf("%-18s %12.0f %12.0f %8.2fx\n", name, legacy, procfs, legacy / procfs);
+}
+
+int main(int argc, char **argv) {
+    int pid = argc > 1 ? atoi(argv[1]) : (int)getpid();
+    int iterations = argc > 2 ? atoi(argv[2]) : 20000;
+    string pid_str = to_string(pid);
+    char path[64];
+
+    ProcFile stat("/proc/stat");
+    ProcFile pid_stat(proc_pid_path(path, sizeof(path), pid, "stat"));
+    ProcFile pid_status(proc_pid_path(path, sizeof(path), pid, "status"));
+    // Path-constructed files open on their first read
+    if (!stat.read() || !pid_stat.read() || !pid_status.read()) {
+        fprintf(stderr, "cannot open procfs files for pid %d\n", pid);
+        return 1;
+    }
+
+    printf("pid %d, %d iterations, ns per read+parse\n", pid, iterations);
+    printf("%-18s %12s %12s %9s\n", "file", "ifstream", "ProcFile", "speedup");
+    report("/proc/stat",
+           time_ns(iterations, [] { return legacy_stat(); }),
+           time_ns(iterations, [&] { return procfs_stat(stat); }));
+    report("/proc/<pid>/stat",
+           time_ns(iterations, [&] { return legacy_pid_stat(pid_str); }),
+           time_ns(iterations, [&] { return procfs_pid_stat(pid_stat); }));
+    report("/proc/<pid>/status",
+           time_ns(iterations, [&] { return legacy_pid_status(pid_str); }),
+           time_ns(iterations, [&] { return procfs_pid_status(pid_status); }));
+    return 0;
+}
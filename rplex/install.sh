@@ -8,8 +8,9 @@ sudo apt install -y g++ libncurses5-dev libncursesw5-dev
 
 # Compile programs
 cd rplex
-g++ rplex_monitor.cpp -o rplex.out -std=c++11
-g++ rplex_monitor3.cpp -o rplex3.out -std=c++11 -lncurses
+g++ rplex_monitor.cpp -o rplex.out -std=c++11 -lncurses -lcurl -pthread -ldl
+g++ rplex_monitor3.cpp -o rplex3.out -std=c++11 -lncurses -pthread -ldl
+gcc -shared -fPIC -O2 -I. plugins/kernel_plugin.c -o plugins/kernel_plugin.so
 
 # Set executable permissions
 chmod +x rplex rplex3 rplex.out rplex3.out
@@ -0,0 +1,95 @@
+/************************************************************
+ * RPLEX - example collector plugin
+ *
+ * Runnable and blocked tasks from /proc/stat and open file
+ * handles from /proc/sys/fs/file-nr, none of which rplex
+ * reads itself. A starting point for site-specific
+ * collectors:
+ *
+ *   gcc -shared -fPIC -O2 -I.. -o kernel_plugin.so kernel_plugin.c
+ *   ../rplex.out --plugin ./kernel_plugin.so
+ ************************************************************/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "rplex_plugin.h"
+
+struct state {
+    int stat_fd;
+    int file_nr_fd;
+    char buf[65536];
+};
+
+static const struct rplex_metric metrics[] = {
+    {"procs_running", "", "Tasks runnable right now."},
+    {"procs_blocked", "", "Tasks waiting on I/O right now."},
+    {"files_open", "", "File handles allocated by the kernel."},
+};
+
+/* Read the whole file from the start; the kernel regenerates it. */
+static const char *read_all(int fd, char *buf, size_t cap) {
+    ssize_t n = pread(fd, buf, cap - 1, 0);
+    if (n < 0) return NULL;
+    buf[n] = '\0';
+    return buf;
+}
+
+static double field_after(const char *text, const char *key) {
+    const char *p = strstr(text, key);
+    return p ? strtod(p + strlen(key), NULL) : NAN;
+}
+
+static void *init(char *error, size_t error_cap) {
+    struct state *s = malloc(sizeof(*s));
+    if (!s) {
+        snprintf(error, error_cap, "out of memory");
+        return NULL;
+    }
+    s->stat_fd = open("/proc/stat", O_RDONLY | O_CLOEXEC);
+    s->file_nr_fd = open("/proc/sys/fs/file-nr", O_RDONLY | O_CLOEXEC);
+    if (s->stat_fd < 0) {
+        snprintf(error, error_cap, "/proc/stat: %s", strerror(errno));
+        if (s->file_nr_fd >= 0) close(s->file_nr_fd);
+        free(s);
+        return NULL;
+    }
+    return s;
+}
+
+static int sample(void *state, double *values) {
+    struct state *s = state;
+    const char *text = read_all(s->stat_fd, s->buf, sizeof(s->buf));
+    if (!text) return -1;
+    values[0] = field_after(text, "\nprocs_running ");
+    values[1] = field_after(text, "\nprocs_blocked ");
+    /* Missing in some containers: report it as unknown */
+    text = s->file_nr_fd >= 0 ? read_all(s->file_nr_fd, s->buf, sizeof(s->buf)) : NULL;
+    values[2] = text ? strtod(text, NULL) : NAN;
+    return 0;
+}
+
+static void destroy(void *state) {
+    struct state *s = state;
+    close(s->stat_fd);
+    if (s->file_nr_fd >= 0) close(s->file_nr_fd);
+    free(s);
+}
+
+static const struct rplex_plugin plugin = {
+    RPLEX_PLUGIN_ABI,
+    "kernel",
+    sizeof(metrics) / sizeof(metrics[0]),
+    metrics,
+    init,
+    sample,
+    destroy,
+};
+
+const struct rplex_plugin *rplex_plugin_entry(void) {
+    return &plugin;
+}
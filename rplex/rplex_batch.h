@@ -0,0 +1,283 @@
+/************************************************************
+ * RPLEX - headless batch output
+ *
+ * Streams timestamped samples of selected metrics to stdout
+ * or a file as CSV, NDJSON or a compact length-prefixed
+ * binary format, without starting ncurses. Meant to feed
+ * existing pipelines at intervals well below 100 ms.
+ ************************************************************/
+
+#ifndef RPLEX_BATCH_H
+#define RPLEX_BATCH_H
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <functional>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <csignal>
+#include <stdint.h>
+#include "rplex_selfprof.h"
+#include "rplex_collector.h"
+
+enum BatchFormat { BATCH_CSV, BATCH_NDJSON, BATCH_BINARY };
+
+struct BatchConfig {
+    bool enabled;
+    BatchFormat format;
+    int interval_ms;
+    std::string metrics;        // comma separated; empty means all
+    std::string output;         // file path, "-" for stdout
+    long count;                 // samples to write, 0 = until killed
+
+    BatchConfig() : enabled(false), format(BATCH_CSV), interval_ms(1000), output("-"), count(0) {}
+};
+
+inline bool parse_batch_format(const char *s, BatchFormat &out) {
+    if (strcmp(s, "csv") == 0) out = BATCH_CSV;
+    else if (strcmp(s, "ndjson") == 0 || strcmp(s, "json") == 0) out = BATCH_NDJSON;
+    else if (strcmp(s, "binary") == 0 || strcmp(s, "bin") == 0) out = BATCH_BINARY;
+    else return false;
+    return true;
+}
+
+// Resolve a comma separated list against the available metric names.
+// Indices come back in the order asked for. False names the first
+// unknown metric in `bad`.
+inline bool select_metrics(const std::string &list, const std::vector<std::string> &available,
+                           std::vector<int> &out, std::string &bad) {
+    out.clear();
+    if (list.empty() || list == "all") {
+        for (size_t i = 0; i < available.size(); i++) out.push_back((int)i);
+        return true;
+    }
+    size_t pos = 0;
+    while (pos <= list.size()) {
+        size_t comma = list.find(',', pos);
+        if (comma == std::string::npos) comma = list.size();
+        std::string name = list.substr(pos, comma - pos);
+        pos = comma + 1;
+        if (name.empty()) continue;
+        size_t i = 0;
+        while (i < available.size() && available[i] != name) i++;
+        if (i == available.size()) {
+            bad = name;
+            return false;
+        }
+        out.push_back((int)i);
+    }
+    if (out.empty()) bad = list;
+    return !out.empty();
+}
+
+// Formats one record per sample into a reused buffer and hands it to the
+// stream with a single fwrite, flushed so a reader sees every sample as
+// soon as it is taken.
+//
+// Binary layout, host byte order: every record is a uint32 length of
+// what follows, a type byte, then the payload.
+//   'H' header:  uint16 version (1), uint16 n, n x (uint8 len, name)
+//   'S' sample:  int64 unix time in microseconds, n x float64
+class BatchWriter {
+public:
+    BatchWriter(FILE *out, BatchFormat format, const std::vector<std::string> &names)
+        : out_(out), format_(format), names_(names) {}
+
+    bool write_header() {
+        buf_.clear();
+        if (format_ == BATCH_CSV) {
+            append("timestamp");
+            for (size_t i = 0; i < names_.size(); i++) {
+                append(",");
+                append(names_[i].c_str());
+            }
+            append("\n");
+        } else if (format_ == BATCH_BINARY) {
+            begin_record('H');
+            put_u16(1);
+            put_u16((uint16_t)names_.size());
+            for (size_t i = 0; i < names_.size(); i++) {
+                size_t len = names_[i].size() < 255 ? names_[i].size() : 255;
+                buf_.push_back((char)len);
+                buf_.insert(buf_.end(), names_[i].begin(), names_[i].begin() + len);
+            }
+            end_record();
+        }
+        return flush();
+    }
+
+    // values has one entry per name; NaN marks a reading that failed.
+    bool write_sample(int64_t unix_us, const double *values) {
+        buf_.clear();
+        if (format_ == BATCH_BINARY) {
+            begin_record('S');
+            put(&unix_us, sizeof(unix_us));
+            put(values, names_.size() * sizeof(double));
+            end_record();
+            return flush();
+        }
+
+        char num[64];
+        snprintf(num, sizeof(num), "%lld.%06lld", (long long)(unix_us / 1000000), (long long)(unix_us % 1000000));
+        if (format_ == BATCH_CSV) {
+            append(num);
+            for (size_t i = 0; i < names_.size(); i++) {
+                append(",");
+                if (!std::isnan(values[i])) append_number(values[i]);
+            }
+            append("\n");
+        } else {
+            append("{\"timestamp\":");
+            append(num);
+            for (size_t i = 0; i < names_.size(); i++) {
+                append(",\"");
+                append(names_[i].c_str());
+                append("\":");
+                if (std::isnan(values[i])) append("null");
+                else append_number(values[i]);
+            }
+            append("}\n");
+        }
+        return flush();
+    }
+
+private:
+    void append(const char *s) { buf_.insert(buf_.end(), s, s + strlen(s)); }
+
+    void append_number(double v) {
+        char num[32];
+        snprintf(num, sizeof(num), "%.10g", v);
+        append(num);
+    }
+
+    void put(const void *p, size_t len) {
+        const char *c = (const char *)p;
+        buf_.insert(buf_.end(), c, c + len);
+    }
+
+    void put_u16(uint16_t v) { put(&v, sizeof(v)); }
+
+    void begin_record(char type) {
+        buf_.resize(sizeof(uint32_t));
+        buf_.push_back(type);
+    }
+
+    void end_record() {
+        uint32_t len = (uint32_t)(buf_.size() - sizeof(uint32_t));
+        memcpy(&buf_[0], &len, sizeof(len));
+    }
+
+    bool flush() {
+        if (!buf_.empty() && fwrite(&buf_[0], 1, buf_.size(), out_) != buf_.size()) return false;
+        return fflush(out_) == 0;
+    }
+
+    FILE *out_;
+    BatchFormat format_;
+    std::vector<std::string> names_;
+    std::vector<char> buf_;
+};
+
+// Metrics of the batch runner itself, offered after the caller's;
+// collectors cannot use these names (reserved_metric_name()).
+enum { BATCH_SELF_CPU, BATCH_SELF_RSS, BATCH_SELF_SAMPLE_MS, BATCH_SELF_COUNT };
+
+// Sample every config.interval_ms on absolute deadlines and write each
+// sample until config.count is reached or the output goes away (a closed
+// pipe ends the run instead of killing the process). `sample` fills one
+// value per selected metric, in selection order; it only ever sees
+// indices into `available`. Returns an exit status.
+inline int run_batch(const BatchConfig &config, const std::vector<std::string> &available,
+                     std::function<void(const std::vector<int> &, double *)> sample) {
+    static const char *self_names[BATCH_SELF_COUNT] = {"self_cpu_pct", "self_rss_mb", "self_sample_ms"};
+    std::vector<std::string> all(available);
+    all.insert(all.end(), self_names, self_names + BATCH_SELF_COUNT);
+    std::vector<int> selected;
+    std::string bad;
+    if (!select_metrics(config.metrics, all, selected, bad)) {
+        fprintf(stderr, "unknown metric '%s'; available:", bad.c_str());
+        for (size_t i = 0; i < all.size(); i++) fprintf(stderr, " %s", all[i].c_str());
+        fprintf(stderr, "\n");
+        return 1;
+    }
+    std::vector<std::string> names;
+    for (size_t i = 0; i < selected.size(); i++) names.push_back(all[selected[i]]);
+
+    // Split the selection: the caller's metrics, and where each lands
+    std::vector<int> caller;
+    std::vector<size_t> caller_pos;
+    for (size_t i = 0; i < selected.size(); i++) {
+        if (selected[i] < (int)available.size()) {
+            caller.push_back(selected[i]);
+            caller_pos.push_back(i);
+        }
+    }
+    std::vector<double> caller_values(caller.size() + 1);
+    SelfMonitor self;
+    SelfUsage usage;
+    double sample_ms = 0;
+    std::function<void(double *)> take = [&](double *values) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        if (!caller.empty()) sample(caller, &caller_values[0]);
+        sample_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        self.sample(usage);
+        for (size_t i = 0; i < caller.size(); i++) values[caller_pos[i]] = caller_values[i];
+        for (size_t i = 0; i < selected.size(); i++) {
+            int own = selected[i] - (int)available.size();
+            if (own == BATCH_SELF_CPU) values[i] = usage.cpu_percent;
+            else if (own == BATCH_SELF_RSS) values[i] = usage.rss_kb / 1024.0;
+            else if (own == BATCH_SELF_SAMPLE_MS) values[i] = sample_ms;
+        }
+    };
+
+    FILE *out = stdout;
+    if (config.output != "-") {
+        out = fopen(config.output.c_str(), config.format == BATCH_BINARY ? "wb" : "w");
+        if (!out) {
+            perror(config.output.c_str());
+            return 1;
+        }
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    std::vector<double> values(selected.size());
+    BatchWriter writer(out, config.format, names);
+    bool ok = writer.write_header();
+
+    // Rates are deltas, so take one throwaway sample to set the baseline.
+    std::chrono::milliseconds interval(config.interval_ms > 0 ? config.interval_ms : 1);
+    take(&values[0]);
+    std::chrono::steady_clock::time_point next = std::chrono::steady_clock::now() + interval;
+    for (long n = 0; ok && (config.count == 0 || n < config.count); n++) {
+        std::this_thread::sleep_until(next);
+        take(&values[0]);
+        int64_t now_us = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        ok = writer.write_sample(now_us, &values[0]);
+        next += interval;
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (next < now) next = now;  // fell behind; don't burst to catch up
+    }
+
+    if (out != stdout) fclose(out);
+    return 0;
+}
+
+// Batch mode over a MetricSet, for both binaries: only the collectors
+// behind the selected metrics are sampled.
+inline int run_batch(const BatchConfig &config, MetricSet &set) {
+    std::vector<int> active;
+    return run_batch(config, set.names(), [&](const std::vector<int> &selected, double *values) {
+        if (selected != active) {
+            set.select(selected);
+            active = selected;
+        }
+        set.sample();
+        for (size_t i = 0; i < selected.size(); i++) values[i] = set.value(selected[i]);
+    });
+}
+
+#endif
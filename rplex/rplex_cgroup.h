@@ -0,0 +1,529 @@
+/************************************************************
+ * RPLEX - cgroup v2 and pressure stall information
+ *
+ * Host-wide PSI from /proc/pressure, and per-cgroup CPU,
+ * memory, I/O, PSI and process counts from the cgroup v2
+ * hierarchy, in the spirit of systemd-cgtop.
+ *
+ * Each cgroup's files stay open between samples, so a
+ * sample is one pread() per file. The tree is only walked
+ * again every few samples, or as soon as the root's
+ * cgroup.stat reports a different number of descendants.
+ ************************************************************/
+
+#ifndef RPLEX_CGROUP_H
+#define RPLEX_CGROUP_H
+
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <algorithm>
+#include <chrono>
+#include <cerrno>
+#include <cstring>
+#include <cstdio>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "rplex_procfs.h"
+
+// One PSI file: share of wall time in which some (or all non-idle)
+// tasks were stalled on the resource. Averages are percentages,
+// totals microseconds.
+struct Pressure {
+    bool available;
+    double some_avg10, some_avg60, some_avg300;
+    double full_avg10, full_avg60, full_avg300;
+    unsigned long long some_total, full_total;
+};
+
+// Parse "some avg10=0.00 avg60=0.00 avg300=0.00 total=0" and the
+// matching "full" line. Kernels before 5.13 have no "full" for CPU.
+inline bool parse_pressure(const char *data, size_t len, Pressure &p) {
+    memset(&p, 0, sizeof(p));
+    ProcScanner s(data, len);
+    if (s.at_end()) return false;
+    do {
+        double *avg;
+        unsigned long long *total;
+        if (s.starts_with("some", 4)) {
+            avg = &p.some_avg10;
+            total = &p.some_total;
+        } else if (s.starts_with("full", 4)) {
+            avg = &p.full_avg10;
+            total = &p.full_total;
+        } else {
+            continue;
+        }
+        s.skip_spaces();
+        bool ok = s.starts_with("avg10=", 6) && s.next_decimal(avg[0]);
+        s.skip_spaces();
+        ok = ok && s.starts_with("avg60=", 6) && s.next_decimal(avg[1]);
+        s.skip_spaces();
+        ok = ok && s.starts_with("avg300=", 7) && s.next_decimal(avg[2]);
+        s.skip_spaces();
+        ok = ok && s.starts_with("total=", 6) && s.next_u64(*total);
+        if (!ok) return false;
+        p.available = true;
+    } while (s.next_line());
+    return p.available;
+}
+
+struct SystemPressure {
+    Pressure cpu, memory, io;
+};
+
+// Keeps /proc/pressure/{cpu,memory,io} open. Without CONFIG_PSI (or
+// with psi=0) the files are missing and every Pressure reads unavailable.
+class PressureSampler {
+public:
+    PressureSampler() : cpu_("/proc/pressure/cpu"), memory_("/proc/pressure/memory"),
+                        io_("/proc/pressure/io") {}
+
+    bool sample(SystemPressure &out) {
+        read(cpu_, out.cpu);
+        read(memory_, out.memory);
+        read(io_, out.io);
+        return out.cpu.available || out.memory.available || out.io.available;
+    }
+
+private:
+    PressureSampler(const PressureSampler &);
+    PressureSampler &operator=(const PressureSampler &);
+
+    static void read(ProcFile &f, Pressure &p) {
+        if (!f.read() || !parse_pressure(f.data(), f.size(), p)) memset(&p, 0, sizeof(p));
+    }
+
+    ProcFile cpu_;
+    ProcFile memory_;
+    ProcFile io_;
+};
+
+// Mount point of the cgroup v2 hierarchy: /sys/fs/cgroup on unified
+// systems, /sys/fs/cgroup/unified on hybrid ones. The mount table is
+// rplex's own, so a relocated sysfs is taken to be unified.
+inline bool find_cgroup2_mount(char *out, size_t cap) {
+    if (!fs_roots().sys.empty()) {
+        snprintf(out, cap, "/sys/fs/cgroup");
+        return true;
+    }
+    ProcFile mounts("/proc/self/mounts");
+    if (!mounts.read()) return false;
+    ProcScanner s(mounts);
+    do {
+        // device mountpoint fstype options
+        if (!s.skip_field()) continue;
+        s.skip_spaces();
+        const char *mount = s.p;
+        if (!s.skip_field()) continue;
+        size_t len = s.p - mount;
+        s.skip_spaces();
+        if (!s.looking_at("cgroup2 ", 8) || len >= cap) continue;
+        memcpy(out, mount, len);
+        out[len] = '\0';
+        return true;
+    } while (s.next_line());
+    return false;
+}
+
+// What one cgroup did over the last interval.
+struct CgroupStats {
+    char path[128];            // relative to the root, "/" for the root; long paths keep their tail
+    int depth;                 // 0 for the root
+    double cpu_percent;        // of one CPU, children included
+    long long memory_bytes;    // memory.current, -1 without the memory controller
+    long long anon_bytes, file_bytes;
+    double io_read_bytes, io_write_bytes;   // per second, children included
+    Pressure cpu, memory, io;
+    unsigned procs;            // processes directly in this cgroup
+    unsigned total_procs;      // ... and in its descendants
+
+    // Highest "some" average of the three resources over 10 s.
+    double worst_pressure() const {
+        return std::max(cpu.some_avg10, std::max(memory.some_avg10, io.some_avg10));
+    }
+};
+
+enum CgroupSortKey {
+    CG_SORT_CPU,
+    CG_SORT_MEM,
+    CG_SORT_IO,
+    CG_SORT_PRESSURE,
+    CG_SORT_NAME
+};
+
+class CgroupTable {
+public:
+    CgroupTable() : len_(0), generation_(0), since_walk_(0), rescan_every_(10),
+                    descendants_(-1), have_last_(false) {}
+
+    ~CgroupTable() { close_all(); }
+
+    // Use the hierarchy mounted at root. Returns false if it has no
+    // cgroup.procs, i.e. is not a cgroup mount.
+    bool open(const char *root) {
+        close_all();
+        root_ = root;
+        while (root_.size() > 1 && root_[root_.size() - 1] == '/') root_.erase(root_.size() - 1);
+        std::string probe = root_ + "/cgroup.procs";
+        if (!proc_exists(probe.c_str())) {
+            root_.clear();
+            return false;
+        }
+        raise_fd_limit();
+        stat_.open((root_ + "/cgroup.stat").c_str());
+        since_walk_ = rescan_every_;
+        return true;
+    }
+
+    bool is_open() const { return !root_.empty(); }
+    const std::string &root() const { return root_; }
+
+    // Full walks happen at least every `samples` samples.
+    void set_rescan_interval(unsigned samples) { rescan_every_ = samples ? samples : 1; }
+
+    // Re-read every cgroup, first re-walking the tree if it may have changed.
+    void sample() {
+        if (root_.empty()) return;
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        double elapsed = have_last_ ? std::chrono::duration<double>(now - last_).count() : 0;
+        last_ = now;
+        have_last_ = true;
+
+        bool changed = descendants_changed();   // always read, to keep the baseline
+        if (++since_walk_ >= rescan_every_ || changed) walk();
+        for (size_t i = 0; i < groups_.size(); i++) read_group(groups_[i], elapsed);
+        // Deepest first, so every child is added before its parent is
+        for (size_t i = 0; i < groups_.size(); i++) groups_[i].stats.total_procs = groups_[i].stats.procs;
+        for (size_t r = 0; r < by_depth_.size(); r++) {
+            const Group &g = groups_[by_depth_[r]];
+            if (g.parent >= 0) groups_[g.parent].stats.total_procs += g.stats.total_procs;
+        }
+    }
+
+    size_t size() const { return groups_.size(); }
+    const CgroupStats &stats(size_t i) const { return groups_[i].stats; }
+    bool alive(size_t i) const { return groups_[i].alive; }
+
+    // Rows of the first k live cgroups by key, the root left out: the
+    // host-wide panels already cover it. Descending except for names.
+    void top(CgroupSortKey key, size_t k, std::vector<uint32_t> &out) const {
+        out.clear();
+        for (size_t i = 0; i < groups_.size(); i++) {
+            if (groups_[i].alive && groups_[i].stats.depth > 0) out.push_back((uint32_t)i);
+        }
+        k = std::min(k, out.size());
+        std::partial_sort(out.begin(), out.begin() + k, out.end(), Before(groups_, key));
+        out.resize(k);
+    }
+
+private:
+    CgroupTable(const CgroupTable &);
+    CgroupTable &operator=(const CgroupTable &);
+
+    enum File {
+        CPU_STAT,
+        MEMORY_CURRENT,
+        MEMORY_STAT,
+        IO_STAT,
+        CPU_PRESSURE,
+        MEMORY_PRESSURE,
+        IO_PRESSURE,
+        PROCS,
+        FILE_COUNT
+    };
+
+    static const char *file_name(int f) {
+        static const char *names[FILE_COUNT] = {
+            "cpu.stat", "memory.current", "memory.stat", "io.stat",
+            "cpu.pressure", "memory.pressure", "io.pressure", "cgroup.procs"};
+        return names[f];
+    }
+
+    struct Group {
+        std::string path;          // relative to root_, "" for the root
+        int fds[FILE_COUNT];       // -1 where the controller is not enabled
+        bool transient;            // ran out of fds: open/read/close each sample
+        bool alive;                // false once cpu.stat stops reading (rmdir)
+        int parent;                // index, -1 for the root
+        unsigned seen;             // walk generation
+        unsigned long long usage_usec, read_bytes, write_bytes;
+        bool has_prev;
+        CgroupStats stats;
+    };
+
+    struct Before {
+        const std::vector<Group> &g;
+        CgroupSortKey key;
+        Before(const std::vector<Group> &groups, CgroupSortKey k) : g(groups), key(k) {}
+        bool operator()(uint32_t a, uint32_t b) const {
+            const CgroupStats &x = g[a].stats, &y = g[b].stats;
+            switch (key) {
+            case CG_SORT_MEM:
+                if (x.memory_bytes != y.memory_bytes) return x.memory_bytes > y.memory_bytes;
+                break;
+            case CG_SORT_IO:
+                if (x.io_read_bytes + x.io_write_bytes != y.io_read_bytes + y.io_write_bytes) {
+                    return x.io_read_bytes + x.io_write_bytes > y.io_read_bytes + y.io_write_bytes;
+                }
+                break;
+            case CG_SORT_PRESSURE:
+                if (x.worst_pressure() != y.worst_pressure()) return x.worst_pressure() > y.worst_pressure();
+                break;
+            case CG_SORT_NAME:
+                break;
+            default:
+                if (x.cpu_percent != y.cpu_percent) return x.cpu_percent > y.cpu_percent;
+                break;
+            }
+            return g[a].path < g[b].path;
+        }
+    };
+
+    // The root's cgroup.stat counts live descendants, so a creation or
+    // removal shows up on the next sample without listing directories.
+    bool descendants_changed() {
+        if (!stat_.read()) return false;
+        ProcScanner s(stat_);
+        unsigned long long n;
+        if (!s.find_key("nr_descendants ", 15) || !s.next_u64(n)) return false;
+        bool changed = descendants_ >= 0 && (long long)n != descendants_;
+        descendants_ = (long long)n;
+        return changed;
+    }
+
+    void walk() {
+        since_walk_ = 0;
+        generation_++;
+        std::vector<std::string> pending(1, std::string());
+        std::string dir_path;
+        while (!pending.empty()) {
+            std::string rel;
+            rel.swap(pending.back());
+            pending.pop_back();
+            visit(rel);
+
+            dir_path = root_ + "/" + rel;
+            DIR *dir = proc_opendir(dir_path.c_str());
+            if (!dir) continue;
+            struct dirent *ent;
+            while ((ent = readdir(dir)) != NULL) {
+                if (ent->d_name[0] == '.') continue;
+                bool is_dir = ent->d_type == DT_DIR;
+                if (ent->d_type == DT_UNKNOWN) {
+                    struct stat st;
+                    char buf[4096];
+                    std::string child = dir_path + "/" + ent->d_name;
+                    is_dir = stat(fs_path(child.c_str(), buf, sizeof(buf)), &st) == 0 && S_ISDIR(st.st_mode);
+                }
+                if (is_dir) pending.push_back(rel.empty() ? std::string(ent->d_name) : rel + "/" + ent->d_name);
+            }
+            closedir(dir);
+        }
+
+        // Drop what the walk no longer found, then relink parents
+        for (size_t i = 0; i < groups_.size();) {
+            if (groups_[i].seen == generation_) {
+                i++;
+                continue;
+            }
+            close_group(groups_[i]);
+            index_.erase(groups_[i].path);
+            if (i != groups_.size() - 1) {
+                groups_[i] = groups_.back();
+                index_[groups_[i].path] = i;
+            }
+            groups_.pop_back();
+        }
+        by_depth_.resize(groups_.size());
+        for (size_t i = 0; i < groups_.size(); i++) {
+            Group &g = groups_[i];
+            g.parent = -1;
+            if (!g.path.empty()) {
+                size_t slash = g.path.rfind('/');
+                std::unordered_map<std::string, size_t>::const_iterator it =
+                    index_.find(slash == std::string::npos ? std::string() : g.path.substr(0, slash));
+                if (it != index_.end()) g.parent = (int)it->second;
+            }
+            by_depth_[i] = (uint32_t)i;
+        }
+        std::sort(by_depth_.begin(), by_depth_.end(), Deeper(groups_));
+    }
+
+    struct Deeper {
+        const std::vector<Group> &g;
+        explicit Deeper(const std::vector<Group> &groups) : g(groups) {}
+        bool operator()(uint32_t a, uint32_t b) const { return g[a].stats.depth > g[b].stats.depth; }
+    };
+
+    void visit(const std::string &rel) {
+        std::unordered_map<std::string, size_t>::iterator it = index_.find(rel);
+        if (it != index_.end()) {
+            Group &g = groups_[it->second];
+            // A cgroup removed and recreated under the same name between
+            // walks: its old fds are dead, open the new directory.
+            if (!g.alive) {
+                close_group(g);
+                open_group(g);
+            }
+            g.seen = generation_;
+            return;
+        }
+        groups_.push_back(Group());
+        Group &g = groups_.back();
+        g.path = rel;
+        g.seen = generation_;
+        g.parent = -1;
+        memset(&g.stats, 0, sizeof(g.stats));
+        g.stats.depth = rel.empty() ? 0 : 1 + (int)std::count(rel.begin(), rel.end(), '/');
+        copy_path(g.stats.path, sizeof(g.stats.path), rel);
+        open_group(g);
+        index_[rel] = groups_.size() - 1;
+    }
+
+    // Keep the end of paths too long for the fixed buffer; the leaf is
+    // what tells containers apart.
+    static void copy_path(char *out, size_t cap, const std::string &rel) {
+        std::string full = "/" + rel;
+        if (full.size() < cap) {
+            memcpy(out, full.c_str(), full.size() + 1);
+            return;
+        }
+        size_t keep = cap - 4;
+        memcpy(out, "...", 3);
+        memcpy(out + 3, full.c_str() + full.size() - keep, keep + 1);
+    }
+
+    std::string file_path(const Group &g, int f) const {
+        return root_ + "/" + (g.path.empty() ? std::string() : g.path + "/") + file_name(f);
+    }
+
+    void open_group(Group &g) {
+        g.transient = false;
+        g.alive = true;
+        g.has_prev = false;
+        for (int f = 0; f < FILE_COUNT; f++) g.fds[f] = -1;
+        for (int f = 0; f < FILE_COUNT; f++) {
+            g.fds[f] = proc_open(file_path(g, f).c_str());
+            if (g.fds[f] < 0 && (errno == EMFILE || errno == ENFILE)) {
+                close_group(g);
+                g.transient = true;
+                return;
+            }
+        }
+    }
+
+    void close_group(Group &g) {
+        for (int f = 0; f < FILE_COUNT; f++) {
+            if (g.fds[f] >= 0) ::close(g.fds[f]);
+            g.fds[f] = -1;
+        }
+    }
+
+    void close_all() {
+        for (size_t i = 0; i < groups_.size(); i++) close_group(groups_[i]);
+        groups_.clear();
+        index_.clear();
+        by_depth_.clear();
+        stat_.close();
+        descendants_ = -1;
+        have_last_ = false;
+    }
+
+    bool read_file(const Group &g, int f) {
+        if (!g.transient) return ProcFile::pread_all(g.fds[f], buf_, len_);
+        int fd = proc_open(file_path(g, f).c_str());
+        bool ok = ProcFile::pread_all(fd, buf_, len_);
+        if (fd >= 0) ::close(fd);
+        return ok;
+    }
+
+    void read_group(Group &g, double elapsed) {
+        CgroupStats &s = g.stats;
+        unsigned long long usage;
+        if (!g.alive || !read_file(g, CPU_STAT) || !parse_usage(usage)) {
+            // rmdir'ed since the last walk; the next walk forgets it
+            g.alive = false;
+            s.procs = 0;
+            return;
+        }
+        bool have = g.has_prev && elapsed > 0;
+        s.cpu_percent = have && usage >= g.usage_usec ? (usage - g.usage_usec) / (elapsed * 1e4) : 0;
+        g.usage_usec = usage;
+
+        unsigned long long current;
+        s.memory_bytes = -1;
+        if (read_file(g, MEMORY_CURRENT) && ProcScanner(&buf_[0], len_).next_u64(current)) {
+            s.memory_bytes = (long long)current;
+        }
+        s.anon_bytes = s.file_bytes = 0;
+        if (read_file(g, MEMORY_STAT)) parse_memory_stat(s);
+
+        unsigned long long rd = 0, wr = 0;
+        if (read_file(g, IO_STAT)) parse_io_stat(rd, wr);
+        s.io_read_bytes = have && rd >= g.read_bytes ? (rd - g.read_bytes) / elapsed : 0;
+        s.io_write_bytes = have && wr >= g.write_bytes ? (wr - g.write_bytes) / elapsed : 0;
+        g.read_bytes = rd;
+        g.write_bytes = wr;
+
+        read_pressure(g, CPU_PRESSURE, s.cpu);
+        read_pressure(g, MEMORY_PRESSURE, s.memory);
+        read_pressure(g, IO_PRESSURE, s.io);
+
+        s.procs = 0;
+        if (read_file(g, PROCS)) s.procs = (unsigned)std::count(buf_.begin(), buf_.begin() + len_, '\n');
+        g.has_prev = true;
+    }
+
+    void read_pressure(const Group &g, int f, Pressure &p) {
+        if (!read_file(g, f) || !parse_pressure(&buf_[0], len_, p)) memset(&p, 0, sizeof(p));
+    }
+
+    bool parse_usage(unsigned long long &usage) {
+        ProcScanner sc(&buf_[0], len_);
+        return sc.find_key("usage_usec ", 11) && sc.next_u64(usage);
+    }
+
+    void parse_memory_stat(CgroupStats &s) {
+        ProcScanner sc(&buf_[0], len_);
+        unsigned long long v;
+        do {
+            if (sc.starts_with("anon ", 5) && sc.next_u64(v)) s.anon_bytes = (long long)v;
+            else if (sc.starts_with("file ", 5) && sc.next_u64(v)) s.file_bytes = (long long)v;
+        } while (sc.next_line());
+    }
+
+    // "8:0 rbytes=... wbytes=... rios=... wios=... dbytes=... dios=...",
+    // one line per device.
+    void parse_io_stat(unsigned long long &rd, unsigned long long &wr) {
+        ProcScanner sc(&buf_[0], len_);
+        if (sc.at_end()) return;
+        do {
+            if (!sc.skip_field()) continue;
+            while (true) {
+                sc.skip_spaces();
+                if (sc.at_end() || *sc.p == '\n') break;
+                unsigned long long v;
+                if (sc.starts_with("rbytes=", 7) && sc.next_u64(v)) rd += v;
+                else if (sc.starts_with("wbytes=", 7) && sc.next_u64(v)) wr += v;
+                else sc.skip_field();
+            }
+        } while (sc.next_line());
+    }
+
+    std::string root_;
+    std::vector<Group> groups_;
+    std::unordered_map<std::string, size_t> index_;
+    std::vector<uint32_t> by_depth_;
+    ProcFile stat_;            // root cgroup.stat
+    std::vector<char> buf_;    // shared by every read
+    size_t len_;
+    unsigned generation_;
+    unsigned since_walk_;
+    unsigned rescan_every_;
+    long long descendants_;
+    std::chrono::steady_clock::time_point last_;
+    bool have_last_;
+};
+
+#endif
@@ -0,0 +1,402 @@
+/************************************************************
+ * RPLEX - metric collectors
+ *
+ * One sampling engine for every frontend. A MetricCollector
+ * opens what it needs in init(), describes its metrics once
+ * and then fills its slice of a preallocated value array on
+ * every sample. A MetricSet lays its collectors out in one
+ * array, so a sample is a pass over them with no allocation.
+ * Both binaries build the same built-in set (CPU, memory,
+ * load) and add collectors loaded from plugins that export
+ * the C interface in rplex_plugin.h.
+ ************************************************************/
+
+#ifndef RPLEX_COLLECTOR_H
+#define RPLEX_COLLECTOR_H
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <dlfcn.h>
+#include <sys/sysinfo.h>
+#include "rplex_cpustat.h"
+#include "rplex_meminfo.h"
+#include "rplex_plugin.h"
+
+struct MetricField {
+    std::string name;
+    std::string unit;
+    std::string help;
+};
+
+inline void add_field(std::vector<MetricField> &out, const char *name, const char *unit, const char *help) {
+    MetricField f;
+    f.name = name;
+    f.unit = unit ? unit : "";
+    f.help = help ? help : "";
+    out.push_back(f);
+}
+
+// Lower case letters, digits and '_', not starting with a digit, so a
+// name works unchanged as a CSV column, a JSON key and in /metrics.
+inline bool valid_metric_name(const std::string &name) {
+    if (name.empty() || (name[0] >= '0' && name[0] <= '9')) return false;
+    for (size_t i = 0; i < name.size(); i++) {
+        char c = name[i];
+        if (!((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '_')) return false;
+    }
+    return true;
+}
+
+// Names starting "self_" are kept for a frontend's own metrics, such as
+// the batch runner's self_cpu_pct, which sit next to the collectors'.
+inline bool reserved_metric_name(const std::string &name) { return name.compare(0, 5, "self_") == 0; }
+
+class MetricCollector {
+public:
+    MetricCollector() {}
+    virtual ~MetricCollector() {}
+
+    virtual const char *name() const = 0;
+
+    // Open files and check the host has what is needed.
+    virtual bool init(std::string &error) = 0;
+
+    // The metrics sample() fills, in order; fixed once init() succeeded.
+    virtual void describe(std::vector<MetricField> &out) const = 0;
+
+    // One value per described metric, NAN where unknown. Called from
+    // one thread at a time; must not allocate once warmed up.
+    virtual void sample(double *values) = 0;
+
+private:
+    MetricCollector(const MetricCollector &);
+    MetricCollector &operator=(const MetricCollector &);
+};
+
+// Busy percentage of the whole machine.
+class CpuCollector : public MetricCollector {
+public:
+    const char *name() const { return "cpu"; }
+
+    bool init(std::string &error) {
+        if (!cpu_.sample()) {
+            error = "cannot read /proc/stat";
+            return false;
+        }
+        return true;
+    }
+
+    void describe(std::vector<MetricField> &out) const {
+        add_field(out, "cpu_pct", "%", "Busy CPU time over the last sample interval.");
+    }
+
+    void sample(double *values) { values[0] = cpu_.sample() ? cpu_.total() : NAN; }
+
+private:
+    CpuSampler cpu_;
+};
+
+// Busy percentage of each CPU by number, as core<N>_pct. The columns
+// are the CPUs present at init(); one that is offline reads NAN. Kept
+// apart from CpuCollector so the per-CPU columns come after the
+// totals, and a selection without them does not pay for them.
+class CoreCollector : public MetricCollector {
+public:
+    CoreCollector() : columns_(0) {}
+
+    const char *name() const { return "cores"; }
+
+    bool init(std::string &error) {
+        if (!cpu_.sample()) {
+            error = "cannot read /proc/stat";
+            return false;
+        }
+        columns_ = cpu_.cpus();
+        return true;
+    }
+
+    void describe(std::vector<MetricField> &out) const {
+        for (size_t i = 0; i < columns_; i++) {
+            char name[32];
+            snprintf(name, sizeof(name), "core%zu_pct", i);
+            add_field(out, name, "%", "Busy time of one logical CPU over the last sample interval.");
+        }
+    }
+
+    void sample(double *values) {
+        bool ok = cpu_.sample();
+        for (size_t i = 0; i < columns_; i++) {
+            values[i] = ok && i < cpu_.cpus() && cpu_.online(i) ? cpu_.usage(i) : NAN;
+        }
+    }
+
+private:
+    CpuSampler cpu_;
+    size_t columns_;
+};
+
+// Used meaning MemTotal minus MemAvailable, as everywhere else.
+class MemoryCollector : public MetricCollector {
+public:
+    const char *name() const { return "memory"; }
+
+    bool init(std::string &error) {
+        MemInfo m;
+        if (!mem_.sample(m)) {
+            error = "cannot read /proc/meminfo";
+            return false;
+        }
+        return true;
+    }
+
+    void describe(std::vector<MetricField> &out) const {
+        add_field(out, "mem_pct", "%", "Memory in use, reclaimable cache excluded.");
+        add_field(out, "mem_used_mb", "MB", "MemTotal minus MemAvailable.");
+        add_field(out, "mem_total_mb", "MB", "MemTotal.");
+    }
+
+    void sample(double *values) {
+        MemInfo m;
+        if (!mem_.sample(m) || m.total == 0) {
+            values[0] = values[1] = values[2] = NAN;
+            return;
+        }
+        values[0] = m.used_percent();
+        values[1] = m.used() / 1024.0;
+        values[2] = m.total / 1024.0;
+    }
+
+private:
+    MemSampler mem_;
+};
+
+// Load average and task count, from one sysinfo(2) call.
+class LoadCollector : public MetricCollector {
+public:
+    const char *name() const { return "load"; }
+
+    bool init(std::string &) { return true; }
+
+    void describe(std::vector<MetricField> &out) const {
+        add_field(out, "load1", "", "One minute load average.");
+        add_field(out, "tasks", "", "Processes and threads.");
+    }
+
+    void sample(double *values) {
+        struct sysinfo si;
+        if (sysinfo(&si) != 0) {
+            values[0] = values[1] = NAN;
+            return;
+        }
+        values[0] = si.loads[0] / 65536.0;
+        values[1] = si.procs;
+    }
+};
+
+// A collector living in a shared object. The library stays loaded until
+// the collector is destroyed.
+class PluginCollector : public MetricCollector {
+public:
+    explicit PluginCollector(const std::string &path)
+        : path_(path), handle_(NULL), plugin_(NULL), state_(NULL), live_(false) {}
+
+    ~PluginCollector() {
+        if (live_ && plugin_->destroy) plugin_->destroy(state_);
+        if (handle_) dlclose(handle_);
+    }
+
+    const char *name() const { return plugin_ && plugin_->name ? plugin_->name : path_.c_str(); }
+
+    bool init(std::string &error) {
+        handle_ = dlopen(path_.c_str(), RTLD_NOW | RTLD_LOCAL);
+        if (!handle_) {
+            error = dlerror();
+            return false;
+        }
+        typedef const rplex_plugin *(*Entry)();
+        Entry entry = (Entry)dlsym(handle_, RPLEX_PLUGIN_ENTRY);
+        if (!entry) {
+            error = "no " RPLEX_PLUGIN_ENTRY "() in " + path_;
+            return false;
+        }
+        plugin_ = entry();
+        if (!plugin_ || plugin_->abi != RPLEX_PLUGIN_ABI) {
+            char buf[96];
+            snprintf(buf, sizeof(buf), "plugin interface %u, expected %u",
+                     plugin_ ? plugin_->abi : 0, (unsigned)RPLEX_PLUGIN_ABI);
+            error = buf;
+            plugin_ = NULL;
+            return false;
+        }
+        if (!plugin_->sample || (plugin_->metric_count && !plugin_->metrics)) {
+            error = "plugin has no sample() or metrics";
+            plugin_ = NULL;
+            return false;
+        }
+        for (size_t i = 0; i < plugin_->metric_count; i++) {
+            const char *n = plugin_->metrics[i].name;
+            if (!n || !valid_metric_name(n)) {
+                error = std::string("bad metric name '") + (n ? n : "") + "'";
+                plugin_ = NULL;
+                return false;
+            }
+        }
+        if (plugin_->init) {
+            char buf[256] = "";
+            state_ = plugin_->init(buf, sizeof(buf));
+            if (!state_ && buf[0]) {
+                error = buf;
+                plugin_ = NULL;
+                return false;
+            }
+        }
+        live_ = true;
+        return true;
+    }
+
+    void describe(std::vector<MetricField> &out) const {
+        for (size_t i = 0; plugin_ && i < plugin_->metric_count; i++) {
+            const rplex_metric &m = plugin_->metrics[i];
+            add_field(out, m.name, m.unit, m.help);
+        }
+    }
+
+    void sample(double *values) {
+        if (plugin_->sample(state_, values) != 0) {
+            for (size_t i = 0; i < plugin_->metric_count; i++) values[i] = NAN;
+        }
+    }
+
+private:
+    std::string path_;
+    void *handle_;
+    const rplex_plugin *plugin_;
+    void *state_;
+    bool live_;   // init() ran, so destroy() is owed
+};
+
+// Collectors laid out in one value array, in the order added. A set can
+// be narrowed to the collectors behind some of its metrics (select()),
+// so asking for one cheap column never pays for the rest.
+class MetricSet {
+public:
+    MetricSet() {}
+
+    ~MetricSet() {
+        for (size_t i = 0; i < collectors_.size(); i++) delete collectors_[i];
+    }
+
+    // Takes ownership; call before init().
+    void add(MetricCollector *collector) { collectors_.push_back(collector); }
+
+    // Initialise every collector, lay out their metrics and check names
+    // are unique and not reserved. The first failure is reported as
+    // "name: reason".
+    bool init(std::string &error) {
+        fields_.clear();
+        offsets_.clear();
+        owner_.clear();
+        for (size_t c = 0; c < collectors_.size(); c++) {
+            std::string why;
+            if (!collectors_[c]->init(why)) {
+                error = std::string(collectors_[c]->name()) + ": " + why;
+                return false;
+            }
+            offsets_.push_back(fields_.size());
+            collectors_[c]->describe(fields_);
+            owner_.resize(fields_.size(), c);
+        }
+        offsets_.push_back(fields_.size());
+        for (size_t i = 0; i < fields_.size(); i++) {
+            if (reserved_metric_name(fields_[i].name)) {
+                error = std::string(collectors_[owner_[i]]->name()) + ": metric " + fields_[i].name +
+                        " is reserved for rplex itself";
+                return false;
+            }
+            for (size_t j = 0; j < i; j++) {
+                if (fields_[i].name == fields_[j].name) {
+                    error = std::string(collectors_[owner_[i]]->name()) + ": metric " + fields_[i].name +
+                            " already comes from " + collectors_[owner_[j]]->name();
+                    return false;
+                }
+            }
+        }
+        values_.assign(fields_.size(), NAN);
+        active_.assign(collectors_.size(), 1);
+        return true;
+    }
+
+    size_t size() const { return fields_.size(); }
+    const std::vector<MetricField> &fields() const { return fields_; }
+    const double *values() const { return values_.empty() ? NULL : &values_[0]; }
+    double value(size_t field) const { return values_[field]; }
+
+    std::vector<std::string> names() const {
+        std::vector<std::string> out;
+        for (size_t i = 0; i < fields_.size(); i++) out.push_back(fields_[i].name);
+        return out;
+    }
+
+    // Sample only the collectors behind these metrics from now on.
+    void select(const std::vector<int> &fields) {
+        std::fill(active_.begin(), active_.end(), 0);
+        for (size_t i = 0; i < fields.size(); i++) {
+            if (fields[i] >= 0 && (size_t)fields[i] < owner_.size()) active_[owner_[fields[i]]] = 1;
+        }
+    }
+
+    void sample() {
+        for (size_t c = 0; c < collectors_.size(); c++) {
+            if (active_[c] && offsets_[c + 1] > offsets_[c]) collectors_[c]->sample(&values_[offsets_[c]]);
+        }
+    }
+
+private:
+    MetricSet(const MetricSet &);
+    MetricSet &operator=(const MetricSet &);
+
+    std::vector<MetricCollector *> collectors_;
+    std::vector<MetricField> fields_;
+    std::vector<size_t> offsets_;        // first field of each collector, then the total
+    std::vector<size_t> owner_;          // collector of each field
+    std::vector<unsigned char> active_;
+    std::vector<double> values_;
+};
+
+// "name value unit" for every metric, on one line for a status bar or
+// footer; unknown values read "-". Truncates to fit cap.
+inline void format_metrics(const std::vector<MetricField> &fields, const std::vector<double> &values,
+                           char *out, size_t cap) {
+    size_t n = 0;
+    if (cap) out[0] = '\0';
+    for (size_t i = 0; i < fields.size() && i < values.size() && n + 1 < cap; i++) {
+        const char *sep = i ? "  " : "";
+        int w;
+        if (std::isnan(values[i])) {
+            w = snprintf(out + n, cap - n, "%s%s -", sep, fields[i].name.c_str());
+        } else {
+            w = snprintf(out + n, cap - n, "%s%s %.4g%s", sep, fields[i].name.c_str(), values[i],
+                         fields[i].unit.c_str());
+        }
+        if (w < 0) break;
+        n = std::min(n + (size_t)w, cap - 1);
+    }
+}
+
+// The collectors every frontend starts with.
+inline void add_builtin_collectors(MetricSet &set) {
+    set.add(new CpuCollector);
+    set.add(new MemoryCollector);
+    set.add(new LoadCollector);
+    set.add(new CoreCollector);
+}
+
+// --plugin PATH, as many as given.
+inline void add_plugins(MetricSet &set, const std::vector<std::string> &paths) {
+    for (size_t i = 0; i < paths.size(); i++) set.add(new PluginCollector(paths[i]));
+}
+
+#endif
@@ -0,0 +1,122 @@
+/************************************************************
+ * RPLEX - CPU usage
+ *
+ * Total and per-CPU busy time from /proc/stat, shared by
+ * both dashboards, batch mode and the flight recorder so
+ * they all agree. Idle and iowait both count as idle. CPUs
+ * are indexed by the number on their line, so one going
+ * offline or coming back never shifts another one's state.
+ ************************************************************/
+
+#ifndef RPLEX_CPUSTAT_H
+#define RPLEX_CPUSTAT_H
+
+#include <vector>
+#include <algorithm>
+#include <stdint.h>
+#include "rplex_procfs.h"
+
+class CpuSampler {
+public:
+    CpuSampler() : file_("/proc/stat"), total_(0), prev_total_(0), prev_idle_(0) {}
+
+    // Re-read /proc/stat. False when it could not be read, leaving the
+    // previous usage in place. Usage needs two samples: the first reads 0.
+    bool sample() {
+        if (!file_.read()) return false;
+        begin_pass();
+        ProcScanner s(file_);
+        CpuTimes t;
+        bool have_total = false;
+        while (s.starts_with("cpu", 3)) {
+            unsigned long long cpu;
+            if (s.looking_at(" ", 1)) {
+                have_total = parse_cpu_times(s, t);
+                if (have_total) total_ = busy(t.total(), t.idle_all(), prev_total_, prev_idle_);
+            } else if (s.next_u64(cpu) && parse_cpu_times(s, t)) {
+                set(cpu, t);
+            }
+            if (!s.next_line()) break;
+        }
+        compute_usage();
+        return have_total;
+    }
+
+    // Busy percent of the whole machine since the previous sample.
+    float total() const { return total_; }
+
+    // Highest CPU number seen so far, plus one; offline CPUs read 0.
+    size_t cpus() const { return usage_.size(); }
+    bool online(size_t cpu) const { return online_[cpu] != 0; }
+    float usage(size_t cpu) const { return usage_[cpu]; }
+    const std::vector<float> &usage() const { return usage_; }
+
+    size_t online_count() const {
+        return (size_t)std::count(online_.begin(), online_.end(), (unsigned char)1);
+    }
+
+private:
+    CpuSampler(const CpuSampler &);
+    CpuSampler &operator=(const CpuSampler &);
+
+    static float busy(unsigned long long total, unsigned long long idle,
+                      unsigned long long &prev_total, unsigned long long &prev_idle) {
+        unsigned long long total_diff = total - prev_total, idle_diff = idle - prev_idle;
+        bool first = prev_total == 0;
+        prev_total = total;
+        prev_idle = idle;
+        if (first || total_diff == 0 || idle_diff > total_diff) return 0.0f;
+        return 100.0f * (total_diff - idle_diff) / total_diff;
+    }
+
+    // Current counters become the previous ones; nothing is online
+    // until this pass says so.
+    void begin_pass() {
+        cur_total_.swap(prev_cpu_total_);
+        cur_idle_.swap(prev_cpu_idle_);
+        online_.swap(was_online_);
+        std::fill(online_.begin(), online_.end(), 0);
+    }
+
+    void set(size_t cpu, const CpuTimes &t) {
+        if (cpu >= cur_total_.size()) {
+            size_t n = cpu + 1;
+            cur_total_.resize(n, 0);
+            cur_idle_.resize(n, 0);
+            prev_cpu_total_.resize(n, 0);
+            prev_cpu_idle_.resize(n, 0);
+            online_.resize(n, 0);
+            was_online_.resize(n, 0);
+            usage_.resize(n, 0);
+        }
+        cur_total_[cpu] = t.total();
+        cur_idle_[cpu] = t.idle_all();
+        online_[cpu] = 1;
+    }
+
+    // A CPU needs two consecutive online samples to have a usage.
+    // Parallel arrays keep this one branch-free loop the compiler can
+    // vectorise across hundreds of CPUs; deltas over one interval fit
+    // in 32 bits. Before that (prev_* still 0) they are whole uptime
+    // totals, so the arithmetic is unsigned, where wrapping is defined,
+    // and `live` discards the result.
+    void compute_usage() {
+        size_t n = cur_total_.size();
+        for (size_t i = 0; i < n; i++) {
+            uint32_t dt = (uint32_t)(cur_total_[i] - prev_cpu_total_[i]);
+            uint32_t di = (uint32_t)(cur_idle_[i] - prev_cpu_idle_[i]);
+            uint32_t live = online_[i] & was_online_[i] & (dt > 0) & (di <= dt);
+            uint32_t denom = dt > 0 ? dt : 1;   // no branch around the division
+            usage_[i] = (float)live * 100.0f * (float)(dt - di) / (float)denom;
+        }
+    }
+
+    ProcFile file_;
+    float total_;
+    unsigned long long prev_total_, prev_idle_;
+    std::vector<unsigned long long> cur_total_, cur_idle_, prev_cpu_total_, prev_cpu_idle_;
+    std::vector<unsigned char> online_, was_online_;
+    std::vector<float> usage_;
+};
+
+#endif
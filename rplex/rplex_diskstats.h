@@ -0,0 +1,231 @@
+/************************************************************
+ * RPLEX - storage
+ *
+ * Per-device throughput, IOPS, queue depth and utilisation
+ * from /proc/diskstats, and filesystem capacity through
+ * statvfs() on every block-device mount. Whole disks only:
+ * partitions would count the same I/O twice.
+ ************************************************************/
+
+#ifndef RPLEX_DISKSTATS_H
+#define RPLEX_DISKSTATS_H
+
+#include <vector>
+#include <chrono>
+#include <cstring>
+#include <cstdio>
+#include <climits>
+#include <unistd.h>
+#include <sys/statvfs.h>
+#include "rplex_procfs.h"
+
+// Cumulative counters of one /proc/diskstats line (see iostats.rst).
+struct DiskCounters {
+    char name[32];
+    unsigned long long reads, sectors_read, writes, sectors_written;
+    unsigned long long in_flight, io_ms, weighted_ms;
+};
+
+struct DiskRates {
+    char name[32];
+    double read_bytes, write_bytes;   // per second
+    double reads, writes;             // completed I/Os per second
+    double queue_depth;               // average requests in flight
+    double utilisation;               // percent of the interval with I/O in flight
+    unsigned long long in_flight;     // right now
+};
+
+struct FsUsage {
+    char mount[PATH_MAX];
+    char device[32];
+    unsigned long long total_bytes, free_bytes, avail_bytes;
+
+    // Share of the space ordinary users can write that is taken.
+    double used_percent() const {
+        unsigned long long used = total_bytes - free_bytes;
+        unsigned long long usable = used + avail_bytes;
+        return usable ? 100.0 * used / usable : 0;
+    }
+};
+
+// Parse /proc/diskstats, keeping only names accepted by `keep`.
+template <typename Keep>
+inline bool parse_diskstats(const ProcFile &f, std::vector<DiskCounters> &out, Keep keep) {
+    size_t n = 0;
+    ProcScanner s(f);
+    if (s.at_end()) return false;
+    do {
+        // major minor name
+        if (!s.skip_fields(2)) continue;
+        s.skip_spaces();
+        const char *name = s.p;
+        if (!s.skip_field()) continue;
+        size_t len = s.p - name;
+        if (n == out.size()) out.resize(n + 1);
+        DiskCounters &d = out[n];
+        if (len >= sizeof(d.name)) len = sizeof(d.name) - 1;
+        memcpy(d.name, name, len);
+        d.name[len] = '\0';
+        if (!keep(d.name)) continue;
+
+        unsigned long long merged, read_ms, write_ms;
+        if (s.next_u64(d.reads) && s.next_u64(merged) && s.next_u64(d.sectors_read) &&
+            s.next_u64(read_ms) && s.next_u64(d.writes) && s.next_u64(merged) &&
+            s.next_u64(d.sectors_written) && s.next_u64(write_ms) && s.next_u64(d.in_flight) &&
+            s.next_u64(d.io_ms) && s.next_u64(d.weighted_ms)) {
+            n++;
+        }
+    } while (s.next_line());
+    out.resize(n);
+    return true;
+}
+
+// Whole block devices have a /sys/block entry; partitions do not.
+// RAM disks and unused loop devices are left out.
+inline bool is_whole_disk(const char *name) {
+    if (strncmp(name, "ram", 3) == 0) return false;
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/block/%s", name);
+    return proc_exists(path);
+}
+
+class DiskSampler {
+public:
+    DiskSampler() : diskstats_("/proc/diskstats"), mounts_("/proc/self/mounts"), have_last_(false) {}
+
+    // Rates since the previous call; the first reports zero rates.
+    void sample(std::vector<DiskRates> &out) {
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        double elapsed = have_last_ ? std::chrono::duration<double>(now - last_).count() : 0;
+        last_ = now;
+
+        if (diskstats_.read()) parse_diskstats(diskstats_, cur_, DeviceFilter(*this));
+        out.clear();
+        for (size_t i = 0; i < cur_.size(); i++) {
+            const DiskCounters &c = cur_[i];
+            // Loop devices that never did any I/O are just noise
+            if (strncmp(c.name, "loop", 4) == 0 && c.reads + c.writes == 0) continue;
+            const DiskCounters *p = previous(c.name, i);
+            out.resize(out.size() + 1);
+            DiskRates &r = out.back();
+            memcpy(r.name, c.name, sizeof(r.name));
+            r.in_flight = c.in_flight;
+            if (!p || elapsed <= 0) {
+                r.read_bytes = r.write_bytes = r.reads = r.writes = 0;
+                r.queue_depth = r.utilisation = 0;
+                continue;
+            }
+            r.read_bytes = delta(c.sectors_read, p->sectors_read) * 512.0 / elapsed;
+            r.write_bytes = delta(c.sectors_written, p->sectors_written) * 512.0 / elapsed;
+            r.reads = delta(c.reads, p->reads) / elapsed;
+            r.writes = delta(c.writes, p->writes) / elapsed;
+            r.queue_depth = delta(c.weighted_ms, p->weighted_ms) / (elapsed * 1000);
+            r.utilisation = delta(c.io_ms, p->io_ms) / (elapsed * 10);
+            if (r.utilisation > 100) r.utilisation = 100;
+        }
+        prev_.swap(cur_);
+        have_last_ = true;
+    }
+
+    // Capacity of every mounted block device, once per device.
+    void filesystems(std::vector<FsUsage> &out) {
+        out.clear();
+        if (!mounts_.read()) return;
+        ProcScanner s(mounts_);
+        do {
+            if (!s.looking_at("/dev/", 5)) continue;
+            FsUsage fs;
+            const char *dev = s.p;
+            s.skip_field();
+            copy_field(fs.device, sizeof(fs.device), dev + 5, s.p);
+            s.skip_spaces();
+            const char *mount = s.p;
+            s.skip_field();
+            // statvfs() on a cut-off path would fail or find a parent
+            // filesystem, so a path that does not fit is left out
+            if ((size_t)(s.p - mount) >= sizeof(fs.mount)) continue;
+            copy_field(fs.mount, sizeof(fs.mount), mount, s.p);
+            unescape(fs.mount);
+
+            bool seen = false;
+            for (size_t i = 0; i < out.size() && !seen; i++) seen = strcmp(out[i].device, fs.device) == 0;
+            struct statvfs st;
+            if (seen || statvfs(fs.mount, &st) != 0 || st.f_blocks == 0) continue;
+            fs.total_bytes = (unsigned long long)st.f_blocks * st.f_frsize;
+            fs.free_bytes = (unsigned long long)st.f_bfree * st.f_frsize;
+            fs.avail_bytes = (unsigned long long)st.f_bavail * st.f_frsize;
+            out.push_back(fs);
+        } while (s.next_line());
+    }
+
+private:
+    DiskSampler(const DiskSampler &);
+    DiskSampler &operator=(const DiskSampler &);
+
+    // Whether a name is a whole disk, cached so /sys is only asked once
+    // per device name.
+    struct DeviceFilter {
+        DiskSampler &d;
+        explicit DeviceFilter(DiskSampler &sampler) : d(sampler) {}
+        bool operator()(const char *name) const {
+            for (size_t i = 0; i < d.known_.size(); i++) {
+                if (strcmp(d.known_[i].name, name) == 0) return d.known_[i].whole;
+            }
+            Known k;
+            strncpy(k.name, name, sizeof(k.name) - 1);
+            k.name[sizeof(k.name) - 1] = '\0';
+            k.whole = is_whole_disk(name);
+            d.known_.push_back(k);
+            return k.whole;
+        }
+    };
+
+    struct Known {
+        char name[32];
+        bool whole;
+    };
+
+    static unsigned long long delta(unsigned long long now, unsigned long long before) {
+        return now >= before ? now - before : 0;
+    }
+
+    static void copy_field(char *out, size_t cap, const char *begin, const char *end) {
+        size_t n = end > begin ? end - begin : 0;
+        if (n >= cap) n = cap - 1;
+        memcpy(out, begin, n);
+        out[n] = '\0';
+    }
+
+    // Mount points escape space, tab, newline and backslash as \ooo.
+    static void unescape(char *s) {
+        char *w = s;
+        for (char *r = s; *r; r++) {
+            if (r[0] == '\\' && r[1] >= '0' && r[1] <= '7' && r[2] >= '0' && r[2] <= '7' &&
+                r[3] >= '0' && r[3] <= '7') {
+                *w++ = (char)((r[1] - '0') * 64 + (r[2] - '0') * 8 + (r[3] - '0'));
+                r += 3;
+            } else {
+                *w++ = *r;
+            }
+        }
+        *w = '\0';
+    }
+
+    const DiskCounters *previous(const char *name, size_t hint) const {
+        if (!have_last_) return NULL;
+        if (hint < prev_.size() && strcmp(prev_[hint].name, name) == 0) return &prev_[hint];
+        for (size_t i = 0; i < prev_.size(); i++) {
+            if (strcmp(prev_[i].name, name) == 0) return &prev_[i];
+        }
+        return NULL;
+    }
+
+    ProcFile diskstats_;
+    ProcFile mounts_;
+    std::vector<DiskCounters> cur_, prev_;
+    std::vector<Known> known_;
+    std::chrono::steady_clock::time_point last_;
+    bool have_last_;
+};
+
+#endif
@@ -0,0 +1,213 @@
+/************************************************************
+ * RPLEX - event loop
+ *
+ * One epoll set per thread that multiplexes readable fds
+ * (the terminal), signals through signalfd (SIGWINCH),
+ * eventfd wakeups posted from other threads and timerfd
+ * timers. Timers run on absolute CLOCK_MONOTONIC deadlines
+ * kept by the kernel, so a slow handler never drifts the
+ * schedule; expirations missed while busy coalesce into one
+ * call instead of a burst.
+ ************************************************************/
+
+#ifndef RPLEX_EVENTLOOP_H
+#define RPLEX_EVENTLOOP_H
+
+#include <vector>
+#include <functional>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <signal.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+
+// Block a signal in the calling thread and every thread it starts later,
+// so that it is only ever seen through a signalfd. Call before any
+// thread is created.
+inline void block_signal(int signo) {
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, signo);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+}
+
+// An eventfd any thread can poke to wake an EventLoop. Notifications
+// that arrive before the loop gets round to it coalesce into one.
+class Wakeup {
+public:
+    Wakeup() : fd_(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) {}
+    ~Wakeup() {
+        if (fd_ >= 0) ::close(fd_);
+    }
+
+    void notify() {
+        uint64_t one = 1;
+        ssize_t n = ::write(fd_, &one, sizeof(one));
+        (void)n;   // EAGAIN only when the counter is saturated: still readable
+    }
+
+    int fd() const { return fd_; }
+
+private:
+    Wakeup(const Wakeup &);
+    Wakeup &operator=(const Wakeup &);
+
+    int fd_;
+};
+
+class EventLoop {
+public:
+    typedef std::function<void()> Handler;
+
+    EventLoop() : epoll_(epoll_create1(EPOLL_CLOEXEC)), running_(false) {}
+
+    ~EventLoop() {
+        for (size_t i = 0; i < sources_.size(); i++) {
+            if (sources_[i].owned) ::close(sources_[i].fd);
+        }
+        if (epoll_ >= 0) ::close(epoll_);
+    }
+
+    bool ok() const { return epoll_ >= 0; }
+
+    // Sources are registered before run(); handlers must not add more.
+
+    // Call handler whenever fd is readable. The loop does not own fd.
+    bool watch(int fd, Handler handler) { return add(fd, FD, false, handler) >= 0; }
+
+    // The signal must already be blocked everywhere (block_signal()).
+    bool watch_signal(int signo, Handler handler) {
+        sigset_t set;
+        sigemptyset(&set);
+        sigaddset(&set, signo);
+        int fd = signalfd(-1, &set, SFD_NONBLOCK | SFD_CLOEXEC);
+        if (fd < 0) return false;
+        if (add(fd, SIGNAL, true, handler) < 0) {
+            ::close(fd);
+            return false;
+        }
+        return true;
+    }
+
+    bool watch_wakeup(Wakeup &wakeup, Handler handler) {
+        return wakeup.fd() >= 0 && add(wakeup.fd(), WAKEUP, false, handler) >= 0;
+    }
+
+    // A periodic timer, first due one period from now. period_ms <= 0
+    // leaves it disarmed. Returns an id for set_period(), or -1.
+    int add_timer(long period_ms, Handler handler) {
+        int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (fd < 0) return -1;
+        int id = add(fd, TIMER, true, handler);
+        if (id < 0) {
+            ::close(fd);
+            return -1;
+        }
+        set_period(id, period_ms);
+        return id;
+    }
+
+    // Re-arm a timer; the new schedule starts one period from now.
+    void set_period(int id, long period_ms) {
+        Source &s = sources_[id];
+        s.period_ms = period_ms > 0 ? period_ms : 0;
+        struct itimerspec spec;
+        memset(&spec, 0, sizeof(spec));
+        if (s.period_ms) {
+            spec.it_interval.tv_sec = s.period_ms / 1000;
+            spec.it_interval.tv_nsec = (s.period_ms % 1000) * 1000000L;
+            clock_gettime(CLOCK_MONOTONIC, &spec.it_value);
+            spec.it_value.tv_sec += spec.it_interval.tv_sec;
+            spec.it_value.tv_nsec += spec.it_interval.tv_nsec;
+            if (spec.it_value.tv_nsec >= 1000000000L) {
+                spec.it_value.tv_sec++;
+                spec.it_value.tv_nsec -= 1000000000L;
+            }
+        }
+        timerfd_settime(s.fd, TFD_TIMER_ABSTIME, &spec, NULL);
+    }
+
+    long period(int id) const { return sources_[id].period_ms; }
+
+    // Wait up to timeout_ms (-1: until something happens) and run the
+    // handlers of everything that became ready. False on a real error.
+    bool run_once(int timeout_ms = -1) {
+        struct epoll_event events[16];
+        int n = epoll_wait(epoll_, events, 16, timeout_ms);
+        if (n < 0) return errno == EINTR;
+        for (int i = 0; i < n; i++) {
+            Source &s = sources_[events[i].data.u32];
+            consume(s);
+            s.handler();
+        }
+        return true;
+    }
+
+    void run() {
+        running_ = true;
+        while (running_ && run_once()) {}
+    }
+
+    // From a handler on this loop's thread; other threads go through a
+    // Wakeup whose handler calls stop().
+    void stop() { running_ = false; }
+
+private:
+    EventLoop(const EventLoop &);
+    EventLoop &operator=(const EventLoop &);
+
+    enum Kind { FD, SIGNAL, WAKEUP, TIMER };
+
+    struct Source {
+        int fd;
+        Kind kind;
+        bool owned;
+        long period_ms;
+        Handler handler;
+    };
+
+    int add(int fd, Kind kind, bool owned, Handler handler) {
+        if (epoll_ < 0) return -1;
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.u32 = (uint32_t)sources_.size();
+        if (epoll_ctl(epoll_, EPOLL_CTL_ADD, fd, &ev) != 0) return -1;
+        Source s = {fd, kind, owned, 0, handler};
+        sources_.push_back(s);
+        return (int)sources_.size() - 1;
+    }
+
+    // Clear the readiness of everything but plain fds, whose handler
+    // does its own reading.
+    static void consume(const Source &s) {
+        switch (s.kind) {
+        case SIGNAL: {
+            struct signalfd_siginfo info;
+            while (::read(s.fd, &info, sizeof(info)) == (ssize_t)sizeof(info)) {}
+            break;
+        }
+        case WAKEUP:
+        case TIMER: {
+            uint64_t count;
+            ssize_t n = ::read(s.fd, &count, sizeof(count));
+            (void)n;
+            break;
+        }
+        default:
+            break;
+        }
+    }
+
+    int epoll_;
+    std::vector<Source> sources_;
+    bool running_;
+};
+
+#endif
@@ -0,0 +1,296 @@
+/************************************************************
+ * RPLEX - Prometheus endpoint
+ *
+ * A small HTTP listener on its own thread that answers
+ * GET /metrics with the text exposition of the latest
+ * sample. The sampler renders the full response once per
+ * pass; a scrape only sends that shared buffer, so it never
+ * touches /proc and concurrent scrapers cost almost nothing.
+ ************************************************************/
+
+#ifndef RPLEX_EXPORTER_H
+#define RPLEX_EXPORTER_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+
+// Appends metrics in the Prometheus text format (version 0.0.4).
+class PromWriter {
+public:
+    explicit PromWriter(std::string &out) : out_(out) {}
+
+    void family(const char *name, const char *type, const char *help) {
+        out_ += "# HELP ";
+        out_ += name;
+        out_ += ' ';
+        out_ += help;
+        out_ += "\n# TYPE ";
+        out_ += name;
+        out_ += ' ';
+        out_ += type;
+        out_ += '\n';
+    }
+
+    void sample(const char *name, double value) { sample(name, NULL, value); }
+
+    // labels is a ready-made `key="value",...` list, see label().
+    void sample(const char *name, const char *labels, double value) {
+        out_ += name;
+        if (labels && *labels) {
+            out_ += '{';
+            out_ += labels;
+            out_ += '}';
+        }
+        char num[32];
+        if (std::isnan(value)) snprintf(num, sizeof(num), " NaN\n");
+        else snprintf(num, sizeof(num), " %.10g\n", value);
+        out_ += num;
+    }
+
+    // Append key="value" to a label list, escaping as the format requires.
+    static void label(std::string &labels, const char *key, const char *value) {
+        if (!labels.empty()) labels += ',';
+        labels += key;
+        labels += "=\"";
+        for (const char *p = value; *p; p++) {
+            if (*p == '\\') labels += "\\\\";
+            else if (*p == '"') labels += "\\\"";
+            else if (*p == '\n') labels += "\\n";
+            else labels += *p;
+        }
+        labels += '"';
+    }
+
+private:
+    std::string &out_;
+};
+
+class MetricsServer {
+public:
+    MetricsServer() : listen_fd_(-1), running_(false), scrapes_(0) {
+        wake_[0] = wake_[1] = -1;
+        set_body("");
+    }
+
+    ~MetricsServer() {
+        stop();
+        if (listen_fd_ >= 0) ::close(listen_fd_);
+    }
+
+    // Bind to "host:port", ":port" (all interfaces) or "[v6addr]:port".
+    bool open(const std::string &address, std::string &error) {
+        size_t colon = address.rfind(':');
+        if (colon == std::string::npos) {
+            error = "expected host:port";
+            return false;
+        }
+        std::string host = address.substr(0, colon);
+        std::string port = address.substr(colon + 1);
+        if (host.size() >= 2 && host[0] == '[' && host[host.size() - 1] == ']') {
+            host = host.substr(1, host.size() - 2);
+        }
+
+        struct addrinfo hints, *res;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = AI_PASSIVE | AI_NUMERICSERV;
+        int rc = getaddrinfo(host.empty() ? NULL : host.c_str(), port.c_str(), &hints, &res);
+        if (rc != 0) {
+            error = gai_strerror(rc);
+            return false;
+        }
+        for (struct addrinfo *ai = res; ai; ai = ai->ai_next) {
+            int fd = socket(ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, ai->ai_protocol);
+            if (fd < 0) continue;
+            int one = 1;
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+            if (bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 && listen(fd, 16) == 0) {
+                listen_fd_ = fd;
+                break;
+            }
+            error = strerror(errno);
+            ::close(fd);
+        }
+        freeaddrinfo(res);
+        return listen_fd_ >= 0;
+    }
+
+    void start() {
+        if (listen_fd_ < 0 || running_) return;
+        if (pipe2(wake_, O_NONBLOCK | O_CLOEXEC) != 0) return;
+        running_ = true;
+        thread_ = std::thread(&MetricsServer::run, this);
+    }
+
+    void stop() {
+        if (!running_) return;
+        running_ = false;
+        ssize_t ignored = write(wake_[1], "x", 1);
+        (void)ignored;
+        thread_.join();
+        ::close(wake_[0]);
+        ::close(wake_[1]);
+        wake_[0] = wake_[1] = -1;
+    }
+
+    // Sampler side: replace what scrapes are answered with. Responses
+    // already being sent keep the buffer they started with.
+    void set_body(const std::string &body) {
+        std::string *response = new std::string();
+        char head[160];
+        snprintf(head, sizeof(head),
+                 "HTTP/1.1 200 OK\r\n"
+                 "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+                 "Content-Length: %zu\r\n"
+                 "Connection: close\r\n\r\n", body.size());
+        response->reserve(strlen(head) + body.size());
+        *response += head;
+        *response += body;
+        std::shared_ptr<const std::string> ready(response);
+        std::lock_guard<std::mutex> lock(mutex_);
+        metrics_.swap(ready);
+    }
+
+    unsigned long scrapes() const { return scrapes_.load(); }
+
+private:
+    MetricsServer(const MetricsServer &);
+    MetricsServer &operator=(const MetricsServer &);
+
+    enum { MAX_CLIENTS = 64, MAX_REQUEST = 8192, CLIENT_TIMEOUT_MS = 5000 };
+
+    struct Client {
+        int fd;
+        std::string request;
+        std::shared_ptr<const std::string> response;
+        size_t sent;
+        std::chrono::steady_clock::time_point deadline;
+    };
+
+    std::shared_ptr<const std::string> latest() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return metrics_;
+    }
+
+    static std::shared_ptr<const std::string> plain(const char *status, const char *text) {
+        char buf[256];
+        snprintf(buf, sizeof(buf),
+                 "HTTP/1.1 %s\r\nContent-Type: text/plain\r\nContent-Length: %zu\r\n"
+                 "Connection: close\r\n\r\n%s", status, strlen(text), text);
+        return std::shared_ptr<const std::string>(new std::string(buf));
+    }
+
+    // Once the request head is complete, pick the response for it.
+    void route(Client &c) {
+        size_t sp = c.request.find(' ');
+        size_t end = sp == std::string::npos ? sp : c.request.find_first_of(" ?", sp + 1);
+        std::string method = c.request.substr(0, sp);
+        std::string path = sp == std::string::npos ? "" : c.request.substr(sp + 1, end - sp - 1);
+        if (method != "GET") {
+            c.response = plain("405 Method Not Allowed", "only GET is supported\n");
+        } else if (path == "/metrics") {
+            c.response = latest();
+            scrapes_++;
+        } else if (path == "/") {
+            c.response = plain("200 OK", "rplex exporter, metrics at /metrics\n");
+        } else {
+            c.response = plain("404 Not Found", "not found\n");
+        }
+        c.sent = 0;
+    }
+
+    // Read or write what the socket allows; false when the client is done.
+    bool service(Client &c, short revents) {
+        if (!c.response) {
+            char buf[2048];
+            ssize_t n = recv(c.fd, buf, sizeof(buf), 0);
+            if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) return false;
+            if (n > 0) c.request.append(buf, n);
+            if (c.request.find("\r\n\r\n") != std::string::npos ||
+                c.request.find("\n\n") != std::string::npos) {
+                route(c);
+            } else if (c.request.size() > MAX_REQUEST) {
+                return false;
+            }
+            if (!c.response) return true;
+        } else if (!(revents & POLLOUT)) {
+            return true;
+        }
+        while (c.sent < c.response->size()) {
+            ssize_t n = send(c.fd, c.response->data() + c.sent, c.response->size() - c.sent, MSG_NOSIGNAL);
+            if (n < 0) return errno == EAGAIN || errno == EINTR;
+            c.sent += n;
+        }
+        return false;
+    }
+
+    void run() {
+        std::vector<Client> clients;
+        std::vector<struct pollfd> fds;
+        while (running_) {
+            fds.clear();
+            struct pollfd p;
+            p.fd = wake_[0];
+            p.events = POLLIN;
+            fds.push_back(p);
+            p.fd = listen_fd_;
+            p.events = clients.size() < MAX_CLIENTS ? POLLIN : 0;
+            fds.push_back(p);
+            for (size_t i = 0; i < clients.size(); i++) {
+                p.fd = clients[i].fd;
+                p.events = clients[i].response ? POLLOUT : POLLIN;
+                fds.push_back(p);
+            }
+            if (poll(&fds[0], fds.size(), 1000) < 0 && errno != EINTR) break;
+
+            std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+            for (size_t i = clients.size(); i-- > 0;) {
+                short revents = fds[i + 2].revents;
+                bool keep = now < clients[i].deadline;
+                if (keep && revents) keep = !(revents & (POLLERR | POLLNVAL)) && service(clients[i], revents);
+                if (!keep) {
+                    ::close(clients[i].fd);
+                    clients[i] = clients.back();
+                    clients.pop_back();
+                }
+            }
+            if (fds[1].revents & POLLIN) {
+                int fd;
+                while (clients.size() < MAX_CLIENTS &&
+                       (fd = accept4(listen_fd_, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+                    Client c;
+                    c.fd = fd;
+                    c.sent = 0;
+                    c.deadline = now + std::chrono::milliseconds(CLIENT_TIMEOUT_MS);
+                    clients.push_back(c);
+                }
+            }
+        }
+        for (size_t i = 0; i < clients.size(); i++) ::close(clients[i].fd);
+    }
+
+    int listen_fd_;
+    int wake_[2];
+    std::atomic<bool> running_;
+    std::atomic<unsigned long> scrapes_;
+    std::thread thread_;
+    std::mutex mutex_;
+    std::shared_ptr<const std::string> metrics_;
+};
+
+#endif
@@ -0,0 +1,659 @@
+/************************************************************
+ * RPLEX - fleet agent and viewer
+ *
+ * An agent streams its samples to viewers over TCP or a Unix
+ * socket as the same delta-encoded payloads a recording
+ * holds: a keyframe when a viewer connects or has fallen
+ * behind, then only the process rows that changed. A viewer
+ * keeps non-blocking connections to hundreds of agents on
+ * one epoll thread, rebuilds every host's latest sample and
+ * keeps short CPU and memory histories for an overview.
+ ************************************************************/
+
+#ifndef RPLEX_FLEET_H
+#define RPLEX_FLEET_H
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <cmath>
+#include <stdint.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "rplex_recording.h"
+#include "rplex_series.h"
+#include "rplex_eventloop.h"
+
+// Stream layout: messages of
+//   uint32 size, uint8 type, 3 pad, int64 time_us, size bytes of payload
+// in host byte order. 'H' comes first on every connection: the magic,
+// then hostname and CPU model, each a uint8 length and the bytes.
+// 'K' keyframes and 'D' deltas carry a recording::FrameEncoder payload.
+namespace fleet {
+
+const char MAGIC[8] = {'R', 'P', 'L', 'X', 'N', 'E', 'T', '1'};
+const uint32_t MAX_MESSAGE = 64 << 20;   // anything larger is a broken stream
+
+struct MessageHeader {
+    uint32_t size;
+    uint8_t type;
+    uint8_t pad[3];
+    int64_t time_us;
+};
+
+struct Address {
+    struct sockaddr_storage addr;
+    socklen_t len;
+    int family;
+};
+
+// "unix:/path", "host:port", ":port" (listen on every interface) or
+// "[v6addr]:port". Host names are looked up, so prefer numeric ones
+// when there are hundreds.
+inline bool resolve(const std::string &address, bool passive, Address &out, std::string &error) {
+    memset(&out, 0, sizeof(out));
+    if (address.compare(0, 5, "unix:") == 0) {
+        std::string path = address.substr(5);
+        struct sockaddr_un *un = (struct sockaddr_un *)&out.addr;
+        if (path.empty() || path.size() >= sizeof(un->sun_path)) {
+            error = "bad socket path";
+            return false;
+        }
+        un->sun_family = AF_UNIX;
+        memcpy(un->sun_path, path.c_str(), path.size() + 1);
+        out.len = sizeof(*un);
+        out.family = AF_UNIX;
+        return true;
+    }
+    size_t colon = address.rfind(':');
+    if (colon == std::string::npos) {
+        error = "expected host:port or unix:path";
+        return false;
+    }
+    std::string host = address.substr(0, colon);
+    std::string port = address.substr(colon + 1);
+    if (host.size() >= 2 && host[0] == '[' && host[host.size() - 1] == ']') {
+        host = host.substr(1, host.size() - 2);
+    }
+
+    struct addrinfo hints, *res;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = (passive ? AI_PASSIVE : 0) | AI_NUMERICSERV;
+    int rc = getaddrinfo(host.empty() ? NULL : host.c_str(), port.c_str(), &hints, &res);
+    if (rc != 0) {
+        error = gai_strerror(rc);
+        return false;
+    }
+    memcpy(&out.addr, res->ai_addr, res->ai_addrlen);
+    out.len = res->ai_addrlen;
+    out.family = res->ai_family;
+    freeaddrinfo(res);
+    return true;
+}
+
+inline void append_message(std::vector<char> &out, uint8_t type, int64_t time_us, const std::vector<char> &payload) {
+    MessageHeader h;
+    memset(&h, 0, sizeof(h));
+    h.size = (uint32_t)payload.size();
+    h.type = type;
+    h.time_us = time_us;
+    out.insert(out.end(), (const char *)&h, (const char *)(&h + 1));
+    out.insert(out.end(), payload.begin(), payload.end());
+}
+
+inline void put_string(std::vector<char> &buf, const std::string &s) {
+    size_t len = std::min(s.size(), (size_t)255);
+    recording::put(buf, (uint8_t)len);
+    buf.insert(buf.end(), s.begin(), s.begin() + len);
+}
+
+inline std::string get_string(recording::Cursor &c) {
+    char buf[256];
+    uint8_t len = c.get<uint8_t>();
+    c.bytes(buf, len);
+    return c.ok ? std::string(buf, len) : std::string();
+}
+
+}  // namespace fleet
+
+// Serves this host's samples. publish() runs on the sampler thread;
+// viewers are accepted and written to on the agent's own thread.
+class FleetAgent {
+public:
+    FleetAgent() : listen_fd_(-1), running_(false) {}
+
+    ~FleetAgent() {
+        stop();
+        if (listen_fd_ >= 0) ::close(listen_fd_);
+        if (!unix_path_.empty()) unlink(unix_path_.c_str());
+    }
+
+    bool open(const std::string &address, std::string &error) {
+        fleet::Address a;
+        if (!fleet::resolve(address, true, a, error)) return false;
+        int fd = socket(a.family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            error = strerror(errno);
+            return false;
+        }
+        const char *path = a.family == AF_UNIX ? ((struct sockaddr_un *)&a.addr)->sun_path : NULL;
+        if (path) {
+            unlink(path);   // left behind by an agent that was killed
+        } else {
+            int one = 1;
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        }
+        if (bind(fd, (struct sockaddr *)&a.addr, a.len) != 0 || listen(fd, 64) != 0) {
+            error = strerror(errno);
+            ::close(fd);
+            return false;
+        }
+        listen_fd_ = fd;
+        if (path) unix_path_ = path;
+        return true;
+    }
+
+    void start(const std::string &hostname, const std::string &cpu_model) {
+        if (listen_fd_ < 0 || running_) return;
+        std::vector<char> payload(fleet::MAGIC, fleet::MAGIC + sizeof(fleet::MAGIC));
+        fleet::put_string(payload, hostname);
+        fleet::put_string(payload, cpu_model);
+        hello_.clear();
+        fleet::append_message(hello_, 'H', 0, payload);
+        running_ = true;
+        thread_ = std::thread(&FleetAgent::run, this);
+    }
+
+    void stop() {
+        if (!running_) return;
+        running_ = false;
+        wake_.notify();
+        thread_.join();
+        for (size_t i = 0; i < clients_.size(); i++) ::close(clients_[i].fd);
+        clients_.clear();
+    }
+
+    // Queue one sample for every viewer. The payloads are encoded at
+    // most once each: the delta against the previous sample, and a
+    // keyframe only when some viewer needs one.
+    void publish(const RecordedFrame &frame) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        encoder_.begin(frame);
+        bool have_key = false, have_delta = false;
+        for (size_t i = 0; i < clients_.size(); i++) {
+            Client &c = clients_[i];
+            // A viewer that cannot keep up skips samples and starts
+            // again from a keyframe once its backlog has drained
+            if (c.out.size() - c.sent > MAX_BACKLOG) {
+                c.need_key = true;
+                continue;
+            }
+            std::vector<char> &payload = c.need_key ? key_ : delta_;
+            bool &have = c.need_key ? have_key : have_delta;
+            if (!have) {
+                payload.clear();
+                encoder_.encode(c.need_key, payload);
+                have = true;
+            }
+            fleet::append_message(c.out, c.need_key ? 'K' : 'D', frame.time_us, payload);
+            c.need_key = false;
+        }
+        encoder_.commit();
+        wake_.notify();
+    }
+
+    size_t viewers() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return clients_.size();
+    }
+
+private:
+    FleetAgent(const FleetAgent &);
+    FleetAgent &operator=(const FleetAgent &);
+
+    enum { MAX_CLIENTS = 64, MAX_BACKLOG = 4 << 20 };
+
+    struct Client {
+        int fd;
+        std::vector<char> out;   // messages not yet sent, from out[sent]
+        size_t sent;
+        bool need_key;
+    };
+
+    // Send what the socket takes; false once the viewer is gone.
+    static bool flush(Client &c) {
+        while (c.sent < c.out.size()) {
+            ssize_t n = send(c.fd, &c.out[c.sent], c.out.size() - c.sent, MSG_NOSIGNAL);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                if (errno != EAGAIN) return false;
+                break;
+            }
+            c.sent += n;
+        }
+        if (c.sent == c.out.size()) {
+            c.out.clear();
+            c.sent = 0;
+        } else if (c.sent > c.out.size() / 2) {
+            c.out.erase(c.out.begin(), c.out.begin() + c.sent);
+            c.sent = 0;
+        }
+        return true;
+    }
+
+    // Viewers never send anything; reading only tells whether they left.
+    static bool drain(Client &c) {
+        char buf[512];
+        for (;;) {
+            ssize_t n = recv(c.fd, buf, sizeof(buf), 0);
+            if (n > 0) continue;
+            return n < 0 && (errno == EAGAIN || errno == EINTR);
+        }
+    }
+
+    void run() {
+        std::vector<struct pollfd> fds;
+        while (running_) {
+            fds.clear();
+            struct pollfd p;
+            p.fd = wake_.fd();
+            p.events = POLLIN;
+            fds.push_back(p);
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                p.fd = listen_fd_;
+                p.events = clients_.size() < MAX_CLIENTS ? POLLIN : 0;
+                fds.push_back(p);
+                for (size_t i = 0; i < clients_.size(); i++) {
+                    p.fd = clients_[i].fd;
+                    p.events = POLLIN | (clients_[i].sent < clients_[i].out.size() ? POLLOUT : 0);
+                    fds.push_back(p);
+                }
+            }
+            if (poll(&fds[0], fds.size(), -1) < 0 && errno != EINTR) break;
+            if (fds[0].revents & POLLIN) {
+                uint64_t count;
+                ssize_t n = ::read(wake_.fd(), &count, sizeof(count));
+                (void)n;
+            }
+
+            // Only this thread adds or removes clients, so they still
+            // line up with fds; publish() may have queued more output.
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (size_t i = clients_.size(); i-- > 0;) {
+                Client &c = clients_[i];
+                short revents = i + 2 < fds.size() ? fds[i + 2].revents : 0;
+                bool keep = !(revents & (POLLERR | POLLNVAL));
+                if (keep && (revents & (POLLIN | POLLHUP))) keep = drain(c);
+                if (keep) keep = flush(c);
+                if (!keep) {
+                    ::close(c.fd);
+                    clients_[i] = clients_.back();
+                    clients_.pop_back();
+                }
+            }
+            if (fds[1].revents & POLLIN) {
+                int fd;
+                while (clients_.size() < MAX_CLIENTS &&
+                       (fd = accept4(listen_fd_, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+                    Client c;
+                    c.fd = fd;
+                    c.out = hello_;
+                    c.sent = 0;
+                    c.need_key = true;
+                    clients_.push_back(c);
+                    flush(clients_.back());
+                }
+            }
+        }
+    }
+
+    int listen_fd_;
+    std::string unix_path_;
+    std::atomic<bool> running_;
+    std::thread thread_;
+    Wakeup wake_;
+    std::mutex mutex_;                 // clients_ and the encoder
+    std::vector<Client> clients_;
+    std::vector<char> hello_;
+    recording::FrameEncoder encoder_;
+    std::vector<char> key_, delta_;
+};
+
+// What the fleet overview shows of one agent.
+struct FleetHostView {
+    std::string address;          // as given to the viewer
+    std::string hostname;         // from the agent's hello, empty before it
+    const char *state;            // "connecting", "up", "stale" or "down"
+    std::string error;            // why it is down
+    float cpu_usage;
+    float mem_total;              // GB
+    float mem_percent;
+    size_t processes;
+    RingBuffer<float> cpu_history;   // one point per sample
+    RingBuffer<float> mem_history;
+    int64_t time_us;              // of the newest sample
+    float sample_seconds;         // between the last two samples
+    unsigned long frames;         // samples received
+    unsigned long long bytes;     // received, headers included
+
+    FleetHostView() : state("connecting"), cpu_usage(0), mem_total(0), mem_percent(0), processes(0),
+                      cpu_history(HISTORY), mem_history(HISTORY), time_us(0), sample_seconds(1),
+                      frames(0), bytes(0) {}
+
+    enum { HISTORY = 120 };
+};
+
+// Follows any number of agents from one thread. Lost connections are
+// retried every few seconds; the last values stay until new ones come.
+class FleetViewer {
+public:
+    FleetViewer() : epoll_(-1), running_(false) {}
+    ~FleetViewer() { stop(); }
+
+    // Add every agent before start().
+    void add(const std::string &address) {
+        hosts_.push_back(Host());
+        hosts_.back().view.address = address;
+    }
+
+    size_t size() const { return hosts_.size(); }
+
+    // changed runs on the viewer thread, at most every NOTIFY_MS.
+    bool start(std::function<void()> changed) {
+        if (running_) return true;
+        epoll_ = epoll_create1(EPOLL_CLOEXEC);
+        if (epoll_ < 0) return false;
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.u32 = WAKE_ID;
+        epoll_ctl(epoll_, EPOLL_CTL_ADD, wake_.fd(), &ev);
+        changed_ = changed;
+        running_ = true;
+        thread_ = std::thread(&FleetViewer::run, this);
+        return true;
+    }
+
+    void stop() {
+        if (!running_) return;
+        running_ = false;
+        wake_.notify();
+        thread_.join();
+        for (size_t i = 0; i < hosts_.size(); i++) {
+            if (hosts_[i].fd >= 0) ::close(hosts_[i].fd);
+            hosts_[i].fd = -1;
+        }
+        ::close(epoll_);
+        epoll_ = -1;
+    }
+
+    // Every host, in the order they were added.
+    void overview(std::vector<FleetHostView> &out) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        out.resize(hosts_.size());
+        for (size_t i = 0; i < hosts_.size(); i++) out[i] = hosts_[i].view;
+    }
+
+    // The latest sample of one host with its whole process table;
+    // false until one has arrived.
+    bool sample(size_t i, RecordedFrame &out, std::string &cpu_model) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (i >= hosts_.size() || hosts_[i].view.frames == 0) return false;
+        out = hosts_[i].frame;
+        cpu_model = hosts_[i].cpu_model;
+        return true;
+    }
+
+private:
+    FleetViewer(const FleetViewer &);
+    FleetViewer &operator=(const FleetViewer &);
+
+    enum { RETRY_MS = 3000, STALE_MS = 5000, NOTIFY_MS = 200, READ_CHUNK = 1 << 16,
+           MAX_READ = 1 << 20 };
+    static const uint32_t WAKE_ID = 0xffffffffu;
+
+    enum LinkState { IDLE, CONNECTING, UP };
+
+    struct Host {
+        FleetHostView view;       // guarded by mutex_, like frame and cpu_model
+        RecordedFrame frame;
+        std::string cpu_model;
+        int fd;
+        LinkState link;
+        bool synced;              // a keyframe arrived on this connection
+        std::vector<char> in;     // received, not yet parsed
+        std::chrono::steady_clock::time_point retry_at, last_frame;
+
+        Host() : fd(-1), link(IDLE), synced(false) {}
+    };
+
+    void fail(Host &h, const char *reason) {
+        if (h.fd >= 0) ::close(h.fd);
+        h.fd = -1;
+        h.link = IDLE;
+        h.synced = false;
+        h.in.clear();
+        h.retry_at = std::chrono::steady_clock::now() + std::chrono::milliseconds(RETRY_MS);
+        std::lock_guard<std::mutex> lock(mutex_);
+        h.view.state = "down";
+        h.view.error = reason;
+    }
+
+    void connect_host(uint32_t id) {
+        Host &h = hosts_[id];
+        fleet::Address a;
+        std::string error;
+        if (!fleet::resolve(h.view.address, false, a, error)) {
+            fail(h, error.c_str());
+            return;
+        }
+        h.fd = socket(a.family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (h.fd < 0 || (::connect(h.fd, (struct sockaddr *)&a.addr, a.len) != 0 && errno != EINPROGRESS)) {
+            fail(h, strerror(errno));
+            return;
+        }
+        // Writable once the connection is made or has failed
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN | EPOLLOUT;
+        ev.data.u32 = id;
+        if (epoll_ctl(epoll_, EPOLL_CTL_ADD, h.fd, &ev) != 0) {
+            fail(h, strerror(errno));
+            return;
+        }
+        h.link = CONNECTING;
+    }
+
+    // Handle readiness of one host; true if anything the UI shows changed.
+    bool service(uint32_t id, uint32_t events) {
+        Host &h = hosts_[id];
+        if (h.link == CONNECTING) {
+            int err = 0;
+            socklen_t len = sizeof(err);
+            getsockopt(h.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+            if (err) {
+                fail(h, strerror(err));
+                return true;
+            }
+            if (!(events & (EPOLLOUT | EPOLLIN))) return false;
+            struct epoll_event ev;
+            memset(&ev, 0, sizeof(ev));
+            ev.events = EPOLLIN;
+            ev.data.u32 = id;
+            epoll_ctl(epoll_, EPOLL_CTL_MOD, h.fd, &ev);
+            h.link = UP;
+            h.last_frame = std::chrono::steady_clock::now();
+            std::lock_guard<std::mutex> lock(mutex_);
+            h.view.state = "up";
+            h.view.error.clear();
+        }
+        if (!(events & (EPOLLIN | EPOLLHUP | EPOLLERR))) return true;
+
+        // Bounded so one busy agent cannot starve the others
+        size_t total = 0;
+        while (total < MAX_READ) {
+            size_t at = h.in.size();
+            h.in.resize(at + READ_CHUNK);
+            ssize_t n = recv(h.fd, &h.in[at], READ_CHUNK, 0);
+            h.in.resize(at + (n > 0 ? n : 0));
+            if (n == 0) {
+                fail(h, "closed by agent");
+                return true;
+            }
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                if (errno == EAGAIN) break;
+                fail(h, strerror(errno));
+                return true;
+            }
+            total += n;
+        }
+        return parse(h, total);
+    }
+
+    // Apply every complete message in h.in.
+    bool parse(Host &h, size_t received) {
+        size_t pos = 0;
+        bool changed = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            h.view.bytes += received;
+        }
+        while (h.in.size() - pos >= sizeof(fleet::MessageHeader)) {
+            fleet::MessageHeader m;
+            memcpy(&m, &h.in[pos], sizeof(m));
+            if (m.size > fleet::MAX_MESSAGE) {
+                fail(h, "bad message");
+                return true;
+            }
+            if (h.in.size() - pos < sizeof(m) + m.size) break;
+            const char *payload = &h.in[pos + sizeof(m)];
+            if (!apply(h, m, payload)) return true;   // failed, h.in is gone
+            changed = true;
+            pos += sizeof(m) + m.size;
+        }
+        h.in.erase(h.in.begin(), h.in.begin() + pos);
+        return changed;
+    }
+
+    bool apply(Host &h, const fleet::MessageHeader &m, const char *payload) {
+        if (m.type == 'H') {
+            recording::Cursor c(payload, m.size);
+            char magic[sizeof(fleet::MAGIC)];
+            c.bytes(magic, sizeof(magic));
+            std::string hostname = fleet::get_string(c);
+            std::string cpu_model = fleet::get_string(c);
+            if (!c.ok || memcmp(magic, fleet::MAGIC, sizeof(magic)) != 0) {
+                fail(h, "not an rplex agent");
+                return false;
+            }
+            std::lock_guard<std::mutex> lock(mutex_);
+            h.view.hostname = hostname;
+            h.cpu_model = cpu_model;
+            return true;
+        }
+        if (m.type != 'K' && m.type != 'D') return true;   // from a newer agent
+        if (m.type == 'D' && !h.synced) return true;
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        int64_t previous = h.view.frames ? h.frame.time_us : 0;
+        if (!recording::decode_payload(payload, m.size, m.type == 'K', h.frame)) {
+            lock.unlock();
+            fail(h, "corrupt sample");
+            return false;
+        }
+        h.synced = true;
+        h.last_frame = std::chrono::steady_clock::now();
+        h.frame.time_us = m.time_us;
+        FleetHostView &v = h.view;
+        v.state = "up";
+        v.cpu_usage = h.frame.cpu_usage;
+        v.mem_total = h.frame.mem_total;
+        v.mem_percent = h.frame.mem_total > 0 ? h.frame.mem_used / h.frame.mem_total * 100.0f : 0;
+        v.processes = h.frame.processes.size();
+        v.cpu_history.push(v.cpu_usage);
+        v.mem_history.push(v.mem_percent);
+        // Rounded, as the graphs label their columns with it
+        if (previous && m.time_us > previous) v.sample_seconds = std::max(0.1f, roundf((m.time_us - previous) / 1e5f) / 10);
+        v.time_us = m.time_us;
+        v.frames++;
+        return true;
+    }
+
+    void run() {
+        struct epoll_event events[64];
+        std::chrono::steady_clock::time_point notified;
+        bool dirty = true;
+        while (running_) {
+            std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+            long timeout = RETRY_MS;
+            for (uint32_t i = 0; i < hosts_.size(); i++) {
+                Host &h = hosts_[i];
+                if (h.link == IDLE) {
+                    if (now >= h.retry_at) {
+                        connect_host(i);
+                        dirty = true;
+                    } else {
+                        timeout = std::min(timeout, ms_until(now, h.retry_at));
+                    }
+                } else if (h.link == UP && now - h.last_frame > std::chrono::milliseconds(STALE_MS)) {
+                    // Connected but silent: a hung agent or a dead peer
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    if (strcmp(h.view.state, "stale") != 0) dirty = true;
+                    h.view.state = "stale";
+                }
+            }
+            if (dirty) timeout = std::min(timeout, ms_until(now, notified + std::chrono::milliseconds(NOTIFY_MS)));
+
+            int n = epoll_wait(epoll_, events, 64, (int)std::max(timeout, 0L));
+            if (n < 0 && errno != EINTR) break;
+            for (int k = 0; k < n; k++) {
+                if (events[k].data.u32 == WAKE_ID) {
+                    uint64_t count;
+                    ssize_t r = ::read(wake_.fd(), &count, sizeof(count));
+                    (void)r;
+                    continue;
+                }
+                if (hosts_[events[k].data.u32].fd >= 0 && service(events[k].data.u32, events[k].events)) dirty = true;
+            }
+
+            // Hundreds of agents each publishing once a second would
+            // otherwise wake the UI hundreds of times a second
+            now = std::chrono::steady_clock::now();
+            if (dirty && now - notified >= std::chrono::milliseconds(NOTIFY_MS)) {
+                if (changed_) changed_();
+                notified = now;
+                dirty = false;
+            }
+        }
+    }
+
+    static long ms_until(std::chrono::steady_clock::time_point now, std::chrono::steady_clock::time_point t) {
+        return t > now ? (long)std::chrono::duration_cast<std::chrono::milliseconds>(t - now).count() + 1 : 0;
+    }
+
+    int epoll_;
+    std::atomic<bool> running_;
+    std::thread thread_;
+    Wakeup wake_;
+    std::function<void()> changed_;
+    std::mutex mutex_;
+    std::vector<Host> hosts_;   // fixed once started; only the viewer thread touches the links
+};
+
+#endif
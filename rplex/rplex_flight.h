@@ -0,0 +1,601 @@
+/************************************************************
+ * RPLEX - flight recorder
+ *
+ * Samples CPU, per-core usage, memory and the busiest
+ * processes tens of times a second into a fixed ring, and
+ * checks trigger rules ("core > 95 for 2s") on every
+ * sample. When one fires, the samples from N seconds before
+ * it to N seconds after are written out as a recording
+ * (rplex_recording.h) that --replay opens.
+ *
+ * The sampler never waits for the writer. Each ring slot
+ * carries a sequence number, bumped before and after the
+ * slot is filled, so the writer thread copies samples out
+ * while new ones land and drops any it sees rewritten.
+ *
+ * A full /proc scan at tens of Hz would cost more than all
+ * the rest, so only a short list of candidates, picked by
+ * the regular process scan (set_candidates()), is re-read
+ * on every sample. When CPU use jumps well past what the
+ * candidates account for, a process outside the list must
+ * be busy, and the recorder asks for an early scan.
+ ************************************************************/
+
+#ifndef RPLEX_FLIGHT_H
+#define RPLEX_FLIGHT_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <functional>
+#include <condition_variable>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <stdint.h>
+#include <unistd.h>
+#include "rplex_procfs.h"
+#include "rplex_proctable.h"
+#include "rplex_meminfo.h"
+#include "rplex_cpustat.h"
+#include "rplex_snapshot.h"
+#include "rplex_recording.h"
+
+namespace flight {
+
+enum Metric {
+    CPU,             // total busy percent
+    CORE,            // busy percent of each core; true if any core matches
+    MEM,             // used percent (MemTotal - MemAvailable)
+    MEM_AVAILABLE,   // MemAvailable percent of MemTotal
+    PROCESS          // CPU percent of the busiest process
+};
+
+// METRIC OP VALUE[%] [for DURATION], e.g. "core > 95 for 2s",
+// "memavail < 5%". With a duration the metric is averaged over that
+// long, which also evens out the 10 ms tick granularity of /proc at
+// high sampling rates.
+struct Rule {
+    Metric metric;
+    bool above;          // > and >=; otherwise < and <=
+    bool inclusive;      // >= and <=
+    float threshold;
+    int64_t for_us;
+    std::string text;    // as given, for file notes and the status line
+};
+
+inline bool parse_rule(const std::string &text, Rule &rule, std::string &error) {
+    static const struct { const char *name; Metric metric; } metrics[] = {
+        {"cpu", CPU}, {"core", CORE}, {"mem", MEM}, {"memavail", MEM_AVAILABLE}, {"proc", PROCESS}};
+    const char *p = text.c_str();
+    while (*p == ' ') p++;
+    const char *name = p;
+    while ((*p >= 'a' && *p <= 'z') || *p == '.') p++;
+    std::string metric(name, p - name);
+    size_t m = 0;
+    while (m < sizeof(metrics) / sizeof(metrics[0]) && metric != metrics[m].name) m++;
+    if (m == sizeof(metrics) / sizeof(metrics[0])) {
+        error = "unknown metric '" + metric + "' (cpu, core, mem, memavail, proc)";
+        return false;
+    }
+    rule.metric = metrics[m].metric;
+
+    while (*p == ' ') p++;
+    if (*p != '<' && *p != '>') {
+        error = "expected < or > after " + metric;
+        return false;
+    }
+    rule.above = *p++ == '>';
+    rule.inclusive = *p == '=';
+    if (rule.inclusive) p++;
+
+    char *end;
+    rule.threshold = (float)strtod(p, &end);
+    if (end == p) {
+        error = "expected a number";
+        return false;
+    }
+    p = end;
+    if (*p == '%') p++;
+    while (*p == ' ') p++;
+
+    rule.for_us = 0;
+    if (strncmp(p, "for", 3) == 0) {
+        p += 3;
+        double d = strtod(p, &end);
+        if (end == p || d < 0) {
+            error = "expected a duration after 'for'";
+            return false;
+        }
+        p = end;
+        if (strncmp(p, "ms", 2) == 0) {
+            rule.for_us = (int64_t)(d * 1000);
+            p += 2;
+        } else if (*p == 's' || *p == '\0' || *p == ' ') {
+            rule.for_us = (int64_t)(d * 1000000);
+            if (*p == 's') p++;
+        } else if (*p == 'm') {
+            rule.for_us = (int64_t)(d * 60000000);
+            p++;
+        } else {
+            error = "durations end in ms, s or m";
+            return false;
+        }
+        while (*p == ' ') p++;
+    }
+    if (*p) {
+        error = std::string("unexpected '") + p + "'";
+        return false;
+    }
+    rule.text = text;
+    return true;
+}
+
+// A rule as evaluated: running sums over the last n samples of every
+// value the metric has (one, or one per core).
+class RuleState {
+public:
+    RuleState(const Rule &rule, int hz)
+        : rule_(rule), n_(std::max<size_t>(1, (size_t)((double)rule.for_us * hz / 1e6 + 0.5))),
+          filled_(0), at_(0), armed_(true) {}
+
+    const Rule &rule() const { return rule_; }
+
+    // Push one sample; true when the rule starts to hold. It fires again
+    // only after it has stopped holding.
+    bool update(const float *values, size_t width) {
+        if (width != sums_.size()) {
+            sums_.assign(width, 0.0);
+            history_.assign(n_ * width, 0.0f);
+            filled_ = at_ = 0;
+        }
+        float *slot = width ? &history_[at_ * width] : NULL;
+        for (size_t k = 0; k < width; k++) {
+            if (filled_ == n_) sums_[k] -= slot[k];
+            sums_[k] += values[k];
+            slot[k] = values[k];
+        }
+        at_ = (at_ + 1) % n_;
+        if (filled_ < n_) filled_++;
+
+        bool holds = false;
+        for (size_t k = 0; k < width && filled_ == n_ && !holds; k++) {
+            float mean = (float)(sums_[k] / n_);
+            holds = rule_.above ? (rule_.inclusive ? mean >= rule_.threshold : mean > rule_.threshold)
+                                : (rule_.inclusive ? mean <= rule_.threshold : mean < rule_.threshold);
+        }
+        bool fired = holds && armed_;
+        armed_ = !holds;
+        return fired;
+    }
+
+private:
+    Rule rule_;
+    size_t n_;
+    size_t filled_, at_;
+    bool armed_;
+    std::vector<double> sums_;
+    std::vector<float> history_;   // n_ rows of width values
+};
+
+// Fixed-size samples in a ring with one writer. Readers copy a sample
+// out and keep it only if its slot was not rewritten meanwhile: slot
+// sequence 2n+1 while sample n is written, 2n+2 once it is complete.
+class SampleRing {
+public:
+    SampleRing() : capacity_(0), cores_(0), processes_(0), head_(0) {}
+
+    void init(size_t capacity, size_t cores, size_t processes) {
+        capacity_ = std::max<size_t>(capacity, 1);
+        cores_ = cores;
+        processes_ = processes;
+        std::vector<std::atomic<uint64_t> > seq(capacity_);
+        seq_.swap(seq);
+        for (size_t i = 0; i < capacity_; i++) seq_[i].store(0, std::memory_order_relaxed);
+        headers_.assign(capacity_, Header());
+        core_values_.assign(capacity_ * cores_, 0.0f);
+        procs_.assign(capacity_ * processes_, RecordedProcess());
+        head_.store(0, std::memory_order_relaxed);
+    }
+
+    size_t capacity() const { return capacity_; }
+    size_t cores() const { return cores_; }
+    size_t processes() const { return processes_; }
+
+    // Samples written so far; the newest is head() - 1.
+    uint64_t head() const { return head_.load(std::memory_order_acquire); }
+
+    // Writer side: fill the returned slot, then commit().
+    struct Header {
+        int64_t time_us;
+        float cpu, mem_total, mem_used;   // percent, GB, GB
+        uint32_t processes;
+    };
+    size_t begin_write() {
+        uint64_t n = head_.load(std::memory_order_relaxed);
+        size_t slot = n % capacity_;
+        seq_[slot].store(2 * n + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        return slot;
+    }
+    Header &header(size_t slot) { return headers_[slot]; }
+    float *cores(size_t slot) { return cores_ ? &core_values_[slot * cores_] : NULL; }
+    RecordedProcess *procs(size_t slot) { return processes_ ? &procs_[slot * processes_] : NULL; }
+    void commit() {
+        uint64_t n = head_.load(std::memory_order_relaxed);
+        seq_[n % capacity_].store(2 * n + 2, std::memory_order_release);
+        head_.store(n + 1, std::memory_order_release);
+    }
+
+    // Copy sample n into out; false if it is not written yet or was
+    // overwritten before or while it was copied.
+    bool read(uint64_t n, RecordedFrame &out) const {
+        size_t slot = n % capacity_;
+        if (seq_[slot].load(std::memory_order_acquire) != 2 * n + 2) return false;
+        const Header &h = headers_[slot];
+        out.time_us = h.time_us;
+        out.cpu_usage = h.cpu;
+        out.mem_total = h.mem_total;
+        out.mem_used = h.mem_used;
+        out.cores.assign(core_values_.begin() + slot * cores_, core_values_.begin() + (slot + 1) * cores_);
+        size_t count = std::min<size_t>(h.processes, processes_);
+        out.processes.assign(procs_.begin() + slot * processes_, procs_.begin() + slot * processes_ + count);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return seq_[slot].load(std::memory_order_relaxed) == 2 * n + 2;
+    }
+
+private:
+    SampleRing(const SampleRing &);
+    SampleRing &operator=(const SampleRing &);
+
+    size_t capacity_, cores_, processes_;
+    std::vector<std::atomic<uint64_t> > seq_;
+    std::vector<Header> headers_;
+    std::vector<float> core_values_;
+    std::vector<RecordedProcess> procs_;
+    std::atomic<uint64_t> head_;
+};
+
+}  // namespace flight
+
+class FlightRecorder {
+public:
+    enum { PROCESSES = 20 };   // candidates followed, and processes per sample
+
+    // Called on the writer thread after each dump: the file, what fired
+    // (plus how many samples were lost, if any), and an error if it could
+    // not be written.
+    typedef std::function<void(const std::string &path, const std::string &why, const std::string &error)>
+        DumpHandler;
+
+    FlightRecorder() : hz_(0), window_s_(10), manual_(false), candidates_changed_(false), unexplained_avg_(0),
+                       unexplained_run_(0), capture_(false), capture_first_(0),
+                       capture_end_(0), capture_us_(0), dumps_(0), lost_(0), running_(false),
+                       have_last_(false) {}
+    ~FlightRecorder() { stop(); }
+
+    void add_rule(const flight::Rule &rule) { rules_.push_back(rule); }
+    size_t rules() const { return rules_.size(); }
+
+    // Called on the sampler thread, at most twice a second, when the
+    // candidates should be picked again right away.
+    void on_rescan(std::function<void()> rescan) { rescan_ = rescan; }
+
+    // Sample hz times a second, keeping window_s seconds before and after
+    // every trigger; dumps go to dir.
+    bool start(int hz, double window_s, const std::string &dir, const std::string &cpu_model,
+               DumpHandler on_dump, std::string &error) {
+        stop();
+        if (hz < 1 || hz > 100 || window_s <= 0) {
+            error = "rate must be 1-100 Hz and the window positive";
+            return false;
+        }
+        if (access(dir.c_str(), W_OK) != 0) {
+            error = dir + ": " + strerror(errno);
+            return false;
+        }
+        hz_ = hz;
+        window_s_ = window_s;
+        dir_ = dir;
+        cpu_model_ = cpu_model;
+        on_dump_ = on_dump;
+        states_.clear();
+        for (size_t i = 0; i < rules_.size(); i++) states_.push_back(flight::RuleState(rules_[i], hz));
+        // Both windows, plus slack for the writer to copy out a dump
+        // while the sampler keeps going; rules keep their own history.
+        // A first read finds how many CPUs there are.
+        cpu_.sample();
+        ring_.init((size_t)((2 * window_s + 10) * hz), cpu_.cpus(), PROCESSES);
+
+        running_ = true;
+        writer_ = std::thread(&FlightRecorder::write_dumps, this);
+        sampler_.start(std::chrono::milliseconds(1000 / hz), [this] { sample(); });
+        return true;
+    }
+
+    void stop() {
+        sampler_.stop();
+        {
+            std::lock_guard<std::mutex> lock(jobs_mutex_);
+            if (!running_) return;
+            running_ = false;
+        }
+        jobs_ready_.notify_all();
+        if (writer_.joinable()) writer_.join();
+        hz_ = 0;
+    }
+
+    bool running() const { return hz_ > 0; }
+    int hz() const { return hz_; }
+
+    // Processes worth following at the full rate, from the regular scan.
+    void set_candidates(const std::vector<int> &pids) {
+        std::lock_guard<std::mutex> lock(candidates_mutex_);
+        next_candidates_ = pids;
+        candidates_changed_ = true;
+    }
+
+    // Dump as if a rule had fired now ('F' in the dashboard).
+    void trigger() { manual_ = true; }
+
+    // For the status line: dumps written, samples they are missing, the
+    // newest, and whether one is being captured.
+    unsigned dumps() const { return dumps_; }
+    unsigned long lost() const { return lost_; }
+    bool capturing() const { return capture_; }
+    std::string last_dump() const {
+        std::lock_guard<std::mutex> lock(jobs_mutex_);
+        return last_dump_;
+    }
+
+private:
+    FlightRecorder(const FlightRecorder &);
+    FlightRecorder &operator=(const FlightRecorder &);
+
+    struct Job {
+        uint64_t first, last;   // ring samples, inclusive
+        int64_t time_us;        // of the trigger
+        std::string why;
+    };
+
+    // Sampler thread, hz times a second.
+    void sample() {
+        int64_t now_us = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        size_t slot = ring_.begin_write();
+        flight::SampleRing::Header &h = ring_.header(slot);
+        h.time_us = now_us;
+
+        // CPU, as the dashboard computes it
+        float *cores = ring_.cores(slot);
+        size_t ncores = ring_.cores();
+        h.cpu = 0;
+        std::fill(cores, cores + ncores, 0.0f);
+        if (cpu_.sample()) {
+            h.cpu = cpu_.total();
+            size_t n = std::min(ncores, cpu_.cpus());
+            std::copy(cpu_.usage().begin(), cpu_.usage().begin() + n, cores);
+        }
+        // The first sample only sets the counters' baseline: there is no
+        // interval yet, so it is recorded as zero and not judged by rules
+        bool baseline = !have_last_;
+        have_last_ = true;
+        if (baseline) {
+            h.cpu = 0;
+            std::fill(cores, cores + ncores, 0.0f);
+        }
+
+        MemInfo mem;
+        float mem_used_pct = 0, mem_avail_pct = 100;
+        h.mem_total = h.mem_used = 0;
+        if (mem_.sample(mem)) {
+            h.mem_total = mem.total / (1024.0f * 1024);
+            h.mem_used = mem.used() / (1024.0f * 1024);
+            mem_used_pct = (float)mem.used_percent();
+            mem_avail_pct = mem.total ? 100.0f * mem.available / mem.total : 0;
+        }
+
+        // The candidates, busiest first
+        if (candidates_changed_ && candidates_mutex_.try_lock()) {
+            apply_candidates();
+            candidates_changed_ = false;
+            candidates_mutex_.unlock();
+        }
+        processes_.refresh();
+        processes_.top(SORT_CPU, ring_.processes(), rows_);
+        RecordedProcess *procs = ring_.procs(slot);
+        for (size_t i = 0; i < rows_.size(); i++) {
+            RecordedProcess &p = procs[i];
+            uint32_t row = rows_[i];
+            p.pid = processes_.pid(row);
+            p.cpu = baseline ? 0.0f : processes_.cpu_percent(row);
+            p.rss_kb = processes_.rss_kb(row);
+            memset(p.name, 0, sizeof(p.name));
+            strncpy(p.name, processes_.name(row), sizeof(p.name) - 1);
+        }
+        h.processes = (uint32_t)rows_.size();
+        float top_process = rows_.empty() ? 0.0f : procs[0].cpu;
+        float explained = 0;
+        for (size_t i = 0; i < rows_.size(); i++) explained += procs[i].cpu;
+        ring_.commit();
+        if (!baseline) check_unexplained(h.cpu * std::max<size_t>(ncores, 1) - explained);
+
+        // Rules see every sample after the baseline, captures or not, so
+        // "for" windows stay continuous
+        uint64_t n = ring_.head() - 1;
+        std::string why;
+        for (size_t i = 0; i < states_.size() && !baseline; i++) {
+            const flight::Rule &r = states_[i].rule();
+            float v;
+            const float *values = &v;
+            size_t width = 1;
+            switch (r.metric) {
+            case flight::CPU: v = h.cpu; break;
+            case flight::CORE: values = cores; width = ncores; break;
+            case flight::MEM: v = mem_used_pct; break;
+            case flight::MEM_AVAILABLE: v = mem_avail_pct; break;
+            case flight::PROCESS: v = top_process; break;
+            }
+            if (states_[i].update(values, width)) why += (why.empty() ? "" : ", ") + r.text;
+        }
+        if (manual_.exchange(false)) why += why.empty() ? "manual" : ", manual";
+
+        if (!why.empty() && !capture_) {
+            uint64_t before = (uint64_t)(window_s_ * hz_);
+            capture_first_ = n > before ? n - before : 0;
+            capture_end_ = n + (uint64_t)(window_s_ * hz_);
+            capture_us_ = now_us;
+            capture_why_ = why;
+            capture_ = true;
+        }
+        if (capture_ && n >= capture_end_) {
+            Job job = {capture_first_, capture_end_, capture_us_, capture_why_};
+            {
+                std::lock_guard<std::mutex> lock(jobs_mutex_);
+                jobs_.push_back(job);
+            }
+            jobs_ready_.notify_one();
+            capture_ = false;
+        }
+    }
+
+    // CPU (in percent of one core) used outside the candidates. Some is
+    // always there (interrupts, short-lived tasks), so it is measured
+    // against a slow moving average; two samples half a core above that
+    // ask for a rescan.
+    void check_unexplained(float unexplained) {
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        bool jump = unexplained > unexplained_avg_ + 50;
+        unexplained_avg_ += (unexplained - unexplained_avg_) * 0.02f;
+        unexplained_run_ = jump ? unexplained_run_ + 1 : 0;
+        if (unexplained_run_ >= 2 && rescan_ && now - last_rescan_ >= std::chrono::milliseconds(500)) {
+            rescan_();
+            last_rescan_ = now;
+        }
+    }
+
+    // Follow the new candidate list: drop the rows that left it, read the
+    // new PIDs on the next refresh().
+    void apply_candidates() {
+        std::vector<int> keep(next_candidates_);
+        std::sort(keep.begin(), keep.end());
+        for (size_t i = processes_.size(); i-- > 0;) {
+            if (!std::binary_search(keep.begin(), keep.end(), processes_.pid(i))) processes_.forget(processes_.pid(i));
+        }
+        for (size_t i = 0; i < keep.size(); i++) {
+            if (processes_.find(keep[i]) < 0) processes_.track(keep[i]);
+        }
+    }
+
+    // Writer thread: turns captures into recordings.
+    void write_dumps() {
+        std::unique_lock<std::mutex> lock(jobs_mutex_);
+        while (true) {
+            jobs_ready_.wait(lock, [this] { return !running_ || !jobs_.empty(); });
+            if (jobs_.empty()) return;   // stopping; captures still open are dropped
+            Job job = jobs_.front();
+            jobs_.pop_front();
+            lock.unlock();
+            std::string path, error;
+            write_dump(job, path, error);   // appends any loss to job.why
+            lock.lock();
+            if (error.empty()) {
+                dumps_++;
+                last_dump_ = path;
+            }
+            if (on_dump_) {
+                lock.unlock();
+                on_dump_(path, job.why, error);
+                lock.lock();
+            }
+        }
+    }
+
+    // Samples the sampler overwrote before they were copied are skipped,
+    // and the note says how many, so a dump with gaps does not pass for
+    // a complete one.
+    void write_dump(Job &job, std::string &path, std::string &error) {
+        char stamp[32];
+        time_t t = (time_t)(job.time_us / 1000000);
+        struct tm tm;
+        localtime_r(&t, &tm);
+        strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &tm);
+        char name[64];
+        snprintf(name, sizeof(name), "rplex-flight-%s.rplx", stamp);
+        path = dir_ + "/" + name;
+        for (int i = 2; access(path.c_str(), F_OK) == 0; i++) {
+            snprintf(name, sizeof(name), "rplex-flight-%s-%d.rplx", stamp, i);
+            path = dir_ + "/" + name;
+        }
+
+        Recorder out;
+        if (!out.open(path, job.time_us, cpu_model_, error)) return;
+        out.describe(1000000 / hz_, job.why);
+        RecordedFrame frame;
+        unsigned long lost = 0;
+        for (uint64_t n = job.first; n <= job.last; n++) {
+            if (!ring_.read(n, frame)) {
+                lost++;
+                continue;
+            }
+            if (!out.write(frame)) {
+                error = "write failed";
+                break;
+            }
+        }
+        if (lost) {
+            char note[48];
+            snprintf(note, sizeof(note), ", %lu samples lost", lost);
+            job.why += note;
+            out.describe(1000000 / hz_, job.why);
+            lost_ += lost;
+        }
+        out.close();
+    }
+
+    int hz_;
+    double window_s_;
+    std::string dir_, cpu_model_;
+    DumpHandler on_dump_;
+    std::vector<flight::Rule> rules_;
+    std::vector<flight::RuleState> states_;   // sampler thread only
+    flight::SampleRing ring_;
+    std::atomic<bool> manual_;
+
+    // Sampler thread state
+    CpuSampler cpu_;
+    MemSampler mem_;
+    ProcessTable processes_;   // the candidates only
+    std::vector<uint32_t> rows_;
+    std::mutex candidates_mutex_;
+    std::vector<int> next_candidates_;
+    std::atomic<bool> candidates_changed_;
+    std::function<void()> rescan_;
+    float unexplained_avg_;
+    unsigned unexplained_run_;
+    std::chrono::steady_clock::time_point last_rescan_;
+    std::atomic<bool> capture_;
+    uint64_t capture_first_, capture_end_;
+    int64_t capture_us_;
+    std::string capture_why_;
+
+    // Writer thread
+    mutable std::mutex jobs_mutex_;
+    std::condition_variable jobs_ready_;
+    std::deque<Job> jobs_;
+    std::atomic<unsigned> dumps_;
+    std::atomic<unsigned long> lost_;   // samples overwritten before they were copied out
+    std::string last_dump_;
+    bool running_;
+    bool have_last_;
+    SamplerThread sampler_;
+    std::thread writer_;
+};
+
+#endif
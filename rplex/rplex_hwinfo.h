@@ -0,0 +1,286 @@
+/************************************************************
+ * RPLEX - hardware inventory
+ *
+ * Static facts about the machine (CPU model and topology,
+ * GPUs, RAM type and speed) read once from /proc/cpuinfo,
+ * /sys and the SMBIOS tables, with no subprocesses. Re-read
+ * only on request or when the kernel reports a hotplug.
+ ************************************************************/
+
+#ifndef RPLEX_HWINFO_H
+#define RPLEX_HWINFO_H
+
+#include <string>
+#include <vector>
+#include <set>
+#include <utility>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include <dirent.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include "rplex_procfs.h"
+
+struct HardwareInventory {
+    std::string cpu_model;
+    int packages;
+    int physical_cores;
+    int logical_cores;
+    double cpu_max_mhz;       // 0 if unknown
+    std::string gpu_model;    // "Not detected" if no display controller
+    std::string ram_type;     // "Unknown" without SMBIOS access (usually root only)
+    double ram_speed_mhz;     // MT/s as reported by SMBIOS, 0 if unknown
+    long total_ram_mb;
+
+    HardwareInventory() : packages(1), physical_cores(0), logical_cores(0), cpu_max_mhz(0),
+                          ram_speed_mhz(0), total_ram_mb(0) {}
+};
+
+// CPU model, clock fallback and RAM total from /proc.
+inline void read_cpuinfo_facts(HardwareInventory &hw) {
+    ProcFile cpuinfo("/proc/cpuinfo");
+    char value[128];
+    if (cpuinfo.read()) {
+        ProcScanner s(cpuinfo);
+        // x86 says "model name"; many ARM kernels only have "Hardware" or "Processor".
+        static const char *keys[] = {"model name", "Hardware", "Processor", "cpu model"};
+        for (size_t k = 0; k < sizeof(keys) / sizeof(keys[0]) && hw.cpu_model.empty(); k++) {
+            ProcScanner line = s;
+            if (line.find_key(keys[k], strlen(keys[k]))) {
+                while (!line.at_end() && *line.p != ':' && *line.p != '\n') line.p++;
+                if (!line.at_end() && *line.p == ':') {
+                    line.p++;
+                    line.rest_of_line(value, sizeof(value));
+                    hw.cpu_model = value;
+                }
+            }
+        }
+        ProcScanner mhz = s;
+        if (hw.cpu_max_mhz == 0 && mhz.find_key("cpu MHz", 7)) {
+            while (!mhz.at_end() && *mhz.p != ':' && *mhz.p != '\n') mhz.p++;
+            if (!mhz.at_end()) mhz.p++;
+            mhz.rest_of_line(value, sizeof(value));
+            hw.cpu_max_mhz = atof(value);
+        }
+    }
+    if (hw.cpu_model.empty()) hw.cpu_model = "Unknown CPU";
+
+    ProcFile meminfo("/proc/meminfo");
+    if (meminfo.read()) {
+        ProcScanner s(meminfo);
+        long long kb;
+        if (s.find_key("MemTotal:", 9) && s.next_i64(kb)) hw.total_ram_mb = kb / 1024;
+    }
+}
+
+// Logical CPUs, cores and packages from the sysfs topology. A core is a
+// distinct (package, core id) pair; its SMT siblings share that pair.
+inline void read_cpu_topology(HardwareInventory &hw) {
+    DIR *dir = proc_opendir("/sys/devices/system/cpu");
+    if (!dir) return;
+    std::set<std::pair<int, int> > cores;
+    std::set<int> packages;
+    int logical = 0;
+    char path[320], value[64];
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != NULL) {
+        if (strncmp(ent->d_name, "cpu", 3) != 0 || !isdigit((unsigned char)ent->d_name[3])) continue;
+        // Offline CPUs have no topology directory.
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/%s/topology/core_id", ent->d_name);
+        if (!read_first_line(path, value, sizeof(value))) continue;
+        int core = atoi(value);
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/%s/topology/physical_package_id", ent->d_name);
+        int package = read_first_line(path, value, sizeof(value)) ? atoi(value) : 0;
+        cores.insert(std::make_pair(package, core));
+        packages.insert(package);
+        logical++;
+
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/%s/cpufreq/cpuinfo_max_freq", ent->d_name);
+        if (read_first_line(path, value, sizeof(value))) {
+            double mhz = atof(value) / 1000.0;  // kHz
+            if (mhz > hw.cpu_max_mhz) hw.cpu_max_mhz = mhz;
+        }
+    }
+    closedir(dir);
+    if (logical > 0) {
+        hw.logical_cores = logical;
+        hw.physical_cores = (int)cores.size();
+        hw.packages = (int)packages.size();
+    }
+}
+
+inline const char *pci_vendor_name(unsigned vendor) {
+    switch (vendor) {
+    case 0x10de: return "NVIDIA";
+    case 0x1002: return "AMD";
+    case 0x8086: return "Intel";
+    case 0x1a03: return "ASPEED";
+    case 0x102b: return "Matrox";
+    case 0x15ad: return "VMware";
+    case 0x1234: return "QEMU";
+    case 0x1af4: return "virtio";
+    case 0x80ee: return "VirtualBox";
+    case 0x1414: return "Microsoft";
+    case 0x13b5: return "ARM";
+    default: return "PCI";
+    }
+}
+
+// Display controllers (PCI class 0x03) with vendor, ids and bound driver.
+// Without the pci.ids database only the vendor can be named.
+inline void read_gpus(HardwareInventory &hw) {
+    hw.gpu_model.clear();
+    DIR *dir = proc_opendir("/sys/bus/pci/devices");
+    if (dir) {
+        char path[320], value[64], link[256];
+        struct dirent *ent;
+        while ((ent = readdir(dir)) != NULL) {
+            if (ent->d_name[0] == '.') continue;
+            snprintf(path, sizeof(path), "/sys/bus/pci/devices/%s/class", ent->d_name);
+            if (!read_first_line(path, value, sizeof(value))) continue;
+            unsigned long cls = strtoul(value, NULL, 16);
+            if ((cls >> 16) != 0x03) continue;
+
+            snprintf(path, sizeof(path), "/sys/bus/pci/devices/%s/vendor", ent->d_name);
+            unsigned vendor = read_first_line(path, value, sizeof(value)) ? strtoul(value, NULL, 16) : 0;
+            snprintf(path, sizeof(path), "/sys/bus/pci/devices/%s/device", ent->d_name);
+            unsigned device = read_first_line(path, value, sizeof(value)) ? strtoul(value, NULL, 16) : 0;
+
+            char entry[320];
+            snprintf(entry, sizeof(entry), "%s [%04x:%04x]", pci_vendor_name(vendor), vendor, device);
+            snprintf(path, sizeof(path), "/sys/bus/pci/devices/%s/driver", ent->d_name);
+            char mapped[4096];
+            ssize_t n = readlink(fs_path(path, mapped, sizeof(mapped)), link, sizeof(link) - 1);
+            if (n > 0) {
+                link[n] = '\0';
+                const char *driver = strrchr(link, '/');
+                size_t used = strlen(entry);
+                snprintf(entry + used, sizeof(entry) - used, " (%s)", driver ? driver + 1 : link);
+            }
+            if (!hw.gpu_model.empty()) hw.gpu_model += ", ";
+            hw.gpu_model += entry;
+        }
+        closedir(dir);
+    }
+    if (hw.gpu_model.empty()) hw.gpu_model = "Not detected";
+}
+
+inline const char *smbios_memory_type(unsigned type) {
+    switch (type) {
+    case 0x0f: return "SDRAM";
+    case 0x12: return "DDR";
+    case 0x13: return "DDR2";
+    case 0x18: return "DDR3";
+    case 0x1a: return "DDR4";
+    case 0x1b: return "LPDDR";
+    case 0x1c: return "LPDDR2";
+    case 0x1d: return "LPDDR3";
+    case 0x1e: return "LPDDR4";
+    case 0x22: return "DDR5";
+    case 0x23: return "LPDDR5";
+    default: return NULL;
+    }
+}
+
+// RAM type and speed from the first populated SMBIOS type 17 (Memory
+// Device) record. The raw table is what dmidecode reads; it is usually
+// readable by root only, in which case the fields stay unknown.
+inline void read_memory_devices(HardwareInventory &hw) {
+    hw.ram_type = "Unknown";
+    hw.ram_speed_mhz = 0;
+    ProcFile dmi("/sys/firmware/dmi/tables/DMI");
+    if (!dmi.read()) return;
+    const unsigned char *p = (const unsigned char *)dmi.data();
+    const unsigned char *end = p + dmi.size();
+    while (p + 4 <= end) {
+        unsigned type = p[0], len = p[1];
+        if (len < 4 || p + len > end) break;
+        if (type == 127) break;  // end-of-table
+        if (type == 17 && len >= 0x17) {
+            unsigned size = p[0x0c] | (p[0x0d] << 8);
+            if (size != 0 && size != 0xffff) {  // 0 = empty slot
+                const char *name = smbios_memory_type(p[0x12]);
+                if (name) hw.ram_type = name;
+                unsigned speed = p[0x15] | (p[0x16] << 8);
+                if (len >= 0x22) {
+                    unsigned configured = p[0x20] | (p[0x21] << 8);
+                    if (configured && configured != 0xffff) speed = configured;
+                }
+                if (speed != 0xffff) hw.ram_speed_mhz = speed;
+                return;
+            }
+        }
+        // Skip the formatted area and the string set, which ends in two NULs.
+        const unsigned char *q = p + len;
+        while (q + 1 < end && (q[0] || q[1])) q++;
+        p = q + 2;
+    }
+}
+
+inline void read_hardware_inventory(HardwareInventory &hw) {
+    hw.cpu_model.clear();
+    hw.packages = 1;
+    hw.physical_cores = 0;
+    hw.logical_cores = 0;
+    hw.cpu_max_mhz = 0;
+    hw.total_ram_mb = 0;
+    read_cpu_topology(hw);
+    read_cpuinfo_facts(hw);
+    read_gpus(hw);
+    read_memory_devices(hw);
+}
+
+// Listens for kernel uevents and reports CPU, memory or GPU hotplug.
+// Unprivileged processes may join the kernel uevent multicast group.
+class HotplugMonitor {
+public:
+    HotplugMonitor() : fd_(-1) {
+        fd_ = socket(AF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT);
+        if (fd_ < 0) return;
+        struct sockaddr_nl addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.nl_family = AF_NETLINK;
+        addr.nl_groups = 1;  // kernel events
+        if (bind(fd_, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+            ::close(fd_);
+            fd_ = -1;
+        }
+    }
+
+    ~HotplugMonitor() {
+        if (fd_ >= 0) ::close(fd_);
+    }
+
+    int fd() const { return fd_; }
+
+    // Drain pending events without blocking; true if any of them
+    // concerned hardware the inventory describes.
+    bool changed() {
+        if (fd_ < 0) return false;
+        bool relevant = false;
+        char msg[8192];
+        ssize_t n;
+        while ((n = recv(fd_, msg, sizeof(msg) - 1, 0)) > 0) {
+            msg[n] = '\0';
+            // Payload is "action@devpath\0KEY=value\0..."
+            for (const char *kv = msg; kv < msg + n; kv += strlen(kv) + 1) {
+                if (strcmp(kv, "SUBSYSTEM=cpu") == 0 || strcmp(kv, "SUBSYSTEM=memory") == 0 ||
+                    strcmp(kv, "SUBSYSTEM=drm") == 0) {
+                    relevant = true;
+                }
+            }
+        }
+        return relevant;
+    }
+
+private:
+    HotplugMonitor(const HotplugMonitor &);
+    HotplugMonitor &operator=(const HotplugMonitor &);
+
+    int fd_;
+};
+
+#endif
@@ -0,0 +1,86 @@
+/************************************************************
+ * RPLEX - memory accounting
+ *
+ * System memory from /proc/meminfo. "Used" is MemTotal
+ * minus MemAvailable, so reclaimable page cache and slab no
+ * longer make a long-running host look full; cache, slab,
+ * swap and dirty/writeback are reported next to it.
+ ************************************************************/
+
+#ifndef RPLEX_MEMINFO_H
+#define RPLEX_MEMINFO_H
+
+#include <cstring>
+#include "rplex_procfs.h"
+
+// All values in kB, as /proc/meminfo reports them.
+struct MemInfo {
+    unsigned long long total, free, available;
+    unsigned long long buffers, cached, shmem;
+    unsigned long long slab, slab_reclaimable;
+    unsigned long long swap_total, swap_free, swap_cached;
+    unsigned long long dirty, writeback;
+
+    unsigned long long used() const { return total > available ? total - available : 0; }
+    unsigned long long swap_used() const { return swap_total > swap_free ? swap_total - swap_free : 0; }
+    double used_percent() const { return total ? 100.0 * used() / total : 0; }
+    // Page cache as free(1) shows it: shared memory cannot be dropped
+    unsigned long long page_cache() const {
+        return buffers + cached > shmem ? buffers + cached - shmem : 0;
+    }
+};
+
+// Lines are matched by key wherever they appear, since fields have been
+// added between existing ones across kernel versions.
+inline bool parse_meminfo(const ProcFile &f, MemInfo &m) {
+    struct Field {
+        const char *key;
+        size_t len;
+        unsigned long long *value;
+    };
+    const Field fields[] = {
+        {"MemTotal:", 9, &m.total},         {"MemFree:", 8, &m.free},
+        {"MemAvailable:", 13, &m.available}, {"Buffers:", 8, &m.buffers},
+        {"Cached:", 7, &m.cached},           {"SwapCached:", 11, &m.swap_cached},
+        {"SwapTotal:", 10, &m.swap_total},   {"SwapFree:", 9, &m.swap_free},
+        {"Dirty:", 6, &m.dirty},             {"Writeback:", 10, &m.writeback},
+        {"Shmem:", 6, &m.shmem},             {"Slab:", 5, &m.slab},
+        {"SReclaimable:", 13, &m.slab_reclaimable},
+    };
+    const size_t count = sizeof(fields) / sizeof(fields[0]);
+    memset(&m, 0, sizeof(m));
+    bool have_available = false;
+    ProcScanner s(f);
+    if (s.at_end()) return false;
+    do {
+        for (size_t i = 0; i < count; i++) {
+            if (s.starts_with(fields[i].key, fields[i].len)) {
+                s.next_u64(*fields[i].value);
+                if (fields[i].value == &m.available) have_available = true;
+                break;
+            }
+        }
+    } while (s.next_line());
+    // Kernels before 3.14 have no MemAvailable; approximate it
+    if (!have_available) {
+        unsigned long long reclaimable = m.free + m.buffers + m.cached + m.slab_reclaimable;
+        m.available = reclaimable > m.shmem ? reclaimable - m.shmem : 0;
+    }
+    return m.total > 0;
+}
+
+// Keeps /proc/meminfo open between samples.
+class MemSampler {
+public:
+    MemSampler() : file_("/proc/meminfo") {}
+
+    bool sample(MemInfo &out) { return file_.read() && parse_meminfo(file_, out); }
+
+private:
+    MemSampler(const MemSampler &);
+    MemSampler &operator=(const MemSampler &);
+
+    ProcFile file_;
+};
+
+#endif
@@ -3,21 +3,60 @@
 #include <string>
 #include <vector>
 #include <thread>
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
 #include <chrono>
 #include <sstream>
 #include <iomanip>
 #include <curl/curl.h>
 #include <sys/utsname.h>
-#include <sys/sysinfo.h>
 #include <dirent.h>
 #include <cmath>
 #include <algorithm>
 #include <unistd.h>  
 #include <cstring>   
 #include <ctime>   
+#include <csignal>
+#include <sys/ioctl.h>
+#include "rplex_procfs.h"
+#include "rplex_proctable.h"
+#include "rplex_proclife.h"
+#include "rplex_snapshot.h"
+#include "rplex_eventloop.h"
+#include "rplex_series.h"
+#include "rplex_stats.h"
+#include "rplex_netid.h"
+#include "rplex_netstat.h"
+#include "rplex_diskstats.h"
+#include "rplex_meminfo.h"
+#include "rplex_cpustat.h"
+#include "rplex_collector.h"
+#include "rplex_cgroup.h"
+#include "rplex_selfprof.h"
+#include "rplex_hwinfo.h"
+#include "rplex_render.h"
+#include "rplex_batch.h"
+#include "rplex_exporter.h"
+#include "rplex_recording.h"
+#include "rplex_fleet.h"
+#include "rplex_flight.h"
 
 using namespace std;
 
+// Count C++ heap allocations for the self-profile; see allocation_count().
+// Kept out of line so the compiler never sees malloc() meet operator delete.
+__attribute__((noinline)) void *operator new(size_t size) {
+    allocation_count().fetch_add(1, memory_order_relaxed);
+    if (void *p = malloc(size ? size : 1)) return p;
+    throw bad_alloc();
+}
+
+__attribute__((noinline)) void operator delete(void *p) noexcept {
+    free(p);
+}
+
 // Color pairs
 #define COLOR_DEFAULT 1
 #define COLOR_TITLE 2
@@ -28,11 +67,59 @@ using namespace std;
 #define COLOR_BAR 7
 #define COLOR_GRAPH 8
 
+// One row of the process panel. Numbers stay numeric until drawn.
 struct ProcessInfo {
     int pid;
-    string name;
-    string memory;
-    string cpu;
+    char name[16];
+    long long rss_kb;
+    float cpu;
+    float io_read, io_write;   // bytes per second
+    long long pss_kb, swap_kb; // -1 until smaps_rollup has been read
+    int depth;                 // indentation in the tree view
+    char fold;                 // tree: '-' children shown, '+' folded, ' ' leaf
+    bool thread;               // a thread (pid is its TID) of the process above
+    float tree_cpu;            // with all descendants, in the tree view
+    long long tree_rss_kb;
+};
+
+// Everything one frame needs. Filled by the sampler thread, drawn by the UI.
+struct MonitorSnapshot {
+    string cpu_model;
+    float cpu_usage;
+    vector<float> core_usage;
+    float mem_total;                   // GB
+    float mem_used;                    // GB, total minus available
+    float mem_percent;
+    vector<SeriesPoint> cpu_history;   // newest points of the selected tier
+    vector<SeriesPoint> mem_history;
+    float history_step;                // seconds per graph column
+    vector<StatsSummary> cpu_stats;    // one per entry of stats_windows
+    vector<StatsSummary> mem_stats;
+    MemInfo mem;                       // kB, as in /proc/meminfo
+    NetStats net;                      // interface and TCP rates
+    vector<SeriesPoint> net_history;   // bytes/s received + sent, all interfaces but lo
+    vector<DiskRates> disks;
+    vector<FsUsage> filesystems;
+    vector<ProcessInfo> processes;
+    ProcSortKey sort;
+    bool process_tree;                 // processes are a tree ('T')
+    size_t process_first;              // list position of processes[0]
+    size_t process_total;              // rows in the whole list, threads included
+    bool proc_events;                  // churn below comes from the proc connector
+    unsigned long forks, exits, short_lived;   // during the last interval
+    char last_short_lived[16];         // name of the newest one, if any
+    SystemPressure pressure;           // host-wide PSI
+    bool show_cgroups;                 // cgroups instead of processes in the lower panel
+    CgroupSortKey cgroup_sort;
+    vector<CgroupStats> cgroups;       // top rows in cgroup_sort order
+    bool have_cgroups;                 // a cgroup v2 hierarchy is mounted
+    vector<PhaseSummary> phases;       // sampler phases of the last frame
+    SelfUsage self;                    // rplex's own footprint
+    unsigned stretch;                  // collector periods times this (CPU budget)
+    double cpu_budget;                 // --cpu-budget, 0 if off
+    time_t taken;                      // when the values were sampled
+    string status;                     // recording or replay state for the header
+    vector<double> plugins;            // plugin metrics, in the order of plugins.fields()
 };
 
 static size_t WriteCallback(void *contents, size_t size, size_t nmemb, void *userp) {
@@ -40,165 +127,1066 @@ static size_t WriteCallback(void *contents, size_t size, size_t nmemb, void *use
     return size * nmemb;
 }
 
-string get_ip() {
+// HttpFetch for the public-address lookup in rplex_netid.h.
+bool get_ip(const string &url, long timeout_ms, string &body) {
     CURL *curl;
     CURLcode res;
-    string readBuffer;
 
     curl = curl_easy_init();
     if(curl) {
-        curl_easy_setopt(curl, CURLOPT_URL, "https://api.ipify.org");
+        curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
         curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
-        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &readBuffer);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &body);
+        curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, timeout_ms);
+        curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS, timeout_ms);
+        curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
         res = curl_easy_perform(curl);
         curl_easy_cleanup(curl);
         
-        if(res == CURLE_OK) {
-            return readBuffer;
+        return res == CURLE_OK;
+    }
+    return false;
+}
+
+// The model never changes while we run, so /proc/cpuinfo is read once.
+string get_cpu_info() {
+    static string info;
+    if (info.empty()) {
+        HardwareInventory hw;
+        read_cpuinfo_facts(hw);
+        info = hw.cpu_model;
+        if (info.length() > 40) {
+            info = info.substr(0, 37) + "...";
         }
     }
-    return "Unavailable";
+    return info;
+}
+
+TimeSeries cpu_history;
+atomic<int> history_tier(0);   // tier shown in the graphs, set by the UI
+
+// While the CPU budget stretches the periods, one sample stands for this
+// many and is pushed as often, so history tiers and stats windows, which
+// count samples, keep their time spans. Sampler thread only.
+unsigned sample_repeat = 1;
+
+void push_history(TimeSeries &series, float v) {
+    for (unsigned i = 0; i < sample_repeat; i++) series.push(v);
+}
+
+template <typename Stats>
+void push_stats(Stats &stats, float v) {
+    for (unsigned i = 0; i < sample_repeat; i++) stats.push(v);
+}
+
+// Rolling statistics next to each series, fed by its collector
+vector<size_t> stats_windows;   // seconds, set from --stats-windows
+vector<size_t> cpu_window_samples;   // the same windows in CPU samples
+MetricStats cpu_stats, mem_stats;
+// Every core keeps only the shortest window since there may be hundreds
+vector<WindowStats> core_stats;
+
+// Turn stats_windows into sample counts for one CPU and one memory
+// sample every cpu_seconds/mem_seconds. This restarts every window.
+void configure_stats(double cpu_seconds, double mem_seconds) {
+    vector<size_t> mem_window_samples;
+    cpu_window_samples.clear();
+    for (size_t i = 0; i < stats_windows.size(); i++) {
+        cpu_window_samples.push_back(max((size_t)1, (size_t)(stats_windows[i] / cpu_seconds + 0.5)));
+        mem_window_samples.push_back(max((size_t)1, (size_t)(stats_windows[i] / mem_seconds + 0.5)));
+    }
+    cpu_stats.configure(cpu_window_samples);
+    mem_stats.configure(mem_window_samples);
+    core_stats.clear();   // refilled at the new size by the next CPU sample
+}
+
+CpuSampler cpu_sampler;
+
+// Total usage; cores gets one entry per CPU number, 0 while offline.
+float get_cpu_usage(vector<float> &cores) {
+    if (!cpu_sampler.sample()) return 0.0f;
+    float usage = cpu_sampler.total();
+    
+    cores.assign(cpu_sampler.usage().begin(), cpu_sampler.usage().end());
+    while (!cpu_window_samples.empty() && core_stats.size() < cores.size()) {
+        core_stats.push_back(WindowStats(cpu_window_samples[0]));
+    }
+    for (size_t i = 0; i < core_stats.size(); i++) {
+        if (cpu_sampler.online(i)) push_stats(core_stats[i], cores[i]);
+    }
+    
+    // Update history
+    push_history(cpu_history, usage);
+    push_stats(cpu_stats, usage);
+    
+    return usage;
+}
+
+TimeSeries mem_history;
+
+MemSampler mem_sampler;
+
+// Used memory is what cannot be reclaimed: MemTotal - MemAvailable.
+void get_ram_info(float &total, float &used, float &percent, MemInfo &info) {
+    if (!mem_sampler.sample(info)) return;
+    
+    total = info.total / (1024.0f * 1024);
+    used = info.used() / (1024.0f * 1024);
+    percent = (float)info.used_percent();
+    
+    // Update history
+    push_history(mem_history, percent);
+    push_stats(mem_stats, percent);
 }
 
-void draw_graph(WINDOW *win, int y, int x, const vector<float> &values, int width, int height, int color_pair) {
-    if (values.empty()) return;
+// Phases of one sampler pass, for the self-profile overlay ('o')
+enum SamplePhase {
+    PHASE_CPU, PHASE_MEMORY, PHASE_NETWORK, PHASE_DISK, PHASE_PROCESSES,
+    PHASE_SORT, PHASE_PSS, PHASE_CGROUPS, PHASE_PLUGINS, PHASE_METRICS, PHASE_RECORD, PHASE_AGENT, SAMPLE_PHASES
+};
+const char *sample_phase_names[SAMPLE_PHASES] = {
+    "cpu", "memory", "network", "disk", "processes",
+    "sort", "pss", "cgroups", "plugins", "metrics", "record", "agent"};
+PhaseTimes sample_phases(sample_phase_names, SAMPLE_PHASES);   // sampler thread only
+SelfMonitor self_monitor;
+OverheadBudget overhead_budget;   // configured by --cpu-budget
+CollectorThread *live_sampler = NULL;   // the sampler the budget slows down
+Wakeup ui_wakeup;   // poked whenever a snapshot or network identity is published
+
+// Collectors of the live sampler, each on its own period in ms
+// (--intervals); 0 means once at startup, or when triggered.
+enum Collector {
+    COLLECT_HARDWARE, COLLECT_CPU, COLLECT_MEMORY, COLLECT_NETWORK, COLLECT_DISK,
+    COLLECT_PROCESSES, COLLECT_CGROUPS, COLLECT_PLUGINS, COLLECT_EXPORT, COLLECTORS
+};
+const char *collector_names[COLLECTORS] = {
+    "hardware", "cpu", "memory", "network", "disk", "processes", "cgroups", "plugins", "export"};
+long collector_periods[COLLECTORS] = {0, 250, 250, 1000, 1000, 2000, 2000, 1000, 1000};
 
-    float max_val = *max_element(values.begin(), values.end());
-    if (max_val == 0) max_val = 1;
+// Collectors loaded with --plugin; the built-in ones are read above
+MetricSet plugins;
 
-    wattron(win, COLOR_PAIR(color_pair));
-    for (int i = 0; i < width && i < (int)values.size(); i++) {
-        int bar_height = min(height, (int)((values[i] / max_val) * height));
-        for (int j = 0; j < bar_height; j++) {
-            mvwaddch(win, y + height - j - 1, x + i, ACS_CKBOARD);
+NetSampler net_sampler;
+TimeSeries net_history;
+
+// Interface and TCP rates on the same cadence as the other samples.
+void get_net_stats(NetStats &out) {
+    net_sampler.sample(out);
+    double total = 0;
+    for (size_t i = 0; i < out.interfaces.size(); i++) {
+        const NetIfRates &r = out.interfaces[i];
+        if (strcmp(r.name, "lo") != 0) total += r.rx_bytes + r.tx_bytes;
+    }
+    push_history(net_history, (float)total);
+}
+
+DiskSampler disk_sampler;
+
+ProcessTable process_table;
+ProcessTracker process_tracker(process_table);   // attached to events by --proc-events
+atomic<int> process_sort(SORT_CPU);   // set by the UI, read by the sampler
+atomic<int> process_rows(5);
+
+// How the process panel lists processes beyond the sort key. Set by the
+// UI, read by the sampler, both under process_view_mutex.
+struct ProcessView {
+    ProcessView() : tree(false), top_row(0) {}
+    bool tree;                     // 'T': parent/child tree instead of a flat list
+    size_t top_row;                // list position the panel starts at
+    unordered_set<int> threads;    // PIDs listed with their threads (Enter)
+    unordered_set<int> folded;     // tree nodes whose children are hidden
+};
+mutex process_view_mutex;
+ProcessView process_view;
+
+// One table per process listed with its threads, following
+// /proc/<pid>/task. Only those are ever scanned, so threads cost
+// nothing until asked for. Sampler thread only.
+unordered_map<int, ProcessTable *> thread_tables;
+
+void scan_threads(const unordered_set<int> &open) {
+    for (unordered_map<int, ProcessTable *>::iterator it = thread_tables.begin(); it != thread_tables.end();) {
+        if (!open.count(it->first) || process_table.find(it->first) < 0) {
+            delete it->second;
+            it = thread_tables.erase(it);
+        } else {
+            ++it;
         }
     }
-    wattroff(win, COLOR_PAIR(color_pair));
+    for (unordered_set<int>::const_iterator it = open.begin(); it != open.end(); ++it) {
+        if (process_table.find(*it) < 0) continue;
+        ProcessTable *&threads = thread_tables[*it];
+        if (!threads) {
+            char dir[48];
+            snprintf(dir, sizeof(dir), "/proc/%d/task", *it);
+            threads = new ProcessTable(dir);
+            threads->set_fd_budget(1024);   // the process table needs the rest
+        }
+        threads->scan();
+    }
 }
 
-string get_cpu_info() {
-    ifstream cpuinfo("/proc/cpuinfo");
-    string line;
-    while (getline(cpuinfo, line)) {
-        if (line.find("model name") != string::npos) {
-            size_t pos = line.find(":");
-            if (pos != string::npos) {
-                string info = line.substr(pos + 2);
-                if (info.length() > 40) {
-                    return info.substr(0, 37) + "...";
-                }
-                return info;
+void fill_process_info(const ProcessTable &t, uint32_t row, ProcessInfo &p) {
+    p.pid = t.pid(row);
+    strncpy(p.name, t.name(row), sizeof(p.name) - 1);
+    p.name[sizeof(p.name) - 1] = '\0';
+    p.rss_kb = t.rss_kb(row);
+    p.cpu = t.cpu_percent(row);
+    p.io_read = t.io_read_rate(row);
+    p.io_write = t.io_write_rate(row);
+    p.pss_kb = t.pss_kb(row);
+    p.swap_kb = t.swap_kb(row);
+    p.depth = 0;
+    p.fold = ' ';
+    p.thread = false;
+    p.tree_cpu = p.cpu;
+    p.tree_rss_kb = p.rss_kb;
+}
+
+// Copies the window [first, first + rows) of the process list out of the
+// rows it is walked in, counting every row, threads included, on the way.
+struct ProcessListWindow {
+    ProcessListWindow(size_t first_row, size_t max_rows, ProcSortKey sort_key, bool in_tree, vector<ProcessInfo> &rows)
+        : first(first_row), end(first_row + max_rows), key(sort_key), tree(in_tree), at(0), out(rows) { out.clear(); }
+
+    size_t first, end;
+    ProcSortKey key;
+    bool tree;                     // subtree totals are current
+    size_t at;                     // list position of the next row
+    vector<ProcessInfo> &out;
+    vector<uint32_t> shown;        // table rows of the processes copied out
+    vector<uint32_t> order;
+
+    bool full() const { return at >= end; }
+
+    // One process, then its threads if they are open.
+    void add(uint32_t row, int depth, char fold) {
+        int pid = process_table.pid(row);
+        if (at >= first && at < end) {
+            out.resize(out.size() + 1);
+            ProcessInfo &p = out.back();
+            fill_process_info(process_table, row, p);
+            p.depth = depth;
+            p.fold = fold;
+            if (tree) {
+                p.tree_cpu = process_table.tree_cpu_percent(row);
+                p.tree_rss_kb = process_table.tree_rss_kb(row);
+            }
+            shown.push_back(row);
+        }
+        at++;
+        unordered_map<int, ProcessTable *>::const_iterator it = thread_tables.find(pid);
+        if (it == thread_tables.end()) return;
+        const ProcessTable &threads = *it->second;
+        if (at + threads.size() > first && at < end) {
+            threads.top(key, threads.size(), order);
+            for (size_t i = 0; i < order.size(); i++, at++) {
+                if (at < first || at >= end) continue;
+                out.resize(out.size() + 1);
+                ProcessInfo &p = out.back();
+                fill_process_info(threads, order[i], p);
+                p.depth = depth + 1;
+                p.thread = true;
+                p.rss_kb = p.tree_rss_kb = -1;   // shared with the process
+                p.pss_kb = p.swap_kb = -1;
+            }
+        } else {
+            at += threads.size();
+        }
+    }
+};
+
+// Processes a tree walk shows without folded subtrees, plus open threads.
+size_t count_tree_rows(const unordered_set<int> &folded) {
+    static vector<uint32_t> stack;
+    size_t rows = 0;
+    stack = process_table.roots();
+    while (!stack.empty()) {
+        uint32_t row = stack.back();
+        stack.pop_back();
+        int pid = process_table.pid(row);
+        unordered_map<int, ProcessTable *>::const_iterator it = thread_tables.find(pid);
+        rows += 1 + (it != thread_tables.end() ? it->second->size() : 0);
+        if (folded.count(pid)) continue;
+        for (long c = process_table.first_child(row); c >= 0; c = process_table.next_sibling(c)) {
+            stack.push_back((uint32_t)c);
+        }
+    }
+    return rows;
+}
+
+// Refresh the process table and fill snap with the max_rows rows of the
+// process list the panel shows: the top of the flat list in process_sort
+// order, or of the tree with siblings in that order, scrolled and with
+// the threads of open processes under them.
+void get_processes(size_t max_rows, MonitorSnapshot &snap) {
+    static unordered_set<int> open, folded;
+    {
+        PhaseTimer t(sample_phases, PHASE_PROCESSES);
+        process_tracker.update();
+    }
+    size_t top_row;
+    {
+        lock_guard<mutex> lock(process_view_mutex);
+        snap.process_tree = process_view.tree;
+        top_row = process_view.top_row;
+        // Forget processes that have gone, so a reused PID starts closed
+        for (unordered_set<int>::iterator it = process_view.threads.begin(); it != process_view.threads.end();) {
+            if (process_table.find(*it) < 0) it = process_view.threads.erase(it); else ++it;
+        }
+        for (unordered_set<int>::iterator it = process_view.folded.begin(); it != process_view.folded.end();) {
+            if (process_table.find(*it) < 0) it = process_view.folded.erase(it); else ++it;
+        }
+        open = process_view.threads;
+        folded = process_view.folded;
+    }
+    if (!open.empty() || !thread_tables.empty()) {
+        PhaseTimer t(sample_phases, PHASE_PROCESSES);
+        scan_threads(open);
+    }
+    
+    PhaseTimer t(sample_phases, PHASE_SORT);
+    ProcSortKey key = (ProcSortKey)process_sort.load();
+    size_t total;
+    if (snap.process_tree) {
+        process_table.sum_subtrees();
+        total = count_tree_rows(folded);
+    } else {
+        total = process_table.size();
+        for (unordered_map<int, ProcessTable *>::const_iterator it = thread_tables.begin(); it != thread_tables.end(); ++it) {
+            total += it->second->size();
+        }
+    }
+    size_t first = min(top_row, total > max_rows ? total - max_rows : 0);
+    ProcessListWindow window(first, max_rows, key, snap.process_tree, snap.processes);
+    
+    if (snap.process_tree) {
+        // Depth-first, each node's children sorted only once it is reached
+        static vector<pair<uint32_t, int> > stack;
+        static vector<uint32_t> children;
+        children = process_table.roots();
+        process_table.sort_rows(key, true, children);
+        stack.clear();
+        for (size_t i = children.size(); i-- > 0;) stack.push_back(make_pair(children[i], 0));
+        while (!stack.empty() && !window.full()) {
+            uint32_t row = stack.back().first;
+            int depth = stack.back().second;
+            stack.pop_back();
+            bool leaf = process_table.first_child(row) < 0;
+            bool fold = !leaf && folded.count(process_table.pid(row));
+            window.add(row, depth, leaf ? ' ' : fold ? '+' : '-');
+            if (leaf || fold) continue;
+            children.clear();
+            for (long c = process_table.first_child(row); c >= 0; c = process_table.next_sibling(c)) {
+                children.push_back((uint32_t)c);
             }
+            process_table.sort_rows(key, true, children);
+            for (size_t i = children.size(); i-- > 0;) stack.push_back(make_pair(children[i], depth + 1));
+        }
+    } else {
+        // Every process takes at least one row, so first + max_rows is enough
+        static vector<uint32_t> top;
+        process_table.top(key, first + max_rows, top);
+        for (size_t i = 0; i < top.size() && !window.full(); i++) window.add(top[i], 0, ' ');
+        
+        // PSS only for the rows on screen, each at most every 5 s, and
+        // never more than 10 ms of smaps_rollup per sample; the age is in
+        // scans, so convert from the (possibly stretched) process period
+        PhaseTimer pss(sample_phases, PHASE_PSS);
+        long scan_ms = live_sampler ? live_sampler->period(COLLECT_PROCESSES) : collector_periods[COLLECT_PROCESSES];
+        process_table.sample_memory(window.shown, scan_ms > 0 ? (unsigned)max(1L, 5000 / scan_ms) : 1, 10.0);
+        for (size_t i = 0, r = 0; i < snap.processes.size(); i++) {
+            ProcessInfo &p = snap.processes[i];
+            if (p.thread) continue;
+            p.pss_kb = process_table.pss_kb(window.shown[r]);
+            p.swap_kb = process_table.swap_kb(window.shown[r]);
+            r++;
         }
     }
-    return "Unknown CPU";
+    snap.process_first = first;
+    snap.process_total = total;
 }
 
-vector<float> cpu_history(60, 0); // Store 60 samples for graph
+PressureSampler pressure_sampler;
+CgroupTable cgroup_table;   // opened in main() when cgroup v2 is mounted
+atomic<bool> show_cgroups(false);   // toggled with 'g'
+atomic<int> cgroup_sort(CG_SORT_CPU);
+
+// Re-read every cgroup and copy out the first max_rows in cgroup_sort
+// order. The whole tree is sampled even while the panel is hidden, so
+// /metrics and a toggle back show current rates.
+void get_cgroups(size_t max_rows, vector<CgroupStats> &out) {
+    static vector<uint32_t> top;
+    PhaseTimer t(sample_phases, PHASE_CGROUPS);
+    cgroup_table.sample();
+    cgroup_table.top((CgroupSortKey)cgroup_sort.load(), max_rows, top);
+    out.resize(top.size());
+    for (size_t i = 0; i < top.size(); i++) out[i] = cgroup_table.stats(top[i]);
+}
+
+TripleBuffer<MonitorSnapshot> snapshots;
+MetricsServer *metrics_server = NULL;   // set when --listen is given
+
+// One sample per statistic, labelled with the window and the statistic.
+void write_window_stats(PromWriter &w, const char *name, const char *labels, size_t window,
+                        const StatsSummary &s) {
+    static const char *stat_names[] = {"min", "mean", "max", "p50", "p95", "p99"};
+    const float values[] = {s.min, s.mean, s.max, s.p50, s.p95, s.p99};
+    char label[24];
+    stats_window_label(window, label, sizeof(label));
+    string all;
+    for (int i = 0; i < 6; i++) {
+        all = labels ? labels : "";
+        PromWriter::label(all, "window", label);
+        PromWriter::label(all, "stat", stat_names[i]);
+        w.sample(name, all.c_str(), values[i]);
+    }
+}
 
-float get_cpu_usage() {
-    static unsigned long long last_total = 0, last_idle = 0;
-    ifstream stat("/proc/stat");
-    string line;
-    getline(stat, line);
+// Pre-render the /metrics response from what was just sampled. Top
+// processes come from the table the sampler already scanned.
+void render_metrics(const MonitorSnapshot &snap) {
+    static string body;
+    static string labels;
+    static vector<uint32_t> by_cpu, by_mem, by_io, rows;
+    static vector<uint32_t> cg_rows, cg_top;
+    body.clear();
+    PromWriter w(body);
+    char num[24];
     
-    istringstream iss(line.substr(5));
-    unsigned long long user, nice, system, idle, iowait, irq, softirq;
-    iss >> user >> nice >> system >> idle >> iowait >> irq >> softirq;
+    w.family("rplex_cpu_usage_percent", "gauge", "Busy CPU time over the last sample interval.");
+    w.sample("rplex_cpu_usage_percent", snap.cpu_usage);
+    w.family("rplex_cpu_core_usage_percent", "gauge", "Busy time of each logical CPU over the last sample interval.");
+    for (size_t i = 0; i < snap.core_usage.size(); i++) {
+        snprintf(num, sizeof(num), "%zu", i);
+        labels.clear();
+        PromWriter::label(labels, "core", num);
+        w.sample("rplex_cpu_core_usage_percent", labels.c_str(), snap.core_usage[i]);
+    }
     
-    unsigned long long total = user + nice + system + idle + iowait + irq + softirq;
-    unsigned long long total_diff = total - last_total;
-    unsigned long long idle_diff = idle - last_idle;
+    // Per-core statistics only over the shortest window, so hosts with
+    // hundreds of CPUs don't multiply the response by every window
+    w.family("rplex_cpu_usage_percent_window", "gauge", "CPU usage statistics over trailing windows.");
+    for (size_t i = 0; i < snap.cpu_stats.size(); i++) {
+        write_window_stats(w, "rplex_cpu_usage_percent_window", NULL, stats_windows[i], snap.cpu_stats[i]);
+    }
+    w.family("rplex_cpu_core_usage_percent_window", "gauge", "Per-CPU usage statistics over the shortest window.");
+    for (size_t i = 0; i < snap.core_usage.size() && i < core_stats.size(); i++) {
+        snprintf(num, sizeof(num), "%zu", i);
+        labels.clear();
+        PromWriter::label(labels, "core", num);
+        write_window_stats(w, "rplex_cpu_core_usage_percent_window", labels.c_str(), stats_windows[0],
+                           core_stats[i].summary());
+    }
     
-    last_total = total;
-    last_idle = idle;
+    w.family("rplex_memory_total_bytes", "gauge", "Physical memory.");
+    w.sample("rplex_memory_total_bytes", snap.mem_total * 1073741824.0);
+    w.family("rplex_memory_used_bytes", "gauge", "Physical memory that cannot be reclaimed (MemTotal - MemAvailable).");
+    w.sample("rplex_memory_used_bytes", snap.mem_used * 1073741824.0);
+    w.family("rplex_memory_available_bytes", "gauge", "MemAvailable from /proc/meminfo.");
+    w.sample("rplex_memory_available_bytes", snap.mem.available * 1024.0);
+    w.family("rplex_memory_page_cache_bytes", "gauge", "Buffers and page cache, excluding shared memory.");
+    w.sample("rplex_memory_page_cache_bytes", snap.mem.page_cache() * 1024.0);
+    w.family("rplex_memory_slab_bytes", "gauge", "Kernel slab allocations.");
+    w.sample("rplex_memory_slab_bytes", snap.mem.slab * 1024.0);
+    w.family("rplex_memory_dirty_bytes", "gauge", "Dirty pages waiting to be written, and pages being written back.");
+    labels.clear();
+    PromWriter::label(labels, "state", "dirty");
+    w.sample("rplex_memory_dirty_bytes", labels.c_str(), snap.mem.dirty * 1024.0);
+    labels.clear();
+    PromWriter::label(labels, "state", "writeback");
+    w.sample("rplex_memory_dirty_bytes", labels.c_str(), snap.mem.writeback * 1024.0);
+    w.family("rplex_swap_total_bytes", "gauge", "Swap space.");
+    w.sample("rplex_swap_total_bytes", snap.mem.swap_total * 1024.0);
+    w.family("rplex_swap_used_bytes", "gauge", "Swap space in use.");
+    w.sample("rplex_swap_used_bytes", snap.mem.swap_used() * 1024.0);
+    w.family("rplex_memory_used_percent_window", "gauge", "Memory usage statistics over trailing windows.");
+    for (size_t i = 0; i < snap.mem_stats.size(); i++) {
+        write_window_stats(w, "rplex_memory_used_percent_window", NULL, stats_windows[i], snap.mem_stats[i]);
+    }
     
-    float usage = 0.0f;
-    if (total_diff > 0) {
-        usage = 100.0f * (total_diff - idle_diff) / total_diff;
+    w.family("rplex_network_receive_bytes_per_second", "gauge", "Bytes received per interface over the last sample interval.");
+    for (size_t i = 0; i < snap.net.interfaces.size(); i++) {
+        labels.clear();
+        PromWriter::label(labels, "interface", snap.net.interfaces[i].name);
+        w.sample("rplex_network_receive_bytes_per_second", labels.c_str(), snap.net.interfaces[i].rx_bytes);
+    }
+    w.family("rplex_network_transmit_bytes_per_second", "gauge", "Bytes sent per interface over the last sample interval.");
+    for (size_t i = 0; i < snap.net.interfaces.size(); i++) {
+        labels.clear();
+        PromWriter::label(labels, "interface", snap.net.interfaces[i].name);
+        w.sample("rplex_network_transmit_bytes_per_second", labels.c_str(), snap.net.interfaces[i].tx_bytes);
     }
+    w.family("rplex_tcp_retransmits_per_second", "gauge", "TCP segments retransmitted over the last sample interval.");
+    w.sample("rplex_tcp_retransmits_per_second", snap.net.tcp_retransmits);
+    w.family("rplex_tcp_established", "gauge", "TCP connections in ESTABLISHED or CLOSE_WAIT.");
+    w.sample("rplex_tcp_established", snap.net.tcp_established);
+    w.family("rplex_sockets_used", "gauge", "Sockets in use, from /proc/net/sockstat.");
+    w.sample("rplex_sockets_used", snap.net.sockets_used);
     
-    // Update history
-    cpu_history.erase(cpu_history.begin());
-    cpu_history.push_back(usage);
+    w.family("rplex_disk_read_bytes_per_second", "gauge", "Bytes read per disk over the last sample interval.");
+    for (size_t i = 0; i < snap.disks.size(); i++) {
+        labels.clear();
+        PromWriter::label(labels, "device", snap.disks[i].name);
+        w.sample("rplex_disk_read_bytes_per_second", labels.c_str(), snap.disks[i].read_bytes);
+    }
+    w.family("rplex_disk_write_bytes_per_second", "gauge", "Bytes written per disk over the last sample interval.");
+    for (size_t i = 0; i < snap.disks.size(); i++) {
+        labels.clear();
+        PromWriter::label(labels, "device", snap.disks[i].name);
+        w.sample("rplex_disk_write_bytes_per_second", labels.c_str(), snap.disks[i].write_bytes);
+    }
+    w.family("rplex_disk_utilisation_percent", "gauge", "Share of the last sample interval each disk had I/O in flight.");
+    for (size_t i = 0; i < snap.disks.size(); i++) {
+        labels.clear();
+        PromWriter::label(labels, "device", snap.disks[i].name);
+        w.sample("rplex_disk_utilisation_percent", labels.c_str(), snap.disks[i].utilisation);
+    }
+    w.family("rplex_disk_queue_depth", "gauge", "Average requests in flight per disk over the last sample interval.");
+    for (size_t i = 0; i < snap.disks.size(); i++) {
+        labels.clear();
+        PromWriter::label(labels, "device", snap.disks[i].name);
+        w.sample("rplex_disk_queue_depth", labels.c_str(), snap.disks[i].queue_depth);
+    }
+    w.family("rplex_filesystem_size_bytes", "gauge", "Size of each mounted block-device filesystem.");
+    for (size_t i = 0; i < snap.filesystems.size(); i++) {
+        labels.clear();
+        PromWriter::label(labels, "mountpoint", snap.filesystems[i].mount);
+        w.sample("rplex_filesystem_size_bytes", labels.c_str(), snap.filesystems[i].total_bytes);
+    }
+    w.family("rplex_filesystem_avail_bytes", "gauge", "Space left for unprivileged users on each filesystem.");
+    for (size_t i = 0; i < snap.filesystems.size(); i++) {
+        labels.clear();
+        PromWriter::label(labels, "mountpoint", snap.filesystems[i].mount);
+        w.sample("rplex_filesystem_avail_bytes", labels.c_str(), snap.filesystems[i].avail_bytes);
+    }
     
-    return usage;
+    // Host pressure stall information, "some" and "full" per resource
+    static const char *resources[] = {"cpu", "memory", "io"};
+    const Pressure *host_pressure[] = {&snap.pressure.cpu, &snap.pressure.memory, &snap.pressure.io};
+    w.family("rplex_pressure_stalled_seconds_total", "counter", "Time some or all runnable tasks were stalled, from /proc/pressure.");
+    for (int r = 0; r < 3; r++) {
+        if (!host_pressure[r]->available) continue;
+        labels.clear();
+        PromWriter::label(labels, "resource", resources[r]);
+        PromWriter::label(labels, "kind", "some");
+        w.sample("rplex_pressure_stalled_seconds_total", labels.c_str(), host_pressure[r]->some_total / 1e6);
+        labels.clear();
+        PromWriter::label(labels, "resource", resources[r]);
+        PromWriter::label(labels, "kind", "full");
+        w.sample("rplex_pressure_stalled_seconds_total", labels.c_str(), host_pressure[r]->full_total / 1e6);
+    }
+    w.family("rplex_pressure_avg10_percent", "gauge", "Share of the last 10 seconds some or all runnable tasks were stalled.");
+    for (int r = 0; r < 3; r++) {
+        if (!host_pressure[r]->available) continue;
+        labels.clear();
+        PromWriter::label(labels, "resource", resources[r]);
+        PromWriter::label(labels, "kind", "some");
+        w.sample("rplex_pressure_avg10_percent", labels.c_str(), host_pressure[r]->some_avg10);
+        labels.clear();
+        PromWriter::label(labels, "resource", resources[r]);
+        PromWriter::label(labels, "kind", "full");
+        w.sample("rplex_pressure_avg10_percent", labels.c_str(), host_pressure[r]->full_avg10);
+    }
+    
+    // Top 10 cgroups by CPU, memory, I/O and pressure, each cgroup once
+    if (cgroup_table.is_open()) {
+        static const CgroupSortKey cg_keys[] = {CG_SORT_CPU, CG_SORT_MEM, CG_SORT_IO, CG_SORT_PRESSURE};
+        cg_rows.clear();
+        for (int k = 0; k < 4; k++) {
+            cgroup_table.top(cg_keys[k], 10, cg_top);
+            for (size_t i = 0; i < cg_top.size(); i++) {
+                if (find(cg_rows.begin(), cg_rows.end(), cg_top[i]) == cg_rows.end()) cg_rows.push_back(cg_top[i]);
+            }
+        }
+        w.family("rplex_cgroups", "gauge", "Cgroups in the last walk of the cgroup v2 hierarchy.");
+        w.sample("rplex_cgroups", cgroup_table.size());
+        w.family("rplex_cgroup_cpu_usage_percent", "gauge", "CPU usage of the busiest cgroups, descendants included.");
+        for (size_t i = 0; i < cg_rows.size(); i++) {
+            const CgroupStats &c = cgroup_table.stats(cg_rows[i]);
+            labels.clear();
+            PromWriter::label(labels, "cgroup", c.path);
+            w.sample("rplex_cgroup_cpu_usage_percent", labels.c_str(), c.cpu_percent);
+        }
+        w.family("rplex_cgroup_memory_bytes", "gauge", "memory.current of the largest cgroups.");
+        for (size_t i = 0; i < cg_rows.size(); i++) {
+            const CgroupStats &c = cgroup_table.stats(cg_rows[i]);
+            if (c.memory_bytes < 0) continue;
+            labels.clear();
+            PromWriter::label(labels, "cgroup", c.path);
+            w.sample("rplex_cgroup_memory_bytes", labels.c_str(), (double)c.memory_bytes);
+        }
+        w.family("rplex_cgroup_io_read_bytes_per_second", "gauge", "Storage reads of the busiest cgroups.");
+        for (size_t i = 0; i < cg_rows.size(); i++) {
+            const CgroupStats &c = cgroup_table.stats(cg_rows[i]);
+            labels.clear();
+            PromWriter::label(labels, "cgroup", c.path);
+            w.sample("rplex_cgroup_io_read_bytes_per_second", labels.c_str(), c.io_read_bytes);
+        }
+        w.family("rplex_cgroup_io_write_bytes_per_second", "gauge", "Storage writes of the busiest cgroups.");
+        for (size_t i = 0; i < cg_rows.size(); i++) {
+            const CgroupStats &c = cgroup_table.stats(cg_rows[i]);
+            labels.clear();
+            PromWriter::label(labels, "cgroup", c.path);
+            w.sample("rplex_cgroup_io_write_bytes_per_second", labels.c_str(), c.io_write_bytes);
+        }
+        w.family("rplex_cgroup_pressure_avg10_percent", "gauge", "Share of the last 10 seconds some tasks of the cgroup were stalled.");
+        for (size_t i = 0; i < cg_rows.size(); i++) {
+            const CgroupStats &c = cgroup_table.stats(cg_rows[i]);
+            const Pressure *cg_pressure[] = {&c.cpu, &c.memory, &c.io};
+            for (int r = 0; r < 3; r++) {
+                if (!cg_pressure[r]->available) continue;
+                labels.clear();
+                PromWriter::label(labels, "cgroup", c.path);
+                PromWriter::label(labels, "resource", resources[r]);
+                w.sample("rplex_cgroup_pressure_avg10_percent", labels.c_str(), cg_pressure[r]->some_avg10);
+            }
+        }
+        w.family("rplex_cgroup_processes", "gauge", "Processes in the cgroup and its descendants.");
+        for (size_t i = 0; i < cg_rows.size(); i++) {
+            const CgroupStats &c = cgroup_table.stats(cg_rows[i]);
+            labels.clear();
+            PromWriter::label(labels, "cgroup", c.path);
+            w.sample("rplex_cgroup_processes", labels.c_str(), c.total_procs);
+        }
+    }
+    
+    w.family("rplex_processes", "gauge", "Processes seen in the last /proc scan.");
+    w.sample("rplex_processes", process_table.size());
+    if (process_tracker.event_driven()) {
+        w.family("rplex_process_forks_total", "counter", "Processes forked, from the proc connector.");
+        w.sample("rplex_process_forks_total", process_tracker.forks());
+        w.family("rplex_process_execs_total", "counter", "Program executions, from the proc connector.");
+        w.sample("rplex_process_execs_total", process_tracker.execs());
+        w.family("rplex_process_exits_total", "counter", "Processes exited, from the proc connector.");
+        w.sample("rplex_process_exits_total", process_tracker.exits());
+        w.family("rplex_process_short_lived_total", "counter", "Processes that exited before any sample saw them.");
+        w.sample("rplex_process_short_lived_total", process_tracker.short_lived());
+    }
+    
+    // Top 10 by CPU, memory and I/O, each process once
+    process_table.top(SORT_CPU, 10, by_cpu);
+    process_table.top(SORT_MEM, 10, by_mem);
+    process_table.top(SORT_IO, 10, by_io);
+    rows = by_cpu;
+    for (size_t i = 0; i < by_mem.size(); i++) {
+        if (find(rows.begin(), rows.end(), by_mem[i]) == rows.end()) rows.push_back(by_mem[i]);
+    }
+    for (size_t i = 0; i < by_io.size(); i++) {
+        if (find(rows.begin(), rows.end(), by_io[i]) == rows.end()) rows.push_back(by_io[i]);
+    }
+    w.family("rplex_process_cpu_usage_percent", "gauge", "CPU usage of the busiest and largest processes.");
+    for (size_t i = 0; i < rows.size(); i++) {
+        snprintf(num, sizeof(num), "%d", process_table.pid(rows[i]));
+        labels.clear();
+        PromWriter::label(labels, "pid", num);
+        PromWriter::label(labels, "name", process_table.name(rows[i]));
+        w.sample("rplex_process_cpu_usage_percent", labels.c_str(), process_table.cpu_percent(rows[i]));
+    }
+    w.family("rplex_process_resident_bytes", "gauge", "Resident memory of the busiest and largest processes.");
+    for (size_t i = 0; i < rows.size(); i++) {
+        snprintf(num, sizeof(num), "%d", process_table.pid(rows[i]));
+        labels.clear();
+        PromWriter::label(labels, "pid", num);
+        PromWriter::label(labels, "name", process_table.name(rows[i]));
+        w.sample("rplex_process_resident_bytes", labels.c_str(), process_table.rss_kb(rows[i]) * 1024.0);
+    }
+    w.family("rplex_process_io_read_bytes_per_second", "gauge", "Storage reads of the busiest processes.");
+    for (size_t i = 0; i < rows.size(); i++) {
+        if (!process_table.io_available(rows[i])) continue;
+        snprintf(num, sizeof(num), "%d", process_table.pid(rows[i]));
+        labels.clear();
+        PromWriter::label(labels, "pid", num);
+        PromWriter::label(labels, "name", process_table.name(rows[i]));
+        w.sample("rplex_process_io_read_bytes_per_second", labels.c_str(), process_table.io_read_rate(rows[i]));
+    }
+    w.family("rplex_process_io_write_bytes_per_second", "gauge", "Storage writes of the busiest processes.");
+    for (size_t i = 0; i < rows.size(); i++) {
+        if (!process_table.io_available(rows[i])) continue;
+        snprintf(num, sizeof(num), "%d", process_table.pid(rows[i]));
+        labels.clear();
+        PromWriter::label(labels, "pid", num);
+        PromWriter::label(labels, "name", process_table.name(rows[i]));
+        w.sample("rplex_process_io_write_bytes_per_second", labels.c_str(), process_table.io_write_rate(rows[i]));
+    }
+    
+    // Plugin metrics under their own prefix, so no name a plugin picks
+    // can repeat one of the families above; NAN (unknown) is left out
+    const vector<MetricField> &fields = plugins.fields();
+    for (size_t i = 0; i < fields.size() && i < snap.plugins.size(); i++) {
+        string name = "rplex_plugin_" + fields[i].name;
+        w.family(name.c_str(), "gauge", fields[i].help.c_str());
+        if (!std::isnan(snap.plugins[i])) w.sample(name.c_str(), snap.plugins[i]);
+    }
+    
+    w.family("rplex_last_sample_timestamp_seconds", "gauge", "When the values above were sampled.");
+    w.sample("rplex_last_sample_timestamp_seconds", (double)time(0));
+    w.family("rplex_scrapes_total", "counter", "Scrapes answered by this endpoint.");
+    w.sample("rplex_scrapes_total", metrics_server->scrapes());
+    metrics_server->set_body(body);
 }
 
-vector<float> mem_history(60, 0); // Store 60 samples for graph
+Recorder *recorder = NULL;   // set when --record is given
+FleetAgent *fleet_agent = NULL;   // set when --agent is given
+FlightRecorder *flight_recorder = NULL;   // set when --flight or --trigger is given
 
-void get_ram_info(float &total, float &used, float &percent) {
-    struct sysinfo memInfo;
-    sysinfo(&memInfo);
-    
-    total = memInfo.totalram / (1024.0f * 1024 * 1024);
-    used = (memInfo.totalram - memInfo.freeram) / (1024.0f * 1024 * 1024);
-    percent = (used / total) * 100.0f;
-    
-    // Update history
-    mem_history.erase(mem_history.begin());
-    mem_history.push_back(percent);
+// The sample as recordings and fleet viewers get it: system totals and
+// the whole process table.
+RecordedFrame export_frame;
+
+void fill_export_frame(const MonitorSnapshot &snap) {
+    RecordedFrame &frame = export_frame;
+    frame.time_us = chrono::duration_cast<chrono::microseconds>(
+        chrono::system_clock::now().time_since_epoch()).count();
+    frame.cpu_usage = snap.cpu_usage;
+    frame.mem_total = snap.mem_total;
+    frame.mem_used = snap.mem_used;
+    frame.cores = snap.core_usage;
+    frame.processes.resize(process_table.size());
+    for (size_t i = 0; i < process_table.size(); i++) {
+        RecordedProcess &p = frame.processes[i];
+        p.pid = process_table.pid(i);
+        p.cpu = process_table.cpu_percent(i);
+        p.rss_kb = process_table.rss_kb(i);
+        strncpy(p.name, process_table.name(i), sizeof(p.name) - 1);
+        p.name[sizeof(p.name) - 1] = '\0';
+    }
 }
 
-vector<ProcessInfo> get_processes(int max_processes = 5) {
-    vector<ProcessInfo> processes;
-    DIR *dir;
-    struct dirent *ent;
-    
-    if ((dir = opendir("/proc")) != NULL) {
-        while ((ent = readdir(dir)) != NULL && processes.size() < (size_t)max_processes) {
-            if (ent->d_type == DT_DIR && isdigit(ent->d_name[0])) {
-                int pid = atoi(ent->d_name);
-                string pid_str = ent->d_name;
-                
-                // Get process name
-                ifstream cmdline("/proc/" + pid_str + "/comm");
-                string name;
-                getline(cmdline, name);
-                
-                if (!name.empty()) {
-                    // Get process stats
-                    ifstream stat("/proc/" + pid_str + "/stat");
-                    string stat_line;
-                    getline(stat, stat_line);
-                    
-                    istringstream stat_iss(stat_line);
-                    string dummy;
-                    for (int i = 0; i < 13; i++) stat_iss >> dummy;
-                    unsigned long utime, stime;
-                    stat_iss >> utime >> stime;
-                    float cpu_usage = (utime + stime) / sysconf(_SC_CLK_TCK);
-                    
-                    // Get memory usage
-                    ifstream status("/proc/" + pid_str + "/status");
-                    string status_line;
-                    long vm_rss = 0;
-                    while (getline(status, status_line)) {
-                        if (status_line.find("VmRSS:") == 0) {
-                            istringstream iss(status_line.substr(6));
-                            iss >> vm_rss;
-                            break;
-                        }
-                    }
-                    
-                    processes.push_back({
-                        pid,
-                        name,
-                        to_string(vm_rss / 1024) + " MB",
-                        to_string(cpu_usage) + "%"
-                    });
-                }
-            }
+// Add one part to the header status of the live snapshot.
+void add_status(MonitorSnapshot &snap, const char *text) {
+    if (!snap.status.empty()) snap.status += ' ';
+    snap.status += text;
+}
+
+// Append the sample to the recording.
+void record_sample(MonitorSnapshot &snap) {
+    char status[48];
+    if (recorder->write(export_frame)) {
+        snprintf(status, sizeof(status), "REC %.1f MB", recorder->bytes() / 1048576.0);
+    } else {
+        snprintf(status, sizeof(status), "REC FAILED");
+    }
+    add_status(snap, status);
+}
+
+// Rate, whether a capture is under way, and the dumps written so far
+// with any samples they are missing.
+void flight_status(MonitorSnapshot &snap) {
+    char status[160];
+    int n = snprintf(status, sizeof(status), "FLIGHT %dHz%s", flight_recorder->hz(),
+                     flight_recorder->capturing() ? " CAPTURING" : "");
+    unsigned dumps = flight_recorder->dumps();
+    if (dumps) {
+        string last = flight_recorder->last_dump();
+        size_t slash = last.rfind('/');
+        n += snprintf(status + n, sizeof(status) - n, " %u dump%s, last %s", dumps, dumps == 1 ? "" : "s",
+                      last.c_str() + (slash == string::npos ? 0 : slash + 1));
+    }
+    unsigned long lost = flight_recorder->lost();
+    if (lost && n < (int)sizeof(status)) snprintf(status + n, sizeof(status) - n, " (%lu samples lost)", lost);
+    add_status(snap, status);
+}
+
+// rplex's own cost, and how far the CPU budget stretches the periods.
+void sample_self(MonitorSnapshot &snap) {
+    self_monitor.sample(snap.self);
+    if (live_sampler && overhead_budget.update(snap.self.cpu_percent)) {
+        live_sampler->set_stretch(overhead_budget.factor());
+        sample_repeat = live_sampler->stretch();
+    }
+    snap.stretch = live_sampler ? live_sampler->stretch() : 1;
+    snap.cpu_budget = overhead_budget.budget();
+}
+
+// The collectors below run on the live sampler thread and each fill
+// their part of live_snapshot; publish_live() hands a copy to the UI.
+MonitorSnapshot live_snapshot;
+
+void collect_hardware() {
+    live_snapshot.cpu_model = get_cpu_info();
+}
+
+void collect_cpu() {
+    PhaseTimer t(sample_phases, PHASE_CPU);
+    live_snapshot.cpu_usage = get_cpu_usage(live_snapshot.core_usage);
+}
+
+void collect_memory() {
+    PhaseTimer t(sample_phases, PHASE_MEMORY);
+    MonitorSnapshot &snap = live_snapshot;
+    get_ram_info(snap.mem_total, snap.mem_used, snap.mem_percent, snap.mem);
+}
+
+void collect_network() {
+    PhaseTimer t(sample_phases, PHASE_NETWORK);
+    get_net_stats(live_snapshot.net);
+}
+
+void collect_disk() {
+    PhaseTimer t(sample_phases, PHASE_DISK);
+    disk_sampler.sample(live_snapshot.disks);
+    disk_sampler.filesystems(live_snapshot.filesystems);
+}
+
+void collect_processes() {
+    MonitorSnapshot &snap = live_snapshot;
+    snap.sort = (ProcSortKey)process_sort.load();
+    get_processes((size_t)max(0, process_rows.load()), snap);
+    if (flight_recorder) {
+        // The busiest of this scan are the ones followed at the flight rate
+        static vector<uint32_t> top;
+        static vector<int> pids;
+        process_table.top(SORT_CPU, FlightRecorder::PROCESSES, top);
+        pids.resize(top.size());
+        for (size_t i = 0; i < top.size(); i++) pids[i] = process_table.pid(top[i]);
+        flight_recorder->set_candidates(pids);
+    }
+    snap.proc_events = process_tracker.event_driven();
+    snap.forks = process_tracker.last_forks();
+    snap.exits = process_tracker.last_exits();
+    snap.short_lived = process_tracker.last_short_lived();
+    const RingBuffer<ShortLivedProcess> &recent = process_tracker.recent_short_lived();
+    strcpy(snap.last_short_lived, recent.empty() ? "" : recent.back().name);
+}
+
+void collect_cgroups() {
+    MonitorSnapshot &snap = live_snapshot;
+    {
+        PhaseTimer t(sample_phases, PHASE_CGROUPS);
+        pressure_sampler.sample(snap.pressure);
+    }
+    snap.show_cgroups = show_cgroups;
+    snap.cgroup_sort = (CgroupSortKey)cgroup_sort.load();
+    snap.have_cgroups = cgroup_table.is_open();
+    get_cgroups(snap.show_cgroups ? process_rows.load() : 0, snap.cgroups);
+}
+
+void collect_plugins() {
+    if (!plugins.size()) return;
+    PhaseTimer t(sample_phases, PHASE_PLUGINS);
+    plugins.sample();
+    live_snapshot.plugins.assign(plugins.values(), plugins.values() + plugins.size());
+}
+
+// Graph tails and window statistics; cheap enough for every publish.
+void finish_snapshot(MonitorSnapshot &snap) {
+    snap.taken = time(0);
+    size_t tier = history_tier.load();
+    cpu_history.tail(tier, 60, snap.cpu_history);
+    mem_history.tail(tier, 60, snap.mem_history);
+    net_history.tail(tier, 60, snap.net_history);
+    snap.history_step = cpu_history.samples_per_point(tier) * collector_periods[COLLECT_CPU] / 1000.0f;
+    cpu_stats.summaries(snap.cpu_stats);
+    mem_stats.summaries(snap.mem_stats);
+}
+
+// /metrics, the recording and the self-profile, on their own period;
+// a self-profile frame is everything sampled since the last export.
+void collect_export() {
+    MonitorSnapshot &snap = live_snapshot;
+    finish_snapshot(snap);
+    if (metrics_server) {
+        PhaseTimer t(sample_phases, PHASE_METRICS);
+        render_metrics(snap);
+    }
+    snap.status.clear();
+    if (recorder || fleet_agent) fill_export_frame(snap);
+    if (recorder) {
+        PhaseTimer t(sample_phases, PHASE_RECORD);
+        record_sample(snap);
+    }
+    if (fleet_agent) {
+        PhaseTimer t(sample_phases, PHASE_AGENT);
+        fleet_agent->publish(export_frame);
+        char viewers[32];
+        snprintf(viewers, sizeof(viewers), "AGENT %zu viewers", fleet_agent->viewers());
+        add_status(snap, viewers);
+    }
+    if (flight_recorder) flight_status(snap);
+    if (!snap.plugins.empty()) {
+        char line[256];
+        format_metrics(plugins.fields(), snap.plugins, line, sizeof(line));
+        add_status(snap, line);
+    }
+    sample_phases.end_frame();
+    snap.phases.assign(sample_phases.summaries(), sample_phases.summaries() + sample_phases.size());
+    sample_self(snap);
+}
+
+void publish_live() {
+    finish_snapshot(live_snapshot);
+    snapshots.back() = live_snapshot;
+    snapshots.publish();
+    ui_wakeup.notify();
+}
+
+void start_live_sampler(CollectorThread &sampler) {
+    static void (*const collect[COLLECTORS])() = {
+        collect_hardware, collect_cpu, collect_memory, collect_network, collect_disk,
+        collect_processes, collect_cgroups, collect_plugins, collect_export};
+    for (int i = 0; i < COLLECTORS; i++) sampler.add(collector_names[i], collector_periods[i], collect[i]);
+    live_sampler = &sampler;
+    sampler.start(publish_live);
+}
+
+// Parse --intervals, e.g. "cpu=500,processes=5000".
+bool parse_intervals(const char *list) {
+    const char *p = list;
+    while (*p) {
+        const char *eq = strchr(p, '=');
+        if (!eq) return false;
+        int found = -1;
+        for (int i = 0; i < COLLECTORS; i++) {
+            if (strlen(collector_names[i]) == (size_t)(eq - p) && strncmp(collector_names[i], p, eq - p) == 0) found = i;
         }
-        closedir(dir);
+        char *end;
+        long ms = strtol(eq + 1, &end, 10);
+        if (found < 0 || end == eq + 1 || ms < 0 || (*end && *end != ',')) return false;
+        collector_periods[found] = ms;
+        p = *end ? end + 1 : end;
     }
+    return true;
+}
+
+// Replay state. The UI changes these; the replay sampler applies them.
+atomic<bool> replay_paused(false);
+atomic<int> replay_speed(1);
+atomic<int> replay_seek(0);   // seconds to jump, consumed by the sampler
+
+bool process_before(const RecordedProcess &a, const RecordedProcess &b, ProcSortKey key) {
+    switch (key) {
+    case SORT_MEM: if (a.rss_kb != b.rss_kb) return a.rss_kb > b.rss_kb; break;
+    case SORT_NAME: {
+        int c = strcmp(a.name, b.name);
+        if (c != 0) return c < 0;
+        break;
+    }
+    case SORT_PID: break;
+    default: if (a.cpu != b.cpu) return a.cpu > b.cpu; break;
+    }
+    return a.pid < b.pid;
+}
+
+// Fill the dashboard from a recorded or streamed sample. Graphs and
+// statistics come from cpu_history and friends, which the caller feeds.
+void snapshot_from_frame(const RecordedFrame &state, const string &cpu_model, float sample_seconds,
+                         MonitorSnapshot &snap) {
+    static vector<RecordedProcess> order;
+    snap.cpu_model = cpu_model;
+    snap.cpu_usage = state.cpu_usage;
+    snap.core_usage = state.cores;
+    snap.mem_total = state.mem_total;
+    snap.mem_used = state.mem_used;
+    snap.mem_percent = state.mem_total > 0 ? state.mem_used / state.mem_total * 100.0f : 0;
+    memset(&snap.mem, 0, sizeof(snap.mem));   // only totals are recorded
+    size_t tier = history_tier.load();
+    cpu_history.tail(tier, 60, snap.cpu_history);
+    mem_history.tail(tier, 60, snap.mem_history);
+    snap.history_step = cpu_history.samples_per_point(tier) * sample_seconds;
+    cpu_stats.summaries(snap.cpu_stats);
+    mem_stats.summaries(snap.mem_stats);
+    snap.sort = (ProcSortKey)process_sort.load();
+    snap.proc_events = false;
+    // Samples hold neither PSI nor cgroups
+    memset(&snap.pressure, 0, sizeof(snap.pressure));
+    snap.show_cgroups = show_cgroups;
+    snap.cgroup_sort = (CgroupSortKey)cgroup_sort.load();
+    snap.cgroups.clear();
+    snap.have_cgroups = false;
+    snap.phases.clear();
+    sample_self(snap);
     
-    // Sort by CPU usage (descending)
-    sort(processes.begin(), processes.end(), [](const ProcessInfo &a, const ProcessInfo &b) {
-        return stof(a.cpu.substr(0, a.cpu.size()-1)) > stof(b.cpu.substr(0, b.cpu.size()-1));
-    });
+    order = state.processes;
+    size_t rows = min(order.size(), (size_t)max(0, process_rows.load()));
+    ProcSortKey key = snap.sort;
+    partial_sort(order.begin(), order.begin() + rows, order.end(),
+                 [key](const RecordedProcess &a, const RecordedProcess &b) { return process_before(a, b, key); });
+    snap.processes.resize(rows);
+    for (size_t i = 0; i < rows; i++) {
+        snap.processes[i].pid = order[i].pid;
+        memcpy(snap.processes[i].name, order[i].name, sizeof(order[i].name));
+        snap.processes[i].rss_kb = order[i].rss_kb;
+        snap.processes[i].cpu = order[i].cpu;
+        snap.processes[i].io_read = snap.processes[i].io_write = 0;
+        snap.processes[i].pss_kb = snap.processes[i].swap_kb = -1;
+        snap.processes[i].depth = 0;
+        snap.processes[i].fold = ' ';
+        snap.processes[i].thread = false;
+        snap.processes[i].tree_cpu = order[i].cpu;
+        snap.processes[i].tree_rss_kb = order[i].rss_kb;
+    }
+    // Recordings have neither PPIDs nor threads
+    snap.process_tree = false;
+    snap.process_first = 0;
+    snap.process_total = rows;
+}
+
+// Runs on the replay sampler thread every 100 ms: advance the virtual
+// clock by speed x 100 ms, apply the frames it passed and publish.
+void replay_step(Recording &rec) {
+    static RecordedFrame state;
+    static int64_t clock_us = -1;
+    const int64_t tick_us = 100000;
     
-    return processes;
+    bool changed = false;
+    int seek = replay_seek.exchange(0);
+    if (clock_us < 0 || seek != 0) {
+        int64_t target = clock_us < 0 ? rec.start_time() : clock_us + seek * 1000000LL;
+        target = max(rec.start_time(), min(target, rec.end_time()));
+        // Start a minute early so the graphs have history to show
+        rec.seek(target - 60 * 1000000LL);
+        cpu_history.clear();
+        mem_history.clear();
+        cpu_stats.clear();
+        mem_stats.clear();
+        clock_us = target;
+        changed = true;
+    } else if (!replay_paused) {
+        clock_us += tick_us * replay_speed.load();
+    }
+    
+    int64_t t;
+    while ((t = rec.peek_time()) >= 0 && t <= clock_us && rec.next(state)) {
+        float mem_percent = state.mem_total > 0 ? state.mem_used / state.mem_total * 100.0f : 0;
+        cpu_history.push(state.cpu_usage);
+        mem_history.push(mem_percent);
+        cpu_stats.push(state.cpu_usage);
+        mem_stats.push(mem_percent);
+        changed = true;
+    }
+    if (t < 0 && !replay_paused) {
+        replay_paused = true;   // stop at the end of the recording
+        clock_us = rec.end_time();
+        changed = true;
+    }
+    static bool was_paused = false;
+    static int last_speed = 1;
+    static int last_sort = -1, last_rows = -1, last_tier = -1;
+    static bool last_cgroups = false;
+    changed = changed || was_paused != replay_paused || last_speed != replay_speed ||
+              last_sort != process_sort || last_rows != process_rows || last_tier != history_tier ||
+              last_cgroups != show_cgroups;
+    if (!changed) return;
+    was_paused = replay_paused;
+    last_speed = replay_speed;
+    last_sort = process_sort;
+    last_rows = process_rows;
+    last_tier = history_tier;
+    last_cgroups = show_cgroups;
+    
+    MonitorSnapshot &snap = snapshots.back();
+    snapshot_from_frame(state, rec.cpu_model(), rec.sample_seconds(), snap);
+    snap.taken = clock_us / 1000000;
+    char status[192];
+    int percent = rec.end_time() > rec.start_time() ?
+        (int)(100 * (clock_us - rec.start_time()) / (rec.end_time() - rec.start_time())) : 100;
+    // Flight recorder dumps say which rule fired
+    snprintf(status, sizeof(status), "REPLAY %3d%% x%d%s%s%s", percent, replay_speed.load(),
+             replay_paused ? " paused" : "", rec.note()[0] ? "  " : "", rec.note());
+    snap.status = status;
+    snapshots.publish();
+    ui_wakeup.notify();
 }
 
 void draw_box(WINDOW *win, int y, int x, int h, int w, const string &title) {
@@ -232,25 +1220,54 @@ void init_colors() {
     init_pair(COLOR_GRAPH, COLOR_RED, COLOR_BLACK);
 }
 
-void display_header(WINDOW *win) {
+void display_header(WINDOW *win, const char *time_str, const string &status, unsigned long long frame_bytes) {
     wattron(win, COLOR_PAIR(COLOR_TITLE) | A_BOLD);
     mvwprintw(win, 0, 2, " RPLEX System Monitor v1.4 ");
+    if (!status.empty()) wprintw(win, " %s ", status.c_str());
     wattroff(win, COLOR_PAIR(COLOR_TITLE) | A_BOLD);
     
-    // Show current time
-    time_t now = time(0);
-    tm *ltm = localtime(&now);
-    char time_str[20];
-    strftime(time_str, sizeof(time_str), "%H:%M:%S", ltm);
-    mvwprintw(win, 0, COLS - strlen(time_str) - 2, " %s ", time_str);
+    // Terminal bytes sent for the previous frame, then the current time
+    mvwprintw(win, 0, getmaxx(win) - strlen(time_str) - 22, "tx %6llu B/frame", frame_bytes);
+    mvwprintw(win, 0, getmaxx(win) - strlen(time_str) - 2, " %s ", time_str);
+}
+
+float graph_scale(const vector<SeriesPoint> &values) {
+    float max_val = 0;
+    for (size_t i = 0; i < values.size(); i++) max_val = max(max_val, values[i].avg);
+    return max_val == 0 ? 1 : max_val;
 }
 
-void display_cpu_stats(WINDOW *win, int y, int x) {
-    float cpu_usage = get_cpu_usage();
+// Bytes (or bytes per second) with a binary suffix, e.g. "12.3M".
+void format_rate(double bytes, char *out, size_t cap) {
+    static const char units[] = "BKMGT";
+    int u = 0;
+    while (bytes >= 1024 && u < 4) {
+        bytes /= 1024;
+        u++;
+    }
+    snprintf(out, cap, u == 0 ? "%.0f%c" : "%.1f%c", bytes, units[u]);
+}
+
+// Shortest-window statistics on one line, cut to fit before the border.
+void display_window_stats(WINDOW *win, int y, int x, const char *prefix, const vector<StatsSummary> &stats) {
+    if (stats.empty()) return;
+    const StatsSummary &s = stats[0];
+    char label[24], line[160];
+    stats_window_label(stats_windows[0], label, sizeof(label));
+    snprintf(line, sizeof(line), "%s%s: avg %.1f p50 %.1f p95 %.1f p99 %.1f max %.1f",
+             prefix, label, s.mean, s.p50, s.p95, s.p99, s.max);
+    mvwprintw(win, y, x, "%.*s", max(0, getmaxx(win) - x - 2), line);
+}
+
+void display_cpu_stats(WINDOW *win, int y, int x, const MonitorSnapshot &snap) {
+    float cpu_usage = snap.cpu_usage;
+    char history[32];
+    snprintf(history, sizeof(history), "%gs/col  ", snap.history_step);
     
     wattron(win, COLOR_PAIR(COLOR_CPU));
-    mvwprintw(win, y, x, "CPU: %s", get_cpu_info().c_str());
+    mvwprintw(win, y, x, "CPU: %s", snap.cpu_model.c_str());
     mvwprintw(win, y+1, x, "Usage: %.1f%%", cpu_usage);
+    display_window_stats(win, y+2, x, history, snap.cpu_stats);
     
     // Draw CPU bar
     wattron(win, COLOR_PAIR(COLOR_BAR));
@@ -266,18 +1283,28 @@ void display_cpu_stats(WINDOW *win, int y, int x) {
     }
     wprintw(win, "]");
     wattroff(win, COLOR_PAIR(COLOR_BAR));
-    
-    // Draw CPU graph
-    draw_graph(win, y+3, x, cpu_history, 60, 8, COLOR_GRAPH);
     wattroff(win, COLOR_PAIR(COLOR_CPU));
 }
 
-void display_mem_stats(WINDOW *win, int y, int x) {
-    float total, used, percent;
-    get_ram_info(total, used, percent);
+void display_mem_stats(WINDOW *win, int y, int x, const MonitorSnapshot &snap) {
+    float total = snap.mem_total, used = snap.mem_used, percent = snap.mem_percent;
+    
+    const MemInfo &m = snap.mem;
+    char cache[16], slab[16], swap_used[16], swap_total[16], dirty[16];
     
     wattron(win, COLOR_PAIR(COLOR_MEM));
     mvwprintw(win, y, x, "Memory: %.1f/%.1f GB (%.1f%%)", used, total, percent);
+    if (m.total) {
+        // Where the rest went, and the pressure valves
+        format_rate(m.page_cache() * 1024.0, cache, sizeof(cache));
+        format_rate(m.slab * 1024.0, slab, sizeof(slab));
+        format_rate(m.swap_used() * 1024.0, swap_used, sizeof(swap_used));
+        format_rate(m.swap_total * 1024.0, swap_total, sizeof(swap_total));
+        format_rate((m.dirty + m.writeback) * 1024.0, dirty, sizeof(dirty));
+        wprintw(win, "  cache %s slab %s", cache, slab);
+        mvwprintw(win, y+1, x + 28, "swap %s/%s dirty %s", swap_used, swap_total, dirty);
+    }
+    display_window_stats(win, y+2, x, "", snap.mem_stats);
     
     // Draw memory bar
     wattron(win, COLOR_PAIR(COLOR_BAR));
@@ -293,97 +1320,1229 @@ void display_mem_stats(WINDOW *win, int y, int x) {
     }
     wprintw(win, "]");
     wattroff(win, COLOR_PAIR(COLOR_BAR));
-    
-    // Draw memory graph
-    draw_graph(win, y+3, x, mem_history, 60, 8, COLOR_GRAPH);
     wattroff(win, COLOR_PAIR(COLOR_MEM));
 }
 
-void display_processes(WINDOW *win, int y, int x, int width, int height) {
-    draw_box(win, y, x, height, width, "Processes");
+// cursor is the panel row of the selection, -1 for none. In the tree view
+// PSS and swap make way for the CPU and RSS of whole subtrees; threads
+// are listed {name} under their process, with its memory left blank.
+void display_processes(WINDOW *win, int y, int x, int width, int height, const MonitorSnapshot &snap,
+                       long cursor) {
+    static const char *sort_titles[] = {"Processes (by CPU)", "Processes (by MEM)",
+                                        "Processes (by PID)", "Processes (by NAME)",
+                                        "Processes (by I/O)"};
+    static const char *tree_titles[] = {"Process tree (by CPU)", "Process tree (by MEM)",
+                                        "Process tree (by PID)", "Process tree (by NAME)",
+                                        "Process tree (by I/O)"};
+    char io[16], name[64];
+    draw_box(win, y, x, height, width, (snap.process_tree ? tree_titles : sort_titles)[snap.sort]);
     
-    auto processes = get_processes(height - 3);
+    const vector<ProcessInfo> &processes = snap.processes;
     
     wattron(win, COLOR_PAIR(COLOR_PROCESS));
     mvwprintw(win, y+1, x+2, "PID");
     mvwprintw(win, y+1, x+10, "CPU%%");
-    mvwprintw(win, y+1, x+18, "MEM");
-    mvwprintw(win, y+1, x+26, "NAME");
+    mvwprintw(win, y+1, x+18, "RSS");
+    mvwprintw(win, y+1, x+26, snap.process_tree ? "SUBCPU" : "PSS");
+    mvwprintw(win, y+1, x+34, snap.process_tree ? "SUBRSS" : "SWAP");
+    mvwprintw(win, y+1, x+42, "I/O/s");
+    mvwprintw(win, y+1, x+50, "NAME");
+    // More rows than fit: where the panel is in the list
+    if (snap.process_total > processes.size() && width > 30) {
+        mvwprintw(win, y+1, x+width-14, "%5zu/%-5zu", snap.process_first + 1, snap.process_total);
+    }
+    
+    int name_width = max(0, width - 52);
+    for (size_t i = 0; i < processes.size() && (int)i < height - 4; i++) {
+        const ProcessInfo &p = processes[i];
+        if ((long)i == cursor) {
+            wattron(win, A_REVERSE);
+            mvwprintw(win, y+3+i, x+1, "%*s", max(0, width - 2), "");
+        }
+        mvwprintw(win, y+3+i, x+2, "%5d", p.pid);
+        mvwprintw(win, y+3+i, x+10, "%5.1f%%", p.cpu);
+        if (p.thread) {
+            mvwprintw(win, y+3+i, x+18, "%7s", "");
+        } else {
+            mvwprintw(win, y+3+i, x+18, "%4lld MB", p.rss_kb / 1024);
+        }
+        if (snap.process_tree) {
+            if (!p.thread) {
+                mvwprintw(win, y+3+i, x+26, "%5.1f%%", p.tree_cpu);
+                mvwprintw(win, y+3+i, x+34, "%4lld MB", p.tree_rss_kb / 1024);
+            }
+        } else if (p.pss_kb >= 0) {
+            // PSS and swap are sampled lazily; '-' until read or if unreadable
+            mvwprintw(win, y+3+i, x+26, "%4lld MB", p.pss_kb / 1024);
+            mvwprintw(win, y+3+i, x+34, "%4lld MB", p.swap_kb / 1024);
+        } else if (!p.thread) {
+            mvwprintw(win, y+3+i, x+26, "%7s", "-");
+            mvwprintw(win, y+3+i, x+34, "%7s", "-");
+        }
+        format_rate(p.io_read + p.io_write, io, sizeof(io));
+        mvwprintw(win, y+3+i, x+42, "%6s", io);
+        // Deep trees would push the names out of the panel
+        int indent = 2 * min(p.depth, 10);
+        if (p.thread) {
+            snprintf(name, sizeof(name), "%*s{%s}", indent, "", p.name);
+        } else if (snap.process_tree) {
+            snprintf(name, sizeof(name), "%*s%c %s", indent, "", p.fold, p.name);
+        } else {
+            snprintf(name, sizeof(name), "%s", p.name);
+        }
+        mvwprintw(win, y+3+i, x+50, "%.*s", name_width, name);
+        if ((long)i == cursor) wattroff(win, A_REVERSE);
+    }
+    wattroff(win, COLOR_PAIR(COLOR_PROCESS));
+    
+    // Process churn on the bottom border when events are available
+    if (snap.proc_events) {
+        wattron(win, COLOR_PAIR(COLOR_TITLE));
+        mvwprintw(win, y+height-1, x+2, " fork %lu exit %lu short-lived %lu%s%.15s%s ",
+                  snap.forks, snap.exits, snap.short_lived, snap.last_short_lived[0] ? " (" : "",
+                  snap.last_short_lived, snap.last_short_lived[0] ? ")" : "");
+        wattroff(win, COLOR_PAIR(COLOR_TITLE));
+    }
+}
+
+// The cgroups doing the most, in place of the process list ('g'). PSI
+// columns are the "some" 10 s averages; host-wide PSI sits on the border.
+void display_cgroups(WINDOW *win, int y, int x, int width, int height, const MonitorSnapshot &snap) {
+    static const char *sort_titles[] = {"Cgroups (by CPU)", "Cgroups (by MEM)", "Cgroups (by I/O)",
+                                        "Cgroups (by PSI)", "Cgroups (by NAME)"};
+    char io[16], mem[16];
+    draw_box(win, y, x, height, width, sort_titles[snap.cgroup_sort]);
+    
+    wattron(win, COLOR_PAIR(COLOR_PROCESS));
+    if (!snap.have_cgroups) {
+        mvwprintw(win, y+1, x+2, "%.*s", max(0, width - 4), "No cgroup v2 hierarchy mounted");
+        wattroff(win, COLOR_PAIR(COLOR_PROCESS));
+        return;
+    }
+    mvwprintw(win, y+1, x+2, "CPU%%");
+    mvwprintw(win, y+1, x+10, "MEM");
+    mvwprintw(win, y+1, x+18, "I/O/s");
+    mvwprintw(win, y+1, x+26, "PSI cpu  mem   io");
+    mvwprintw(win, y+1, x+45, "PROCS");
+    mvwprintw(win, y+1, x+52, "CGROUP");
     
-    for (size_t i = 0; i < processes.size(); i++) {
-        mvwprintw(win, y+3+i, x+2, "%5d", processes[i].pid);
-        mvwprintw(win, y+3+i, x+10, "%5s", processes[i].cpu.c_str());
-        mvwprintw(win, y+3+i, x+18, "%6s", processes[i].memory.c_str());
-        mvwprintw(win, y+3+i, x+26, "%.20s", processes[i].name.c_str());
+    int path_width = max(0, width - 54);
+    for (size_t i = 0; i < snap.cgroups.size() && (int)i < height - 4; i++) {
+        const CgroupStats &c = snap.cgroups[i];
+        mvwprintw(win, y+3+i, x+2, "%5.1f%%", c.cpu_percent);
+        if (c.memory_bytes >= 0) {
+            format_rate((double)c.memory_bytes, mem, sizeof(mem));
+            mvwprintw(win, y+3+i, x+10, "%6s", mem);
+        } else {
+            mvwprintw(win, y+3+i, x+10, "%6s", "-");
+        }
+        format_rate(c.io_read_bytes + c.io_write_bytes, io, sizeof(io));
+        mvwprintw(win, y+3+i, x+18, "%6s", io);
+        mvwprintw(win, y+3+i, x+26, "%7.1f %4.1f %4.1f", c.cpu.some_avg10, c.memory.some_avg10, c.io.some_avg10);
+        mvwprintw(win, y+3+i, x+45, "%5u", c.total_procs);
+        // Deep paths keep their leaf, which is what tells containers apart
+        size_t len = strlen(c.path);
+        const char *path = (int)len > path_width ? c.path + len - path_width : c.path;
+        mvwprintw(win, y+3+i, x+52, "%.*s", path_width, path);
     }
     wattroff(win, COLOR_PAIR(COLOR_PROCESS));
+    
+    const SystemPressure &p = snap.pressure;
+    if (p.cpu.available || p.memory.available || p.io.available) {
+        wattron(win, COLOR_PAIR(COLOR_TITLE));
+        mvwprintw(win, y+height-1, x+2, " host PSI some/full cpu %.1f/%.1f mem %.1f/%.1f io %.1f/%.1f ",
+                  p.cpu.some_avg10, p.cpu.full_avg10, p.memory.some_avg10, p.memory.full_avg10,
+                  p.io.some_avg10, p.io.full_avg10);
+        wattroff(win, COLOR_PAIR(COLOR_TITLE));
+    }
+}
+
+// Interfaces with the most traffic first; those that never carried any
+// are left out.
+void display_net_stats(WINDOW *win, int y, int x, int width, int rows, const NetStats &net) {
+    static vector<const NetIfRates *> order;
+    char rx[16], tx[16];
+    
+    wattron(win, COLOR_PAIR(COLOR_NETWORK));
+    char line[128];
+    snprintf(line, sizeof(line), "TCP %ld est  retrans %.1f/s (%.2f%%)  sockets %ld",
+             net.tcp_established, net.tcp_retransmits, net.retransmit_percent(), net.sockets_used);
+    mvwprintw(win, y, x, "%.*s", width, line);
+    if (rows < 2) {
+        wattroff(win, COLOR_PAIR(COLOR_NETWORK));
+        return;
+    }
+    mvwprintw(win, y+1, x, "%.*s", width, "IFACE        RX/s     TX/s  pkt in/out  err drop");
+    
+    order.clear();
+    for (size_t i = 0; i < net.interfaces.size(); i++) order.push_back(&net.interfaces[i]);
+    stable_sort(order.begin(), order.end(), [](const NetIfRates *a, const NetIfRates *b) {
+        return a->rx_bytes + a->tx_bytes > b->rx_bytes + b->tx_bytes;
+    });
+    for (int i = 0; i < rows - 2 && i < (int)order.size(); i++) {
+        const NetIfRates &r = *order[i];
+        format_rate(r.rx_bytes, rx, sizeof(rx));
+        format_rate(r.tx_bytes, tx, sizeof(tx));
+        snprintf(line, sizeof(line), "%-10.10s %6s %8s %5.0f/%-5.0f %4.0f %4.0f", r.name, rx, tx,
+                 r.rx_packets, r.tx_packets, r.rx_errors + r.tx_errors, r.rx_drops + r.tx_drops);
+        mvwprintw(win, y+2+i, x, "%.*s", width, line);
+    }
+    wattroff(win, COLOR_PAIR(COLOR_NETWORK));
+}
+
+void display_network(WINDOW *win, int y, int x, int width, int height, const NetIdentity &net,
+                     const NetStats &stats, int stat_rows) {
+    draw_box(win, y, x, height, width, "Network");
+    
+    wattron(win, COLOR_PAIR(COLOR_NETWORK));
+    if (!net.external.empty()) {
+        bool stale = strcmp(net.external_status, "ok") != 0;
+        mvwprintw(win, y+1, x+2, "IP: %s%s", net.external.c_str(), stale ? " (stale)" : "");
+    } else {
+        mvwprintw(win, y+1, x+2, "IP: %s", net.external_status);
+    }
+    for (size_t i = 0; i < net.local.size() && i < 2; i++) {
+        mvwprintw(win, y+2+i, x+2, "%-8s %.*s", net.local[i].ifname, max(0, width - 14), net.local[i].addr);
+    }
+    wattroff(win, COLOR_PAIR(COLOR_NETWORK));
+    if (stat_rows > 0 && !stats.interfaces.empty()) display_net_stats(win, y+4, x+2, width - 4, stat_rows, stats);
 }
 
-void display_network(WINDOW *win, int y, int x, int width) {
-    draw_box(win, y, x, 5, width, "Network");
+// Disk rates, then the capacity of each filesystem.
+void display_storage(WINDOW *win, int width, int height, const MonitorSnapshot &snap) {
+    draw_box(win, 0, 0, height, width, "Storage");
+    char line[128], rd[16], wr[16], used[16], size[16];
+    int row = 1, last = height - 2;
     
     wattron(win, COLOR_PAIR(COLOR_NETWORK));
-    mvwprintw(win, y+1, x+2, "IP: %s", get_ip().c_str());
+    if (!snap.disks.empty() && row <= last) {
+        mvwprintw(win, row++, 2, "%.*s", width - 4, "DEVICE     READ/s  WRITE/s    r/s    w/s  util queue");
+    }
+    for (size_t i = 0; i < snap.disks.size() && row <= last; i++) {
+        const DiskRates &d = snap.disks[i];
+        format_rate(d.read_bytes, rd, sizeof(rd));
+        format_rate(d.write_bytes, wr, sizeof(wr));
+        snprintf(line, sizeof(line), "%-8.8s %8s %8s %6.0f %6.0f %4.0f%% %5.1f",
+                 d.name, rd, wr, d.reads, d.writes, d.utilisation, d.queue_depth);
+        mvwprintw(win, row++, 2, "%.*s", width - 4, line);
+    }
+    for (size_t i = 0; i < snap.filesystems.size() && row <= last; i++) {
+        const FsUsage &fs = snap.filesystems[i];
+        format_rate((double)(fs.total_bytes - fs.free_bytes), used, sizeof(used));
+        format_rate((double)fs.total_bytes, size, sizeof(size));
+        snprintf(line, sizeof(line), "%-20.20s %7s / %-7s %3.0f%%", fs.mount, used, size, fs.used_percent());
+        mvwprintw(win, row++, 2, "%.*s", width - 4, line);
+    }
     wattroff(win, COLOR_PAIR(COLOR_NETWORK));
 }
 
-void real_time_monitor() {
+// Where each frame's UI time goes, next to the sampler's phases.
+enum UiPhase { UI_RENDER, UI_FLUSH, UI_PHASES };
+const char *ui_phase_names[UI_PHASES] = {"render", "flush"};
+
+// Self-profile overlay: per-phase wall time, then rplex's own usage.
+void display_profile(WINDOW *win, int width, int height, const MonitorSnapshot &snap, const PhaseTimes &ui) {
+    draw_box(win, 0, 0, height, width, "rplex self-profile");
+    const SelfUsage &u = snap.self;
+    int row = 1, last = height - 2;
+    
+    wattron(win, COLOR_PAIR(COLOR_PROCESS));
+    mvwprintw(win, row++, 2, "%-12s %8s %8s %8s", "PHASE (ms)", "last", "avg", "max");
+    for (size_t i = 0; i < snap.phases.size() + ui.size() && row <= last - 3; i++) {
+        const PhaseSummary &p = i < snap.phases.size() ? snap.phases[i] : ui.summary(i - snap.phases.size());
+        mvwprintw(win, row++, 2, "%-12s %8.2f %8.2f %8.2f", p.name, p.last_ms, p.avg_ms, p.max_ms);
+    }
+    row = last - 2;
+    mvwprintw(win, row++, 2, "CPU %.1f%%  RSS %.1f MB  threads %lld",
+              u.cpu_percent, u.rss_kb / 1024.0, u.threads);
+    mvwprintw(win, row++, 2, "syscalls/s r %.0f w %.0f  opens/s %.0f  allocs/s %.0f",
+              u.read_calls, u.write_calls, u.opens, u.allocations);
+    if (snap.cpu_budget > 0) {
+        mvwprintw(win, row++, 2, "periods x%u, budget %.1f%% CPU", snap.stretch, snap.cpu_budget);
+    } else {
+        mvwprintw(win, row++, 2, "periods x%u, no CPU budget", snap.stretch);
+    }
+    wattroff(win, COLOR_PAIR(COLOR_PROCESS));
+}
+
+// One window per panel; each is repainted only when its data changes.
+struct Dashboard {
+    Dashboard() : show_profile(false), ui_phases(ui_phase_names, UI_PHASES), process_selecting(false),
+                  process_selected(0), process_first(0), process_total(0) {}
+    
+    Panel header;
+    Panel cpu;
+    Panel mem;
+    Panel processes;
+    Panel network;
+    Panel storage;
+    GraphView cpu_graph;
+    GraphView mem_graph;
+    GraphView net_graph;
+    Panel profile;
+    bool show_profile;         // toggled with 'o'
+    PhaseTimes ui_phases;
+    // Selection in the process list, shown once a key moves it
+    bool process_selecting;
+    size_t process_selected;   // list position
+    vector<ProcessInfo> shown_processes;   // as last drawn
+    size_t process_first, process_total;
+};
+
+// Everything gets repainted, e.g. after a resize or when the overlay
+// goes away.
+void invalidate_dashboard(Dashboard &d) {
+    d.header.invalidate();
+    d.cpu.invalidate();
+    d.mem.invalidate();
+    d.processes.invalidate();
+    d.network.invalidate();
+    d.storage.invalidate();
+    d.profile.invalidate();
+    d.cpu_graph.touch();
+    d.mem_graph.touch();
+    d.net_graph.touch();
+}
+
+void render_dashboard(Dashboard &d, const MonitorSnapshot &snap, const NetIdentity &net, TermMeter &meter) {
+    int max_y, max_x;
+    getmaxyx(stdscr, max_y, max_x);
+    
+    int half = max_x/2;
+    int graph_width = min(60, half - 6);
+    d.header.place(0, 0, 1, max_x);
+    d.cpu.place(2, 2, 13, half - 2);
+    d.mem.place(2, half + 1, 13, half - 3);
+    d.cpu_graph.place(6, 4, 8, graph_width);
+    d.mem_graph.place(6, half + 3, 8, graph_width);
+    int process_height = max_y - 16;
+    d.processes.place(15, 2, process_height > 10 ? process_height : 0, half - 2);
+    // The right column grows with the process list. Network gets
+    // addresses, then TCP and interface rates, then a throughput graph
+    // once there is room; storage takes the lower half when tall enough.
+    int right_height = process_height > 10 ? process_height : max_y > 20 ? 5 : 0;
+    int disk_height = right_height >= 20 ? right_height / 2 : 0;
+    int net_height = right_height - disk_height;
+    int net_graph_height = net_height >= 14 ? 4 : 0;
+    int net_stat_rows = max(0, net_height - 6 - (net_graph_height ? net_graph_height + 1 : 0));
+    d.network.place(15, half + 1, net_height, half - 3);
+    d.net_graph.place(15 + net_height - 1 - net_graph_height, half + 3, net_graph_height, graph_width);
+    d.storage.place(15 + net_height, half + 1, disk_height, half - 3);
+    
+    // Overlay in the top right corner of the lower half
+    int profile_height = (int)(snap.phases.size() + d.ui_phases.size()) + 7;
+    bool profile_fits = d.show_profile && max_y >= 15 + profile_height && max_x >= 60;
+    d.profile.place(15, max_x - 58, profile_fits ? profile_height : 0, 56);
+    
+    // The sampler picks up the new row count on its next pass
+    process_rows = max(0, process_height - 4);
+    PhaseTimer render_timer(d.ui_phases, UI_RENDER);
+    
+    tm *ltm = localtime(&snap.taken);
+    char time_str[24];
+    strftime(time_str, sizeof(time_str), snap.status.compare(0, 6, "REPLAY") == 0 ? "%Y-%m-%d %H:%M:%S" : "%H:%M:%S", ltm);
+    // Sampling slowed down by the CPU budget
+    static string status;
+    status = snap.status;
+    if (snap.cpu_budget > 0 && snap.stretch > 1) {
+        char slow[48];
+        snprintf(slow, sizeof(slow), "%sSAMPLING %ux SLOWER (CPU BUDGET)", status.empty() ? "" : " ", snap.stretch);
+        status += slow;
+    }
+    Signature header_sig;
+    header_sig.add_str(time_str).add_str(status.c_str()).add(meter.last_frame());
+    if (d.header.needs_redraw(header_sig)) {
+        display_header(d.header.win(), time_str, status, meter.last_frame());
+    }
+    
+    Signature cpu_sig;
+    cpu_sig.add_str(snap.cpu_model.c_str()).add(snap.cpu_usage).add(snap.history_step);
+    if (!snap.cpu_stats.empty()) cpu_sig.add(snap.cpu_stats[0]);
+    if (d.cpu.needs_redraw(cpu_sig)) {
+        draw_box(d.cpu.win(), 0, 0, d.cpu.height(), d.cpu.width(), "CPU");
+        display_cpu_stats(d.cpu.win(), 1, 2, snap);
+        d.cpu_graph.touch();
+    }
+    
+    Signature mem_sig;
+    mem_sig.add(snap.mem_total).add(snap.mem_used).add(snap.mem_percent).add(snap.mem);
+    if (!snap.mem_stats.empty()) mem_sig.add(snap.mem_stats[0]);
+    if (d.mem.needs_redraw(mem_sig)) {
+        draw_box(d.mem.win(), 0, 0, d.mem.height(), d.mem.width(), "Memory");
+        display_mem_stats(d.mem.win(), 1, 2, snap);
+        d.mem_graph.touch();
+    }
+    
+    d.shown_processes = snap.processes;
+    d.process_first = snap.process_first;
+    d.process_total = snap.process_total;
+    if (d.process_selected >= snap.process_total) d.process_selected = snap.process_total ? snap.process_total - 1 : 0;
+    long cursor = d.process_selecting && d.process_selected >= snap.process_first ?
+        (long)(d.process_selected - snap.process_first) : -1;
+    
+    Signature proc_sig;
+    proc_sig.add(snap.sort).add(snap.proc_events).add(snap.process_tree).add(snap.process_first).add(snap.process_total);
+    proc_sig.add(cursor);
+    if (snap.proc_events) proc_sig.add(snap.forks).add(snap.exits).add(snap.short_lived).add_str(snap.last_short_lived);
+    for (size_t i = 0; i < snap.processes.size(); i++) {
+        const ProcessInfo &p = snap.processes[i];
+        proc_sig.add(p.pid).add(p.cpu).add(p.rss_kb).add(p.pss_kb).add(p.swap_kb).add(p.io_read).add(p.io_write).add_str(p.name);
+        proc_sig.add(p.depth).add(p.fold).add(p.thread).add(p.tree_cpu).add(p.tree_rss_kb);
+    }
+    proc_sig.add(snap.show_cgroups);
+    if (snap.show_cgroups) {
+        const SystemPressure &p = snap.pressure;
+        proc_sig.add(snap.cgroup_sort).add(snap.have_cgroups);
+        proc_sig.add(p.cpu.some_avg10).add(p.cpu.full_avg10).add(p.memory.some_avg10).add(p.memory.full_avg10);
+        proc_sig.add(p.io.some_avg10).add(p.io.full_avg10);
+        for (size_t i = 0; i < snap.cgroups.size(); i++) {
+            const CgroupStats &c = snap.cgroups[i];
+            proc_sig.add_str(c.path).add(c.cpu_percent).add(c.memory_bytes).add(c.io_read_bytes).add(c.io_write_bytes);
+            proc_sig.add(c.cpu.some_avg10).add(c.memory.some_avg10).add(c.io.some_avg10).add(c.total_procs);
+        }
+    }
+    if (d.processes.needs_redraw(proc_sig)) {
+        if (snap.show_cgroups) {
+            display_cgroups(d.processes.win(), 0, 0, d.processes.width(), d.processes.height(), snap);
+        } else {
+            display_processes(d.processes.win(), 0, 0, d.processes.width(), d.processes.height(), snap, cursor);
+        }
+    }
+    
+    Signature net_sig;
+    net_sig.add_str(net.external.c_str()).add_str(net.external_status).add(net_stat_rows);
+    for (size_t i = 0; i < net.local.size(); i++) {
+        net_sig.add_str(net.local[i].ifname).add_str(net.local[i].addr);
+    }
+    const NetStats &ns = snap.net;
+    net_sig.add(ns.tcp_established).add(ns.tcp_retransmits).add(ns.tcp_out_segments).add(ns.sockets_used);
+    for (size_t i = 0; i < ns.interfaces.size(); i++) net_sig.add(ns.interfaces[i]);
+    if (d.network.needs_redraw(net_sig)) {
+        display_network(d.network.win(), 0, 0, d.network.width(), d.network.height(), net, ns, net_stat_rows);
+        d.net_graph.touch();
+    }
+    
+    Signature storage_sig;
+    for (size_t i = 0; i < snap.disks.size(); i++) storage_sig.add(snap.disks[i]);
+    for (size_t i = 0; i < snap.filesystems.size(); i++) storage_sig.add(snap.filesystems[i]);
+    if (d.storage.needs_redraw(storage_sig)) {
+        display_storage(d.storage.win(), d.storage.width(), d.storage.height(), snap);
+    }
+    
+    d.cpu_graph.update(snap.cpu_history, graph_scale(snap.cpu_history), ACS_CKBOARD, COLOR_PAIR(COLOR_GRAPH));
+    d.mem_graph.update(snap.mem_history, graph_scale(snap.mem_history), ACS_CKBOARD, COLOR_PAIR(COLOR_GRAPH));
+    d.net_graph.update(snap.net_history, graph_scale(snap.net_history), ACS_CKBOARD, COLOR_PAIR(COLOR_NETWORK));
+    
+    if (d.profile.win()) {
+        Signature profile_sig;
+        const SelfUsage &u = snap.self;
+        profile_sig.add(u.cpu_percent).add(u.rss_kb).add(u.threads).add(u.read_calls).add(u.write_calls);
+        profile_sig.add(u.opens).add(u.allocations).add(snap.stretch).add(snap.cpu_budget);
+        for (size_t i = 0; i < snap.phases.size(); i++) profile_sig.add(snap.phases[i].last_ms).add(snap.phases[i].max_ms);
+        for (size_t i = 0; i < d.ui_phases.size(); i++) profile_sig.add(d.ui_phases.summary(i).last_ms);
+        if (d.profile.needs_redraw(profile_sig)) {
+            display_profile(d.profile.win(), d.profile.width(), d.profile.height(), snap, d.ui_phases);
+        }
+        // Panels underneath may have been repainted; stay on top
+        d.profile.touch();
+    }
+    
+    // Graphs sit on top of their panels, so they are queued last
+    d.header.commit();
+    d.cpu.commit();
+    d.mem.commit();
+    d.processes.commit();
+    d.network.commit();
+    d.storage.commit();
+    d.cpu_graph.commit();
+    d.mem_graph.commit();
+    d.net_graph.commit();
+    d.profile.commit();
+    render_timer.stop();
+    {
+        PhaseTimer t(d.ui_phases, UI_FLUSH);
+        meter.flush();
+    }
+    d.ui_phases.end_frame();
+}
+
+// Selection in the process list: the arrows and page keys move it. Live,
+// Enter lists the threads of the selected process under it, 'T' turns
+// the list into the process tree, and there Left and Right fold and
+// unfold the selected subtree. Returns true when the sampler has to
+// rebuild the list.
+bool handle_process_key(int ch, Dashboard &d) {
+    size_t page = (size_t)max(1, process_rows.load());
+    size_t last = d.process_total ? d.process_total - 1 : 0;
+    size_t &pos = d.process_selected;
+    bool enter = ch == '\n' || ch == '\r' || ch == KEY_ENTER;
+    bool live = live_sampler != NULL;
+    switch (ch) {
+    case KEY_UP: if (pos > 0) pos--; break;
+    case KEY_DOWN: pos = min(last, pos + 1); break;
+    case KEY_PPAGE: pos = pos > page ? pos - page : 0; break;
+    case KEY_NPAGE: pos = min(last, pos + page); break;
+    case KEY_HOME: pos = 0; break;
+    case KEY_END: pos = last; break;
+    default:
+        if (!live || !(enter || ch == 'T' || ch == KEY_LEFT || ch == KEY_RIGHT)) return false;
+    }
+    d.process_selecting = true;
+    
+    lock_guard<mutex> lock(process_view_mutex);
+    bool rebuild = false;
+    if (ch == 'T') {
+        process_view.tree = !process_view.tree;
+        pos = 0;
+        rebuild = true;
+    } else if (enter || ch == KEY_LEFT || ch == KEY_RIGHT) {
+        // The selected process, or the one owning the selected thread
+        long r = (long)pos - (long)d.process_first;
+        if (r < 0 || r >= (long)d.shown_processes.size()) return false;
+        while (r > 0 && d.shown_processes[r].thread) r--;
+        const ProcessInfo &p = d.shown_processes[r];
+        if (p.thread) return false;
+        bool on_thread = (size_t)r != pos - d.process_first;
+        if (enter) {
+            if (!process_view.threads.erase(p.pid)) process_view.threads.insert(p.pid);
+        } else if (ch == KEY_LEFT && on_thread) {
+            process_view.threads.erase(p.pid);
+        } else if (ch == KEY_LEFT && process_view.tree && p.fold == '-') {
+            process_view.folded.insert(p.pid);
+        } else if (ch == KEY_RIGHT && process_view.tree && p.fold == '+') {
+            process_view.folded.erase(p.pid);
+        } else {
+            return false;
+        }
+        pos = d.process_first + r;
+        rebuild = true;
+    }
+    // Keep the selection on screen
+    size_t &top_row = process_view.top_row;
+    if (ch == 'T') top_row = 0;
+    if (pos < top_row) {
+        top_row = pos;
+        rebuild = true;
+    } else if (pos >= top_row + page) {
+        top_row = pos - page + 1;
+        rebuild = true;
+    }
+    return rebuild && live;
+}
+
+// React to one key. Returns false to quit.
+bool handle_key(int ch, Dashboard &dashboard, bool replaying) {
+    if (ch == 'q' || ch == 'Q') return false;
+    
+    if (ch == KEY_RESIZE) {
+        // Wipe whatever the old layout left behind; panels that keep
+        // their geometry must then be repainted on top.
+        erase();
+        wnoutrefresh(stdscr);
+        invalidate_dashboard(dashboard);
+    }
+    
+    // Self-profile overlay; what it covered is repainted when it closes
+    if (ch == 'o') {
+        dashboard.show_profile = !dashboard.show_profile;
+        invalidate_dashboard(dashboard);
+    }
+    
+    // Process sort column; the cgroup panel follows the same keys,
+    // plus 's' for pressure
+    if (ch == 'c') { process_sort = SORT_CPU; cgroup_sort = CG_SORT_CPU; }
+    if (ch == 'm') { process_sort = SORT_MEM; cgroup_sort = CG_SORT_MEM; }
+    if (ch == 'p') process_sort = SORT_PID;
+    if (ch == 'n') { process_sort = SORT_NAME; cgroup_sort = CG_SORT_NAME; }
+    if (ch == 'i') { process_sort = SORT_IO; cgroup_sort = CG_SORT_IO; }
+    if (ch == 's') cgroup_sort = CG_SORT_PRESSURE;
+    if (ch == 'g') show_cgroups = !show_cgroups;
+    if (!show_cgroups && handle_process_key(ch, dashboard)) live_sampler->trigger(COLLECT_PROCESSES);
+    // Re-sort now rather than at the next scan
+    if (live_sampler && ch > 0 && ch < 128 && strchr("cmpnisg", ch)) {
+        live_sampler->trigger(COLLECT_PROCESSES);
+        live_sampler->trigger(COLLECT_CGROUPS);
+    }
+    
+    // Flight recorder: dump the last and next window now
+    if (ch == 'F' && flight_recorder && !replaying) flight_recorder->trigger();
+    
+    // Graph resolution: raw, 10 s and 1 min rollups
+    if (ch == 't') history_tier = (history_tier + 1) % cpu_history.tier_count();
+    
+    // Replay: pause, fast-forward speed, seek 10 s / 5 min
+    if (replaying) {
+        if (ch == ' ') replay_paused = !replay_paused;
+        if (ch == 'f') replay_speed = replay_speed >= 64 ? 1 : replay_speed * 2;
+        if (ch == KEY_RIGHT) replay_seek += 10;
+        if (ch == KEY_LEFT) replay_seek -= 10;
+        if (ch == ']') replay_seek += 300;
+        if (ch == '[') replay_seek -= 300;
+    }
+    return true;
+}
+
+void real_time_monitor(NetIdentityResolver &network, Recording *replay) {
     initscr();
     curs_set(0);
     noecho();
-    timeout(1000);
+    nodelay(stdscr, TRUE);   // keys are read once stdin is readable
     keypad(stdscr, TRUE);
     
     init_colors();
     
-    while (true) {
-        clear();
-        
-        // Get terminal dimensions
-        int max_y, max_x;
-        getmaxyx(stdscr, max_y, max_x);
-        
-        // Draw header
-        display_header(stdscr);
-        
-        // Draw CPU stats (top left)
-        draw_box(stdscr, 2, 2, 13, max_x/2 - 2, "CPU");
-        display_cpu_stats(stdscr, 3, 4);
-        
-        // Draw memory stats (top right)
-        draw_box(stdscr, 2, max_x/2 + 1, 13, max_x/2 - 3, "Memory");
-        display_mem_stats(stdscr, 3, max_x/2 + 3);
-        
-        // Draw processes (bottom left)
-        int process_height = max_y - 16;
-        if (process_height > 10) {
-            draw_box(stdscr, 15, 2, process_height, max_x/2 - 2, "Top Processes");
-            display_processes(stdscr, 15, 2, max_x/2 - 2, process_height);
+    // Collection happens off the UI thread. This one sleeps in epoll
+    // until a key, a resize or a published snapshot, and repaints then.
+    CollectorThread live;
+    SamplerThread replayer;
+    if (replay) {
+        replayer.start(chrono::milliseconds(100), [replay] { replay_step(*replay); });
+    } else {
+        start_live_sampler(live);
+    }
+    network.start(chrono::milliseconds(5000), [] { ui_wakeup.notify(); });
+    
+    Dashboard dashboard;
+    TermMeter meter;
+    bool have_snapshot = false;
+    bool dirty = false;
+    bool quit = false;
+    EventLoop loop;
+    auto read_keys = [&] {
+        int ch;
+        while (!quit && (ch = getch()) != ERR) {
+            quit = !handle_key(ch, dashboard, replay != NULL);
+            dirty = true;
         }
-        
-        // Draw network info (bottom right)
-        if (max_y > 16) {
-            display_network(stdscr, 15, max_x/2 + 1, max_x/2 - 3);
+    };
+    loop.watch(STDIN_FILENO, read_keys);
+    // SIGWINCH is blocked in main(), so it only arrives here;
+    // resizeterm() queues the KEY_RESIZE the key handler acts on.
+    loop.watch_signal(SIGWINCH, [&] {
+        struct winsize ws;
+        if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0) resizeterm(ws.ws_row, ws.ws_col);
+        read_keys();
+    });
+    loop.watch_wakeup(ui_wakeup, [] {});
+    while (!quit) {
+        if (snapshots.acquire()) {
+            have_snapshot = true;
+            dirty = true;
         }
+        if (network.acquire()) dirty = true;
         
-        refresh();
-        
-        // Check for quit command
-        int ch = getch();
-        if (ch == 'q' || ch == 'Q') {
-            break;
+        if (dirty && have_snapshot) {
+            render_dashboard(dashboard, snapshots.front(), network.current(), meter);
+            dirty = false;
         }
+        if (!loop.run_once()) break;
     }
     
+    replayer.stop();
+    live.stop();
+    live_sampler = NULL;
+    network.stop();
     endwin();
 }
 
-int main() {
+// Fleet viewer (--viewer): one row per agent, hosts in trouble first;
+// Enter opens the selected host in the usual dashboard.
+enum FleetSort { FLEET_CPU, FLEET_MEM, FLEET_NAME };
+
+struct FleetScreen {
+    FleetScreen() : sort(FLEET_CPU), selected(0), top(0), drilled(-1), drilled_frames(0) {}
+    
+    Panel header;
+    Panel table;
+    FleetSort sort;
+    size_t selected;               // row of the cursor; the worst hosts stay on top
+    size_t top;                    // first row shown
+    int drilled;                   // host shown in the dashboard, -1 for the overview
+    unsigned long drilled_frames;  // its samples already in the graphs
+    vector<FleetHostView> hosts;
+    vector<size_t> order;          // hosts in display order
+    RecordedFrame frame;           // the drilled host's latest sample
+    string cpu_model;
+    MonitorSnapshot snap;
+};
+
+const char *fleet_host_name(const FleetHostView &h) {
+    return h.hostname.empty() ? h.address.c_str() : h.hostname.c_str();
+}
+
+// Hosts that are not reporting come first, then the busiest.
+void sort_fleet(FleetScreen &f) {
+    f.order.resize(f.hosts.size());
+    for (size_t i = 0; i < f.order.size(); i++) f.order[i] = i;
+    const vector<FleetHostView> &hosts = f.hosts;
+    FleetSort key = f.sort;
+    stable_sort(f.order.begin(), f.order.end(), [&hosts, key](size_t a, size_t b) {
+        const FleetHostView &x = hosts[a], &y = hosts[b];
+        if (key == FLEET_NAME) {
+            int c = strcmp(fleet_host_name(x), fleet_host_name(y));
+            return c != 0 ? c < 0 : x.address < y.address;
+        }
+        bool x_up = strcmp(x.state, "up") == 0, y_up = strcmp(y.state, "up") == 0;
+        if (x_up != y_up) return !x_up;
+        return key == FLEET_MEM ? x.mem_percent > y.mem_percent : x.cpu_usage > y.cpu_usage;
+    });
+}
+
+// One character per sample, newest on the right, 0-100% on a ramp.
+void sparkline(const RingBuffer<float> &values, int width, char *out) {
+    static const char ramp[] = "_.:-=+*#%@";
+    int n = min((int)values.size(), width);
+    for (int i = 0; i < width - n; i++) out[i] = ' ';
+    for (int i = 0; i < n; i++) {
+        int level = (int)(values[values.size() - n + i] / 100 * 9 + 0.5f);
+        out[width - n + i] = ramp[max(0, min(9, level))];
+    }
+    out[width] = '\0';
+}
+
+void display_fleet(WINDOW *win, int width, int height, const FleetScreen &f) {
+    static const char *sort_titles[] = {"Fleet (by CPU)", "Fleet (by MEM)", "Fleet (by NAME)"};
+    draw_box(win, 0, 0, height, width, sort_titles[f.sort]);
+    char line[512], cpu[128], mem[128];
+    int inner = min(width - 4, (int)sizeof(line) - 1);
+    
+    size_t up = 0, stale = 0, down = 0;
+    double cpu_sum = 0, mem_sum = 0;
+    for (size_t i = 0; i < f.hosts.size(); i++) {
+        const FleetHostView &h = f.hosts[i];
+        if (strcmp(h.state, "up") == 0) {
+            up++;
+            cpu_sum += h.cpu_usage;
+            mem_sum += h.mem_percent;
+        } else if (strcmp(h.state, "stale") == 0) {
+            stale++;
+        } else {
+            down++;
+        }
+    }
+    wattron(win, COLOR_PAIR(COLOR_CPU));
+    snprintf(line, sizeof(line), "%zu hosts: %zu up, %zu stale, %zu down   mean CPU %.1f%%  MEM %.1f%%",
+             f.hosts.size(), up, stale, down, up ? cpu_sum / up : 0.0, up ? mem_sum / up : 0.0);
+    mvwprintw(win, 1, 2, "%.*s", inner, line);
+    wattroff(win, COLOR_PAIR(COLOR_CPU));
+    
+    // HOST ADDRESS STATE take 46 columns, the numbers 21; the two
+    // histories share the rest
+    int spark = max(8, min((int)FleetHostView::HISTORY, (width - 4 - 46 - 21 - 2) / 2));
+    wattron(win, COLOR_PAIR(COLOR_PROCESS));
+    snprintf(line, sizeof(line), "%-16s %-21s %-6s %5s %-*s %5s %-*s %6s", "HOST", "ADDRESS", "STATE",
+             "CPU%", spark, "CPU history", "MEM%", spark, "MEM history", "PROCS");
+    mvwprintw(win, 2, 2, "%.*s", inner, line);
+    
+    int rows = height - 4;
+    for (int r = 0; r < rows && f.top + r < f.order.size(); r++) {
+        size_t index = f.order[f.top + r];
+        const FleetHostView &h = f.hosts[index];
+        if (h.frames == 0) {
+            // Nothing to show yet but why
+            snprintf(line, sizeof(line), "%-16.16s %-21.21s %-6s %s", fleet_host_name(h), h.address.c_str(),
+                     h.state, h.error.c_str());
+        } else {
+            sparkline(h.cpu_history, spark, cpu);
+            sparkline(h.mem_history, spark, mem);
+            snprintf(line, sizeof(line), "%-16.16s %-21.21s %-6s %5.1f %s %5.1f %s %6zu", fleet_host_name(h),
+                     h.address.c_str(), h.state, h.cpu_usage, cpu, h.mem_percent, mem, h.processes);
+        }
+        if (f.top + r == f.selected) wattron(win, A_REVERSE);
+        mvwprintw(win, 3 + r, 2, "%-*.*s", inner, inner, line);
+        if (f.top + r == f.selected) wattroff(win, A_REVERSE);
+    }
+    wattroff(win, COLOR_PAIR(COLOR_PROCESS));
+    
+    wattron(win, COLOR_PAIR(COLOR_TITLE));
+    mvwprintw(win, height - 1, 2, " Enter dashboard  c/m/n sort  q quit ");
+    wattroff(win, COLOR_PAIR(COLOR_TITLE));
+}
+
+void render_fleet(FleetScreen &f, TermMeter &meter) {
+    int max_y, max_x;
+    getmaxyx(stdscr, max_y, max_x);
+    f.header.place(0, 0, 1, max_x);
+    f.table.place(1, 0, max_y - 1, max_x);
+    
+    // Keep the cursor in view
+    size_t rows = (size_t)max(1, f.table.height() - 4);
+    if (f.selected >= f.order.size()) f.selected = f.order.empty() ? 0 : f.order.size() - 1;
+    if (f.selected < f.top) f.top = f.selected;
+    if (f.selected >= f.top + rows) f.top = f.selected - rows + 1;
+    
+    time_t now = time(0);
+    char time_str[24], status[32];
+    strftime(time_str, sizeof(time_str), "%H:%M:%S", localtime(&now));
+    snprintf(status, sizeof(status), "FLEET %zu hosts", f.hosts.size());
+    Signature header_sig;
+    header_sig.add_str(time_str).add_str(status).add(meter.last_frame());
+    if (f.header.needs_redraw(header_sig)) display_header(f.header.win(), time_str, status, meter.last_frame());
+    
+    Signature table_sig;
+    table_sig.add(f.sort).add(f.top).add(f.selected);
+    for (size_t i = 0; i < f.hosts.size(); i++) {
+        const FleetHostView &h = f.hosts[i];
+        table_sig.add(h.frames).add(h.cpu_usage).add(h.mem_percent).add_str(h.state).add_str(h.error.c_str());
+        table_sig.add_str(h.hostname.c_str());
+    }
+    if (f.table.needs_redraw(table_sig)) display_fleet(f.table.win(), f.table.width(), f.table.height(), f);
+    
+    f.header.commit();
+    f.table.commit();
+    meter.flush();
+}
+
+void open_fleet_host(FleetScreen &f, Dashboard &d) {
+    f.drilled = (int)f.order[f.selected];
+    const FleetHostView &h = f.hosts[f.drilled];
+    // The graphs start from the history the viewer kept
+    cpu_history.clear();
+    mem_history.clear();
+    cpu_stats.clear();
+    mem_stats.clear();
+    f.drilled_frames = h.frames - min((unsigned long)h.cpu_history.size(), h.frames);
+    f.frame = RecordedFrame();
+    f.cpu_model.clear();
+    erase();
+    wnoutrefresh(stdscr);
+    invalidate_dashboard(d);
+}
+
+void render_fleet_host(FleetScreen &f, FleetViewer &viewer, Dashboard &d, TermMeter &meter) {
+    const FleetHostView &h = f.hosts[f.drilled];
+    if (h.frames != f.drilled_frames) {
+        // Samples that arrived since the last frame; the viewer only
+        // keeps the newest full one
+        size_t fresh = min((size_t)(h.frames - f.drilled_frames), h.cpu_history.size());
+        for (size_t i = h.cpu_history.size() - fresh; i < h.cpu_history.size(); i++) {
+            cpu_history.push(h.cpu_history[i]);
+            mem_history.push(h.mem_history[i]);
+            cpu_stats.push(h.cpu_history[i]);
+            mem_stats.push(h.mem_history[i]);
+        }
+        f.drilled_frames = h.frames;
+        viewer.sample(f.drilled, f.frame, f.cpu_model);
+    }
+    
+    MonitorSnapshot &snap = f.snap;
+    snapshot_from_frame(f.frame, f.cpu_model, h.sample_seconds, snap);
+    snap.taken = h.time_us ? (time_t)(h.time_us / 1000000) : time(0);
+    snap.status = "FLEET ";
+    snap.status += fleet_host_name(h);
+    if (strcmp(h.state, "up") != 0) {
+        snap.status += ' ';
+        snap.status += h.state;
+    }
+    snap.status += "  Esc back";
+    // The Network box shows where the agent is
+    static NetIdentity net;
+    net.external = h.address;
+    net.external_status = strcmp(h.state, "up") == 0 ? "ok" : h.state;
+    render_dashboard(d, snap, net, meter);
+}
+
+// React to one key in the fleet viewer. Returns false to quit.
+bool handle_fleet_key(int ch, FleetScreen &f, Dashboard &d) {
+    if (ch == 'q' || ch == 'Q') return false;
+    if (f.drilled >= 0) {
+        if (ch == 27 || ch == 'b' || ch == KEY_BACKSPACE || ch == 127) {
+            f.drilled = -1;
+            erase();
+            wnoutrefresh(stdscr);
+            f.header.invalidate();
+            f.table.invalidate();
+            return true;
+        }
+        return handle_key(ch, d, false);
+    }
+    
+    if (ch == KEY_RESIZE) {
+        erase();
+        wnoutrefresh(stdscr);
+        f.header.invalidate();
+        f.table.invalidate();
+    }
+    if (ch == 'c') f.sort = FLEET_CPU;
+    if (ch == 'm') f.sort = FLEET_MEM;
+    if (ch == 'n') f.sort = FLEET_NAME;
+    if (f.order.empty()) return true;
+    
+    size_t page = (size_t)max(1, f.table.height() - 4);
+    size_t last = f.order.size() - 1;
+    size_t &pos = f.selected;
+    if (ch == KEY_UP && pos > 0) pos--;
+    if (ch == KEY_DOWN && pos < last) pos++;
+    if (ch == KEY_PPAGE) pos = pos > page ? pos - page : 0;
+    if (ch == KEY_NPAGE) pos = min(last, pos + page);
+    if (ch == KEY_HOME) pos = 0;
+    if (ch == KEY_END) pos = last;
+    pos = min(pos, last);
+    if (ch == '\n' || ch == '\r' || ch == KEY_ENTER) open_fleet_host(f, d);
+    return true;
+}
+
+void fleet_monitor(FleetViewer &viewer) {
+    initscr();
+    curs_set(0);
+    noecho();
+    nodelay(stdscr, TRUE);
+    keypad(stdscr, TRUE);
+    set_escdelay(25);   // Esc leaves a host's dashboard
+    
+    init_colors();
+    
+    // The viewer thread wakes this one at most five times a second,
+    // however many agents report
+    viewer.start([] { ui_wakeup.notify(); });
+    
+    FleetScreen fleet;
+    Dashboard dashboard;
+    TermMeter meter;
+    bool quit = false;
+    EventLoop loop;
+    auto read_keys = [&] {
+        int ch;
+        while (!quit && (ch = getch()) != ERR) quit = !handle_fleet_key(ch, fleet, dashboard);
+    };
+    loop.watch(STDIN_FILENO, read_keys);
+    loop.watch_signal(SIGWINCH, [&] {
+        struct winsize ws;
+        if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0) resizeterm(ws.ws_row, ws.ws_col);
+        read_keys();
+    });
+    loop.watch_wakeup(ui_wakeup, [] {});
+    // The clock and "stale" still move when no agent reports
+    loop.add_timer(1000, [] {});
+    while (!quit) {
+        viewer.overview(fleet.hosts);
+        sort_fleet(fleet);
+        if (fleet.drilled >= 0) {
+            render_fleet_host(fleet, viewer, dashboard, meter);
+        } else {
+            render_fleet(fleet, meter);
+        }
+        if (!loop.run_once()) break;
+    }
+    
+    viewer.stop();
+    endwin();
+}
+
+// --viewer: addresses separated by commas or whitespace, or @FILE to
+// read them from a file ('#' starts a comment).
+bool parse_fleet_list(const char *arg, vector<string> &out) {
+    string text;
+    if (arg[0] == '@') {
+        ifstream in(arg + 1);
+        if (!in) return false;
+        string line;
+        while (getline(in, line)) text += line.substr(0, line.find('#')) + "\n";
+    } else {
+        text = arg;
+    }
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t end = text.find_first_of(", \t\n", pos);
+        if (end == string::npos) end = text.size();
+        if (end > pos) out.push_back(text.substr(pos, end - pos));
+        pos = end + 1;
+    }
+    return true;
+}
+
+void usage(const char *prog) {
+    printf("Usage: %s [options]\n"
+           "  --ip-url URL       public-address endpoint (default https://api.ipify.org)\n"
+           "  --no-external-ip   only show local interface addresses\n"
+           "  --ip-ttl SECONDS   reuse a public-address lookup this long (default 300)\n"
+           "  --ip-timeout MS    give up on a lookup after this long (default 3000)\n"
+           "  --batch FORMAT     no UI; stream samples as csv, ndjson or binary\n"
+           "  --interval MS      batch sample interval (default 1000)\n"
+           "  --metrics LIST     comma separated batch metrics (default all):\n"
+           "                     cpu_pct,mem_pct,mem_used_mb,mem_total_mb,load1,tasks,\n"
+           "                     core0_pct,... and the metrics of each plugin\n"
+           "  --output FILE      batch output file (default stdout)\n"
+           "  --count N          stop after N batch samples\n"
+           "  --listen ADDR      serve Prometheus metrics on host:port, e.g. 127.0.0.1:9659\n"
+           "  --record FILE      write every sample, with the full process table, to a new FILE\n"
+           "  --replay FILE      play a recording in the dashboard (space pause, f speed,\n"
+           "                     left/right seek 10 s, [/] seek 5 min)\n"
+           "  --agent ADDR       stream samples to fleet viewers on host:port or unix:PATH\n"
+           "  --viewer LIST      fleet overview of agents, e.g. 10.0.0.5:9660,unix:/run/rplex.sock;\n"
+           "                     @FILE reads the addresses from FILE\n"
+           "  --flight HZ        flight recorder: sample CPU, memory and the busiest processes\n"
+           "                     HZ times a second (1-100) and dump to a recording on a trigger\n"
+           "  --trigger RULE     dump when RULE holds, e.g. 'core > 95 for 2s', 'memavail < 5';\n"
+           "                     metrics: cpu,core,mem,memavail,proc (repeatable; F dumps now)\n"
+           "  --flight-window S  seconds kept before and after a trigger (default 10)\n"
+           "  --flight-dir DIR   where dumps go (default .)\n"
+           "  --no-ui            with --listen, --record, --agent or --flight: run headless\n"
+           "                     until killed\n"
+           "  --stats-windows S  rolling statistics windows in seconds (default 60,300,900)\n"
+           "  --proc-events      follow fork/exec/exit through the proc connector instead of\n"
+           "                     listing /proc every sample (needs CAP_NET_ADMIN)\n"
+           "  --cpu-budget PCT   sample less often while rplex itself uses more than PCT\n"
+           "                     percent of one CPU (up to every 16 s)\n"
+           "  --intervals LIST   collector periods in ms, e.g. cpu=250,processes=2000;\n"
+           "                     collectors: hardware,cpu,memory,network,disk,processes,\n"
+           "                     cgroups,plugins,export (metrics, recording, self-profile);\n"
+           "                     0 runs one only at startup\n"
+           "  --proc-root DIR    read procfs from DIR instead of /proc (e.g. a fixture tree)\n"
+           "  --sys-root DIR     read sysfs from DIR instead of /sys\n"
+           "  --plugin PATH      load a collector plugin (.so); may be repeated\n", prog);
+}
+
+int main(int argc, char **argv) {
+    NetIdConfig net_config;
+    BatchConfig batch;
+    string listen_address;
+    string record_path;
+    string replay_path;
+    string agent_address;
+    vector<string> viewer_hosts;
+    int flight_hz = 0;
+    double flight_window = 10;
+    string flight_dir = ".";
+    FlightRecorder flight;
+    bool no_ui = false;
+    bool proc_events = false;
+    double cpu_budget = 0;
+    const char *windows_arg = "60,300,900";
+    const char *proc_root = NULL;
+    const char *sys_root = NULL;
+    vector<string> plugin_paths;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--ip-url" && has_value) {
+            net_config.url = argv[++i];
+        } else if (arg == "--no-external-ip") {
+            net_config.external = false;
+        } else if (arg == "--ip-ttl" && has_value) {
+            net_config.ttl_seconds = atoi(argv[++i]);
+        } else if (arg == "--ip-timeout" && has_value) {
+            net_config.timeout_ms = atol(argv[++i]);
+        } else if (arg == "--batch" && has_value && parse_batch_format(argv[i + 1], batch.format)) {
+            batch.enabled = true;
+            i++;
+        } else if (arg == "--interval" && has_value) {
+            batch.interval_ms = atoi(argv[++i]);
+        } else if (arg == "--metrics" && has_value) {
+            batch.metrics = argv[++i];
+        } else if (arg == "--output" && has_value) {
+            batch.output = argv[++i];
+        } else if (arg == "--count" && has_value) {
+            batch.count = atol(argv[++i]);
+        } else if (arg == "--listen" && has_value) {
+            listen_address = argv[++i];
+        } else if (arg == "--record" && has_value) {
+            record_path = argv[++i];
+        } else if (arg == "--replay" && has_value) {
+            replay_path = argv[++i];
+        } else if (arg == "--agent" && has_value) {
+            agent_address = argv[++i];
+        } else if (arg == "--viewer" && has_value) {
+            if (!parse_fleet_list(argv[++i], viewer_hosts)) {
+                fprintf(stderr, "cannot read %s\n", argv[i] + 1);
+                return 1;
+            }
+        } else if (arg == "--flight" && has_value) {
+            flight_hz = atoi(argv[++i]);
+        } else if (arg == "--flight-window" && has_value) {
+            flight_window = atof(argv[++i]);
+        } else if (arg == "--flight-dir" && has_value) {
+            flight_dir = argv[++i];
+        } else if (arg == "--trigger" && has_value) {
+            flight::Rule rule;
+            string error;
+            if (!flight::parse_rule(argv[++i], rule, error)) {
+                fprintf(stderr, "bad trigger '%s': %s\n", argv[i], error.c_str());
+                return 1;
+            }
+            flight.add_rule(rule);
+        } else if (arg == "--no-ui") {
+            no_ui = true;
+        } else if (arg == "--proc-events") {
+            proc_events = true;
+        } else if (arg == "--cpu-budget" && has_value) {
+            cpu_budget = atof(argv[++i]);
+        } else if (arg == "--stats-windows" && has_value) {
+            windows_arg = argv[++i];
+        } else if (arg == "--intervals" && has_value) {
+            if (!parse_intervals(argv[++i])) {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (arg == "--proc-root" && has_value) {
+            proc_root = argv[++i];
+        } else if (arg == "--sys-root" && has_value) {
+            sys_root = argv[++i];
+        } else if (arg == "--plugin" && has_value) {
+            plugin_paths.push_back(argv[++i]);
+        } else {
+            usage(argv[0]);
+            return arg == "-h" || arg == "--help" ? 0 : 1;
+        }
+    }
+    // Rules without a rate get 20 Hz
+    if (!flight_hz && flight.rules()) flight_hz = 20;
+    
+    if (!parse_stats_windows(windows_arg, 1.0, stats_windows)) {
+        usage(argv[0]);
+        return 1;
+    }
+    set_fs_roots(proc_root, sys_root);
+    Recording replay;
+    if (!replay_path.empty()) {
+        string error;
+        if (!replay.open(replay_path, error)) {
+            fprintf(stderr, "cannot replay %s: %s\n", replay_path.c_str(), error.c_str());
+            return 1;
+        }
+    }
+    // Windows count samples: one per collector period live, one per
+    // recorded sample (a second unless the file says otherwise) in a
+    // recording, one per second from an agent
+    bool live = replay_path.empty() && viewer_hosts.empty();
+    double other_seconds = replay_path.empty() ? 1.0 : replay.sample_seconds();
+    double cpu_seconds = collector_periods[COLLECT_CPU] > 0 && live ? collector_periods[COLLECT_CPU] / 1000.0 : other_seconds;
+    double mem_seconds = collector_periods[COLLECT_MEMORY] > 0 && live ? collector_periods[COLLECT_MEMORY] / 1000.0 : other_seconds;
+    configure_stats(cpu_seconds, mem_seconds);
+    // History tiers count samples too, so size them for the same periods
+    double net_seconds = collector_periods[COLLECT_NETWORK] > 0 && live ? collector_periods[COLLECT_NETWORK] / 1000.0 : other_seconds;
+    cpu_history = TimeSeries::for_period((long)(cpu_seconds * 1000));
+    mem_history = TimeSeries::for_period((long)(mem_seconds * 1000));
+    net_history = TimeSeries::for_period((long)(net_seconds * 1000));
+    overhead_budget.configure(cpu_budget);
+    
+    // Batch mode samples the built-in collectors next to the plugins
+    if (batch.enabled) add_builtin_collectors(plugins);
+    add_plugins(plugins, plugin_paths);
+    string plugin_error;
+    if (!plugins.init(plugin_error)) {
+        fprintf(stderr, "%s\n", plugin_error.c_str());
+        return 1;
+    }
+    if (batch.enabled) return run_batch(batch, plugins);
+    
+    if (!viewer_hosts.empty()) {
+        if (no_ui || !replay_path.empty()) {
+            usage(argv[0]);
+            return 1;
+        }
+        block_signal(SIGWINCH);
+        FleetViewer viewer;
+        for (size_t i = 0; i < viewer_hosts.size(); i++) viewer.add(viewer_hosts[i]);
+        fleet_monitor(viewer);
+        return 0;
+    }
+    
+    if (no_ui && ((listen_address.empty() && record_path.empty() && agent_address.empty() && !flight_hz) ||
+                  !replay_path.empty())) {
+        usage(argv[0]);
+        return 1;
+    }
+    // A headless exporter waits for SIGINT/SIGTERM in sigwait(), and the
+    // dashboard reads SIGWINCH from a signalfd. Block them before any
+    // thread starts so every thread inherits the mask.
+    sigset_t stop_signals;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    if (no_ui) pthread_sigmask(SIG_BLOCK, &stop_signals, NULL);
+    block_signal(SIGWINCH);
+    
+    MetricsServer server;
+    if (!listen_address.empty()) {
+        string error;
+        if (!server.open(listen_address, error)) {
+            fprintf(stderr, "cannot listen on %s: %s\n", listen_address.c_str(), error.c_str());
+            return 1;
+        }
+        metrics_server = &server;
+        server.start();
+    }
+    FleetAgent agent;
+    if (!agent_address.empty() && replay_path.empty()) {
+        string error;
+        if (!agent.open(agent_address, error)) {
+            fprintf(stderr, "cannot serve viewers on %s: %s\n", agent_address.c_str(), error.c_str());
+            return 1;
+        }
+        char host[256] = "";
+        gethostname(host, sizeof(host) - 1);
+        agent.start(host, get_cpu_info());
+        fleet_agent = &agent;
+    }
+    Recorder session;
+    if (!record_path.empty() && replay_path.empty()) {
+        string error;
+        int64_t now_us = chrono::duration_cast<chrono::microseconds>(
+            chrono::system_clock::now().time_since_epoch()).count();
+        if (!session.open(record_path, now_us, get_cpu_info(), error)) {
+            fprintf(stderr, "cannot record to %s: %s\n", record_path.c_str(), error.c_str());
+            return 1;
+        }
+        // One frame per export, so replay steps and windows match
+        char host[256] = "";
+        gethostname(host, sizeof(host) - 1);
+        session.describe((uint32_t)(collector_periods[COLLECT_EXPORT] * 1000), string("--record on ") + host);
+        recorder = &session;
+    }
+    char cgroup_root[256];
+    if (replay_path.empty() && find_cgroup2_mount(cgroup_root, sizeof(cgroup_root))) {
+        cgroup_table.open(cgroup_root);
+    }
+    ProcConnector connector;
+    if (proc_events && replay_path.empty()) {
+        string error;
+        if (connector.open(error)) {
+            connector.start();
+            process_tracker.attach(&connector);
+        } else {
+            fprintf(stderr, "process events unavailable (%s), listing /proc instead\n", error.c_str());
+        }
+    }
+    if (flight_hz && replay_path.empty()) {
+        FlightRecorder::DumpHandler log;
+        if (no_ui) {
+            log = [](const string &path, const string &why, const string &error) {
+                if (error.empty()) {
+                    fprintf(stderr, "flight recorder: %s written (%s)\n", path.c_str(), why.c_str());
+                } else {
+                    fprintf(stderr, "flight recorder: cannot write %s: %s\n", path.c_str(), error.c_str());
+                }
+            };
+        }
+        // A busy process outside the candidates: list processes now
+        flight.on_rescan([] {
+            if (live_sampler) live_sampler->trigger(COLLECT_PROCESSES);
+        });
+        string error;
+        if (!flight.start(flight_hz, flight_window, flight_dir, get_cpu_info(), log, error)) {
+            fprintf(stderr, "cannot start the flight recorder: %s\n", error.c_str());
+            return 1;
+        }
+        flight_recorder = &flight;
+    }
+    if (no_ui) {
+        CollectorThread system_sampler;
+        start_live_sampler(system_sampler);
+        int sig;
+        sigwait(&stop_signals, &sig);
+        system_sampler.stop();
+        live_sampler = NULL;
+        server.stop();
+        return 0;
+    }
+    
     // Initialize curl
     curl_global_init(CURL_GLOBAL_DEFAULT);
     
     // Run the monitor
-    real_time_monitor();
+    NetIdentityResolver network(net_config, get_ip);
+    real_time_monitor(network, replay_path.empty() ? NULL : &replay);
     
     // Cleanup curl
     curl_global_cleanup();
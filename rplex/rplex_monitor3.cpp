@@ -13,13 +13,27 @@
 #include <vector>
 #include <chrono>
 #include <thread>
+#include <atomic>
 #include <ctime>
 #include <iomanip>
-#include <sys/sysinfo.h>
 #include <unistd.h>
 #include <sstream>
 #include <algorithm>
+#include <cmath>
 #include <ncurses.h>
+#include <sys/ioctl.h>
+#include "rplex_procfs.h"
+#include "rplex_snapshot.h"
+#include "rplex_eventloop.h"
+#include "rplex_series.h"
+#include "rplex_stats.h"
+#include "rplex_hwinfo.h"
+#include "rplex_diskstats.h"
+#include "rplex_meminfo.h"
+#include "rplex_render.h"
+#include "rplex_batch.h"
+#include "rplex_cpustat.h"
+#include "rplex_collector.h"
 
 using namespace std;
 using namespace chrono;
@@ -27,7 +41,6 @@ using namespace chrono;
 // Constants
 #define REFRESH_RATE 0.5
 #define GRAPH_HEIGHT 10
-#define MAX_CORES 32
 
 // ANSI Color Codes
 const string RED = "\033[31m";
@@ -42,8 +55,8 @@ const string RESET = "\033[0m";
 
 struct CpuCore {
     int id;
-    double usage;
-    vector<double> history;
+    bool online;
+    float usage;
 };
 
 struct SystemInfo {
@@ -52,8 +65,9 @@ struct SystemInfo {
     string cpuType;
     double cpuSpeed;
     int physicalCores;
-    int logicalCores;
-    vector<CpuCore> cores;
+    int logicalCores;           // online now
+    double totalCpu;            // from the aggregate "cpu" line
+    vector<CpuCore> cores;      // indexed by CPU number, offline ones included
     
     // GPU
     string gpuModel;
@@ -65,226 +79,550 @@ struct SystemInfo {
     string ramType;
     double ramSpeed;
     
-    // Storage
+    // Storage, in MB over every mounted block device
     long totalStorage;
     long freeStorage;
     
-    // History for graphs
-    vector<double> cpuHistory;
-    vector<double> memHistory;
+    // History for graphs (newest points of the selected tier)
+    vector<SeriesPoint> cpuHistory;
+    vector<SeriesPoint> memHistory;
+    int selectedCore;
+    vector<SeriesPoint> coreHistory;   // of selectedCore only
+    double historyStep;   // seconds per graph column
+    
+    // Rolling statistics, one entry per statsWindows
+    vector<StatsSummary> cpuStats;
+    vector<StatsSummary> memStats;
+    StatsSummary coreStats;   // selectedCore over the shortest window
+    
+    // Plugin metrics (--plugin), in the order of plugins.fields()
+    vector<double> pluginValues;
+};
+
+// Full multi-resolution history lives on the sampler side; snapshots
+// only carry the columns that can be drawn.
+TimeSeries cpuSeries = TimeSeries::for_period((long)(REFRESH_RATE * 1000));
+TimeSeries memSeries = TimeSeries::for_period((long)(REFRESH_RATE * 1000));
+vector<TimeSeries> coreSeries;   // by CPU number, shorter tiers than the totals
+atomic<int> historyTier(0);       // set by the UI, read by the sampler
+atomic<int> selectedCore(0);      // core whose graph is shown
+atomic<int> historyColumns(80);   // widest graph on screen
+
+// Statistics follow the series they sit next to; every core keeps only
+// the shortest window since there may be hundreds of them
+vector<size_t> statsWindows;    // in seconds, from --stats-windows
+MetricStats cpuStats;
+MetricStats memStats;
+vector<WindowStats> coreStats;
+
+// Collectors loaded with --plugin; the built-in ones are read above
+MetricSet plugins;
+
+// Each part of the screen is its own window, repainted only when what it
+// shows has changed; graphs scroll in place instead of being redrawn.
+struct Dashboard {
+    Panel header;
+    Panel hardware;
+    Panel memory;
+    Panel cores;        // heatmap of every core
+    Panel coreTitle;    // drill-in on the selected core
+    Panel footer;
+    GraphView cpuGraph;
+    GraphView memGraph;
+    GraphView coreGraph;
+    int coresPerRow;    // heatmap geometry, for moving the selection
+    
+    Dashboard() : coresPerRow(1) {}
 };
 
 // Function prototypes
 void initNCurses();
-void displayDashboard(SystemInfo &info);
-void updateSystemInfo(SystemInfo &info);
-void drawGraph(vector<double> &history, int y, int x, int height, int width, string color);
-void drawCpuGraphs(SystemInfo &info);
-string executeCommand(const char* cmd);
-string getCpuInfo();
-string getGpuInfo();
-string getRamInfo();
-void displayHardwareInfo(SystemInfo &info);
+void displayDashboard(Dashboard &d, const SystemInfo &info, TermMeter &meter);
+void readHardware(SystemInfo &info);
+void readCpu(SystemInfo &info);
+void readMemory(SystemInfo &info);
+void readStorage(SystemInfo &info);
+void readPlugins(SystemInfo &info);
+void finishSystemInfo(SystemInfo &info);
+float graphScale(const vector<SeriesPoint> &history);
+void displayHardwareInfo(WINDOW *win, const SystemInfo &info);
+char heatGlyph(const CpuCore &core);
+void busiestCore(const SystemInfo &info, int &id, float &usage);
+void displayCoreHeatmap(WINDOW *win, const SystemInfo &info, int cellWidth, int perRow, int firstRow);
+string statsLine(const StatsSummary &stats, size_t window);
+int runBatch(const BatchConfig &config, const vector<string> &pluginPaths);
 
-int main() {
-    SystemInfo info;
+void usage(const char *prog) {
+    printf("Usage: %s [options]\n"
+           "  --batch FORMAT     no UI; stream samples as csv, ndjson or binary\n"
+           "  --interval MS      batch sample interval (default 1000)\n"
+           "  --metrics LIST     comma separated batch metrics (default all):\n"
+           "                     cpu_pct,mem_pct,mem_used_mb,mem_total_mb,load1,tasks,\n"
+           "                     core0_pct,... and the metrics of each plugin\n"
+           "  --output FILE      batch output file (default stdout)\n"
+           "  --count N          stop after N batch samples\n"
+           "  --stats-windows S  rolling statistics windows in seconds (default 60,300,900)\n"
+           "  --proc-root DIR    read procfs from DIR instead of /proc\n"
+           "  --sys-root DIR     read sysfs from DIR instead of /sys\n"
+           "  --plugin PATH      load a collector plugin (.so); may be repeated\n", prog);
+}
+
+int main(int argc, char **argv) {
+    BatchConfig batch;
+    const char *windowsArg = "60,300,900";
+    const char *procRoot = NULL;
+    const char *sysRoot = NULL;
+    vector<string> pluginPaths;
+    for(int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if(arg == "--batch" && hasValue && parse_batch_format(argv[i + 1], batch.format)) {
+            batch.enabled = true;
+            i++;
+        } else if(arg == "--interval" && hasValue) {
+            batch.interval_ms = atoi(argv[++i]);
+        } else if(arg == "--metrics" && hasValue) {
+            batch.metrics = argv[++i];
+        } else if(arg == "--output" && hasValue) {
+            batch.output = argv[++i];
+        } else if(arg == "--count" && hasValue) {
+            batch.count = atol(argv[++i]);
+        } else if(arg == "--stats-windows" && hasValue) {
+            windowsArg = argv[++i];
+        } else if(arg == "--proc-root" && hasValue) {
+            procRoot = argv[++i];
+        } else if(arg == "--sys-root" && hasValue) {
+            sysRoot = argv[++i];
+        } else if(arg == "--plugin" && hasValue) {
+            pluginPaths.push_back(argv[++i]);
+        } else {
+            usage(argv[0]);
+            return arg == "-h" || arg == "--help" ? 0 : 1;
+        }
+    }
+    set_fs_roots(procRoot, sysRoot);
+    vector<size_t> windowSamples;
+    if(!parse_stats_windows(windowsArg, REFRESH_RATE, windowSamples)) {
+        usage(argv[0]);
+        return 1;
+    }
+    parse_stats_windows(windowsArg, 1, statsWindows);
+    cpuStats.configure(windowSamples);
+    memStats.configure(windowSamples);
+    if(batch.enabled) return runBatch(batch, pluginPaths);
+    add_plugins(plugins, pluginPaths);
+    string pluginError;
+    if(!plugins.init(pluginError)) {
+        fprintf(stderr, "%s\n", pluginError.c_str());
+        return 1;
+    }
+    
+    // The dashboard reads SIGWINCH from a signalfd; block it before the
+    // sampler thread starts so no thread takes it
+    block_signal(SIGWINCH);
     initscr();
     cbreak();
     noecho();
     curs_set(0);
-    timeout(0);
+    nodelay(stdscr, TRUE);
+    keypad(stdscr, TRUE);
     
-    // Initialize history
-    for(int i = 0; i < 50; i++) {
-        info.cpuHistory.push_back(0);
-        info.memHistory.push_back(0);
-    }
+    // The sampler thread owns its own SystemInfo and publishes a copy
+    // after each wakeup; the UI only ever draws the latest published copy.
+    // Usage and memory are read every REFRESH_RATE, filesystems every
+    // 5 s and the hardware inventory at startup, on 'r' and on hotplug.
+    TripleBuffer<SystemInfo> snapshots;
+    SystemInfo sampled;
+    Wakeup uiWakeup;
+    HotplugMonitor hotplug;
+    
+    CollectorThread sampler;
+    long fastMs = (long)(REFRESH_RATE * 1000);
+    size_t hardwareCollector = sampler.add("hardware", 0, [&] { readHardware(sampled); });
+    sampler.add("cpu", fastMs, [&] { readCpu(sampled); });
+    sampler.add("memory", fastMs, [&] { readMemory(sampled); });
+    sampler.add("storage", 5000, [&] { readStorage(sampled); });
+    if(plugins.size()) sampler.add("plugins", 1000, [&] { readPlugins(sampled); });
+    sampler.watch(hotplug.fd(), [&] {
+        if(hotplug.changed()) readHardware(sampled);
+    });
+    sampler.start([&] {
+        finishSystemInfo(sampled);
+        snapshots.back() = sampled;
+        snapshots.publish();
+        uiWakeup.notify();
+    });
     
-    while(true) {
-        updateSystemInfo(info);
-        displayDashboard(info);
-        
-        // Handle input
-        int ch = getch();
-        if(ch == 'q') break;
-        
-        this_thread::sleep_for(chrono::milliseconds((int)(REFRESH_RATE * 1000)));
+    Dashboard dashboard;
+    TermMeter meter;
+    bool haveSnapshot = false;
+    bool dirty = false;
+    bool quit = false;
+    
+    // Sleep in epoll until a key, a resize or a new snapshot; react at once
+    EventLoop loop;
+    auto readKeys = [&] {
+        int ch;
+        while(!quit && (ch = getch()) != ERR) {
+            if(ch == 'q') quit = true;
+            if(ch == 'r') sampler.trigger(hardwareCollector);
+            if(ch == 't') historyTier = (historyTier + 1) % cpuSeries.tier_count();
+            
+            // Move the drill-in selection around the core heatmap
+            int step = 0;
+            if(ch == KEY_LEFT) step = -1;
+            if(ch == KEY_RIGHT) step = 1;
+            if(ch == KEY_UP) step = -dashboard.coresPerRow;
+            if(ch == KEY_DOWN) step = dashboard.coresPerRow;
+            if(step && haveSnapshot) {
+                int count = snapshots.front().cores.size();
+                int next = selectedCore + step;
+                if(next >= 0 && next < count) {
+                    selectedCore = next;
+                    dirty = true;
+                }
+            }
+            if(ch == KEY_RESIZE) {
+                // Clear what the old layout left behind and repaint everything
+                erase();
+                wnoutrefresh(stdscr);
+                dashboard.header.invalidate();
+                dashboard.hardware.invalidate();
+                dashboard.memory.invalidate();
+                dashboard.cores.invalidate();
+                dashboard.coreTitle.invalidate();
+                dashboard.footer.invalidate();
+                dashboard.cpuGraph.touch();
+                dashboard.memGraph.touch();
+                dashboard.coreGraph.touch();
+                dirty = true;
+            }
+        }
+    };
+    loop.watch(STDIN_FILENO, readKeys);
+    // resizeterm() queues the KEY_RESIZE handled above
+    loop.watch_signal(SIGWINCH, [&] {
+        struct winsize ws;
+        if(ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0) resizeterm(ws.ws_row, ws.ws_col);
+        readKeys();
+    });
+    loop.watch_wakeup(uiWakeup, [] {});
+    while(!quit) {
+        historyColumns = COLS;
+        if(snapshots.acquire()) {
+            haveSnapshot = !snapshots.front().cores.empty();
+            dirty = true;
+        }
+        if(dirty && haveSnapshot) {
+            displayDashboard(dashboard, snapshots.front(), meter);
+            dirty = false;
+        }
+        if(!loop.run_once()) break;
     }
     
+    sampler.stop();
     endwin();
     return 0;
 }
 
-void updateSystemInfo(SystemInfo &info) {
-    // CPU Info
-    info.cpuModel = getCpuInfo();
+// Static hardware facts: read at startup, then only on request ('r')
+// or when a hotplug event says they changed.
+void readHardware(SystemInfo &info) {
+    static HardwareInventory hw;
+    read_hardware_inventory(hw);
+    info.cpuModel = hw.cpu_model;
+    info.cpuSpeed = hw.cpu_max_mhz;
+    info.physicalCores = hw.physical_cores;
+    info.gpuModel = hw.gpu_model;
+    info.ramType = hw.ram_type;
+    info.ramSpeed = hw.ram_speed_mhz;
+}
+
+// Aggregate and per-CPU usage, indexed by CPU number
+void readCpu(SystemInfo &info) {
+    static CpuSampler cpu;
+    if(!cpu.sample() || cpu.cpus() == 0) return;
+    info.totalCpu = cpu.total();
     
-    // Get CPU cores usage
-    ifstream cpuFile("/proc/stat");
-    string line;
-    vector<string> cpuTimes;
-    while(getline(cpuFile, line) && line.substr(0, 3) == "cpu") {
-        cpuTimes.push_back(line);
+    size_t cpuCount = cpu.cpus();
+    info.cores.resize(cpuCount);
+    while(coreSeries.size() < cpuCount) {
+        coreSeries.push_back(TimeSeries::for_period((long)(REFRESH_RATE * 1000), 160));
+        coreStats.push_back(WindowStats(cpuStats.window(0).window()));
     }
-    cpuFile.close();
-    
-    // Calculate CPU usage for each core
-    info.logicalCores = cpuTimes.size() - 1;
-    info.cores.resize(info.logicalCores);
-    
-    for(int i = 0; i < info.logicalCores; i++) {
-        istringstream iss(cpuTimes[i+1]);
-        string cpuLabel;
-        long user, nice, system, idle, iowait, irq, softirq;
-        iss >> cpuLabel >> user >> nice >> system >> idle >> iowait >> irq >> softirq;
-        
-        long total = user + nice + system + idle + iowait + irq + softirq;
-        long idleTime = idle + iowait;
-        
-        static vector<long> prevTotal(info.logicalCores, 0);
-        static vector<long> prevIdle(info.logicalCores, 0);
-        
-        double usage = 0.0;
-        if(prevTotal[i] != 0) {
-            long totalDiff = total - prevTotal[i];
-            long idleDiff = idleTime - prevIdle[i];
-            usage = 100.0 * (totalDiff - idleDiff) / totalDiff;
-        }
-        
+    info.logicalCores = 0;
+    for(size_t i = 0; i < cpuCount; i++) {
         info.cores[i].id = i;
-        info.cores[i].usage = usage;
-        info.cores[i].history.push_back(usage);
-        if(info.cores[i].history.size() > 50) {
-            info.cores[i].history.erase(info.cores[i].history.begin());
+        info.cores[i].online = cpu.online(i);
+        info.cores[i].usage = cpu.usage(i);
+        if(cpu.online(i)) {
+            info.logicalCores++;
+            coreSeries[i].push(cpu.usage(i));
+            coreStats[i].push(cpu.usage(i));
         }
-        
-        prevTotal[i] = total;
-        prevIdle[i] = idleTime;
     }
-    
-    // Memory info
-    struct sysinfo memInfo;
-    sysinfo(&memInfo);
-    info.totalRam = memInfo.totalram / (1024 * 1024);
-    info.freeRam = memInfo.freeram / (1024 * 1024);
-    info.usedRam = info.totalRam - info.freeRam;
-    
-    // Update history
+    cpuSeries.push(info.totalCpu);
+    cpuStats.push(info.totalCpu);
+}
+
+// Page cache the kernel can drop does not count as used
+void readMemory(SystemInfo &info) {
+    static MemSampler memSampler;
+    MemInfo mem;
+    if(memSampler.sample(mem)) {
+        info.totalRam = mem.total / 1024;
+        info.freeRam = mem.available / 1024;
+        info.usedRam = mem.used() / 1024;
+    } else {
+        info.totalRam = info.freeRam = info.usedRam = 0;
+    }
+    // Nothing to graph without MemTotal (e.g. a --proc-root tree lacking meminfo)
+    if(info.totalRam <= 0) return;
     double memPercentage = (static_cast<double>(info.usedRam) / info.totalRam) * 100;
-    info.cpuHistory.push_back(info.cores[0].usage);
-    info.memHistory.push_back(memPercentage);
-    if(info.cpuHistory.size() > 50) info.cpuHistory.erase(info.cpuHistory.begin());
-    if(info.memHistory.size() > 50) info.memHistory.erase(info.memHistory.begin());
-    
-    // GPU Info
-    info.gpuModel = getGpuInfo();
-    
-    // RAM Info
-    info.ramType = getRamInfo();
+    memSeries.push(memPercentage);
+    memStats.push(memPercentage);
+}
+
+void readPlugins(SystemInfo &info) {
+    plugins.sample();
+    info.pluginValues.assign(plugins.values(), plugins.values() + plugins.size());
 }
 
-void displayDashboard(SystemInfo &info) {
-    clear();
+void readStorage(SystemInfo &info) {
+    static DiskSampler disks;
+    static vector<FsUsage> filesystems;
+    disks.filesystems(filesystems);
+    info.totalStorage = info.freeStorage = 0;
+    for(size_t i = 0; i < filesystems.size(); i++) {
+        info.totalStorage += filesystems[i].total_bytes / (1024 * 1024);
+        info.freeStorage += filesystems[i].avail_bytes / (1024 * 1024);
+    }
+}
+
+// Copy out only what fits on screen from the selected tier
+void finishSystemInfo(SystemInfo &info) {
+    if(info.cores.empty()) return;
+    size_t tier = historyTier.load();
+    size_t columns = historyColumns.load();
+    cpuSeries.tail(tier, columns, info.cpuHistory);
+    memSeries.tail(tier, columns, info.memHistory);
+    info.selectedCore = min(max(0, selectedCore.load()), (int)info.cores.size() - 1);
+    coreSeries[info.selectedCore].tail(tier, columns, info.coreHistory);
+    info.historyStep = cpuSeries.samples_per_point(tier) * REFRESH_RATE;
+    cpuStats.summaries(info.cpuStats);
+    memStats.summaries(info.memStats);
+    info.coreStats = coreStats[info.selectedCore].summary();
+}
+
+void displayDashboard(Dashboard &d, const SystemInfo &info, TermMeter &meter) {
+    // Rows 0-15 span the screen; below that memory takes the left half.
+    // The right half has a heatmap with one cell per core and, under it,
+    // the graph of the selected core.
+    int half = COLS / 2;
+    int rightWidth = COLS - half - 1;
+    int coreCount = info.cores.size();
+    int gridRows = max(1, LINES - 2 - 16 - 1 - 6);
+    int cellWidth = 2;
+    int perRow = max(1, rightWidth / cellWidth);
+    if((coreCount + perRow - 1) / perRow > gridRows) {
+        cellWidth = 1;   // too many cores for spaced cells
+        perRow = max(1, rightWidth);
+    }
+    int rows = (coreCount + perRow - 1) / perRow;
+    int shownRows = min(rows, gridRows);
+    // Scroll the grid so the selected core stays visible
+    int firstRow = min(max(0, info.selectedCore / perRow - shownRows + 1), rows - shownRows);
+    d.coresPerRow = perRow;
     
-    // Header
-    attron(A_BOLD | COLOR_PAIR(1));
-    mvprintw(0, 0, "RPLEX SYSTEM MONITOR - Ultimate Edition");
-    attroff(A_BOLD | COLOR_PAIR(1));
-    mvprintw(1, 0, "Developed by Devil659 | Version 3.0.0 | Real-Time Monitoring");
-    mvhline(2, 0, ACS_HLINE, COLS);
+    d.header.place(0, 0, 3, COLS);
+    d.hardware.place(3, 0, 3, COLS);
+    d.cpuGraph.place(6, 0, GRAPH_HEIGHT, COLS);
+    d.memory.place(16, 0, 1, half);
+    d.memGraph.place(17, 0, GRAPH_HEIGHT, half - 1);
+    d.cores.place(16, half + 1, 1 + shownRows, rightWidth);
+    d.coreTitle.place(18 + shownRows, half + 1, 1, rightWidth);
+    d.coreGraph.place(19 + shownRows, half + 1, 4, rightWidth);
+    d.footer.place(LINES - 2, 0, 2, COLS);
     
-    // Hardware Info
-    displayHardwareInfo(info);
+    Signature headerSig;
+    headerSig.add(COLS);
+    if(d.header.needs_redraw(headerSig)) {
+        WINDOW *w = d.header.win();
+        wattron(w, A_BOLD | COLOR_PAIR(1));
+        mvwprintw(w, 0, 0, "RPLEX SYSTEM MONITOR - Ultimate Edition");
+        wattroff(w, A_BOLD | COLOR_PAIR(1));
+        mvwprintw(w, 1, 0, "Developed by Devil659 | Version 3.0.0 | Real-Time Monitoring");
+        mvwhline(w, 2, 0, ACS_HLINE, COLS);
+    }
     
-    // CPU Graphs
-    drawCpuGraphs(info);
+    Signature hardwareSig;
+    hardwareSig.add_str(info.cpuModel.c_str()).add(info.cpuSpeed).add_str(info.gpuModel.c_str())
+               .add_str(info.ramType.c_str()).add(info.ramSpeed).add(info.physicalCores)
+               .add(info.logicalCores).add(info.totalStorage).add(info.freeStorage).add(info.totalCpu).add(info.cpuStats[0]);
+    if(d.hardware.needs_redraw(hardwareSig)) {
+        displayHardwareInfo(d.hardware.win(), info);
+    }
     
-    // Memory Graph
-    double memPercentage = (static_cast<double>(info.usedRam) / info.totalRam) * 100;
-    mvprintw(15, 0, "Memory Usage: %.1f%% (Used: %ldMB / Total: %ldMB)", 
-             memPercentage, info.usedRam, info.totalRam);
-    drawGraph(info.memHistory, 16, 0, GRAPH_HEIGHT, COLS/2, "red");
+    Signature memorySig;
+    memorySig.add(info.usedRam).add(info.totalRam).add(info.memStats[0]);
+    if(d.memory.needs_redraw(memorySig)) {
+        char line[256];
+        if(info.totalRam > 0) {
+            double memPercentage = (static_cast<double>(info.usedRam) / info.totalRam) * 100;
+            snprintf(line, sizeof(line), "Memory Usage: %.1f%% (%ld/%ldMB) %s", memPercentage,
+                     info.usedRam, info.totalRam, statsLine(info.memStats[0], statsWindows[0]).c_str());
+        } else {
+            snprintf(line, sizeof(line), "Memory Usage: -");
+        }
+        mvwprintw(d.memory.win(), 0, 0, "%.*s", half - 1, line);
+    }
     
-    // Footer
-    mvhline(LINES-2, 0, ACS_HLINE, COLS);
-    attron(COLOR_PAIR(2));
-    mvprintw(LINES-1, 0, "Press 'q' to quit | Refresh rate: %.1fs", REFRESH_RATE);
-    attroff(COLOR_PAIR(2));
+    // Cells only change when a core moves to another glyph; the title
+    // when the busiest core or its whole percent does
+    float busiest;
+    int busiestId;
+    busiestCore(info, busiestId, busiest);
+    Signature coresSig;
+    coresSig.add(info.selectedCore).add(cellWidth).add(perRow).add(firstRow).add(info.logicalCores);
+    coresSig.add(busiestId).add((int)rintf(busiest));   // rounds as %.0f does
+    for(int i = 0; i < coreCount; i++) coresSig.add(heatGlyph(info.cores[i]));
+    if(d.cores.needs_redraw(coresSig)) {
+        displayCoreHeatmap(d.cores.win(), info, cellWidth, perRow, firstRow);
+    }
     
-    refresh();
+    const CpuCore &selected = info.cores[info.selectedCore];
+    Signature coreSig;
+    coreSig.add(selected.id).add(selected.online).add(selected.usage).add(info.coreStats);
+    if(d.coreTitle.needs_redraw(coreSig)) {
+        if(selected.online) {
+            string line = statsLine(info.coreStats, statsWindows[0]);
+            mvwprintw(d.coreTitle.win(), 0, 0, "Core %d: %.1f%% %.*s", selected.id, selected.usage,
+                      max(0, rightWidth - 14), line.c_str());
+        } else {
+            mvwprintw(d.coreTitle.win(), 0, 0, "Core %d: offline", selected.id);
+        }
+    }
+    
+    Signature footerSig;
+    footerSig.add(COLS).add(info.historyStep).add(meter.last_frame());
+    for(size_t i = 0; i < info.pluginValues.size(); i++) footerSig.add(info.pluginValues[i]);
+    if(d.footer.needs_redraw(footerSig)) {
+        WINDOW *w = d.footer.win();
+        mvwhline(w, 0, 0, ACS_HLINE, COLS);
+        // Plugin metrics sit on the rule above the key help
+        if(!info.pluginValues.empty()) {
+            char line[512];
+            format_metrics(plugins.fields(), info.pluginValues, line, sizeof(line));
+            mvwprintw(w, 0, 2, " %.*s ", max(0, COLS - 6), line);
+        }
+        wattron(w, COLOR_PAIR(2));
+        mvwprintw(w, 1, 0, "Press 'q' to quit, 't' to change history resolution, arrows to pick a core | Refresh rate: %.1fs | %gs/column | %llu B/frame",
+                  REFRESH_RATE, info.historyStep, meter.last_frame());
+        wattroff(w, COLOR_PAIR(2));
+    }
+    
+    d.cpuGraph.update(info.cpuHistory, graphScale(info.cpuHistory), ACS_BLOCK, COLOR_PAIR(4));
+    d.memGraph.update(info.memHistory, graphScale(info.memHistory), ACS_BLOCK, COLOR_PAIR(3));
+    d.coreGraph.update(info.coreHistory, graphScale(info.coreHistory), ACS_BLOCK, 0);
+    
+    d.header.commit();
+    d.hardware.commit();
+    d.cpuGraph.commit();
+    d.memory.commit();
+    d.memGraph.commit();
+    d.cores.commit();
+    d.coreTitle.commit();
+    d.coreGraph.commit();
+    d.footer.commit();
+    meter.flush();
 }
 
-// [Additional function implementations would go here...]
-
-string executeCommand(const char* cmd) {
-    char buffer[128];
-    string result = "";
-    FILE* pipe = popen(cmd, "r");
-    if (!pipe) return "Error";
-    while (fgets(buffer, sizeof(buffer), pipe) != NULL) {
-        result += buffer;
+// Headless mode: the shared collectors, as rplex.out's batch mode runs
+// them, plus any plugins; no ncurses and no graph history.
+int runBatch(const BatchConfig &config, const vector<string> &pluginPaths) {
+    MetricSet set;
+    add_builtin_collectors(set);
+    add_plugins(set, pluginPaths);
+    string error;
+    if(!set.init(error)) {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 1;
     }
-    pclose(pipe);
-    return result;
+    return run_batch(config, set);
 }
 
-string getCpuInfo() {
-    string model = executeCommand("lscpu | grep 'Model name' | cut -d':' -f2 | xargs");
-    model.erase(remove(model.begin(), model.end(), '\n'), model.end());
-    return model;
+// Bars are relative to the largest value in the history, or to 100%
+// while everything is still zero
+float graphScale(const vector<SeriesPoint> &history) {
+    float maxVal = 0;
+    for(size_t i = 0; i < history.size(); i++) maxVal = max(maxVal, history[i].avg);
+    return maxVal == 0 ? 100 : maxVal;
 }
 
-string getGpuInfo() {
-    string gpu = executeCommand("lspci | grep -i vga | cut -d':' -f3-");
-    gpu.erase(remove(gpu.begin(), gpu.end(), '\n'), gpu.end());
-    return gpu.empty() ? "Not detected" : gpu;
+void displayHardwareInfo(WINDOW *win, const SystemInfo &info) {
+    mvwprintw(win, 0, 0, "Hardware: %s @ %.0fMHz | GPU: %s | RAM: %s %.0fMT/s", 
+              info.cpuModel.c_str(), info.cpuSpeed, info.gpuModel.c_str(), 
+              info.ramType.c_str(), info.ramSpeed);
+    mvwprintw(win, 1, 0, "CPU: %s (%d cores, %d threads) | Storage: %.1f/%.1f GB free",
+              info.cpuModel.c_str(), info.physicalCores, info.logicalCores,
+              info.freeStorage / 1024.0, info.totalStorage / 1024.0);
+    mvwprintw(win, 2, 0, "Total CPU Usage: %.1f%%  %s", info.totalCpu,
+              statsLine(info.cpuStats[0], statsWindows[0]).c_str());
+    for(size_t i = 1; i < info.cpuStats.size(); i++) {
+        char label[24];
+        stats_window_label(statsWindows[i], label, sizeof(label));
+        wprintw(win, " | %s p95 %.1f", label, info.cpuStats[i].p95);
+    }
 }
 
-string getRamInfo() {
-    string ram = executeCommand("dmidecode --type memory | grep -i 'Type:' | head -1 | cut -d':' -f2");
-    ram.erase(remove(ram.begin(), ram.end(), '\n'), ram.end());
-    return ram.empty() ? "DDR4" : ram; // Default to DDR4 if not detected
+// Percentiles of one window, e.g. "1m avg 12.0 p50 10.1 p95 30.2 p99 41.0 max 55.0"
+string statsLine(const StatsSummary &stats, size_t window) {
+    char label[24], line[128];
+    stats_window_label(window, label, sizeof(label));
+    snprintf(line, sizeof(line), "%s avg %.1f p50 %.1f p95 %.1f p99 %.1f max %.1f",
+             label, stats.mean, stats.p50, stats.p95, stats.p99, stats.max);
+    return line;
 }
 
-void drawGraph(vector<double> &history, int y, int x, int height, int width, string color) {
-    if(history.empty()) return;
-    
-    double max_val = *max_element(history.begin(), history.end());
-    if(max_val == 0) max_val = 100;
-    
-    for(int i = 0; i < min((int)history.size(), width); i++) {
-        int bar_height = (history[i] / max_val) * height;
-        for(int j = 0; j < height; j++) {
-            if(j < bar_height) {
-                if(color == "red") attron(COLOR_PAIR(3));
-                else if(color == "green") attron(COLOR_PAIR(4));
-                mvaddch(y + height - j - 1, x + i, ACS_BLOCK);
-                if(color == "red") attroff(COLOR_PAIR(3));
-                else if(color == "green") attroff(COLOR_PAIR(4));
-            }
+// One character per core, darker to brighter in 10% steps
+char heatGlyph(const CpuCore &core) {
+    static const char ramp[] = " .:-=+*#%@";
+    if(!core.online) return 'x';
+    int level = (int)(core.usage / 10);
+    return ramp[max(0, min(level, 9))];
+}
+
+// The online core with the highest usage, for the heatmap title
+void busiestCore(const SystemInfo &info, int &id, float &usage) {
+    usage = 0;
+    id = 0;
+    for(size_t i = 0; i < info.cores.size(); i++) {
+        if(info.cores[i].online && info.cores[i].usage > usage) {
+            usage = info.cores[i].usage;
+            id = info.cores[i].id;
         }
     }
 }
 
-void drawCpuGraphs(SystemInfo &info) {
-    mvprintw(4, 0, "CPU: %s (%d cores, %d threads)", 
-             info.cpuModel.c_str(), info.physicalCores, info.logicalCores);
+void displayCoreHeatmap(WINDOW *win, const SystemInfo &info, int cellWidth, int perRow, int firstRow) {
+    float busiest;
+    int busiestId;
+    busiestCore(info, busiestId, busiest);
+    mvwprintw(win, 0, 0, "Cores: %d online | busiest: core %d at %.0f%% | ' .:-=+*#%%@' = 0-100%%",
+              info.logicalCores, busiestId, busiest);
     
-    // Main CPU graph
-    mvprintw(5, 0, "Total CPU Usage: %.1f%%", info.cores[0].usage);
-    drawGraph(info.cpuHistory, 6, 0, GRAPH_HEIGHT, COLS, "green");
-    
-    // Individual core graphs
-    int cols_per_core = COLS / min(4, info.logicalCores);
-    for(int i = 0; i < min(4, info.logicalCores); i++) {
-        int x = i * cols_per_core;
-        mvprintw(17, x, "Core %d: %.1f%%", i, info.cores[i].usage);
-        drawGraph(info.cores[i].history, 18, x, 5, cols_per_core-2, "yellow");
+    int rows = getmaxy(win) - 1;
+    for(int r = 0; r < rows; r++) {
+        wmove(win, r + 1, 0);
+        for(int c = 0; c < perRow; c++) {
+            int i = (firstRow + r) * perRow + c;
+            if(i >= (int)info.cores.size()) break;
+            // Cells of very busy cores stand out in bold; the selected one is reversed
+            attr_t attr = 0;
+            if(info.cores[i].online && info.cores[i].usage >= 80) attr |= A_BOLD;
+            if(i == info.selectedCore) attr |= A_REVERSE;
+            waddch(win, heatGlyph(info.cores[i]) | attr);
+            if(cellWidth > 1) waddch(win, ' ');
+        }
     }
 }
-
-void displayHardwareInfo(SystemInfo &info) {
-    mvprintw(3, 0, "Hardware: %s | GPU: %s | RAM: %s %ldMHz", 
-             info.cpuModel.c_str(), info.gpuModel.c_str(), 
-             info.ramType.c_str(), info.ramSpeed);
-}
@@ -0,0 +1,143 @@
+/************************************************************
+ * RPLEX - network identity
+ *
+ * Local addresses come straight from the kernel through
+ * getifaddrs(). The public address is an optional HTTP
+ * lookup that runs on its own thread, is cached for a TTL
+ * and never blocks the UI.
+ ************************************************************/
+
+#ifndef RPLEX_NETID_H
+#define RPLEX_NETID_H
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstring>
+#include <ifaddrs.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "rplex_snapshot.h"
+
+struct LocalAddress {
+    char ifname[IFNAMSIZ];
+    char addr[INET6_ADDRSTRLEN];
+    bool ipv6;
+};
+
+// Enumerate addresses of interfaces that are up, skipping loopback.
+// IPv4 addresses are listed before IPv6 ones.
+inline void list_local_addresses(std::vector<LocalAddress> &out) {
+    out.clear();
+    struct ifaddrs *ifs;
+    if (getifaddrs(&ifs) != 0) return;
+    for (int pass = 0; pass < 2; pass++) {
+        int family = pass == 0 ? AF_INET : AF_INET6;
+        for (struct ifaddrs *ifa = ifs; ifa; ifa = ifa->ifa_next) {
+            if (!ifa->ifa_addr || ifa->ifa_addr->sa_family != family) continue;
+            if (!(ifa->ifa_flags & IFF_UP) || (ifa->ifa_flags & IFF_LOOPBACK)) continue;
+            LocalAddress a;
+            strncpy(a.ifname, ifa->ifa_name, sizeof(a.ifname) - 1);
+            a.ifname[sizeof(a.ifname) - 1] = '\0';
+            a.ipv6 = family == AF_INET6;
+            const void *src = a.ipv6 ?
+                (const void *)&((struct sockaddr_in6 *)ifa->ifa_addr)->sin6_addr :
+                (const void *)&((struct sockaddr_in *)ifa->ifa_addr)->sin_addr;
+            if (!inet_ntop(family, src, a.addr, sizeof(a.addr))) continue;
+            out.push_back(a);
+        }
+    }
+    freeifaddrs(ifs);
+}
+
+struct NetIdConfig {
+    bool external;              // look up the public address at all
+    std::string url;            // plain-text "what is my IP" endpoint
+    int ttl_seconds;            // how long a successful lookup is reused
+    int retry_seconds;          // wait after a failed lookup
+    long timeout_ms;            // per-lookup limit, connect included
+
+    NetIdConfig() : external(true), url("https://api.ipify.org"), ttl_seconds(300),
+                    retry_seconds(30), timeout_ms(3000) {}
+};
+
+struct NetIdentity {
+    std::vector<LocalAddress> local;
+    std::string external;       // last good public address, empty if none yet
+    const char *external_status;  // "disabled", "pending", "ok", "unavailable"
+
+    NetIdentity() : external_status("pending") {}
+};
+
+// HTTP GET used for the public lookup. Kept as a hook so this header does
+// not depend on libcurl; returns false on any failure or timeout.
+typedef bool (*HttpFetch)(const std::string &url, long timeout_ms, std::string &body);
+
+class NetIdentityResolver {
+public:
+    NetIdentityResolver(const NetIdConfig &config, HttpFetch fetch)
+        : config_(config), fetch_(fetch), due_(std::chrono::steady_clock::now()) {
+        work_.external_status = config_.external && fetch_ ? "pending" : "disabled";
+    }
+
+    // Local addresses are re-read every `interval`; the public address
+    // only when its TTL has run out. `published`, if set, is called on
+    // the resolver thread after each update.
+    void start(std::chrono::milliseconds interval = std::chrono::milliseconds(5000),
+               std::function<void()> published = std::function<void()>()) {
+        published_hook_ = published;
+        sampler_.start(interval, [this] { sample(); });
+    }
+
+    void stop() { sampler_.stop(); }
+
+    // UI side: true when a newer identity became current().
+    bool acquire() { return published_.acquire(); }
+    const NetIdentity &current() const { return published_.front(); }
+
+private:
+    void sample() {
+        list_local_addresses(work_.local);
+
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (config_.external && fetch_ && now >= due_) {
+            std::string body;
+            if (fetch_(config_.url, config_.timeout_ms, body) && trim_address(body)) {
+                work_.external = body;
+                work_.external_status = "ok";
+                due_ = now + std::chrono::seconds(config_.ttl_seconds);
+            } else {
+                // Keep showing the last good address, just mark it stale.
+                work_.external_status = "unavailable";
+                due_ = now + std::chrono::seconds(config_.retry_seconds);
+            }
+        }
+
+        published_.back() = work_;
+        published_.publish();
+        if (published_hook_) published_hook_();
+    }
+
+    // Accept only something that looks like an address, so an HTML error
+    // page from a captive portal never lands in the panel.
+    static bool trim_address(std::string &s) {
+        size_t b = s.find_first_not_of(" \t\r\n");
+        size_t e = s.find_last_not_of(" \t\r\n");
+        if (b == std::string::npos) return false;
+        s = s.substr(b, e - b + 1);
+        if (s.size() >= INET6_ADDRSTRLEN) return false;
+        unsigned char buf[sizeof(struct in6_addr)];
+        return inet_pton(AF_INET, s.c_str(), buf) == 1 || inet_pton(AF_INET6, s.c_str(), buf) == 1;
+    }
+
+    NetIdConfig config_;
+    HttpFetch fetch_;
+    std::chrono::steady_clock::time_point due_;
+    NetIdentity work_;
+    TripleBuffer<NetIdentity> published_;
+    std::function<void()> published_hook_;
+    SamplerThread sampler_;
+};
+
+#endif
@@ -0,0 +1,207 @@
+/************************************************************
+ * RPLEX - network throughput
+ *
+ * Per-interface byte, packet, error and drop rates from
+ * /proc/net/dev, TCP segment and retransmit rates from
+ * /proc/net/snmp and socket counts from /proc/net/sockstat.
+ * Files stay open and are parsed in place into reused
+ * arrays, so a steady-state sample allocates nothing.
+ ************************************************************/
+
+#ifndef RPLEX_NETSTAT_H
+#define RPLEX_NETSTAT_H
+
+#include <vector>
+#include <chrono>
+#include <cstring>
+#include <stdint.h>
+#include "rplex_procfs.h"
+
+// Raw cumulative counters of one interface.
+struct NetIfCounters {
+    char name[16];
+    unsigned long long rx_bytes, rx_packets, rx_errors, rx_drops;
+    unsigned long long tx_bytes, tx_packets, tx_errors, tx_drops;
+};
+
+// Per-second rates of one interface over the last interval.
+struct NetIfRates {
+    char name[16];
+    double rx_bytes, rx_packets, rx_errors, rx_drops;
+    double tx_bytes, tx_packets, tx_errors, tx_drops;
+};
+
+struct NetStats {
+    std::vector<NetIfRates> interfaces;   // in /proc/net/dev order
+    double tcp_out_segments;    // per second
+    double tcp_retransmits;     // per second
+    double tcp_in_errors;       // per second
+    long tcp_established;
+    long tcp_in_use;
+    long tcp_time_wait;
+    long udp_in_use;
+    long sockets_used;
+
+    NetStats() : tcp_out_segments(0), tcp_retransmits(0), tcp_in_errors(0), tcp_established(0),
+                 tcp_in_use(0), tcp_time_wait(0), udp_in_use(0), sockets_used(0) {}
+
+    // Retransmitted share of sent segments, in percent.
+    double retransmit_percent() const {
+        return tcp_out_segments > 0 ? 100.0 * tcp_retransmits / tcp_out_segments : 0;
+    }
+};
+
+// Parse /proc/net/dev into out, reusing its storage. Interfaces appear
+// in file order; names longer than 15 characters are truncated.
+inline bool parse_net_dev(const ProcFile &f, std::vector<NetIfCounters> &out) {
+    size_t n = 0;
+    ProcScanner s(f);
+    // Two header lines
+    if (!s.next_line() || !s.next_line()) return false;
+    do {
+        s.skip_spaces();
+        const char *name = s.p;
+        while (s.p < s.end && *s.p != ':' && *s.p != '\n') s.p++;
+        if (s.p >= s.end || *s.p != ':') continue;
+        size_t len = s.p - name;
+        s.p++;   // counters may follow the colon without a space
+
+        if (n == out.size()) out.resize(n + 1);
+        NetIfCounters &c = out[n];
+        if (len >= sizeof(c.name)) len = sizeof(c.name) - 1;
+        memcpy(c.name, name, len);
+        c.name[len] = '\0';
+        unsigned long long ignored;
+        bool ok = s.next_u64(c.rx_bytes) && s.next_u64(c.rx_packets) &&
+                  s.next_u64(c.rx_errors) && s.next_u64(c.rx_drops);
+        // fifo frame compressed multicast
+        for (int i = 0; ok && i < 4; i++) ok = s.next_u64(ignored);
+        ok = ok && s.next_u64(c.tx_bytes) && s.next_u64(c.tx_packets) &&
+             s.next_u64(c.tx_errors) && s.next_u64(c.tx_drops);
+        if (ok) n++;
+    } while (s.next_line());
+    out.resize(n);
+    return true;
+}
+
+// Values of the named columns of a "Prefix: name name..." header line
+// followed by a "Prefix: value value..." line, as in /proc/net/snmp.
+// Columns not found are left untouched.
+inline bool parse_snmp_table(const ProcFile &f, const char *prefix, const char *const *names,
+                             long long *values, size_t count) {
+    ProcScanner header(f);
+    size_t plen = strlen(prefix);
+    if (!header.find_key(prefix, plen)) return false;
+    ProcScanner row = header;
+    if (!row.next_line() || !row.starts_with(prefix, plen)) return false;
+    while (true) {
+        header.skip_spaces();
+        const char *name = header.p;
+        if (!header.skip_field()) break;
+        size_t len = header.p - name;
+        long long v;
+        if (!row.next_i64(v)) return false;
+        for (size_t i = 0; i < count; i++) {
+            if (strlen(names[i]) == len && memcmp(names[i], name, len) == 0) values[i] = v;
+        }
+    }
+    return true;
+}
+
+// Find "key" on the line starting with `line` in /proc/net/sockstat and
+// read the number after it, e.g. ("TCP:", "tw").
+inline long sockstat_value(const ProcFile &f, const char *line, const char *key) {
+    ProcScanner s(f);
+    if (!s.find_key(line, strlen(line))) return 0;
+    size_t klen = strlen(key);
+    while (true) {
+        s.skip_spaces();
+        const char *token = s.p;
+        if (!s.skip_field()) return 0;
+        if ((size_t)(s.p - token) == klen && memcmp(token, key, klen) == 0) {
+            long long v;
+            return s.next_i64(v) ? (long)v : 0;
+        }
+    }
+}
+
+class NetSampler {
+public:
+    NetSampler() : dev_("/proc/net/dev"), snmp_("/proc/net/snmp"), sockstat_("/proc/net/sockstat"),
+                   have_last_(false) {
+        memset(tcp_prev_, 0, sizeof(tcp_prev_));
+    }
+
+    // Rates since the previous call; the first call only sets the baseline
+    // and reports zero rates.
+    void sample(NetStats &out) {
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        double elapsed = have_last_ ? std::chrono::duration<double>(now - last_).count() : 0;
+        last_ = now;
+
+        if (dev_.read()) parse_net_dev(dev_, cur_);
+        out.interfaces.resize(cur_.size());
+        for (size_t i = 0; i < cur_.size(); i++) {
+            const NetIfCounters &c = cur_[i];
+            const NetIfCounters *p = previous(c.name, i);
+            NetIfRates &r = out.interfaces[i];
+            memcpy(r.name, c.name, sizeof(r.name));
+            r.rx_bytes = rate(c.rx_bytes, p ? p->rx_bytes : c.rx_bytes, elapsed);
+            r.rx_packets = rate(c.rx_packets, p ? p->rx_packets : c.rx_packets, elapsed);
+            r.rx_errors = rate(c.rx_errors, p ? p->rx_errors : c.rx_errors, elapsed);
+            r.rx_drops = rate(c.rx_drops, p ? p->rx_drops : c.rx_drops, elapsed);
+            r.tx_bytes = rate(c.tx_bytes, p ? p->tx_bytes : c.tx_bytes, elapsed);
+            r.tx_packets = rate(c.tx_packets, p ? p->tx_packets : c.tx_packets, elapsed);
+            r.tx_errors = rate(c.tx_errors, p ? p->tx_errors : c.tx_errors, elapsed);
+            r.tx_drops = rate(c.tx_drops, p ? p->tx_drops : c.tx_drops, elapsed);
+        }
+        prev_.swap(cur_);
+
+        static const char *const tcp_names[] = {"CurrEstab", "OutSegs", "RetransSegs", "InErrs"};
+        long long tcp[4] = {0, 0, 0, 0};
+        if (snmp_.read() && parse_snmp_table(snmp_, "Tcp:", tcp_names, tcp, 4)) {
+            out.tcp_established = (long)tcp[0];
+            out.tcp_out_segments = have_last_ ? rate(tcp[1], tcp_prev_[1], elapsed) : 0;
+            out.tcp_retransmits = have_last_ ? rate(tcp[2], tcp_prev_[2], elapsed) : 0;
+            out.tcp_in_errors = have_last_ ? rate(tcp[3], tcp_prev_[3], elapsed) : 0;
+            memcpy(tcp_prev_, tcp, sizeof(tcp));
+        }
+        if (sockstat_.read()) {
+            out.sockets_used = sockstat_value(sockstat_, "sockets:", "used");
+            out.tcp_in_use = sockstat_value(sockstat_, "TCP:", "inuse");
+            out.tcp_time_wait = sockstat_value(sockstat_, "TCP:", "tw");
+            out.udp_in_use = sockstat_value(sockstat_, "UDP:", "inuse");
+        }
+        have_last_ = true;
+    }
+
+private:
+    NetSampler(const NetSampler &);
+    NetSampler &operator=(const NetSampler &);
+
+    // Interfaces come and go, so match by name, trying the same slot first.
+    const NetIfCounters *previous(const char *name, size_t hint) const {
+        if (!have_last_) return NULL;
+        if (hint < prev_.size() && strcmp(prev_[hint].name, name) == 0) return &prev_[hint];
+        for (size_t i = 0; i < prev_.size(); i++) {
+            if (strcmp(prev_[i].name, name) == 0) return &prev_[i];
+        }
+        return NULL;
+    }
+
+    // A counter that went backwards was reset (driver reload); count from 0.
+    static double rate(unsigned long long now, unsigned long long before, double elapsed) {
+        if (elapsed <= 0) return 0;
+        return (now >= before ? now - before : now) / elapsed;
+    }
+
+    ProcFile dev_;
+    ProcFile snmp_;
+    ProcFile sockstat_;
+    std::vector<NetIfCounters> cur_, prev_;
+    long long tcp_prev_[4];
+    std::chrono::steady_clock::time_point last_;
+    bool have_last_;
+};
+
+#endif
@@ -0,0 +1,64 @@
+/************************************************************
+ * RPLEX - collector plugin interface
+ *
+ * What a collector plugin exports. Plugins are shared
+ * objects loaded at startup with --plugin PATH, by either
+ * binary. This header is plain C and needs nothing else
+ * from rplex, so a site-specific collector builds on its
+ * own, in C or C++:
+ *
+ *   cc -shared -fPIC -O2 -o myplugin.so myplugin.c
+ ************************************************************/
+
+#ifndef RPLEX_PLUGIN_H
+#define RPLEX_PLUGIN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RPLEX_PLUGIN_ABI 1
+#define RPLEX_PLUGIN_ENTRY "rplex_plugin_entry"
+
+/* One value reported on every sample. The name becomes a batch
+ * column and the /metrics family rplex_plugin_<name>, so it is
+ * made of lower case letters, digits and '_', must not clash with
+ * another metric and must not start with "self_". */
+struct rplex_metric {
+    const char *name;
+    const char *unit;    /* "%", "MB", "1/s"... or "" */
+    const char *help;    /* one line */
+};
+
+struct rplex_plugin {
+    uint32_t abi;                           /* RPLEX_PLUGIN_ABI */
+    const char *name;
+    size_t metric_count;
+    const struct rplex_metric *metrics;
+
+    /* Called once before the first sample. Returns the state handed to
+     * the other calls (may be NULL), or sets error and returns NULL with
+     * error[0] != 0 on failure. May itself be NULL. */
+    void *(*init)(char *error, size_t error_cap);
+
+    /* Write metric_count values, NAN for any not known right now. Called
+     * from one thread at a time, up to tens of times a second: keep files
+     * open and do not block. Nonzero means the whole sample failed. */
+    int (*sample)(void *state, double *values);
+
+    /* May be NULL. */
+    void (*destroy)(void *state);
+};
+
+/* The symbol rplex looks up; the returned struct lives as long as the
+ * plugin stays loaded. */
+const struct rplex_plugin *rplex_plugin_entry(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
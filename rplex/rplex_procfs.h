@@ -0,0 +1,387 @@
+/************************************************************
+ * RPLEX - procfs reader
+ *
+ * Shared by rplex_monitor.cpp and rplex_monitor3.cpp.
+ * Files are opened once and re-read with pread() into a
+ * buffer that only ever grows, and numbers are parsed with
+ * a small scanner, so a steady-state sample allocates nothing.
+ *
+ * procfs and sysfs may be relocated (set_fs_roots()), so
+ * benchmarks and tests can run every collector against a
+ * synthetic fixture tree.
+ ************************************************************/
+
+#ifndef RPLEX_PROCFS_H
+#define RPLEX_PROCFS_H
+
+#include <vector>
+#include <string>
+#include <atomic>
+#include <cstring>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/resource.h>
+
+// Opens of procfs/sysfs files since startup, for the self-profile.
+inline std::atomic<unsigned long long> &proc_open_count() {
+    static std::atomic<unsigned long long> count(0);
+    return count;
+}
+
+// Where procfs and sysfs are found; empty means /proc and /sys.
+struct FsRoots {
+    std::string proc;
+    std::string sys;
+};
+
+inline FsRoots &fs_roots() {
+    static FsRoots roots;
+    return roots;
+}
+
+// Relocate /proc and /sys, e.g. to a fixture tree. Call before the first
+// sample: files already open keep pointing where they were opened.
+inline void set_fs_roots(const char *proc, const char *sys) {
+    fs_roots().proc = proc ? proc : "";
+    fs_roots().sys = sys ? sys : "";
+}
+
+// Map an absolute /proc or /sys path onto the configured roots, using
+// buf when it has to be rewritten. /proc/self and /proc/thread-self
+// always mean rplex itself.
+inline const char *fs_path(const char *path, char *buf, size_t cap) {
+    const FsRoots &r = fs_roots();
+    const std::string *root = NULL;
+    size_t skip = 0;
+    if (!r.proc.empty() && strncmp(path, "/proc", 5) == 0 && (path[5] == '/' || path[5] == '\0') &&
+        strncmp(path + 5, "/self", 5) != 0 && strncmp(path + 5, "/thread-self", 12) != 0) {
+        root = &r.proc;
+        skip = 5;
+    } else if (!r.sys.empty() && strncmp(path, "/sys", 4) == 0 && (path[4] == '/' || path[4] == '\0')) {
+        root = &r.sys;
+        skip = 4;
+    }
+    if (!root) return path;
+    snprintf(buf, cap, "%s%s", root->c_str(), path + skip);
+    return buf;
+}
+
+// Read-only, close-on-exec open that is counted in proc_open_count().
+inline int proc_open(const char *path) {
+    char buf[4096];
+    proc_open_count().fetch_add(1, std::memory_order_relaxed);
+    return ::open(fs_path(path, buf, sizeof(buf)), O_RDONLY | O_CLOEXEC);
+}
+
+inline DIR *proc_opendir(const char *path) {
+    char buf[4096];
+    return opendir(fs_path(path, buf, sizeof(buf)));
+}
+
+inline bool proc_exists(const char *path) {
+    char buf[4096];
+    return access(fs_path(path, buf, sizeof(buf)), F_OK) == 0;
+}
+
+// A procfs/sysfs file held open between samples. The kernel regenerates
+// the contents on every read from offset 0, so one fd serves forever
+// (for /proc/<pid>/* until the process exits and reads fail with ESRCH).
+// Constructed with a path, the file is opened on the first read(), so
+// long-lived samplers follow set_fs_roots() calls made after they exist;
+// until an open succeeds every read() tries again, so a file that
+// appears later is picked up.
+class ProcFile {
+public:
+    ProcFile() : fd_(-1), len_(0) {}
+    explicit ProcFile(const char *path) : fd_(-1), len_(0), deferred_(path) {}
+    ~ProcFile() { close(); }
+
+    bool open(const char *path) {
+        close();
+        deferred_.clear();
+        fd_ = proc_open(path);
+        return fd_ >= 0;
+    }
+
+    void close() {
+        if (fd_ >= 0) ::close(fd_);
+        fd_ = -1;
+        len_ = 0;
+    }
+
+    // Only true once opened; a deferred path is opened by read().
+    bool is_open() const { return fd_ >= 0; }
+
+    // Re-read the whole file. Returns false if the fd is gone or the
+    // read failed (e.g. the process behind a /proc/<pid> file exited).
+    bool read() {
+        if (!deferred_.empty()) {
+            fd_ = proc_open(deferred_.c_str());
+            if (fd_ >= 0) deferred_.clear();
+        }
+        return pread_all(fd_, buf_, len_);
+    }
+
+    // Read all of fd from offset 0 into buf (NUL-terminated), growing it as
+    // needed. Callers that keep many fds share one buffer through this.
+    static bool pread_all(int fd, std::vector<char> &buf, size_t &len) {
+        len = 0;
+        if (fd < 0) return false;
+        if (buf.empty()) buf.resize(4096);
+        while (true) {
+            ssize_t n = ::pread(fd, &buf[len], buf.size() - len - 1, len);
+            if (n < 0) {
+                len = 0;
+                return false;
+            }
+            if (n == 0) break;
+            len += n;
+            if (len + 1 >= buf.size()) buf.resize(buf.size() * 2);
+        }
+        buf[len] = '\0';
+        return true;
+    }
+
+    const char *data() const { return buf_.empty() ? "" : &buf_[0]; }
+    size_t size() const { return len_; }
+
+private:
+    ProcFile(const ProcFile &);
+    ProcFile &operator=(const ProcFile &);
+
+    int fd_;
+    std::vector<char> buf_;
+    size_t len_;
+    std::string deferred_;   // path to open on the first read()
+};
+
+// Forward-only, non-allocating tokenizer over a ProcFile buffer.
+struct ProcScanner {
+    const char *p;
+    const char *end;
+
+    ProcScanner(const char *data, size_t len) : p(data), end(data + len) {}
+    explicit ProcScanner(const ProcFile &f) : p(f.data()), end(f.data() + f.size()) {}
+
+    bool at_end() const { return p >= end; }
+
+    void skip_spaces() {
+        while (p < end && (*p == ' ' || *p == '\t')) p++;
+    }
+
+    // Skip one whitespace-delimited token on the current line.
+    bool skip_field() {
+        skip_spaces();
+        if (p >= end || *p == '\n') return false;
+        while (p < end && *p != ' ' && *p != '\t' && *p != '\n') p++;
+        return true;
+    }
+
+    bool skip_fields(int n) {
+        for (int i = 0; i < n; i++) {
+            if (!skip_field()) return false;
+        }
+        return true;
+    }
+
+    // Move to the first character of the next line.
+    bool next_line() {
+        while (p < end && *p != '\n') p++;
+        if (p >= end) return false;
+        p++;
+        return p < end;
+    }
+
+    bool next_u64(unsigned long long &v) {
+        skip_spaces();
+        if (p >= end || *p < '0' || *p > '9') return false;
+        unsigned long long r = 0;
+        while (p < end && *p >= '0' && *p <= '9') {
+            r = r * 10 + (unsigned)(*p - '0');
+            p++;
+        }
+        v = r;
+        return true;
+    }
+
+    bool next_i64(long long &v) {
+        skip_spaces();
+        bool neg = false;
+        if (p < end && *p == '-') {
+            neg = true;
+            p++;
+        }
+        unsigned long long u;
+        if (!next_u64(u)) return false;
+        v = neg ? -(long long)u : (long long)u;
+        return true;
+    }
+
+    // Unsigned fixed-point number such as "0.66", as in /proc/pressure.
+    bool next_decimal(double &v) {
+        unsigned long long whole;
+        if (!next_u64(whole)) return false;
+        v = (double)whole;
+        if (p < end && *p == '.') {
+            double scale = 0.1;
+            for (p++; p < end && *p >= '0' && *p <= '9'; p++, scale /= 10) v += (*p - '0') * scale;
+        }
+        return true;
+    }
+
+    bool looking_at(const char *prefix, size_t len) const {
+        return (size_t)(end - p) >= len && memcmp(p, prefix, len) == 0;
+    }
+
+    // True if the input continues with `prefix`; advances past it.
+    bool starts_with(const char *prefix, size_t len) {
+        if (!looking_at(prefix, len)) return false;
+        p += len;
+        return true;
+    }
+
+    // Advance to the line starting with `key` and position just after it.
+    // Searches from the current position only, so keys should be looked up
+    // in file order.
+    bool find_key(const char *key, size_t len) {
+        while (p < end) {
+            if (starts_with(key, len)) return true;
+            if (!next_line()) return false;
+        }
+        return false;
+    }
+
+    // Copy the rest of the current line (trimmed) into out, truncating.
+    size_t rest_of_line(char *out, size_t cap) {
+        skip_spaces();
+        const char *s = p;
+        while (p < end && *p != '\n') p++;
+        const char *e = p;
+        while (e > s && (e[-1] == ' ' || e[-1] == '\t')) e--;
+        size_t n = e - s;
+        if (cap == 0) return 0;
+        if (n >= cap) n = cap - 1;
+        memcpy(out, s, n);
+        out[n] = '\0';
+        return n;
+    }
+};
+
+// Fields of /proc/<pid>/stat that the monitors use. Field numbers follow proc(5).
+struct PidStat {
+    char state;
+    int ppid;
+    unsigned long long utime;      // field 14
+    unsigned long long stime;      // field 15
+    long long num_threads;         // field 20
+    unsigned long long starttime;  // field 22
+    long long rss_pages;           // field 24
+};
+
+// Parse /proc/<pid>/stat. comm may contain spaces and parentheses, so
+// scanning restarts after the last ')'.
+inline bool parse_pid_stat(const char *data, size_t len, PidStat &out,
+                           char *comm = NULL, size_t comm_cap = 0) {
+    const char *open_paren = (const char *)memchr(data, '(', len);
+    const char *close_paren = NULL;
+    for (const char *q = data + len; q > data; q--) {
+        if (q[-1] == ')') {
+            close_paren = q - 1;
+            break;
+        }
+    }
+    if (!open_paren || !close_paren || close_paren < open_paren) return false;
+
+    if (comm && comm_cap) {
+        size_t n = close_paren - open_paren - 1;
+        if (n >= comm_cap) n = comm_cap - 1;
+        memcpy(comm, open_paren + 1, n);
+        comm[n] = '\0';
+    }
+
+    ProcScanner s(close_paren + 1, data + len - close_paren - 1);
+    s.skip_spaces();
+    if (s.at_end()) return false;
+    out.state = *s.p++;
+
+    long long ppid;
+    unsigned long long ignored;
+    if (!s.next_i64(ppid)) return false;
+    out.ppid = (int)ppid;
+    // pgrp session tty_nr tpgid flags minflt cminflt majflt cmajflt
+    for (int i = 0; i < 9; i++) {
+        long long v;
+        if (!s.next_i64(v)) return false;
+    }
+    if (!s.next_u64(out.utime) || !s.next_u64(out.stime)) return false;
+    // cutime cstime priority nice
+    for (int i = 0; i < 4; i++) {
+        long long v;
+        if (!s.next_i64(v)) return false;
+    }
+    if (!s.next_i64(out.num_threads)) return false;
+    if (!s.next_u64(ignored)) return false;  // itrealvalue
+    if (!s.next_u64(out.starttime)) return false;
+    if (!s.next_u64(ignored)) return false;  // vsize
+    if (!s.next_i64(out.rss_pages)) return false;
+    return true;
+}
+
+// The aggregate or per-core line of /proc/stat.
+struct CpuTimes {
+    unsigned long long user, nice, system, idle, iowait, irq, softirq, steal;
+
+    unsigned long long total() const {
+        return user + nice + system + idle + iowait + irq + softirq + steal;
+    }
+    unsigned long long idle_all() const { return idle + iowait; }
+};
+
+// Parse the numbers after a "cpu"/"cpuN" label. Older kernels stop
+// before steal, so missing trailing fields read as zero.
+inline bool parse_cpu_times(ProcScanner &s, CpuTimes &t) {
+    unsigned long long *fields[] = {&t.user, &t.nice, &t.system, &t.idle,
+                                    &t.iowait, &t.irq, &t.softirq, &t.steal};
+    for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+        if (!s.next_u64(*fields[i])) {
+            if (i < 4) return false;
+            *fields[i] = 0;
+        }
+    }
+    return true;
+}
+
+// Format "/proc/<pid>/<leaf>" into buf without touching the heap.
+inline const char *proc_pid_path(char *buf, size_t cap, int pid, const char *leaf) {
+    snprintf(buf, cap, "/proc/%d/%s", pid, leaf);
+    return buf;
+}
+
+// Read the first line of a small sysfs/procfs file, without the newline.
+inline bool read_first_line(const char *path, char *out, size_t cap) {
+    if (cap == 0) return false;
+    out[0] = '\0';
+    int fd = proc_open(path);
+    if (fd < 0) return false;
+    ssize_t n = ::read(fd, out, cap - 1);
+    ::close(fd);
+    if (n < 0) return false;
+    out[n] = '\0';
+    char *nl = strchr(out, '\n');
+    if (nl) *nl = '\0';
+    return true;
+}
+
+// Keeping per-PID files open needs several fds per task; lift the soft
+// limit to the hard limit once at startup.
+inline void raise_fd_limit() {
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+}
+
+#endif
@@ -0,0 +1,349 @@
+/************************************************************
+ * RPLEX - process lifecycle events
+ *
+ * Subscribes to the kernel proc connector (netlink) for
+ * fork, exec and exit notifications, so the process table
+ * can be kept current without listing /proc every sample,
+ * and processes that live for less than one sample are
+ * still counted. Needs CAP_NET_ADMIN in the initial
+ * namespaces; anywhere else the tracker keeps polling.
+ ************************************************************/
+
+#ifndef RPLEX_PROCLIFE_H
+#define RPLEX_PROCLIFE_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/connector.h>
+#include <linux/cn_proc.h>
+#include "rplex_procfs.h"
+#include "rplex_proctable.h"
+#include "rplex_series.h"
+
+struct ProcEvent {
+    enum Type { FORK, EXEC, EXIT };
+    Type type;
+    int pid;
+    int ppid;           // FORK only
+    int exit_code;      // EXIT only, as from wait()
+    char name[16];      // EXEC only, read as the event arrived
+};
+
+// Reads the proc connector on its own thread, so a process that execs
+// and exits within a sample still has its name read while it runs.
+// Events queue up until the sampler drains them.
+class ProcConnector {
+public:
+    ProcConnector() : fd_(-1), running_(false), overflow_(false) {
+        wake_[0] = wake_[1] = -1;
+    }
+
+    ~ProcConnector() {
+        stop();
+        if (fd_ >= 0) ::close(fd_);
+    }
+
+    // Subscribe and wait for the kernel's acknowledgement. Without
+    // privileges the bind fails; outside the initial PID or user
+    // namespace the kernel ignores the request, so no ack arrives.
+    bool open(std::string &error) {
+        fd_ = socket(PF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_CONNECTOR);
+        if (fd_ < 0) {
+            error = strerror(errno);
+            return false;
+        }
+        int rcvbuf = 4 << 20;
+        setsockopt(fd_, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+        struct sockaddr_nl addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.nl_family = AF_NETLINK;
+        addr.nl_groups = CN_IDX_PROC;
+        if (bind(fd_, (struct sockaddr *)&addr, sizeof(addr)) != 0 || !subscribe(PROC_CN_MCAST_LISTEN)) {
+            error = strerror(errno);
+            close_socket();
+            return false;
+        }
+        if (!wait_for_ack(500, error)) {
+            close_socket();
+            return false;
+        }
+        return true;
+    }
+
+    void start() {
+        if (fd_ < 0 || running_) return;
+        if (pipe2(wake_, O_NONBLOCK | O_CLOEXEC) != 0) return;
+        running_ = true;
+        thread_ = std::thread(&ProcConnector::run, this);
+    }
+
+    void stop() {
+        if (!running_) return;
+        running_ = false;
+        ssize_t ignored = write(wake_[1], "x", 1);
+        (void)ignored;
+        thread_.join();
+        ::close(wake_[0]);
+        ::close(wake_[1]);
+        wake_[0] = wake_[1] = -1;
+        subscribe(PROC_CN_MCAST_IGNORE);
+    }
+
+    bool is_open() const { return fd_ >= 0; }
+
+    // Swap out the events queued since the last call. Returns false if
+    // any were lost (socket or queue overflow), in which case the caller
+    // must rebuild its view from /proc.
+    bool drain(std::vector<ProcEvent> &out) {
+        out.clear();
+        std::lock_guard<std::mutex> lock(mutex_);
+        out.swap(queue_);
+        return !overflow_.exchange(false);
+    }
+
+private:
+    ProcConnector(const ProcConnector &);
+    ProcConnector &operator=(const ProcConnector &);
+
+    enum { MAX_QUEUED = 1 << 16 };
+
+    void close_socket() {
+        ::close(fd_);
+        fd_ = -1;
+    }
+
+    bool subscribe(enum proc_cn_mcast_op op) {
+        char buf[NLMSG_SPACE(sizeof(struct cn_msg) + sizeof(op))];
+        memset(buf, 0, sizeof(buf));
+        struct nlmsghdr *nl = (struct nlmsghdr *)buf;
+        nl->nlmsg_len = NLMSG_LENGTH(sizeof(struct cn_msg) + sizeof(op));
+        nl->nlmsg_type = NLMSG_DONE;
+        nl->nlmsg_pid = 0;
+        struct cn_msg *msg = (struct cn_msg *)NLMSG_DATA(nl);
+        msg->id.idx = CN_IDX_PROC;
+        msg->id.val = CN_VAL_PROC;
+        msg->len = sizeof(op);
+        memcpy(msg->data, &op, sizeof(op));
+        return send(fd_, nl, nl->nlmsg_len, 0) >= 0;
+    }
+
+    bool wait_for_ack(int timeout_ms, std::string &error) {
+        struct pollfd p;
+        p.fd = fd_;
+        p.events = POLLIN;
+        while (poll(&p, 1, timeout_ms) > 0) {
+            ssize_t n = recv(fd_, buf_, sizeof(buf_), 0);
+            if (n <= 0) break;
+            for (struct nlmsghdr *nl = (struct nlmsghdr *)buf_; NLMSG_OK(nl, (size_t)n); nl = NLMSG_NEXT(nl, n)) {
+                const struct proc_event *ev = event_of(nl);
+                if (!ev || ev->what != proc_event::PROC_EVENT_NONE) continue;
+                if (ev->event_data.ack.err == 0) return true;
+                error = strerror(ev->event_data.ack.err);
+                return false;
+            }
+        }
+        error = "no acknowledgement (not in the initial namespace?)";
+        return false;
+    }
+
+    static const struct proc_event *event_of(struct nlmsghdr *nl) {
+        if (nl->nlmsg_type == NLMSG_ERROR || nl->nlmsg_type == NLMSG_NOOP) return NULL;
+        const struct cn_msg *msg = (const struct cn_msg *)NLMSG_DATA(nl);
+        if (msg->id.idx != CN_IDX_PROC || msg->id.val != CN_VAL_PROC) return NULL;
+        if (msg->len < sizeof(struct proc_event) - sizeof(((struct proc_event *)0)->event_data)) return NULL;
+        return (const struct proc_event *)msg->data;
+    }
+
+    // Threads fork and exit too; only whole processes are kept.
+    bool translate(const struct proc_event *ev, ProcEvent &out) {
+        memset(&out, 0, sizeof(out));
+        switch (ev->what) {
+        case proc_event::PROC_EVENT_FORK:
+            if (ev->event_data.fork.child_pid != ev->event_data.fork.child_tgid) return false;
+            out.type = ProcEvent::FORK;
+            out.pid = ev->event_data.fork.child_tgid;
+            out.ppid = ev->event_data.fork.parent_tgid;
+            return true;
+        case proc_event::PROC_EVENT_EXEC: {
+            out.type = ProcEvent::EXEC;
+            out.pid = ev->event_data.exec.process_tgid;
+            char path[64];
+            read_first_line(proc_pid_path(path, sizeof(path), out.pid, "comm"), out.name, sizeof(out.name));
+            return true;
+        }
+        case proc_event::PROC_EVENT_EXIT:
+            if (ev->event_data.exit.process_pid != ev->event_data.exit.process_tgid) return false;
+            out.type = ProcEvent::EXIT;
+            out.pid = ev->event_data.exit.process_tgid;
+            out.exit_code = ev->event_data.exit.exit_code;
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    void run() {
+        std::vector<ProcEvent> batch;
+        struct pollfd fds[2];
+        fds[0].fd = wake_[0];
+        fds[0].events = POLLIN;
+        fds[1].fd = fd_;
+        fds[1].events = POLLIN;
+        while (running_) {
+            if (poll(fds, 2, 1000) < 0 && errno != EINTR) break;
+            if (!(fds[1].revents & POLLIN)) continue;
+            batch.clear();
+            ssize_t n;
+            while ((n = recv(fd_, buf_, sizeof(buf_), MSG_DONTWAIT)) > 0) {
+                for (struct nlmsghdr *nl = (struct nlmsghdr *)buf_; NLMSG_OK(nl, (size_t)n); nl = NLMSG_NEXT(nl, n)) {
+                    const struct proc_event *ev = event_of(nl);
+                    ProcEvent e;
+                    if (ev && translate(ev, e)) batch.push_back(e);
+                }
+            }
+            // The kernel dropped messages because we fell behind
+            if (n < 0 && errno == ENOBUFS) overflow_ = true;
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (queue_.size() + batch.size() > MAX_QUEUED) {
+                overflow_ = true;   // sampler stalled; it will rescan
+                continue;
+            }
+            queue_.insert(queue_.end(), batch.begin(), batch.end());
+        }
+    }
+
+    int fd_;
+    int wake_[2];
+    std::atomic<bool> running_;
+    std::atomic<bool> overflow_;
+    std::thread thread_;
+    std::mutex mutex_;
+    std::vector<ProcEvent> queue_;
+    char buf_[16384] __attribute__((aligned(NLMSG_ALIGNTO)));
+};
+
+// A process that exited before any sample saw it.
+struct ShortLivedProcess {
+    int pid;
+    int exit_code;
+    char name[16];
+};
+
+// Keeps a ProcessTable current. With a connector it applies events and
+// refreshes only known PIDs, listing /proc again once RESCAN_SECONDS
+// have passed (whatever the collector period) as a consistency check,
+// or after lost events; without one it scans every update as before.
+class ProcessTracker {
+public:
+    enum { RESCAN_SECONDS = 60 };
+
+    explicit ProcessTracker(ProcessTable &table)
+        : table_(table), events_(NULL), need_scan_(true), short_lived_(32),
+          forks_(0), execs_(0), exits_(0), short_total_(0), last_forks_(0), last_execs_(0),
+          last_exits_(0), last_short_(0) {}
+
+    // Switch to events from an open, started connector.
+    void attach(ProcConnector *events) {
+        events_ = events;
+        need_scan_ = true;
+    }
+
+    bool event_driven() const { return events_ != NULL; }
+
+    void update() {
+        if (!events_) {
+            table_.scan();
+            return;
+        }
+        bool complete = events_->drain(pending_);
+        unsigned long forks = 0, execs = 0, exits = 0, short_lived = 0;
+        for (size_t i = 0; i < pending_.size(); i++) {
+            const ProcEvent &e = pending_[i];
+            if (e.type == ProcEvent::FORK) {
+                // Until it execs, a child runs its parent's program
+                forks++;
+                long parent = table_.find(e.ppid);
+                born_[e.pid] = parent >= 0 ? table_.name(parent) : "";
+                table_.track(e.pid);
+            } else if (e.type == ProcEvent::EXEC) {
+                execs++;
+                born_[e.pid] = e.name;
+                table_.track(e.pid);
+            } else {
+                exits++;
+                std::unordered_map<int, std::string>::iterator it = born_.find(e.pid);
+                if (it != born_.end() && table_.find(e.pid) < 0) {
+                    // Forked and gone within one interval
+                    ShortLivedProcess p;
+                    p.pid = e.pid;
+                    p.exit_code = e.exit_code;
+                    strncpy(p.name, it->second.c_str(), sizeof(p.name) - 1);
+                    p.name[sizeof(p.name) - 1] = '\0';
+                    short_lived_.push(p);
+                    short_lived++;
+                }
+                if (it != born_.end()) born_.erase(it);
+                table_.forget(e.pid);
+            }
+        }
+        if (!complete) born_.clear();   // some exits may never be seen
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (!complete || need_scan_ || now - last_scan_ >= std::chrono::seconds(RESCAN_SECONDS)) {
+            table_.scan();
+            last_scan_ = now;
+            need_scan_ = false;
+        } else {
+            table_.refresh();
+        }
+        last_forks_ = forks;
+        last_execs_ = execs;
+        last_exits_ = exits;
+        last_short_ = short_lived;
+        forks_ += forks;
+        execs_ += execs;
+        exits_ += exits;
+        short_total_ += short_lived;
+    }
+
+    // Events applied by the last update() and since the start.
+    unsigned long last_forks() const { return last_forks_; }
+    unsigned long last_execs() const { return last_execs_; }
+    unsigned long last_exits() const { return last_exits_; }
+    unsigned long last_short_lived() const { return last_short_; }
+    unsigned long forks() const { return forks_; }
+    unsigned long execs() const { return execs_; }
+    unsigned long exits() const { return exits_; }
+    unsigned long short_lived() const { return short_total_; }
+
+    // Most recent processes that never made it into a sample, oldest first.
+    const RingBuffer<ShortLivedProcess> &recent_short_lived() const { return short_lived_; }
+
+private:
+    ProcessTracker(const ProcessTracker &);
+    ProcessTracker &operator=(const ProcessTracker &);
+
+    ProcessTable &table_;
+    ProcConnector *events_;
+    bool need_scan_;   // no full listing since attach()
+    std::chrono::steady_clock::time_point last_scan_;
+    std::vector<ProcEvent> pending_;
+    std::unordered_map<int, std::string> born_;   // reported since we started, until they exit
+    RingBuffer<ShortLivedProcess> short_lived_;
+    unsigned long forks_, execs_, exits_, short_total_;
+    unsigned long last_forks_, last_execs_, last_exits_, last_short_;
+};
+
+#endif
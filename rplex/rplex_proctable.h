@@ -0,0 +1,657 @@
+/************************************************************
+ * RPLEX - process table
+ *
+ * Persistent, PID-keyed view of every task in /proc. Each
+ * scan walks the whole directory, re-reads /proc/<pid>/stat
+ * through an fd kept open since the PID was first seen, and
+ * turns utime+stime deltas into per-interval CPU%, and the
+ * read_bytes/write_bytes of /proc/<pid>/io into I/O rates.
+ * PSS and swap come from smaps_rollup, which walks every
+ * mapping and is far dearer, so it is only read on request
+ * for the rows being shown (sample_memory()).
+ *
+ * When process lifecycle events are available (see
+ * rplex_proclife.h) refresh() re-reads only the known PIDs
+ * plus the ones reported as new, skipping the readdir.
+ *
+ * Rows are also linked into the process tree by PPID: each
+ * row keeps its parent, first child and siblings, and the
+ * links are patched as rows come, go or get reparented, so
+ * the tree is never rebuilt from scratch. Pointed at
+ * /proc/<pid>/task the same table follows one process's
+ * threads; /proc/<tid>/stat would count the whole process.
+ *
+ * Storage is one array per column so sorting and top-K only
+ * touch the column being compared, and names are interned
+ * in an arena, so a steady-state scan does not allocate.
+ ************************************************************/
+
+#ifndef RPLEX_PROCTABLE_H
+#define RPLEX_PROCTABLE_H
+
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <chrono>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <stdint.h>
+#include <dirent.h>
+#include "rplex_procfs.h"
+
+// Deduplicated, append-only store of short NUL-terminated strings.
+// Process names repeat heavily (kworker, bash, java...), so the arena
+// stays small and an id is a 32-bit offset instead of a std::string.
+class NameArena {
+public:
+    NameArena() : count_(0) {
+        chars_.reserve(4096);
+        slots_.assign(256, 0);
+    }
+
+    uint32_t intern(const char *s, size_t len) {
+        if ((count_ + 1) * 2 > slots_.size()) grow();
+        size_t mask = slots_.size() - 1;
+        for (size_t i = hash(s, len) & mask;; i = (i + 1) & mask) {
+            uint32_t slot = slots_[i];
+            if (slot == 0) {
+                uint32_t off = (uint32_t)chars_.size();
+                chars_.insert(chars_.end(), s, s + len);
+                chars_.push_back('\0');
+                slots_[i] = off + 1;
+                count_++;
+                return off;
+            }
+            const char *existing = &chars_[slot - 1];
+            if (strncmp(existing, s, len) == 0 && existing[len] == '\0') return slot - 1;
+        }
+    }
+
+    const char *get(uint32_t id) const { return &chars_[id]; }
+    size_t bytes() const { return chars_.size(); }
+
+private:
+    static size_t hash(const char *s, size_t len) {
+        uint32_t h = 2166136261u;  // FNV-1a
+        for (size_t i = 0; i < len; i++) h = (h ^ (unsigned char)s[i]) * 16777619u;
+        return h;
+    }
+
+    void grow() {
+        std::vector<uint32_t> old;
+        old.swap(slots_);
+        slots_.assign(old.size() * 2, 0);
+        size_t mask = slots_.size() - 1;
+        for (size_t j = 0; j < old.size(); j++) {
+            if (!old[j]) continue;
+            const char *s = &chars_[old[j] - 1];
+            size_t i = hash(s, strlen(s)) & mask;
+            while (slots_[i]) i = (i + 1) & mask;
+            slots_[i] = old[j];
+        }
+    }
+
+    std::vector<char> chars_;
+    std::vector<uint32_t> slots_;  // offset + 1, 0 = empty
+    size_t count_;
+};
+
+enum ProcSortKey {
+    SORT_CPU,
+    SORT_MEM,
+    SORT_PID,
+    SORT_NAME,
+    SORT_IO
+};
+
+class ProcessTable {
+public:
+    // dir lists the tasks, each with a stat and io file below it.
+    explicit ProcessTable(const char *dir = "/proc")
+        : len_(0), generation_(0), clk_tck_(sysconf(_SC_CLK_TCK)),
+          page_kb_(sysconf(_SC_PAGESIZE) / 1024), have_last_(false), held_fds_(0) {
+        snprintf(dir_, sizeof(dir_), "%s", dir);
+        raise_fd_limit();
+        // Keep headroom below the limit: a row read open/read/close
+        // still needs a free fd, as do sockets and the other tables.
+        struct rlimit rl;
+        rlim_t limit = getrlimit(RLIMIT_NOFILE, &rl) == 0 ? rl.rlim_cur : 1024;
+        fd_budget_ = limit > 512 ? (size_t)(limit - 256) : (size_t)(limit / 2);
+    }
+
+    ~ProcessTable() {
+        for (size_t i = 0; i < stat_fd_.size(); i++) {
+            if (stat_fd_[i] >= 0) ::close(stat_fd_[i]);
+            if (io_fd_[i] >= 0) ::close(io_fd_[i]);
+        }
+    }
+
+    // Walk all of /proc once, refresh every entry and drop exited PIDs.
+    void scan() {
+        double elapsed = begin_pass();
+        pending_.clear();   // the walk finds them anyway
+
+        DIR *dir = proc_opendir(dir_);
+        if (!dir) return;
+        struct dirent *ent;
+        while ((ent = readdir(dir)) != NULL) {
+            if (!isdigit((unsigned char)ent->d_name[0])) continue;
+            update_pid(atoi(ent->d_name), elapsed);
+        }
+        closedir(dir);
+        sweep();
+    }
+
+    // Refresh the PIDs already in the table plus those passed to track(),
+    // without listing /proc. Only complete while every new process has
+    // been reported, so callers fall back to scan() when unsure.
+    void refresh() {
+        double elapsed = begin_pass();
+        for (size_t i = 0; i < pending_.size(); i++) update_pid(pending_[i], elapsed);
+        pending_.clear();
+        for (size_t i = 0; i < pid_.size(); i++) {
+            if (seen_[i] != generation_) update_pid(pid_[i], elapsed);
+        }
+        sweep();
+    }
+
+    // A process appeared; it is read on the next refresh().
+    void track(int pid) { pending_.push_back(pid); }
+
+    // A process exited; drop its row now instead of at the next read.
+    void forget(int pid) {
+        std::unordered_map<int, size_t>::iterator it = index_.find(pid);
+        if (it != index_.end()) remove_at(it->second);
+    }
+
+    // Row of pid, or -1 if it is not in the table.
+    long find(int pid) const {
+        std::unordered_map<int, size_t>::const_iterator it = index_.find(pid);
+        return it == index_.end() ? -1 : (long)it->second;
+    }
+
+    size_t size() const { return pid_.size(); }
+
+    // Cap on the stat/io fds held open; rows past it are read
+    // open/read/close. Lowers the default, which leaves room for nothing
+    // but this table.
+    void set_fd_budget(size_t fds) { fd_budget_ = std::min(fd_budget_, fds); }
+
+    int pid(size_t i) const { return pid_[i]; }
+    int ppid(size_t i) const { return ppid_[i]; }
+    char state(size_t i) const { return state_[i]; }
+    const char *name(size_t i) const { return names_.get(name_[i]); }
+    unsigned long long ticks(size_t i) const { return ticks_[i]; }
+    long long rss_pages(size_t i) const { return rss_pages_[i]; }
+    long long rss_kb(size_t i) const { return rss_pages_[i] * page_kb_; }
+    // Share of one CPU over the last interval, in percent.
+    float cpu_percent(size_t i) const { return cpu_percent_[i]; }
+    // Storage I/O in bytes per second over the last interval. Zero when
+    // /proc/<pid>/io is not readable (another user's process).
+    float io_read_rate(size_t i) const { return io_read_rate_[i]; }
+    float io_write_rate(size_t i) const { return io_write_rate_[i]; }
+    bool io_available(size_t i) const { return io_fd_[i] >= 0; }
+    // From the last sample_memory() that reached this row; -1 if never
+    // read or not readable.
+    long long pss_kb(size_t i) const { return pss_kb_[i]; }
+    long long swap_kb(size_t i) const { return swap_kb_[i]; }
+
+    // Read smaps_rollup for the given rows, in order, skipping rows read
+    // within the last max_age scans, and stop once budget_ms has been
+    // spent. Rows cut off are older than the rest and so come first on
+    // a later call. Returns how many rows were read.
+    size_t sample_memory(const std::vector<uint32_t> &rows, unsigned max_age, double budget_ms) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        std::chrono::duration<double, std::milli> budget(budget_ms);
+        size_t read = 0;
+        for (size_t r = 0; r < rows.size(); r++) {
+            size_t i = rows[r];
+            if (smaps_gen_[i] != 0 && generation_ - smaps_gen_[i] < max_age) continue;
+            if (std::chrono::steady_clock::now() - start > budget) break;
+            smaps_gen_[i] = generation_;
+            if (!read_smaps_rollup(pid_[i], pss_kb_[i], swap_kb_[i])) {
+                pss_kb_[i] = swap_kb_[i] = -1;
+            }
+            read++;
+        }
+        return read;
+    }
+
+    // Tree links: rows, or -1. A row whose parent is not in the table
+    // (init, kthreadd, a PPID outside our PID namespace) is a root.
+    long parent(size_t i) const { return parent_[i]; }
+    long first_child(size_t i) const { return first_child_[i]; }
+    long next_sibling(size_t i) const { return next_sibling_[i]; }
+
+    // Add every row's CPU, RSS and I/O to all its ancestors and list the
+    // roots. One pass over the rows in reverse pre-order, so children are
+    // always summed before their parent.
+    void sum_subtrees() {
+        size_t n = pid_.size();
+        tree_cpu_ = cpu_percent_;
+        tree_rss_ = rss_pages_;
+        tree_io_ = io_rate_;
+        roots_.clear();
+        order_.clear();
+        for (size_t i = 0; i < n; i++) {
+            if (parent_[i] < 0) roots_.push_back((uint32_t)i);
+        }
+        stack_ = roots_;
+        while (!stack_.empty()) {
+            uint32_t i = stack_.back();
+            stack_.pop_back();
+            order_.push_back(i);
+            for (long c = first_child_[i]; c >= 0; c = next_sibling_[c]) stack_.push_back((uint32_t)c);
+        }
+        for (size_t k = order_.size(); k-- > 0;) {
+            uint32_t i = order_[k];
+            long p = parent_[i];
+            if (p < 0) continue;
+            tree_cpu_[p] += tree_cpu_[i];
+            tree_rss_[p] += tree_rss_[i];
+            tree_io_[p] += tree_io_[i];
+        }
+    }
+
+    // From the last sum_subtrees(): the row plus all its descendants.
+    float tree_cpu_percent(size_t i) const { return tree_cpu_[i]; }
+    long long tree_rss_kb(size_t i) const { return tree_rss_[i] * page_kb_; }
+    const std::vector<uint32_t> &roots() const { return roots_; }
+
+    // Order rows by key as top() does; with subtree set, CPU, memory and
+    // I/O compare the sum_subtrees() totals, for siblings in the tree.
+    void sort_rows(ProcSortKey key, bool subtree, std::vector<uint32_t> &rows) const {
+        switch (key) {
+        case SORT_CPU:
+            std::sort(rows.begin(), rows.end(), Descending<float>(subtree ? tree_cpu_ : cpu_percent_, pid_));
+            break;
+        case SORT_MEM:
+            std::sort(rows.begin(), rows.end(), Descending<long long>(subtree ? tree_rss_ : rss_pages_, pid_));
+            break;
+        case SORT_PID:
+            std::sort(rows.begin(), rows.end(), Ascending<int>(pid_));
+            break;
+        case SORT_NAME:
+            std::sort(rows.begin(), rows.end(), NameLess(*this));
+            break;
+        case SORT_IO:
+            std::sort(rows.begin(), rows.end(), Descending<float>(subtree ? tree_io_ : io_rate_, pid_));
+            break;
+        }
+    }
+
+    // Row indices of the first k entries ordered by key (CPU and memory
+    // descending, PID and name ascending). Selection is O(n log k) over
+    // the whole table; out is reused between calls.
+    void top(ProcSortKey key, size_t k, std::vector<uint32_t> &out) const {
+        out.resize(pid_.size());
+        for (size_t i = 0; i < out.size(); i++) out[i] = (uint32_t)i;
+        k = std::min(k, out.size());
+        switch (key) {
+        case SORT_CPU:
+            select(out, k, Descending<float>(cpu_percent_, pid_));
+            break;
+        case SORT_MEM:
+            select(out, k, Descending<long long>(rss_pages_, pid_));
+            break;
+        case SORT_PID:
+            select(out, k, Ascending<int>(pid_));
+            break;
+        case SORT_NAME:
+            select(out, k, NameLess(*this));
+            break;
+        case SORT_IO:
+            select(out, k, Descending<float>(io_rate_, pid_));
+            break;
+        }
+        out.resize(k);
+    }
+
+private:
+    // Ties fall back to PID so the order is stable between frames.
+    template <typename T>
+    struct Descending {
+        const std::vector<T> &col;
+        const std::vector<int> &pid;
+        Descending(const std::vector<T> &c, const std::vector<int> &p) : col(c), pid(p) {}
+        bool operator()(uint32_t a, uint32_t b) const {
+            return col[a] != col[b] ? col[a] > col[b] : pid[a] < pid[b];
+        }
+    };
+
+    template <typename T>
+    struct Ascending {
+        const std::vector<T> &col;
+        explicit Ascending(const std::vector<T> &c) : col(c) {}
+        bool operator()(uint32_t a, uint32_t b) const { return col[a] < col[b]; }
+    };
+
+    struct NameLess {
+        const ProcessTable &t;
+        explicit NameLess(const ProcessTable &table) : t(table) {}
+        bool operator()(uint32_t a, uint32_t b) const {
+            if (t.name_[a] == t.name_[b]) return t.pid_[a] < t.pid_[b];
+            int c = strcmp(t.name(a), t.name(b));
+            return c != 0 ? c < 0 : t.pid_[a] < t.pid_[b];
+        }
+    };
+
+    template <typename Less>
+    static void select(std::vector<uint32_t> &rows, size_t k, Less less) {
+        std::partial_sort(rows.begin(), rows.begin() + k, rows.end(), less);
+    }
+
+    // Start a pass; returns seconds since the previous one.
+    double begin_pass() {
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        double elapsed = have_last_ ?
+            std::chrono::duration<double>(now - last_scan_).count() : 0.0;
+        last_scan_ = now;
+        have_last_ = true;
+        generation_++;
+        return elapsed;
+    }
+
+    // Drop PIDs not seen this pass, filling holes from the back, then
+    // link the rows whose parent was read after them.
+    void sweep() {
+        for (size_t i = 0; i < pid_.size();) {
+            if (seen_[i] != generation_) {
+                remove_at(i);
+            } else {
+                i++;
+            }
+        }
+        for (size_t k = 0; k < unlinked_.size(); k++) {
+            long i = find(unlinked_[k]);
+            if (i >= 0 && parent_[i] < 0) link((size_t)i);
+        }
+        unlinked_.clear();
+    }
+
+    // Hang row i under the row of its PPID. Left a root if that is not in
+    // the table, or would be its own descendant, which stale PPIDs can
+    // briefly suggest while a reused PID's row is being re-read.
+    bool link(size_t i) {
+        long p = find(ppid_[i]);
+        if (p < 0) return false;
+        for (long a = p; a >= 0; a = parent_[a]) {
+            if ((size_t)a == i) return false;
+        }
+        parent_[i] = p;
+        prev_sibling_[i] = -1;
+        next_sibling_[i] = first_child_[p];
+        if (next_sibling_[i] >= 0) prev_sibling_[next_sibling_[i]] = (long)i;
+        first_child_[p] = (long)i;
+        return true;
+    }
+
+    void unlink(size_t i) {
+        long p = parent_[i];
+        if (p < 0) return;
+        long prev = prev_sibling_[i], next = next_sibling_[i];
+        if (prev >= 0) next_sibling_[prev] = next; else first_child_[p] = next;
+        if (next >= 0) prev_sibling_[next] = prev;
+        parent_[i] = prev_sibling_[i] = next_sibling_[i] = -1;
+    }
+
+    // Row `from` is moving to `to`: point its neighbours at the new slot.
+    void relocate_links(size_t from, size_t to) {
+        long prev = prev_sibling_[from], next = next_sibling_[from], p = parent_[from];
+        if (prev >= 0) next_sibling_[prev] = (long)to;
+        else if (p >= 0) first_child_[p] = (long)to;
+        if (next >= 0) prev_sibling_[next] = (long)to;
+        for (long c = first_child_[from]; c >= 0; c = next_sibling_[c]) parent_[c] = (long)to;
+    }
+
+    int open_stat(int pid) const {
+        char path[96];
+        snprintf(path, sizeof(path), "%s/%d/stat", dir_, pid);
+        return proc_open(path);
+    }
+
+    // Only readable for our own processes unless we are root; a failed
+    // open is not retried for the life of the row.
+    int open_io(int pid) const {
+        char path[96];
+        snprintf(path, sizeof(path), "%s/%d/io", dir_, pid);
+        return proc_open(path);
+    }
+
+    bool read_smaps_rollup(int pid, long long &pss, long long &swap) {
+        char path[64];
+        int fd = proc_open(proc_pid_path(path, sizeof(path), pid, "smaps_rollup"));
+        bool ok = ProcFile::pread_all(fd, buf_, len_);
+        if (fd >= 0) ::close(fd);
+        if (!ok) return false;
+        ProcScanner s(&buf_[0], len_);
+        unsigned long long p, w;
+        if (!s.find_key("Pss:", 4) || !s.next_u64(p) || !s.find_key("Swap:", 5) || !s.next_u64(w)) return false;
+        pss = (long long)p;
+        swap = (long long)w;
+        return true;
+    }
+
+    bool read_io(int fd, unsigned long long &read_bytes, unsigned long long &write_bytes) {
+        if (!ProcFile::pread_all(fd, buf_, len_)) return false;
+        ProcScanner s(&buf_[0], len_);
+        return s.find_key("read_bytes:", 11) && s.next_u64(read_bytes) &&
+               s.find_key("write_bytes:", 12) && s.next_u64(write_bytes);
+    }
+
+    template <typename T>
+    static void move_last(std::vector<T> &col, size_t i) {
+        col[i] = col.back();
+        col.pop_back();
+    }
+
+    void remove_at(size_t i) {
+        close_held(stat_fd_[i]);
+        close_held(io_fd_[i]);
+        // Its children become roots until they are read again with the
+        // PPID of whoever adopted them.
+        unlink(i);
+        for (long c = first_child_[i]; c >= 0;) {
+            long next = next_sibling_[c];
+            parent_[c] = prev_sibling_[c] = next_sibling_[c] = -1;
+            c = next;
+        }
+        first_child_[i] = -1;
+        size_t last = pid_.size() - 1;
+        if (i != last) relocate_links(last, i);
+
+        index_.erase(pid_[i]);
+        if (i != last) index_[pid_.back()] = i;
+        move_last(pid_, i);
+        move_last(ppid_, i);
+        move_last(state_, i);
+        move_last(name_, i);
+        move_last(starttime_, i);
+        move_last(ticks_, i);
+        move_last(rss_pages_, i);
+        move_last(cpu_percent_, i);
+        move_last(has_prev_, i);
+        move_last(stat_fd_, i);
+        move_last(io_fd_, i);
+        move_last(io_read_, i);
+        move_last(io_write_, i);
+        move_last(io_read_rate_, i);
+        move_last(io_write_rate_, i);
+        move_last(io_rate_, i);
+        move_last(pss_kb_, i);
+        move_last(swap_kb_, i);
+        move_last(smaps_gen_, i);
+        move_last(seen_, i);
+        move_last(parent_, i);
+        move_last(first_child_, i);
+        move_last(next_sibling_, i);
+        move_last(prev_sibling_, i);
+    }
+
+    size_t add(int pid) {
+        size_t i = pid_.size();
+        pid_.push_back(pid);
+        ppid_.push_back(0);
+        state_.push_back('?');
+        name_.push_back(names_.intern("", 0));
+        starttime_.push_back(0);
+        ticks_.push_back(0);
+        rss_pages_.push_back(0);
+        cpu_percent_.push_back(0.0f);
+        has_prev_.push_back(0);
+        // Past the fd budget rows are read open/read/close (no I/O rates)
+        bool hold = held_fds_ + 2 <= fd_budget_;
+        stat_fd_.push_back(hold ? open_held(open_stat(pid)) : -1);
+        io_fd_.push_back(hold ? open_held(open_io(pid)) : -1);
+        io_read_.push_back(0);
+        io_write_.push_back(0);
+        io_read_rate_.push_back(0.0f);
+        io_write_rate_.push_back(0.0f);
+        io_rate_.push_back(0.0f);
+        pss_kb_.push_back(-1);
+        swap_kb_.push_back(-1);
+        smaps_gen_.push_back(0);
+        seen_.push_back(generation_);
+        parent_.push_back(-1);
+        first_child_.push_back(-1);
+        next_sibling_.push_back(-1);
+        prev_sibling_.push_back(-1);
+        index_[pid] = i;
+        return i;
+    }
+
+    int open_held(int fd) {
+        if (fd >= 0) held_fds_++;
+        return fd;
+    }
+
+    void close_held(int fd) {
+        if (fd < 0) return;
+        ::close(fd);
+        held_fds_--;
+    }
+
+    bool read_stat(int fd, PidStat &ps, char *comm, size_t cap) {
+        return ProcFile::pread_all(fd, buf_, len_) &&
+               parse_pid_stat(&buf_[0], len_, ps, comm, cap);
+    }
+
+    void update_pid(int pid, double elapsed) {
+        std::unordered_map<int, size_t>::iterator it = index_.find(pid);
+        bool is_new = it == index_.end();
+        size_t i = is_new ? add(pid) : it->second;
+
+        // Out of fds: fall back to open/read/close for this entry.
+        bool transient = stat_fd_[i] < 0;
+        int fd = transient ? open_stat(pid) : stat_fd_[i];
+        PidStat ps;
+        char comm[16];
+        bool ok = read_stat(fd, ps, comm, sizeof(comm));
+        if (transient && fd >= 0) ::close(fd);
+        if (!ok && !transient) {
+            // The task our fd pointed at is gone, but the PID is listed
+            // again, so it may have been reused. Reopen and retry once.
+            close_held(stat_fd_[i]);
+            stat_fd_[i] = open_held(open_stat(pid));
+            ok = read_stat(stat_fd_[i], ps, comm, sizeof(comm));
+            close_held(io_fd_[i]);
+            io_fd_[i] = ok ? open_held(open_io(pid)) : -1;
+        }
+        if (!ok) {
+            // Exited between readdir and read; let the sweep drop it.
+            seen_[i] = generation_ - 1;
+            return;
+        }
+
+        if (!is_new && ps.starttime != starttime_[i]) {
+            // Same PID, different process: start its CPU accounting over.
+            has_prev_[i] = 0;
+            pss_kb_[i] = swap_kb_[i] = -1;
+            smaps_gen_[i] = 0;
+        }
+        // comm changes on exec; only re-intern when it does.
+        if (strcmp(comm, names_.get(name_[i])) != 0) {
+            name_[i] = names_.intern(comm, strlen(comm));
+        }
+
+        unsigned long long ticks = ps.utime + ps.stime;
+        if (has_prev_[i] && elapsed > 0 && ticks >= ticks_[i]) {
+            cpu_percent_[i] = (float)(100.0 * (ticks - ticks_[i]) / (elapsed * clk_tck_));
+        } else {
+            cpu_percent_[i] = 0.0f;
+        }
+        unsigned long long read_bytes, write_bytes;
+        if (io_fd_[i] >= 0 && read_io(io_fd_[i], read_bytes, write_bytes)) {
+            bool have = has_prev_[i] && elapsed > 0 && read_bytes >= io_read_[i] && write_bytes >= io_write_[i];
+            io_read_rate_[i] = have ? (float)((read_bytes - io_read_[i]) / elapsed) : 0.0f;
+            io_write_rate_[i] = have ? (float)((write_bytes - io_write_[i]) / elapsed) : 0.0f;
+            io_read_[i] = read_bytes;
+            io_write_[i] = write_bytes;
+        } else {
+            io_read_rate_[i] = io_write_rate_[i] = 0.0f;
+        }
+        io_rate_[i] = io_read_rate_[i] + io_write_rate_[i];
+        if (is_new || ps.ppid != ppid_[i]) {
+            // New, or reparented when its parent exited
+            unlink(i);
+            ppid_[i] = ps.ppid;
+            if (!link(i) && ps.ppid > 0) unlinked_.push_back(pid);
+        } else if (parent_[i] < 0 && ps.ppid > 0) {
+            link(i);   // the parent's row was dropped and has come back
+        }
+        state_[i] = ps.state;
+        starttime_[i] = ps.starttime;
+        rss_pages_[i] = ps.rss_pages;
+        ticks_[i] = ticks;
+        has_prev_[i] = 1;
+        seen_[i] = generation_;
+    }
+
+    // Columns, all indexed by row.
+    std::vector<int> pid_;
+    std::vector<int> ppid_;
+    std::vector<char> state_;
+    std::vector<uint32_t> name_;
+    std::vector<unsigned long long> starttime_;
+    std::vector<unsigned long long> ticks_;
+    std::vector<long long> rss_pages_;
+    std::vector<float> cpu_percent_;
+    std::vector<uint8_t> has_prev_;
+    std::vector<int> stat_fd_;  // -1 past the fd budget; reopened per scan
+    std::vector<int> io_fd_;    // -1 if /proc/<pid>/io could not be opened
+    std::vector<unsigned long long> io_read_;
+    std::vector<unsigned long long> io_write_;
+    std::vector<float> io_read_rate_;
+    std::vector<float> io_write_rate_;
+    std::vector<float> io_rate_;   // read + write, the SORT_IO key
+    std::vector<long long> pss_kb_;
+    std::vector<long long> swap_kb_;
+    std::vector<unsigned> smaps_gen_;   // scan of the last smaps_rollup read, 0 = never
+    std::vector<unsigned> seen_;
+    std::vector<long> parent_;        // tree links, rows or -1
+    std::vector<long> first_child_;
+    std::vector<long> next_sibling_;
+    std::vector<long> prev_sibling_;
+
+    char dir_[48];
+    NameArena names_;
+    std::unordered_map<int, size_t> index_;
+    std::vector<int> pending_;   // reported by track(), not read yet
+    std::vector<int> unlinked_;  // PIDs whose parent was not read yet this pass
+    std::vector<float> tree_cpu_;     // sum_subtrees() results
+    std::vector<long long> tree_rss_;
+    std::vector<float> tree_io_;
+    std::vector<uint32_t> roots_, order_, stack_;
+    std::vector<char> buf_;
+    size_t len_;
+    unsigned generation_;
+    long clk_tck_;
+    long page_kb_;
+    std::chrono::steady_clock::time_point last_scan_;
+    bool have_last_;
+    size_t held_fds_;    // stat/io fds kept open across scans
+    size_t fd_budget_;   // at most this many
+};
+
+#endif
@@ -0,0 +1,554 @@
+/************************************************************
+ * RPLEX - session recording and replay
+ *
+ * Samples are appended as checksummed binary frames to a
+ * memory-mapped, append-only file: periodic keyframes hold
+ * the full process table, the frames between them only the
+ * rows that changed. Index frames chain the keyframes so a
+ * reader can seek in a multi-GB recording without scanning.
+ ************************************************************/
+
+#ifndef RPLEX_RECORDING_H
+#define RPLEX_RECORDING_H
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include <cstring>
+#include <cerrno>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// One process as recorded. Names are cut to the kernel's 15 chars.
+struct RecordedProcess {
+    int pid;
+    float cpu;
+    long long rss_kb;
+    char name[16];
+};
+
+// What one sample looked like. When reading, processes is the full table
+// reconstructed so far, sorted by pid.
+struct RecordedFrame {
+    int64_t time_us;          // Unix time in microseconds
+    float cpu_usage;
+    float mem_total;          // GB
+    float mem_used;           // GB
+    std::vector<float> cores;
+    std::vector<RecordedProcess> processes;
+};
+
+// File layout: a one-page header, then 8-byte aligned frames
+//   uint32 size, uint32 checksum, uint8 type, 7 pad, int64 time_us, payload
+// Types: 'K' keyframe, 'D' delta, 'I' index. The size word is stored
+// last, so a frame cut short by a crash reads as size 0 or fails its
+// checksum, and everything before it stays readable.
+namespace recording {
+
+const char MAGIC[8] = {'R', 'P', 'L', 'X', 'R', 'E', 'C', '1'};
+const size_t HEADER_SIZE = 4096;
+const unsigned KEYFRAME_INTERVAL = 60;   // frames per keyframe
+const unsigned INDEX_INTERVAL = 16;      // keyframes per index frame
+
+struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    int64_t start_us;
+    uint64_t last_index;      // offset of the newest index frame, 0 if none
+    char cpu_model[64];       // of the recorded machine
+    // Zero in files written before these were added
+    uint32_t sample_us;       // nominal time between samples
+    char note[124];           // why the file was written, e.g. a flight recorder rule
+};
+
+struct FrameHeader {
+    uint32_t size;
+    uint32_t check;
+    uint8_t type;
+    uint8_t pad[7];
+    int64_t time_us;
+};
+
+// Index payload: uint64 previous index offset, uint32 n, n x (int64 time, uint64 offset)
+struct IndexEntry {
+    int64_t time_us;
+    uint64_t offset;
+};
+
+inline size_t align8(size_t n) { return (n + 7) & ~(size_t)7; }
+
+inline uint32_t checksum(uint8_t type, int64_t time_us, const char *p, size_t len) {
+    uint32_t h = 2166136261u;
+    h = (h ^ type) * 16777619u;
+    const unsigned char *t = (const unsigned char *)&time_us;
+    for (size_t i = 0; i < sizeof(time_us); i++) h = (h ^ t[i]) * 16777619u;
+    for (size_t i = 0; i < len; i++) h = (h ^ (unsigned char)p[i]) * 16777619u;
+    return h;
+}
+
+// Bounds-checked reads from a frame payload; ok turns false on overrun.
+struct Cursor {
+    const char *p;
+    const char *end;
+    bool ok;
+
+    Cursor(const char *b, size_t len) : p(b), end(b + len), ok(true) {}
+
+    template <typename T>
+    T get() {
+        T v = T();
+        if (ok && (size_t)(end - p) >= sizeof(T)) {
+            memcpy(&v, p, sizeof(T));
+            p += sizeof(T);
+        } else {
+            ok = false;
+        }
+        return v;
+    }
+
+    void bytes(char *out, size_t len) {
+        if (ok && (size_t)(end - p) >= len) {
+            memcpy(out, p, len);
+            p += len;
+        } else {
+            ok = false;
+        }
+    }
+};
+
+inline bool pid_less(const RecordedProcess &a, const RecordedProcess &b) { return a.pid < b.pid; }
+
+template <typename T>
+inline void put(std::vector<char> &buf, const T &v) {
+    const char *c = (const char *)&v;
+    buf.insert(buf.end(), c, c + sizeof(T));
+}
+
+// The payload of a sample frame:
+//   float cpu, float mem_total, float mem_used, uint16 n, n x float core,
+//   uint32 n, n x (int32 pid, float cpu, int64 rss_kb, uint8 len, name),
+//   uint32 n, n x int32 removed pid
+// Encodes frames against the previous one. Also used by rplex_fleet.h,
+// which sends the same payloads over a socket.
+class FrameEncoder {
+public:
+    FrameEncoder() : frame_(NULL) {}
+
+    // Make frame the one to encode. frame.processes may be in any order.
+    void begin(const RecordedFrame &frame) {
+        frame_ = &frame;
+        sorted_ = frame.processes;
+        std::sort(sorted_.begin(), sorted_.end(), pid_less);
+    }
+
+    // Append the payload of the begun frame, whole or as a delta.
+    void encode(bool key, std::vector<char> &buf) {
+        const RecordedFrame &frame = *frame_;
+        put(buf, frame.cpu_usage);
+        put(buf, frame.mem_total);
+        put(buf, frame.mem_used);
+        put(buf, (uint16_t)frame.cores.size());
+        for (size_t i = 0; i < frame.cores.size(); i++) put(buf, frame.cores[i]);
+        encode_processes(key, buf);
+    }
+
+    // The begun frame becomes the base of the next delta.
+    void commit() { last_.swap(sorted_); }
+
+    void reset() { last_.clear(); }
+
+private:
+    static void put_process(std::vector<char> &buf, const RecordedProcess &p, bool with_name) {
+        put(buf, (int32_t)p.pid);
+        put(buf, p.cpu);
+        put(buf, (int64_t)p.rss_kb);
+        size_t len = with_name ? strnlen(p.name, sizeof(p.name) - 1) : 0;
+        put(buf, (uint8_t)len);
+        buf.insert(buf.end(), p.name, p.name + len);
+    }
+
+    // Keyframes carry every row. Deltas merge the pid-sorted old and new
+    // tables: new or changed rows are written (names only for new pids),
+    // vanished pids are listed after them.
+    void encode_processes(bool key, std::vector<char> &buf) {
+        size_t count_at = buf.size();
+        put(buf, (uint32_t)0);
+        uint32_t updated = 0;
+        removed_.clear();
+        size_t i = 0, j = 0;
+        while (j < sorted_.size()) {
+            const RecordedProcess &p = sorted_[j];
+            while (!key && i < last_.size() && last_[i].pid < p.pid) removed_.push_back(last_[i++].pid);
+            bool known = !key && i < last_.size() && last_[i].pid == p.pid;
+            // A reused pid shows up as a new name
+            bool renamed = known && strncmp(last_[i].name, p.name, sizeof(p.name)) != 0;
+            if (!known || renamed || last_[i].cpu != p.cpu || last_[i].rss_kb != p.rss_kb) {
+                put_process(buf, p, !known || renamed);
+                updated++;
+            }
+            if (known) i++;
+            j++;
+        }
+        while (!key && i < last_.size()) removed_.push_back(last_[i++].pid);
+        memcpy(&buf[count_at], &updated, sizeof(updated));
+        put(buf, (uint32_t)removed_.size());
+        for (size_t k = 0; k < removed_.size(); k++) put(buf, (int32_t)removed_[k]);
+    }
+
+    const RecordedFrame *frame_;
+    std::vector<RecordedProcess> sorted_;
+    std::vector<RecordedProcess> last_;   // table as of the previous frame
+    std::vector<int> removed_;
+};
+
+// Apply one payload to state; a keyframe replaces the process table.
+// False if the payload is cut short.
+inline bool decode_payload(const char *p, size_t len, bool key, RecordedFrame &state) {
+    Cursor c(p, len);
+    state.cpu_usage = c.get<float>();
+    state.mem_total = c.get<float>();
+    state.mem_used = c.get<float>();
+    uint16_t ncores = c.get<uint16_t>();
+    state.cores.resize(c.ok ? ncores : 0);
+    for (size_t i = 0; i < state.cores.size(); i++) state.cores[i] = c.get<float>();
+
+    if (key) state.processes.clear();
+    uint32_t updated = c.get<uint32_t>();
+    for (uint32_t i = 0; i < updated && c.ok; i++) {
+        RecordedProcess p;
+        p.pid = c.get<int32_t>();
+        p.cpu = c.get<float>();
+        p.rss_kb = c.get<int64_t>();
+        uint8_t len = c.get<uint8_t>();
+        if (len >= sizeof(p.name)) len = sizeof(p.name) - 1;
+        std::vector<RecordedProcess>::iterator it =
+            std::lower_bound(state.processes.begin(), state.processes.end(), p, pid_less);
+        if (it != state.processes.end() && it->pid == p.pid) {
+            if (len) {
+                c.bytes(it->name, len);
+                it->name[len] = '\0';
+            }
+            it->cpu = p.cpu;
+            it->rss_kb = p.rss_kb;
+        } else {
+            c.bytes(p.name, len);
+            p.name[len] = '\0';
+            state.processes.insert(it, p);
+        }
+    }
+    uint32_t removed = c.get<uint32_t>();
+    for (uint32_t i = 0; i < removed && c.ok; i++) {
+        RecordedProcess key;
+        key.pid = c.get<int32_t>();
+        std::vector<RecordedProcess>::iterator it =
+            std::lower_bound(state.processes.begin(), state.processes.end(), key, pid_less);
+        if (it != state.processes.end() && it->pid == key.pid) state.processes.erase(it);
+    }
+    return c.ok;
+}
+
+}  // namespace recording
+
+class Recorder {
+public:
+    Recorder() : fd_(-1), map_(NULL), capacity_(0), used_(0), frames_(0), last_time_(0) {}
+    ~Recorder() { close(); }
+
+    // Start a new recording at path. An existing file is refused rather
+    // than replaced: it may be the session from before a crash.
+    bool open(const std::string &path, int64_t start_us, const std::string &cpu_model, std::string &error) {
+        close();
+        fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+        if (fd_ < 0 || !grow(GROW_STEP)) {
+            error = strerror(errno);
+            close();
+            return false;
+        }
+        recording::FileHeader *h = header();
+        memcpy(h->magic, recording::MAGIC, sizeof(h->magic));
+        h->version = 1;
+        h->header_size = recording::HEADER_SIZE;
+        h->start_us = start_us;
+        h->last_index = 0;
+        strncpy(h->cpu_model, cpu_model.c_str(), sizeof(h->cpu_model) - 1);
+        used_ = recording::HEADER_SIZE;
+        return true;
+    }
+
+    bool is_open() const { return map_ != NULL; }
+    uint64_t bytes() const { return used_; }
+
+    // Sampling interval and a one-line note for whoever replays it.
+    void describe(uint32_t sample_us, const std::string &note) {
+        if (!map_) return;
+        recording::FileHeader *h = header();
+        h->sample_us = sample_us;
+        strncpy(h->note, note.c_str(), sizeof(h->note) - 1);
+    }
+
+    // Append one sample. frame.processes is the whole table, any order.
+    bool write(const RecordedFrame &frame) {
+        if (!map_) return false;
+        bool key = frames_ % recording::KEYFRAME_INTERVAL == 0;
+        encoder_.begin(frame);
+        buf_.clear();
+        encoder_.encode(key, buf_);
+
+        uint64_t offset = used_;
+        if (!append(key ? 'K' : 'D', frame.time_us)) return false;
+        encoder_.commit();
+        last_time_ = frame.time_us;
+        frames_++;
+
+        if (key) {
+            recording::IndexEntry e = {frame.time_us, offset};
+            pending_.push_back(e);
+            if (pending_.size() == recording::INDEX_INTERVAL) return write_index();
+        }
+        return true;
+    }
+
+    // Flush the open index and cut the file to what was written.
+    void close() {
+        if (map_ && !pending_.empty()) write_index();
+        if (map_) munmap(map_, capacity_);
+        if (fd_ >= 0) {
+            if (used_) {
+                int rc = ftruncate(fd_, used_);
+                (void)rc;
+            }
+            ::close(fd_);
+        }
+        fd_ = -1;
+        map_ = NULL;
+        capacity_ = used_ = 0;
+        frames_ = 0;
+        encoder_.reset();
+        pending_.clear();
+    }
+
+private:
+    Recorder(const Recorder &);
+    Recorder &operator=(const Recorder &);
+
+    enum { GROW_STEP = 16 << 20 };
+
+    recording::FileHeader *header() { return (recording::FileHeader *)map_; }
+
+    bool write_index() {
+        buf_.clear();
+        recording::put(buf_, header()->last_index);
+        recording::put(buf_, (uint32_t)pending_.size());
+        for (size_t i = 0; i < pending_.size(); i++) recording::put(buf_, pending_[i]);
+        uint64_t offset = used_;
+        if (!append('I', last_time_)) return false;
+        pending_.clear();
+        __atomic_store_n(&header()->last_index, offset, __ATOMIC_RELEASE);
+        return true;
+    }
+
+    bool append(uint8_t type, int64_t time_us) {
+        size_t total = recording::align8(sizeof(recording::FrameHeader) + buf_.size());
+        if (used_ + total > capacity_ && !grow(used_ + total + GROW_STEP)) return false;
+        char *at = (char *)map_ + used_;
+        recording::FrameHeader *f = (recording::FrameHeader *)at;
+        f->type = type;
+        f->time_us = time_us;
+        f->check = recording::checksum(type, time_us, buf_.data(), buf_.size());
+        if (!buf_.empty()) memcpy(at + sizeof(*f), &buf_[0], buf_.size());
+        __atomic_store_n(&f->size, (uint32_t)buf_.size(), __ATOMIC_RELEASE);
+        used_ += total;
+        return true;
+    }
+
+    // Extend the file and the mapping; new pages read as zero.
+    bool grow(size_t size) {
+        if (ftruncate(fd_, size) != 0) return false;
+        void *m = map_ ? mremap(map_, capacity_, size, MREMAP_MAYMOVE)
+                       : mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+        if (m == MAP_FAILED) return false;
+        map_ = m;
+        capacity_ = size;
+        return true;
+    }
+
+    int fd_;
+    void *map_;
+    size_t capacity_;
+    uint64_t used_;
+    unsigned long frames_;
+    int64_t last_time_;
+    std::vector<char> buf_;
+    recording::FrameEncoder encoder_;
+    std::vector<recording::IndexEntry> pending_;   // keyframes not yet indexed
+};
+
+// Read side. The file is mapped read-only; the keyframe list comes from
+// the index chain plus a scan of the frames written after the last index.
+class Recording {
+public:
+    Recording() : map_(NULL), size_(0), pos_(0), end_us_(0) {}
+    ~Recording() { close(); }
+
+    bool open(const std::string &path, std::string &error) {
+        close();
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) != 0) {
+            error = strerror(errno);
+            if (fd >= 0) ::close(fd);
+            return false;
+        }
+        size_ = st.st_size;
+        if (size_ >= recording::HEADER_SIZE) {
+            map_ = mmap(NULL, size_, PROT_READ, MAP_SHARED, fd, 0);
+            if (map_ == MAP_FAILED) map_ = NULL;
+        }
+        ::close(fd);
+        const recording::FileHeader *h = (const recording::FileHeader *)map_;
+        if (!map_ || memcmp(h->magic, recording::MAGIC, sizeof(h->magic)) != 0 || h->version != 1) {
+            error = "not an rplex recording";
+            close();
+            return false;
+        }
+        build_index();
+        if (keys_.empty()) {
+            error = "recording has no complete frames";
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close() {
+        if (map_) munmap(map_, size_);
+        map_ = NULL;
+        size_ = pos_ = 0;
+        keys_.clear();
+    }
+
+    int64_t start_time() const { return keys_.empty() ? 0 : keys_.front().time_us; }
+    const char *cpu_model() const { return ((const recording::FileHeader *)map_)->cpu_model; }
+    const char *note() const { return ((const recording::FileHeader *)map_)->note; }
+    // One second unless the writer said otherwise (describe()).
+    float sample_seconds() const {
+        uint32_t us = ((const recording::FileHeader *)map_)->sample_us;
+        return us ? us / 1e6f : 1.0f;
+    }
+    int64_t end_time() const { return end_us_; }
+
+    // Position on the last keyframe at or before t; the next frame read
+    // rebuilds the process table from scratch.
+    void seek(int64_t t) {
+        if (keys_.empty()) return;
+        recording::IndexEntry probe = {t, 0};
+        std::vector<recording::IndexEntry>::const_iterator it =
+            std::upper_bound(keys_.begin(), keys_.end(), probe, time_less);
+        pos_ = it == keys_.begin() ? it->offset : (it - 1)->offset;
+    }
+
+    // Time of the next sample frame, or -1 at the end.
+    int64_t peek_time() {
+        uint64_t pos = pos_;
+        const recording::FrameHeader *f;
+        while ((f = frame_at(pos)) != NULL) {
+            if (f->type != 'I') return f->time_us;
+            pos += frame_bytes(f);
+        }
+        return -1;
+    }
+
+    // Apply the next sample frame to state; false at the end.
+    bool next(RecordedFrame &state) {
+        const recording::FrameHeader *f;
+        while ((f = frame_at(pos_)) != NULL) {
+            pos_ += frame_bytes(f);
+            if (f->type == 'I') continue;
+            if (decode(f, state)) return true;
+        }
+        return false;
+    }
+
+private:
+    Recording(const Recording &);
+    Recording &operator=(const Recording &);
+
+    static bool time_less(const recording::IndexEntry &a, const recording::IndexEntry &b) {
+        return a.time_us < b.time_us;
+    }
+
+    static size_t frame_bytes(const recording::FrameHeader *f) {
+        return recording::align8(sizeof(*f) + f->size);
+    }
+
+    // The frame at pos if it is complete and intact.
+    const recording::FrameHeader *frame_at(uint64_t pos) const {
+        if (pos < recording::HEADER_SIZE || pos + sizeof(recording::FrameHeader) > size_) return NULL;
+        const recording::FrameHeader *f = (const recording::FrameHeader *)((const char *)map_ + pos);
+        if (f->size == 0 || pos + sizeof(*f) + f->size > size_) return NULL;
+        if (f->check != recording::checksum(f->type, f->time_us, (const char *)(f + 1), f->size)) return NULL;
+        return f;
+    }
+
+    void build_index() {
+        keys_.clear();
+        end_us_ = 0;
+        // Walk the chain backwards from the header; each index frame
+        // lists the keyframes written since the one before it.
+        uint64_t scan_from = recording::HEADER_SIZE;
+        uint64_t at = ((const recording::FileHeader *)map_)->last_index;
+        std::vector<recording::IndexEntry> chained;
+        bool first = true;
+        while (at) {
+            const recording::FrameHeader *f = frame_at(at);
+            if (!f || f->type != 'I') break;
+            if (first) {
+                // Stamped with the last sample before it
+                scan_from = at + frame_bytes(f);
+                end_us_ = f->time_us;
+            }
+            first = false;
+            recording::Cursor c((const char *)(f + 1), f->size);
+            uint64_t prev = c.get<uint64_t>();
+            uint32_t n = c.get<uint32_t>();
+            size_t start = chained.size();
+            for (uint32_t i = 0; i < n && c.ok; i++) chained.push_back(c.get<recording::IndexEntry>());
+            if (!c.ok) chained.resize(start);
+            std::reverse(chained.begin() + start, chained.end());
+            at = prev < at ? prev : 0;
+        }
+        keys_.assign(chained.rbegin(), chained.rend());
+
+        // Frames after the newest index: at most INDEX_INTERVAL keyframes' worth.
+        uint64_t pos = scan_from;
+        const recording::FrameHeader *f;
+        while ((f = frame_at(pos)) != NULL) {
+            if (f->type == 'K') {
+                recording::IndexEntry e = {f->time_us, pos};
+                keys_.push_back(e);
+            }
+            if (f->type != 'I') end_us_ = f->time_us;
+            pos += frame_bytes(f);
+        }
+        if (end_us_ == 0 && !keys_.empty()) end_us_ = keys_.back().time_us;
+        pos_ = keys_.empty() ? size_ : keys_.front().offset;
+    }
+
+    bool decode(const recording::FrameHeader *f, RecordedFrame &state) {
+        state.time_us = f->time_us;
+        return recording::decode_payload((const char *)(f + 1), f->size, f->type == 'K', state);
+    }
+
+    void *map_;
+    uint64_t size_;
+    uint64_t pos_;
+    int64_t end_us_;
+    std::vector<recording::IndexEntry> keys_;
+};
+
+#endif
@@ -0,0 +1,232 @@
+/************************************************************
+ * RPLEX - incremental rendering
+ *
+ * Each dashboard panel is its own ncurses window that is
+ * repainted only when the data it shows changes, graphs
+ * scroll by shifting their columns, and every frame goes out
+ * in a single doupdate() whose terminal bytes are counted.
+ ************************************************************/
+
+#ifndef RPLEX_RENDER_H
+#define RPLEX_RENDER_H
+
+#include <ncurses.h>
+#include <vector>
+#include <cstring>
+#include <stdint.h>
+#include "rplex_procfs.h"
+#include "rplex_series.h"
+
+// FNV-1a over whatever a panel draws, to tell whether it changed.
+struct Signature {
+    uint64_t h;
+
+    Signature() : h(1469598103934665603ULL) {}
+
+    Signature &add(const void *data, size_t len) {
+        const unsigned char *p = (const unsigned char *)data;
+        for (size_t i = 0; i < len; i++) h = (h ^ p[i]) * 1099511628211ULL;
+        return *this;
+    }
+
+    template <typename T>
+    Signature &add(const T &v) { return add(&v, sizeof(v)); }
+
+    Signature &add_str(const char *s) { return add(s, strlen(s) + 1); }
+};
+
+// A window that knows what it last showed. Callers compute a Signature
+// of the panel's data and repaint only when needs_redraw() says so.
+class Panel {
+public:
+    Panel() : win_(NULL), y_(0), x_(0), h_(0), w_(0), sig_(0), valid_(false) {}
+    ~Panel() { destroy(); }
+
+    // Move/resize; recreating the window forces the next redraw.
+    void place(int y, int x, int h, int w) {
+        if (win_ && y == y_ && x == x_ && h == h_ && w == w_) return;
+        destroy();
+        y_ = y;
+        x_ = x;
+        h_ = h;
+        w_ = w;
+        if (h > 0 && w > 0 && y >= 0 && x >= 0 && y + h <= LINES && x + w <= COLS) {
+            win_ = newwin(h, w, y, x);
+        }
+        valid_ = false;
+    }
+
+    WINDOW *win() const { return win_; }
+    int height() const { return h_; }
+    int width() const { return w_; }
+
+    // True (and the window erased) if the panel must be repainted.
+    bool needs_redraw(const Signature &sig) {
+        if (!win_) return false;
+        if (valid_ && sig.h == sig_) return false;
+        sig_ = sig.h;
+        valid_ = true;
+        werase(win_);
+        return true;
+    }
+
+    void invalidate() { valid_ = false; }
+
+    // Copy the whole window again on the next commit, e.g. to stay on
+    // top of panels repainted underneath it.
+    void touch() {
+        if (win_) touchwin(win_);
+    }
+
+    // Queue for the next doupdate(); untouched windows cost nothing.
+    void commit() {
+        if (win_) wnoutrefresh(win_);
+    }
+
+private:
+    Panel(const Panel &);
+    Panel &operator=(const Panel &);
+
+    void destroy() {
+        if (win_) delwin(win_);
+        win_ = NULL;
+    }
+
+    WINDOW *win_;
+    int y_, x_, h_, w_;
+    uint64_t sig_;
+    bool valid_;
+};
+
+// A bar graph in its own window. The heights on screen are remembered,
+// so a new sample shifts existing columns left with wdelch (which the
+// terminal can do with a delete-character sequence) and paints only the
+// columns that actually differ.
+class GraphView {
+public:
+    GraphView() : win_(NULL), y_(0), x_(0), h_(0), w_(0) {}
+    ~GraphView() { destroy(); }
+
+    void place(int y, int x, int h, int w) {
+        if (win_ && y == y_ && x == x_ && h == h_ && w == w_) return;
+        destroy();
+        y_ = y;
+        x_ = x;
+        h_ = h;
+        w_ = w;
+        if (h > 0 && w > 0 && y >= 0 && x >= 0 && y + h <= LINES && x + w <= COLS) {
+            win_ = newwin(h, w, y, x);
+            idcok(win_, TRUE);
+        }
+        shown_.assign(w > 0 ? w : 0, 0);
+    }
+
+    // values are oldest first; the newest lands in the rightmost column.
+    // Bars are avg / scale of the window height.
+    void update(const std::vector<SeriesPoint> &values, float scale, chtype ch, attr_t attr) {
+        if (!win_) return;
+        if (scale <= 0) scale = 1;
+        next_.assign(w_, 0);
+        int n = values.size() < (size_t)w_ ? (int)values.size() : w_;
+        for (int i = 0; i < n; i++) {
+            float v = values[values.size() - n + i].avg / scale;
+            int bar = (int)(v * h_);
+            next_[w_ - n + i] = (short)(bar < 0 ? 0 : bar > h_ ? h_ : bar);
+        }
+
+        int shift = find_shift();
+        if (shift > 0) {
+            for (int row = 0; row < h_; row++) {
+                for (int k = 0; k < shift; k++) mvwdelch(win_, row, 0);
+            }
+            shown_.erase(shown_.begin(), shown_.begin() + shift);
+            shown_.resize(w_, 0);
+        }
+        for (int c = 0; c < w_; c++) {
+            if (shown_[c] != next_[c]) draw_column(c, next_[c], ch, attr);
+        }
+        shown_.swap(next_);
+    }
+
+    // Make the whole graph get copied again, e.g. after the panel
+    // underneath it was repainted.
+    void touch() {
+        if (win_) touchwin(win_);
+    }
+
+    void commit() {
+        if (win_) wnoutrefresh(win_);
+    }
+
+private:
+    GraphView(const GraphView &);
+    GraphView &operator=(const GraphView &);
+
+    enum { MAX_SHIFT = 8 };
+
+    void destroy() {
+        if (win_) delwin(win_);
+        win_ = NULL;
+    }
+
+    // Smallest k such that the new columns are the old ones moved k to
+    // the left; 0 if no such shift beats repainting changed columns.
+    int find_shift() const {
+        if (shown_ == next_) return 0;
+        for (int k = 1; k <= MAX_SHIFT && k < w_; k++) {
+            bool match = true;
+            for (int c = 0; c + k < w_ && match; c++) match = shown_[c + k] == next_[c];
+            if (match) return k;
+        }
+        return 0;
+    }
+
+    void draw_column(int c, int bar, chtype ch, attr_t attr) {
+        for (int row = 0; row < h_; row++) {
+            bool filled = row >= h_ - bar;
+            mvwaddch(win_, row, c, filled ? (ch | attr) : ' ');
+        }
+    }
+
+    WINDOW *win_;
+    int y_, x_, h_, w_;
+    std::vector<short> shown_;
+    std::vector<short> next_;
+};
+
+// Flushes a frame and counts the bytes it sent to the terminal, using
+// the calling thread's write counter in /proc/thread-self/io. Must be
+// created on the thread that runs the UI.
+class TermMeter {
+public:
+    TermMeter() : io_("/proc/thread-self/io"), last_(0), total_(0), frames_(0) {}
+
+    void flush() {
+        unsigned long long before = wchar();
+        doupdate();
+        unsigned long long after = wchar();
+        last_ = after >= before ? after - before : 0;
+        total_ += last_;
+        frames_++;
+    }
+
+    unsigned long long last_frame() const { return last_; }
+    unsigned long long total() const { return total_; }
+    unsigned long long frames() const { return frames_; }
+
+private:
+    unsigned long long wchar() {
+        if (!io_.read()) return 0;
+        ProcScanner s(io_);
+        unsigned long long v = 0;
+        if (s.find_key("wchar:", 6)) s.next_u64(v);
+        return v;
+    }
+
+    ProcFile io_;
+    unsigned long long last_;
+    unsigned long long total_;
+    unsigned long long frames_;
+};
+
+#endif
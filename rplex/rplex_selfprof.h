@@ -0,0 +1,224 @@
+/************************************************************
+ * RPLEX - self-profiling
+ *
+ * What the monitor itself costs: wall time of each phase of
+ * a frame (collectors, sorting, rendering, terminal flush),
+ * its own CPU share, RSS, read/write syscalls, procfs opens
+ * and heap allocations, plus an optional CPU budget that
+ * stretches the sample interval while it is exceeded.
+ ************************************************************/
+
+#ifndef RPLEX_SELFPROF_H
+#define RPLEX_SELFPROF_H
+
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+#include <unistd.h>
+#include "rplex_procfs.h"
+
+// C++ heap allocations since startup. The program counts them by
+// replacing operator new; without that this stays at zero.
+inline std::atomic<unsigned long long> &allocation_count() {
+    static std::atomic<unsigned long long> count(0);
+    return count;
+}
+
+struct PhaseSummary {
+    const char *name;
+    float last_ms;    // in the last frame
+    float avg_ms;     // moving average over about 10 frames
+    float max_ms;     // worst of the last 60 frames
+};
+
+// Per-frame wall time of a fixed set of phases. Owned by one thread;
+// copy summaries() out to show them elsewhere.
+class PhaseTimes {
+public:
+    enum { MAX_PHASES = 16, MAX_WINDOW = 60 };
+
+    PhaseTimes(const char *const *names, size_t count) : count_(std::min(count, (size_t)MAX_PHASES)),
+                                                          frames_(0) {
+        for (size_t i = 0; i < count_; i++) {
+            summary_[i].name = names[i];
+            summary_[i].last_ms = summary_[i].avg_ms = summary_[i].max_ms = 0;
+        }
+        memset(current_, 0, sizeof(current_));
+        memset(history_, 0, sizeof(history_));
+    }
+
+    void add(size_t phase, double ms) { current_[phase] += ms; }
+
+    // Close the frame: its totals become last_ms and feed the averages.
+    void end_frame() {
+        size_t slot = frames_ % MAX_WINDOW;
+        for (size_t i = 0; i < count_; i++) {
+            PhaseSummary &s = summary_[i];
+            s.last_ms = (float)current_[i];
+            s.avg_ms = frames_ == 0 ? s.last_ms : s.avg_ms + 0.1f * (s.last_ms - s.avg_ms);
+            history_[i][slot] = s.last_ms;
+            s.max_ms = 0;
+            for (size_t f = 0; f < MAX_WINDOW; f++) s.max_ms = std::max(s.max_ms, history_[i][f]);
+            current_[i] = 0;
+        }
+        frames_++;
+    }
+
+    size_t size() const { return count_; }
+    const PhaseSummary &summary(size_t i) const { return summary_[i]; }
+    const PhaseSummary *summaries() const { return summary_; }
+
+private:
+    size_t count_;
+    unsigned long frames_;
+    double current_[MAX_PHASES];
+    float history_[MAX_PHASES][MAX_WINDOW];
+    PhaseSummary summary_[MAX_PHASES];
+};
+
+// Adds the lifetime of the scope, or the time until stop(), to one phase.
+class PhaseTimer {
+public:
+    PhaseTimer(PhaseTimes &times, size_t phase)
+        : times_(times), phase_(phase), start_(std::chrono::steady_clock::now()), running_(true) {}
+
+    ~PhaseTimer() { stop(); }
+
+    void stop() {
+        if (!running_) return;
+        std::chrono::duration<double, std::milli> d = std::chrono::steady_clock::now() - start_;
+        times_.add(phase_, d.count());
+        running_ = false;
+    }
+
+private:
+    PhaseTimer(const PhaseTimer &);
+    PhaseTimer &operator=(const PhaseTimer &);
+
+    PhaseTimes &times_;
+    size_t phase_;
+    std::chrono::steady_clock::time_point start_;
+    bool running_;
+};
+
+// The monitor's own footprint over the last interval.
+struct SelfUsage {
+    float cpu_percent;        // of one CPU, all threads
+    long long rss_kb;
+    long long threads;
+    double read_calls;        // read-family syscalls per second (syscr)
+    double write_calls;       // write-family syscalls per second (syscw)
+    double opens;             // procfs/sysfs opens per second
+    double allocations;       // C++ heap allocations per second
+};
+
+// Reads /proc/self/stat and /proc/self/io; rates are since the last call.
+class SelfMonitor {
+public:
+    SelfMonitor() : stat_("/proc/self/stat"), io_("/proc/self/io"), clk_tck_(sysconf(_SC_CLK_TCK)),
+                    page_kb_(sysconf(_SC_PAGESIZE) / 1024), ticks_(0), syscr_(0), syscw_(0),
+                    opens_(0), allocations_(0), have_last_(false) {}
+
+    void sample(SelfUsage &out) {
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        double elapsed = have_last_ ? std::chrono::duration<double>(now - last_).count() : 0;
+        last_ = now;
+
+        PidStat ps;
+        unsigned long long ticks = ticks_;
+        if (stat_.read() && parse_pid_stat(stat_.data(), stat_.size(), ps)) {
+            ticks = ps.utime + ps.stime;
+            out.rss_kb = ps.rss_pages * page_kb_;
+            out.threads = ps.num_threads;
+        }
+        unsigned long long syscr = syscr_, syscw = syscw_;
+        if (io_.read()) {
+            ProcScanner s(io_);
+            if (s.find_key("syscr:", 6)) s.next_u64(syscr);
+            if (s.find_key("syscw:", 6)) s.next_u64(syscw);
+        }
+        unsigned long long opens = proc_open_count().load(std::memory_order_relaxed);
+        unsigned long long allocations = allocation_count().load(std::memory_order_relaxed);
+
+        bool have = have_last_ && elapsed > 0;
+        out.cpu_percent = have ? (float)(100.0 * delta(ticks, ticks_) / (elapsed * clk_tck_)) : 0.0f;
+        out.read_calls = have ? delta(syscr, syscr_) / elapsed : 0;
+        out.write_calls = have ? delta(syscw, syscw_) / elapsed : 0;
+        out.opens = have ? delta(opens, opens_) / elapsed : 0;
+        out.allocations = have ? delta(allocations, allocations_) / elapsed : 0;
+        ticks_ = ticks;
+        syscr_ = syscr;
+        syscw_ = syscw;
+        opens_ = opens;
+        allocations_ = allocations;
+        have_last_ = true;
+    }
+
+private:
+    SelfMonitor(const SelfMonitor &);
+    SelfMonitor &operator=(const SelfMonitor &);
+
+    static unsigned long long delta(unsigned long long now, unsigned long long before) {
+        return now >= before ? now - before : 0;
+    }
+
+    ProcFile stat_;
+    ProcFile io_;
+    long clk_tck_;
+    long page_kb_;
+    unsigned long long ticks_, syscr_, syscw_, opens_, allocations_;
+    std::chrono::steady_clock::time_point last_;
+    bool have_last_;
+};
+
+// Keeps the monitor under a share of one CPU by stretching the sample
+// periods. Over budget (averaged over about 10 samples) the stretch
+// factor doubles, up to 16; once usage is below half the budget it
+// halves again. Every change waits 10 samples for the average to settle.
+class OverheadBudget {
+public:
+    enum { MAX_FACTOR = 16 };
+
+    OverheadBudget() : budget_(0), factor_(1), average_(0), since_change_(0), primed_(false) {}
+
+    // percent <= 0 turns the budget off.
+    void configure(double percent) {
+        budget_ = percent;
+        factor_ = 1;
+        average_ = 0;
+        since_change_ = 0;
+        primed_ = false;
+    }
+
+    bool enabled() const { return budget_ > 0; }
+    double budget() const { return budget_; }
+    double average() const { return average_; }
+    // What every period is multiplied by: 1, 2, 4, 8 or 16.
+    unsigned factor() const { return factor_; }
+    bool throttled() const { return factor_ > 1; }
+
+    // Feed one CPU reading; returns true when factor() changed.
+    bool update(double cpu_percent) {
+        if (!enabled()) return false;
+        average_ = since_change_ == 0 && !primed_ ? cpu_percent : average_ + 0.1 * (cpu_percent - average_);
+        primed_ = true;
+        if (++since_change_ < 10) return false;
+        unsigned next = factor_;
+        if (average_ > budget_ && factor_ < MAX_FACTOR) next = factor_ * 2;
+        else if (average_ < budget_ / 2 && factor_ > 1) next = factor_ / 2;
+        if (next == factor_) return false;
+        factor_ = next;
+        since_change_ = 0;
+        return true;
+    }
+
+private:
+    double budget_;
+    unsigned factor_;
+    double average_;
+    unsigned since_change_;
+    bool primed_;
+};
+
+#endif
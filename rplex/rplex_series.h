@@ -0,0 +1,167 @@
+/************************************************************
+ * RPLEX - metric history
+ *
+ * Fixed-capacity ring buffers with O(1) append, and a time
+ * series that rolls raw samples up into coarser min/avg/max
+ * tiers so graphs can cover an hour or a day in bounded
+ * memory.
+ ************************************************************/
+
+#ifndef RPLEX_SERIES_H
+#define RPLEX_SERIES_H
+
+#include <vector>
+#include <cstddef>
+
+template <typename T>
+class RingBuffer {
+public:
+    explicit RingBuffer(size_t capacity = 60) : data_(capacity ? capacity : 1), head_(0), count_(0) {}
+
+    void push(const T &v) {
+        data_[head_] = v;
+        head_ = (head_ + 1) % data_.size();
+        if (count_ < data_.size()) count_++;
+    }
+
+    void clear() {
+        head_ = 0;
+        count_ = 0;
+    }
+
+    size_t size() const { return count_; }
+    size_t capacity() const { return data_.size(); }
+    bool empty() const { return count_ == 0; }
+
+    // 0 is the oldest element still held, size()-1 the newest.
+    const T &operator[](size_t i) const {
+        return data_[(head_ + data_.size() - count_ + i) % data_.size()];
+    }
+    const T &back() const { return (*this)[count_ - 1]; }
+
+private:
+    std::vector<T> data_;
+    size_t head_;   // next write position
+    size_t count_;
+};
+
+// One graph column. Raw samples have min == avg == max.
+struct SeriesPoint {
+    float min;
+    float avg;
+    float max;
+};
+
+struct SeriesTier {
+    unsigned factor;   // samples of the tier below per point
+    size_t capacity;
+};
+
+// A metric's history at several resolutions. Tier 0 holds raw samples;
+// each higher tier holds one point per `factor` points of the tier
+// below. Tiers count samples, not seconds: the defaults assume a 1 s
+// sample and keep 10 minutes raw, an hour at 10 s and a day at 1 min,
+// about 29 KB per series. for_period() sizes them for other rates.
+class TimeSeries {
+public:
+    TimeSeries() { init_period(1000, 0); }
+
+    TimeSeries(const SeriesTier *tiers, size_t count) { init(tiers, count); }
+
+    // The default spans for one sample every period_ms: raw for 10
+    // minutes, then 10 s points for an hour and 1 min points for a day.
+    // max_points, if set, caps every tier.
+    static TimeSeries for_period(long period_ms, size_t max_points = 0) {
+        TimeSeries s(NULL, 0);
+        s.init_period(period_ms, max_points);
+        return s;
+    }
+
+    void push(float v) {
+        SeriesPoint p = {v, v, v};
+        push_tier(0, p);
+    }
+
+    void clear() {
+        for (size_t t = 0; t < tiers_.size(); t++) {
+            tiers_[t].points.clear();
+            tiers_[t].pending = 0;
+        }
+    }
+
+    size_t tier_count() const { return tiers_.size(); }
+    const RingBuffer<SeriesPoint> &tier(size_t t) const { return tiers_[t].points; }
+
+    // Raw samples represented by one point of tier t.
+    unsigned samples_per_point(size_t t) const {
+        unsigned n = 1;
+        for (size_t i = 0; i <= t && i < tiers_.size(); i++) n *= tiers_[i].factor;
+        return n;
+    }
+
+    // Copy the newest n points of tier t (oldest first) into out, which
+    // keeps its capacity between calls.
+    void tail(size_t t, size_t n, std::vector<SeriesPoint> &out) const {
+        const RingBuffer<SeriesPoint> &pts = tiers_[t].points;
+        if (n > pts.size()) n = pts.size();
+        out.resize(n);
+        for (size_t i = 0; i < n; i++) out[i] = pts[pts.size() - n + i];
+    }
+
+private:
+    struct Tier {
+        unsigned factor;
+        RingBuffer<SeriesPoint> points;
+        // Rollup of points from the tier below that are not yet emitted.
+        unsigned pending;
+        SeriesPoint acc;
+        double sum;
+
+        Tier(unsigned f, size_t capacity) : factor(f ? f : 1), points(capacity), pending(0), sum(0) {
+            acc.min = acc.avg = acc.max = 0;
+        }
+    };
+
+    void init(const SeriesTier *tiers, size_t count) {
+        for (size_t i = 0; i < count; i++) tiers_.push_back(Tier(tiers[i].factor, tiers[i].capacity));
+    }
+
+    void init_period(long period_ms, size_t max_points) {
+        if (period_ms <= 0) period_ms = 1000;
+        long per_10s = (10000 + period_ms / 2) / period_ms;
+        SeriesTier tiers[] = {{1, (size_t)(600000 / period_ms)}, {(unsigned)(per_10s > 1 ? per_10s : 1), 360},
+                              {6, 1440}};
+        for (size_t i = 0; i < sizeof(tiers) / sizeof(tiers[0]); i++) {
+            if (tiers[i].capacity < 60) tiers[i].capacity = 60;   // a graph's width
+            if (max_points && tiers[i].capacity > max_points) tiers[i].capacity = max_points;
+        }
+        init(tiers, sizeof(tiers) / sizeof(tiers[0]));
+    }
+
+    void push_tier(size_t t, const SeriesPoint &p) {
+        if (t >= tiers_.size()) return;
+        Tier &tier = tiers_[t];
+        if (tier.factor == 1) {
+            tier.points.push(p);
+            push_tier(t + 1, p);
+            return;
+        }
+        if (tier.pending == 0) {
+            tier.acc = p;
+            tier.sum = 0;
+        }
+        if (p.min < tier.acc.min) tier.acc.min = p.min;
+        if (p.max > tier.acc.max) tier.acc.max = p.max;
+        tier.sum += p.avg;
+        if (++tier.pending == tier.factor) {
+            tier.acc.avg = (float)(tier.sum / tier.factor);
+            tier.pending = 0;
+            tier.points.push(tier.acc);
+            push_tier(t + 1, tier.acc);
+        }
+    }
+
+    std::vector<Tier> tiers_;
+};
+
+#endif
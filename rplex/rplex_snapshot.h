@@ -0,0 +1,245 @@
+/************************************************************
+ * RPLEX - sampler threads and snapshot handoff
+ *
+ * Collection runs on sampler threads that fill a private
+ * slot of a triple buffer and publish it with one atomic
+ * exchange. The ncurses thread picks up the newest slot
+ * without ever waiting on a slow /proc scan or network call.
+ * A CollectorThread runs each collector on its own period
+ * from timerfds, so cheap counters can be read often and
+ * expensive scans rarely.
+ ************************************************************/
+
+#ifndef RPLEX_SNAPSHOT_H
+#define RPLEX_SNAPSHOT_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "rplex_eventloop.h"
+
+// Single-writer, single-reader triple buffer. The writer always owns one
+// slot, the reader owns another, and the third sits in the middle holding
+// the latest published value. Slots are reused, so a T whose assignment
+// keeps its capacity (vectors, strings) stops allocating after warm-up.
+template <typename T>
+class TripleBuffer {
+public:
+    TripleBuffer() : middle_(1), back_(0), front_(2) {}
+
+    // Writer side: fill back() completely, then publish().
+    T &back() { return slots_[back_]; }
+
+    void publish() {
+        unsigned prev = middle_.exchange(back_ | FRESH, std::memory_order_acq_rel);
+        back_ = prev & INDEX;
+    }
+
+    // Reader side: swap in the newest published slot if there is one.
+    // Returns true when front() changed.
+    bool acquire() {
+        if (!(middle_.load(std::memory_order_relaxed) & FRESH)) return false;
+        unsigned prev = middle_.exchange(front_, std::memory_order_acq_rel);
+        front_ = prev & INDEX;
+        return true;
+    }
+
+    const T &front() const { return slots_[front_]; }
+
+private:
+    enum { INDEX = 3, FRESH = 4 };
+
+    TripleBuffer(const TripleBuffer &);
+    TripleBuffer &operator=(const TripleBuffer &);
+
+    T slots_[3];
+    std::atomic<unsigned> middle_;
+    unsigned back_;   // writer-owned
+    unsigned front_;  // reader-owned
+};
+
+// Runs a collection function on its own thread at a fixed period.
+// Deadlines are absolute, so a slow sample shortens the next sleep
+// instead of drifting the schedule. The period may be changed while
+// running (set_interval); it applies from the next sleep.
+class SamplerThread {
+public:
+    SamplerThread() : interval_ms_(1000), running_(false) {}
+    ~SamplerThread() { stop(); }
+
+    void start(std::chrono::milliseconds interval, std::function<void()> sample) {
+        stop();
+        interval_ms_ = interval.count();
+        running_ = true;
+        thread_ = std::thread(&SamplerThread::run, this, sample);
+    }
+
+    void set_interval(std::chrono::milliseconds interval) { interval_ms_ = interval.count(); }
+    std::chrono::milliseconds interval() const { return std::chrono::milliseconds(interval_ms_.load()); }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!running_) return;
+            running_ = false;
+        }
+        wake_.notify_all();
+        if (thread_.joinable()) thread_.join();
+    }
+
+private:
+    SamplerThread(const SamplerThread &);
+    SamplerThread &operator=(const SamplerThread &);
+
+    void run(std::function<void()> sample) {
+        std::chrono::steady_clock::time_point next = std::chrono::steady_clock::now();
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (running_) {
+            lock.unlock();
+            sample();
+            lock.lock();
+            next += interval();
+            std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+            if (next < now) next = now;  // fell behind; don't burst to catch up
+            wake_.wait_until(lock, next, [this] { return !running_; });
+        }
+    }
+
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::atomic<long long> interval_ms_;
+    bool running_;
+};
+
+// Runs a set of collectors on one thread, each every period_ms on an
+// absolute timerfd schedule. Collectors due in the same wakeup all run
+// before `publish` is called once, so consumers get one snapshot per
+// wakeup. A collector with period 0 runs only at start and when
+// triggered. stretch() slows every period down together.
+class CollectorThread {
+public:
+    CollectorThread() : pending_(0), stretch_(1), running_(false) {}
+    ~CollectorThread() { stop(); }
+
+    enum { MAX_COLLECTORS = 64 };
+
+    // Before start(). Returns the id for trigger() and period().
+    size_t add(const char *name, long period_ms, std::function<void()> collect) {
+        Collector c;
+        c.name = name;
+        c.period_ms = period_ms > 0 ? period_ms : 0;
+        c.collect = collect;
+        collectors_.push_back(c);
+        return collectors_.size() - 1;
+    }
+
+    // Before start(): run handler on the collector thread whenever fd is
+    // readable (e.g. a netlink socket); it counts as a collection.
+    void watch(int fd, std::function<void()> handler) {
+        if (fd < 0) return;
+        Watch w = {fd, handler};
+        watches_.push_back(w);
+    }
+
+    void start(std::function<void()> publish) {
+        stop();
+        running_ = true;
+        thread_ = std::thread(&CollectorThread::run, this, publish);
+    }
+
+    void stop() {
+        if (!running_.exchange(false)) return;
+        wake_.notify();
+        if (thread_.joinable()) thread_.join();
+    }
+
+    // Run a collector at the next wakeup, from any thread.
+    void trigger(size_t id) {
+        pending_.fetch_or(1ULL << id);
+        wake_.notify();
+    }
+
+    // Multiply every period by factor (at least 1), from any thread.
+    void set_stretch(unsigned factor) {
+        stretch_ = factor ? factor : 1;
+        wake_.notify();
+    }
+
+    unsigned stretch() const { return stretch_.load(); }
+    size_t size() const { return collectors_.size(); }
+    const char *name(size_t id) const { return collectors_[id].name; }
+    long period(size_t id) const { return collectors_[id].period_ms * (long)stretch_.load(); }
+
+private:
+    CollectorThread(const CollectorThread &);
+    CollectorThread &operator=(const CollectorThread &);
+
+    struct Collector {
+        const char *name;
+        long period_ms;
+        std::function<void()> collect;
+    };
+
+    struct Watch {
+        int fd;
+        std::function<void()> handler;
+    };
+
+    void run(std::function<void()> publish) {
+        EventLoop loop;
+        std::vector<int> timers(collectors_.size(), -1);
+        bool ran = false;
+        unsigned stretch = stretch_;
+        for (size_t i = 0; i < collectors_.size(); i++) {
+            timers[i] = loop.add_timer(collectors_[i].period_ms * stretch, [this, i, &ran] {
+                collectors_[i].collect();
+                ran = true;
+            });
+        }
+        for (size_t i = 0; i < watches_.size(); i++) {
+            loop.watch(watches_[i].fd, [this, i, &ran] {
+                watches_[i].handler();
+                ran = true;
+            });
+        }
+        loop.watch_wakeup(wake_, [&] {
+            if (!running_) return;
+            if (stretch_ != stretch) {
+                stretch = stretch_;
+                for (size_t i = 0; i < timers.size(); i++) {
+                    if (timers[i] >= 0) loop.set_period(timers[i], collectors_[i].period_ms * stretch);
+                }
+            }
+            unsigned long long due = pending_.exchange(0);
+            for (size_t i = 0; i < collectors_.size(); i++) {
+                if (due & (1ULL << i)) {
+                    collectors_[i].collect();
+                    ran = true;
+                }
+            }
+        });
+
+        // Everything once up front, so the first snapshot is complete
+        for (size_t i = 0; i < collectors_.size(); i++) collectors_[i].collect();
+        publish();
+        while (running_ && loop.run_once()) {
+            if (ran && running_) publish();
+            ran = false;
+        }
+    }
+
+    std::vector<Collector> collectors_;
+    std::vector<Watch> watches_;
+    std::atomic<unsigned long long> pending_;   // bit per triggered collector
+    Wakeup wake_;
+    std::atomic<unsigned> stretch_;
+    std::atomic<bool> running_;
+    std::thread thread_;
+};
+
+#endif
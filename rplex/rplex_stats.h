@@ -0,0 +1,223 @@
+/************************************************************
+ * RPLEX - rolling statistics
+ *
+ * Min, max, mean and percentiles of a metric over sliding
+ * windows, updated per sample in O(log n): log-bucketed
+ * counts (a DDSketch-style quantile sketch) in a Fenwick
+ * tree, plus monotonic queues for the extremes. Reading a
+ * summary never rescans the history.
+ ************************************************************/
+
+#ifndef RPLEX_STATS_H
+#define RPLEX_STATS_H
+
+#include <vector>
+#include <deque>
+#include <utility>
+#include <cmath>
+#include <cstdlib>
+#include <cstdio>
+#include <stdint.h>
+#include "rplex_series.h"
+
+struct StatsSummary {
+    size_t count;
+    float min, max, mean;
+    float p50, p95, p99;
+};
+
+// Counts of values in log-spaced buckets, each covering a 4% range, so
+// any quantile comes back within 2% of the true value. Values at or
+// below min_value() (including zero and negatives) share bucket 0 and read
+// back as 0. Two sketches of the same layout merge by adding counts.
+class QuantileSketch {
+public:
+    enum { BUCKETS = 1024 };
+
+    QuantileSketch() : tree_(BUCKETS + 1, 0), total_(0) {}
+
+    static double min_value() { return 1e-3; }
+    static double gamma() { return 1.04; }
+
+    static int bucket(double v) {
+        static const double log_gamma = std::log(gamma());
+        if (!(v > min_value())) return 0;
+        int b = 1 + (int)std::ceil(std::log(v / min_value()) / log_gamma);
+        return b < BUCKETS ? b : BUCKETS - 1;
+    }
+
+    // Midpoint (in relative terms) of a bucket's range.
+    static double value(int b) {
+        if (b <= 0) return 0;
+        return min_value() * std::pow(gamma(), b - 1) * 2 / (1 + gamma());
+    }
+
+    void add(int b, int delta) {
+        total_ += delta;
+        for (int i = b + 1; i <= BUCKETS; i += i & -i) tree_[i] += delta;
+    }
+
+    void merge(const QuantileSketch &other) {
+        // Fenwick trees of equal size add element-wise
+        for (size_t i = 0; i < tree_.size(); i++) tree_[i] += other.tree_[i];
+        total_ += other.total_;
+    }
+
+    long count() const { return total_; }
+
+    // Bucket holding the value of rank floor(q * (count - 1)).
+    double quantile(double q) const {
+        if (total_ <= 0) return 0;
+        long rank = (long)(q * (total_ - 1));
+        int pos = 0;
+        for (int step = BUCKETS; step > 0; step >>= 1) {
+            if (pos + step <= BUCKETS && tree_[pos + step] <= rank) {
+                pos += step;
+                rank -= tree_[pos];
+            }
+        }
+        return value(pos);   // pos is the 0-based bucket index
+    }
+
+private:
+    std::vector<long> tree_;
+    long total_;
+};
+
+// Statistics of the last `window` samples.
+class WindowStats {
+public:
+    explicit WindowStats(size_t window = 60) : values_(window), seq_(0), sum_(0), since_resum_(0) {}
+
+    size_t window() const { return values_.capacity(); }
+
+    void push(float v) {
+        if (!std::isfinite(v)) return;
+        if (values_.size() == values_.capacity()) {
+            float old = values_[0];
+            sketch_.add(QuantileSketch::bucket(old), -1);
+            sum_ -= old;
+        }
+        values_.push(v);
+        sketch_.add(QuantileSketch::bucket(v), 1);
+        sum_ += v;
+        // Re-add from scratch once per window so rounding never builds up
+        if (++since_resum_ >= values_.capacity()) {
+            sum_ = 0;
+            for (size_t i = 0; i < values_.size(); i++) sum_ += values_[i];
+            since_resum_ = 0;
+        }
+
+        // Front of each queue is the window's extreme; entries that
+        // can never become one are dropped as they are overtaken.
+        uint64_t expire = seq_ >= values_.capacity() ? seq_ - values_.capacity() + 1 : 0;
+        while (!mins_.empty() && mins_.back().second >= v) mins_.pop_back();
+        while (!maxs_.empty() && maxs_.back().second <= v) maxs_.pop_back();
+        mins_.push_back(std::make_pair(seq_, v));
+        maxs_.push_back(std::make_pair(seq_, v));
+        while (mins_.front().first < expire) mins_.pop_front();
+        while (maxs_.front().first < expire) maxs_.pop_front();
+        seq_++;
+    }
+
+    void clear() {
+        values_.clear();
+        sketch_ = QuantileSketch();
+        mins_.clear();
+        maxs_.clear();
+        sum_ = 0;
+        since_resum_ = 0;
+    }
+
+    size_t count() const { return values_.size(); }
+    float min() const { return mins_.empty() ? 0 : mins_.front().second; }
+    float max() const { return maxs_.empty() ? 0 : maxs_.front().second; }
+    float mean() const { return values_.empty() ? 0 : (float)(sum_ / values_.size()); }
+
+    // Sketch estimate, kept inside the exact extremes.
+    float quantile(double q) const {
+        if (values_.empty()) return 0;
+        float v = (float)sketch_.quantile(q);
+        return v < min() ? min() : v > max() ? max() : v;
+    }
+
+    const QuantileSketch &sketch() const { return sketch_; }
+
+    StatsSummary summary() const {
+        StatsSummary s;
+        s.count = count();
+        s.min = min();
+        s.max = max();
+        s.mean = mean();
+        s.p50 = quantile(0.50);
+        s.p95 = quantile(0.95);
+        s.p99 = quantile(0.99);
+        return s;
+    }
+
+private:
+    RingBuffer<float> values_;
+    QuantileSketch sketch_;
+    std::deque<std::pair<uint64_t, float> > mins_;
+    std::deque<std::pair<uint64_t, float> > maxs_;
+    uint64_t seq_;
+    double sum_;
+    size_t since_resum_;
+};
+
+// One metric's statistics over each configured window.
+class MetricStats {
+public:
+    MetricStats() {}
+    explicit MetricStats(const std::vector<size_t> &windows) { configure(windows); }
+
+    void configure(const std::vector<size_t> &windows) {
+        windows_.clear();
+        for (size_t i = 0; i < windows.size(); i++) windows_.push_back(WindowStats(windows[i]));
+    }
+
+    void push(float v) {
+        for (size_t i = 0; i < windows_.size(); i++) windows_[i].push(v);
+    }
+
+    void clear() {
+        for (size_t i = 0; i < windows_.size(); i++) windows_[i].clear();
+    }
+
+    size_t window_count() const { return windows_.size(); }
+    const WindowStats &window(size_t i) const { return windows_[i]; }
+
+    // One summary per window into a reused vector.
+    void summaries(std::vector<StatsSummary> &out) const {
+        out.resize(windows_.size());
+        for (size_t i = 0; i < windows_.size(); i++) out[i] = windows_[i].summary();
+    }
+
+private:
+    std::vector<WindowStats> windows_;
+};
+
+// Short label for a window of `seconds`: "30s", "5m", "1h".
+inline void stats_window_label(size_t seconds, char *buf, size_t len) {
+    if (seconds % 3600 == 0) snprintf(buf, len, "%zuh", seconds / 3600);
+    else if (seconds % 60 == 0) snprintf(buf, len, "%zum", seconds / 60);
+    else snprintf(buf, len, "%zus", seconds);
+}
+
+// Windows in seconds, e.g. "60,300,900", turned into sample counts.
+inline bool parse_stats_windows(const char *list, double sample_seconds, std::vector<size_t> &out) {
+    out.clear();
+    const char *p = list;
+    while (*p) {
+        char *end;
+        double seconds = strtod(p, &end);
+        if (end == p || seconds <= 0) return false;
+        size_t samples = (size_t)(seconds / sample_seconds + 0.5);
+        out.push_back(samples ? samples : 1);
+        p = *end == ',' ? end + 1 : end;
+        if (*end && *end != ',') return false;
+    }
+    return !out.empty();
+}
+
+#endif